@@ -0,0 +1,161 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "ccontrol/MergeScheduler.h"
+
+// System headers
+#include <algorithm>
+#include <chrono>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.MergeScheduler");
+
+std::uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+void MergeScheduler::configure(int slots, int interactiveWeight) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _slots = std::max(slots, 0);
+    _interactiveWeight = std::max(interactiveWeight, 1);
+    LOGS(_log, LOG_LVL_INFO, "MergeScheduler slots=" << _slots
+         << " interactiveWeight=" << _interactiveWeight);
+    _cv.notify_all();
+}
+
+
+void MergeScheduler::addQuery(QueryId queryId) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _queries[queryId];
+}
+
+
+bool MergeScheduler::run(QueryId queryId, bool interactive, std::uint64_t bytes,
+                         std::function<bool()> const& merge) {
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t waitMicros = 0;
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        auto iter = _queries.find(queryId);
+        double const weight = interactive ? _interactiveWeight : 1;
+        double startTag = _virtualTime;
+        if (iter != _queries.end()) {
+            iter->second.stats.interactive = interactive;
+            startTag = std::max(startTag, iter->second.lastFinish);
+        }
+        Tag const tag(startTag + std::max(bytes, std::uint64_t(1)) / weight, _sequence++);
+        if (iter != _queries.end()) {
+            iter->second.lastFinish = tag.first;
+        }
+        if (!_hasSlot() || !_waiting.empty()) {
+            _waiting.insert(tag);
+            if (iter != _queries.end()) {
+                iter->second.stats.queuedBytes += bytes;
+            }
+            _cv.wait(lock, [this, &tag]() { return _hasSlot() && *_waiting.begin() == tag; });
+            _waiting.erase(tag);
+            waitMicros = microsSince(start);
+            // The query may have been removed while waiting.
+            iter = _queries.find(queryId);
+            if (iter != _queries.end()) {
+                iter->second.stats.queuedBytes -= bytes;
+                iter->second.stats.waitMicros += waitMicros;
+            }
+        }
+        _virtualTime = std::max(_virtualTime, tag.first);
+        ++_running;
+    }
+    // Let the next merge in line check for a slot.
+    _cv.notify_all();
+
+    auto mergeStart = std::chrono::steady_clock::now();
+    bool ok = false;
+    try {
+        ok = merge();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        --_running;
+        _cv.notify_all();
+        throw;
+    }
+    std::uint64_t const mergeMicros = microsSince(mergeStart);
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        --_running;
+        auto iter = _queries.find(queryId);
+        if (iter != _queries.end()) {
+            ++iter->second.stats.merges;
+            iter->second.stats.mergedBytes += bytes;
+            iter->second.stats.mergeMicros += mergeMicros;
+        }
+    }
+    _cv.notify_all();
+    LOGS(_log, LOG_LVL_TRACE, QueryIdHelper::makeIdStr(queryId) << " merged bytes=" << bytes
+         << " waitMicros=" << waitMicros << " mergeMicros=" << mergeMicros);
+    return ok;
+}
+
+
+MergeScheduler::QueryStats MergeScheduler::getQueryStats(QueryId queryId) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _queries.find(queryId);
+    return iter == _queries.end() ? QueryStats() : iter->second.stats;
+}
+
+
+MergeScheduler::QueryStats MergeScheduler::removeQuery(QueryId queryId) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _queries.find(queryId);
+    if (iter == _queries.end()) {
+        return QueryStats();
+    }
+    QueryStats stats = iter->second.stats;
+    _queries.erase(iter);
+    return stats;
+}
+
+
+int MergeScheduler::getRunning() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _running;
+}
+
+
+MergeScheduler& MergeScheduler::get() {
+    static MergeScheduler scheduler;
+    return scheduler;
+}
+
+}}} // namespace lsst::qserv::ccontrol
@@ -0,0 +1,121 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_CCONTROL_MERGESCHEDULER_H
+#define LSST_QSERV_CCONTROL_MERGESCHEDULER_H
+
+// System headers
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+
+// Qserv headers
+#include "global/intTypes.h"
+
+namespace lsst {
+namespace qserv {
+namespace ccontrol {
+
+/// MergeScheduler shares the result database among the user queries merging
+/// worker results into it. At most a fixed number of merges run at once,
+/// across all queries, and merges waiting for a slot are started in weighted
+/// fair queuing order: each merge is tagged with a virtual finish time of
+///   max(virtual time, finish time of the previous merge of its query)
+///       + bytes / weight
+/// and the merge with the earliest tag goes first, so that queries share the
+/// slots in proportion to their weight whatever the size of their results.
+/// Interactive queries weigh more than scans.
+///
+/// Merges run on the thread that delivered the response, which waits for its
+/// slot, as it could do nothing else meanwhile.
+///
+/// Queries are tracked from addQuery() to removeQuery(). Merges of a query
+/// that is not tracked, like late ones after removeQuery(), still take their
+/// turn but are not counted.
+class MergeScheduler {
+public:
+    /// Merge statistics of a user query.
+    struct QueryStats {
+        bool interactive = false;
+        std::uint64_t merges = 0;       ///< Merges run
+        std::uint64_t mergedBytes = 0;  ///< Bytes of the responses merged
+        std::uint64_t mergeMicros = 0;  ///< Time spent merging
+        std::uint64_t waitMicros = 0;   ///< Time spent waiting for a slot
+        std::int64_t queuedBytes = 0;   ///< Bytes of merges waiting for a slot
+    };
+
+    MergeScheduler() = default;
+    MergeScheduler(MergeScheduler const&) = delete;
+    MergeScheduler& operator=(MergeScheduler const&) = delete;
+
+    /// @param slots              merges that may run at once, 0 for no limit.
+    /// @param interactiveWeight  weight of interactive queries, scans weigh 1.
+    void configure(int slots, int interactiveWeight);
+
+    /// Track the merges of queryId, before its first merge.
+    void addQuery(QueryId queryId);
+
+    /// Run merge once a slot is available and it is the turn of queryId.
+    /// @param bytes size of the response merged.
+    /// @return the value returned by merge.
+    bool run(QueryId queryId, bool interactive, std::uint64_t bytes, std::function<bool()> const& merge);
+
+    /// @return the statistics of queryId.
+    QueryStats getQueryStats(QueryId queryId) const;
+
+    /// Forget queryId, once it has no more merges to run.
+    /// @return its statistics.
+    QueryStats removeQuery(QueryId queryId);
+
+    /// @return the number of merges running.
+    int getRunning() const;
+
+    /// @return the scheduler shared by all user queries of the czar.
+    static MergeScheduler& get();
+
+private:
+    struct Query {
+        QueryStats stats;
+        double lastFinish = 0; ///< Virtual finish time of the last merge.
+    };
+    using Tag = std::pair<double, std::uint64_t>; ///< Virtual finish time, sequence number.
+
+    bool _hasSlot() const { return _slots == 0 || _running < _slots; }
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    std::condition_variable _cv;
+    int _slots{0};
+    int _interactiveWeight{1};
+    int _running{0};
+    double _virtualTime{0};
+    std::uint64_t _sequence{0};
+    std::set<Tag> _waiting; ///< Tags of merges waiting for a slot.
+    std::map<QueryId, Query> _queries;
+};
+
+}}} // namespace lsst::qserv::ccontrol
+
+#endif // LSST_QSERV_CCONTROL_MERGESCHEDULER_H
@@ -25,20 +25,28 @@
 #include "ccontrol/MergingHandler.h"
 
 // System headers
+#include <algorithm>
 #include <cassert>
+#include <sstream>
 
 // LSST headers
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "ccontrol/MergeScheduler.h"
 #include "ccontrol/msgCode.h"
 #include "global/Bug.h"
 #include "global/debugUtil.h"
 #include "global/MsgReceiver.h"
 #include "proto/ProtoHeaderWrap.h"
 #include "proto/ProtoImporter.h"
+#include "proto/ResultCompressor.h"
+#include "proto/ResultStreamDecoder.h"
+#include "proto/RowBatch.h"
 #include "proto/WorkerResponse.h"
+#include "qdisp/Executive.h"
 #include "qdisp/JobQuery.h"
+#include "qdisp/MemoryGovernor.h"
 #include "rproc/InfileMerger.h"
 #include "util/common.h"
 #include "util/StringHash.h"
@@ -81,6 +89,7 @@ const char* MergingHandler::getStateStr(MsgState const& state) {
     case MsgState::INVALID:          return "INVALID";
     case MsgState::HEADER_SIZE_WAIT: return "HEADER_SIZE_WAIT";
     case MsgState::RESULT_WAIT:      return "RESULT_WAIT";
+    case MsgState::RESULT_STREAM:    return "RESULT_STREAM";
     case MsgState::RESULT_RECV:      return "RESULT_RECV";
     case MsgState::RESULT_EXTRA:     return "RESULT_EXTRA";
     case MsgState::HEADER_ERR:       return "HEADER_ERR";
@@ -93,7 +102,7 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
     LOGS(_log, LOG_LVL_DEBUG, "From:" << _wName << " flush state="
          << getStateStr(_state) << " blen=" << bLen << " last=" << last);
     if ((bLen < 0) || (bLen != (int)_mBuf.getSize())) {
-        if (_state != MsgState::RESULT_EXTRA) {
+        if (_state != MsgState::RESULT_EXTRA && _state != MsgState::RESULT_STREAM) {
             LOGS(_log, LOG_LVL_ERROR, "MergingRequester size mismatch: expected "
                  << _mBuf.getSize() << " got " << bLen);
             // Worker sent corrupted data, or there is some other error.
@@ -114,41 +123,20 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
 
         LOGS(_log, LOG_LVL_DEBUG, "HEADER_SIZE_WAIT: From:" << _wName
              << "Resizing buffer to " <<  _response->protoHeader.size());
-        _mBuf.zero(); // Free memory.
-        _mBuf.setTargetSize(_response->protoHeader.size());
         largeResult = _response->protoHeader.largeresult();
-        _state = MsgState::RESULT_WAIT;
-        return true;
+        return _waitForResult();
 
     case MsgState::RESULT_WAIT:
-        {
-            auto jobQuery = getJobQuery().lock();
-            auto jobId = (jobQuery != nullptr) ? jobQuery->getIdStr() : "?";
-            if (!_verifyResult()) { return false; }
-            if (!_setResult()) { return false; } // set _response->result
-            largeResult = _response->result.largeresult();
-            LOGS(_log, LOG_LVL_DEBUG, jobId << " From:" << _wName << " _mBuf "
-                    << util::prettyCharList(_mBuf.getBuffer(), 5));
-            _mBuf.zero(); // not needed after _response->result set.
-            bool msgContinues = _response->result.continues();
-            _state = MsgState::RESULT_RECV;
-            if (msgContinues) {
-                LOGS(_log, LOG_LVL_DEBUG, jobId << " Message continues, waiting for next header.");
-                _state = MsgState::RESULT_EXTRA;
-                _mBuf.setTargetSize(proto::ProtoHeaderWrap::PROTO_HEADER_SIZE);
-            } else {
-                LOGS(_log, LOG_LVL_DEBUG, jobId << " Message ends, setting last=true");
-                last = true;
-            }
-            LOGS(_log, LOG_LVL_DEBUG, jobId << " Flushed msgContinues=" << msgContinues
-                 << " last=" << last << " for tableName=" << _tableName);
-
-            auto success = _merge();
-            if (msgContinues) {
-                _response.reset(new WorkerResponse());
-            }
-            return success;
-        }
+        if (!_verifyResult()) { return false; }
+        if (!_setResult()) { return false; } // set _response->result
+        LOGS(_log, LOG_LVL_DEBUG, "From:" << _wName << " _mBuf "
+                << util::prettyCharList(_mBuf.getBuffer(), 5));
+        _mBuf.zero(); // not needed after _response->result set.
+        return _flushResult(last, largeResult);
+
+    case MsgState::RESULT_STREAM:
+        return _flushStream(bLen, last, largeResult);
+
     case MsgState::RESULT_EXTRA:
         if (!proto::ProtoHeaderWrap::unwrap(_response, _mBuf.getBuffer())) {
             _setError(ccontrol::MSG_RESULT_DECODE,
@@ -159,10 +147,7 @@ bool MergingHandler::flush(int bLen, bool& last, bool& largeResult) {
         largeResult = _response->protoHeader.largeresult();
         LOGS(_log, LOG_LVL_DEBUG, "RESULT_EXTRA: Resizing buffer to "
              << _response->protoHeader.size() << " largeResult=" << largeResult);
-        _mBuf.zero();
-        _mBuf.setTargetSize(_response->protoHeader.size());
-        _state = MsgState::RESULT_WAIT;
-        return true;
+        return _waitForResult();
     case MsgState::RESULT_RECV:
         // We shouldn't wind up here. _buffer.size(0) and last=true should end communication.
         // fall-through
@@ -214,6 +199,16 @@ void MergingHandler::prepScrubResults(int jobId, int attemptCount) {
 }
 
 
+bool MergingHandler::canScrubResults(int jobId, int attemptCount) {
+    return _infileMerger == nullptr || _infileMerger->canScrub(jobId, attemptCount);
+}
+
+
+qdisp::ResponseHandler::Ptr MergingHandler::makeHedge() {
+    return std::make_shared<MergingHandler>(_msgReceiver, _infileMerger, _tableName);
+}
+
+
 std::ostream& MergingHandler::print(std::ostream& os) const {
     return os << "MergingRequester(" << _tableName << ", flushed="
               << (_flushed ? "true)" : "false)") ;
@@ -222,25 +217,235 @@ std::ostream& MergingHandler::print(std::ostream& os) const {
 // MergingRequester private
 ////////////////////////////////////////////////////////////////////////
 
+/// @return true if the results are for an interactive query.
+bool MergingHandler::_isInteractive() {
+    auto jobQuery = getJobQuery().lock();
+    return jobQuery != nullptr && jobQuery->getDescription()->getScanInteractive();
+}
+
 void MergingHandler::_initState() {
     _mBuf.setTargetSize(proto::ProtoHeaderWrap::PROTO_HEADER_SIZE);
     _state = MsgState::HEADER_SIZE_WAIT;
+    _attemptRows = 0;
     _setError(0, "");
 }
 
-bool MergingHandler::_merge() {
+/// Prepare to receive the Result message described by _response->protoHeader.
+/// @return false if the header does not describe a valid message.
+bool MergingHandler::_waitForResult() {
+    _mBuf.zero(); // Free memory.
+    auto const& header = _response->protoHeader;
+    int size = header.size();
+    int rawSize = header.has_compression() ? header.rawsize() : size;
+    if (size < 0 || rawSize < 0
+        || rawSize > static_cast<int>(proto::ProtoHeaderWrap::PROTOBUFFER_HARD_LIMIT)) {
+        _setError(ccontrol::MSG_RESULT_DECODE, "From:" + _wName + " bad result size "
+                  + std::to_string(size) + " raw " + std::to_string(rawSize));
+        _state = MsgState::HEADER_ERR;
+        return false;
+    }
+    if (header.has_compression() && !proto::ResultDecompressor::isSupported()) {
+        _setError(ccontrol::MSG_RESULT_DECODE, "From:" + _wName
+                  + " compressed result, but czar built without zstd");
+        _state = MsgState::HEADER_ERR;
+        return false;
+    }
+    if (header.has_compression() && _decompressor == nullptr) {
+        _decompressor.reset(new proto::ResultDecompressor());
+    }
+    // The decoded size decides, as that is what would be held in memory.
+    if (rawSize > STREAM_FRAGMENT_SIZE) {
+        _decoder.reset(new proto::ResultStreamDecoder());
+        if (header.checksumtype() == proto::CHECKSUM_CRC32C) {
+            _crc32c.reset(new util::Crc32cStream());
+            _md5.reset();
+        } else {
+            _md5.reset(new util::Md5Stream());
+            _crc32c.reset();
+        }
+        if (header.has_compression()) {
+            _decompressor->startStream(rawSize);
+        }
+        _streamLeft = size;
+        _mBuf.setTargetSize(std::min(size, STREAM_FRAGMENT_SIZE));
+        _state = MsgState::RESULT_STREAM;
+    } else {
+        _mBuf.setTargetSize(size);
+        _state = MsgState::RESULT_WAIT;
+    }
+    return true;
+}
+
+/// Merge the complete, verified _response->result and set up the next state.
+bool MergingHandler::_flushResult(bool& last, bool& largeResult) {
+    auto jobQuery = getJobQuery().lock();
+    auto jobId = (jobQuery != nullptr) ? jobQuery->getIdStr() : "?";
+    largeResult = _response->result.largeresult();
+    bool msgContinues = _response->result.continues();
+    _state = MsgState::RESULT_RECV;
+    if (msgContinues) {
+        LOGS(_log, LOG_LVL_DEBUG, jobId << " Message continues, waiting for next header.");
+        _state = MsgState::RESULT_EXTRA;
+        _mBuf.setTargetSize(proto::ProtoHeaderWrap::PROTO_HEADER_SIZE);
+    } else {
+        LOGS(_log, LOG_LVL_DEBUG, jobId << " Message ends, setting last=true");
+        last = true;
+    }
+    LOGS(_log, LOG_LVL_DEBUG, jobId << " Flushed msgContinues=" << msgContinues
+         << " last=" << last << " for tableName=" << _tableName);
+
+    auto success = _merge(_response);
+    _response.reset();
+    if (msgContinues) {
+        _response.reset(new WorkerResponse());
+    } else if (success && jobQuery != nullptr) {
+        // Rows of an attempt only count once the whole attempt is merged, as
+        // the rows of a failed attempt are scrubbed from the result.
+        if (auto exec = jobQuery->getExecutive()) {
+            exec->addResultRows(_attemptRows);
+        }
+    }
+    return success;
+}
+
+/// Decode a fragment of a streamed Result message and merge the rows found in
+/// it. The last fragment completes the message, which is then verified and
+/// flushed like a buffered one.
+bool MergingHandler::_flushStream(int bLen, bool& last, bool& largeResult) {
+    if (bLen < 0 || bLen > _streamLeft || bLen > (int)_mBuf.getSize()) {
+        _setError(ccontrol::MSG_RESULT_DECODE, "From:" + _wName + " bad result fragment size "
+                  + std::to_string(bLen) + " expected " + std::to_string(_streamLeft));
+        _state = MsgState::RESULT_ERR;
+        return false;
+    }
+    auto const& buff = _mBuf.getBuffer();
+    if (_md5 != nullptr) {
+        _md5->update(buff.data(), bLen);
+    } else {
+        _crc32c->update(buff.data(), bLen);
+    }
+    bool decoded;
+    if (_response->protoHeader.has_compression()) {
+        auto decode = [this](char const* data, size_t len) {
+            return _decoder->add(data, len, _response->result);
+        };
+        decoded = _decompressor->addToStream(buff.data(), bLen, decode);
+    } else {
+        decoded = _decoder->add(buff.data(), bLen, _response->result);
+    }
+    if (!decoded) {
+        _setError(ccontrol::MSG_RESULT_DECODE, "Error decoding result msg");
+        _state = MsgState::RESULT_ERR;
+        return false;
+    }
+    _streamLeft -= bLen;
+    LOGS(_log, LOG_LVL_DEBUG, "From:" << _wName << " RESULT_STREAM got " << bLen
+         << " left=" << _streamLeft << " rows=" << proto::countRows(_response->result)
+         << " held=" << _decoder->getHeldBytes());
+    if (_streamLeft > 0) {
+        if (last) {
+            _setError(ccontrol::MSG_RESULT_DECODE, "From:" + _wName + " result msg truncated");
+            _state = MsgState::RESULT_ERR;
+            return false;
+        }
+        if (!_mergeStreamedRows()) { return false; }
+        _mBuf.setTargetSize(std::min(_streamLeft, STREAM_FRAGMENT_SIZE));
+        return true;
+    }
+
+    _mBuf.zero();
+    if (!_checkDigest(_md5 != nullptr ? _md5->digest() : _crc32c->digest())) {
+        return false;
+    }
+    if ((_response->protoHeader.has_compression() && !_decompressor->finishStream())
+        || !_decoder->finish(_response->result)) {
+        _setError(ccontrol::MSG_RESULT_DECODE, "Error decoding result msg");
+        _state = MsgState::RESULT_ERR;
+        return false;
+    }
+    // Rows already merged were labelled from the job description.
+    auto jobQuery = getJobQuery().lock();
+    if (jobQuery != nullptr) {
+        auto desc = jobQuery->getDescription();
+        auto const& result = _response->result;
+        if (result.jobid() != desc->id() || result.attemptcount() != desc->getAttemptCount()) {
+            std::ostringstream os;
+            os << "From:" << _wName << " streamed result for job " << result.jobid()
+               << " attempt " << result.attemptcount() << " does not match "
+               << jobQuery->getIdStr() << " attempt " << desc->getAttemptCount();
+            _setError(ccontrol::MSG_RESULT_ERROR, os.str());
+            _state = MsgState::RESULT_ERR;
+            return false;
+        }
+    }
+    _decoder.reset();
+    _md5.reset();
+    _crc32c.reset();
+    return _flushResult(last, largeResult);
+}
+
+/// Merge the rows decoded so far from a streamed Result message. The job
+/// identification fields follow the rows on the wire, so they are taken from
+/// the job description, and checked against the message once it is complete.
+bool MergingHandler::_mergeStreamedRows() {
+    Result& result = _response->result;
+    // Errors precede rows, and are reported when the message is complete.
+    if (proto::countRows(result) == 0 || result.has_errorcode() || result.has_errormsg()) {
+        return true;
+    }
+    auto jobQuery = getJobQuery().lock();
+    if (jobQuery == nullptr) {
+        LOGS(_log, LOG_LVL_ERROR, "MergingHandler::_mergeStreamedRows() failed, jobQuery was NULL");
+        return false;
+    }
+    auto desc = jobQuery->getDescription();
+    auto part = std::make_shared<WorkerResponse>();
+    part->headerSize = _response->headerSize;
+    part->protoHeader = _response->protoHeader;
+    Result& partResult = part->result;
+    partResult.set_continues(true); // The attempt is not complete yet.
+    *partResult.mutable_rowschema() = result.rowschema();
+    partResult.mutable_row()->Swap(result.mutable_row());
+    partResult.mutable_batch()->Swap(result.mutable_batch());
+    partResult.set_queryid(desc->getQueryId());
+    partResult.set_jobid(desc->id());
+    partResult.set_attemptcount(desc->getAttemptCount());
+    partResult.set_largeresult(_response->protoHeader.largeresult());
+    partResult.set_rowcount(proto::countRows(partResult));
+    partResult.set_transmitsize(0);
+    return _merge(part);
+}
+
+bool MergingHandler::_merge(std::shared_ptr<WorkerResponse> const& response) {
     if (auto job = getJobQuery().lock()) {
         if (_flushed) {
             throw Bug("MergingRequester::_merge : already flushed");
         }
-        bool success = _infileMerger->merge(_response);
-        if (!success) {
+        if (!claimMerge()) {
+            // The duplicate request of the job merges its rows, see HedgedJob.
+            _setError(ccontrol::MSG_RESULT_ERROR, "rows of the job are merged from another request");
+            _state = MsgState::RESULT_ERR;
+            return false;
+        }
+        int rows = proto::countRows(response->result);
+        auto merge = [this, &response]() { return _infileMerger->merge(response); };
+        bool success = false;
+        if (_infileMerger->mergesInMemory()) {
+            success = merge();
+        } else {
+            // Merges of all user queries take turns in the result database.
+            auto desc = job->getDescription();
+            success = MergeScheduler::get().run(desc->getQueryId(), desc->getScanInteractive(),
+                                                response->result.ByteSize(), merge);
+        }
+        if (success) {
+            _attemptRows += rows;
+        } else {
             LOGS(_log, LOG_LVL_WARN, "_merge() failed");
             rproc::InfileMergerError const& err = _infileMerger->getError();
             _setError(ccontrol::MSG_RESULT_ERROR, err.getMsg());
             _state = MsgState::RESULT_ERR;
         }
-        _response.reset();
         return success;
     }
     LOGS(_log, LOG_LVL_ERROR, "MergingHandler::_merge() failed, jobQuery was NULL");
@@ -255,8 +460,20 @@ void MergingHandler::_setError(int code, std::string const& msg) {
 
 bool MergingHandler::_setResult() {
     auto start = std::chrono::system_clock::now();
-    auto buff = _mBuf.getBuffer();
-    if (!ProtoImporter<proto::Result>::setMsgFrom(_response->result, &((buff)[0]), _mBuf.getSize())) {
+    auto const& buff = _mBuf.getBuffer();
+    char const* data = buff.data();
+    size_t size = _mBuf.getSize();
+    std::string raw;
+    if (_response->protoHeader.has_compression()) {
+        if (!_decompressor->decompress(data, size, _response->protoHeader.rawsize(), raw)) {
+            _setError(ccontrol::MSG_RESULT_DECODE, "Error decompressing result msg");
+            _state = MsgState::RESULT_ERR;
+            return false;
+        }
+        data = raw.data();
+        size = raw.size();
+    }
+    if (!ProtoImporter<proto::Result>::setMsgFrom(_response->result, data, size)) {
         _setError(ccontrol::MSG_RESULT_DECODE, "Error decoding result msg");
         _state = MsgState::RESULT_ERR;
         return false;
@@ -267,9 +484,21 @@ bool MergingHandler::_setResult() {
     return true;
 }
 bool MergingHandler::_verifyResult() {
-    auto buff = _mBuf.getBuffer();
-    if (_response->protoHeader.md5() != util::StringHash::getMd5(buff.data(), _mBuf.getSize())) {
-        _setError(ccontrol::MSG_RESULT_MD5, "Result message MD5 mismatch");
+    auto const& buff = _mBuf.getBuffer();
+    if (_response->protoHeader.checksumtype() == proto::CHECKSUM_CRC32C) {
+        return _checkDigest(util::StringHash::getCrc32c(buff.data(), _mBuf.getSize()));
+    }
+    return _checkDigest(util::StringHash::getMd5(buff.data(), _mBuf.getSize()));
+}
+
+/// @return true if digest, computed with the algorithm named in the
+///         ProtoHeader, matches the checksum sent by the worker.
+bool MergingHandler::_checkDigest(std::string const& digest) {
+    auto const& header = _response->protoHeader;
+    bool crc32c = header.checksumtype() == proto::CHECKSUM_CRC32C;
+    if (digest != (crc32c ? header.checksum() : header.md5())) {
+        _setError(ccontrol::MSG_RESULT_MD5, std::string("Result message ")
+                  + (crc32c ? "CRC32C" : "MD5") + " mismatch");
         _state = MsgState::RESULT_ERR;
         return false;
     }
@@ -278,7 +507,9 @@ bool MergingHandler::_verifyResult() {
 
 
 MergeBuffer::~MergeBuffer() {
+    _releaseReserved();
     if (_buff != nullptr && _buff->size() != 0) {
+        qdisp::MemoryGovernor::get().release(_buff->size(), _interactive);
         _totalBytes -= _buff->size();
         LOGS(_log, LOG_LVL_DEBUG, _id << " ~ totalBytes=" << _totalBytes);
     }
@@ -306,15 +537,29 @@ void MergeBuffer::setTargetSize(int sz) {
 }
 
 
-void MergeBuffer::resizeToTargetSize() {
+void MergeBuffer::resizeToTargetSize(bool interactive) {
     LOGS(_log, LOG_LVL_DEBUG, _id << " resizeToTargetSize targetSize=" << _targetSize);
-    _resize(_targetSize);
+    _resize(_targetSize, interactive);
+}
+
+
+bool MergeBuffer::reserveTargetSize(bool interactive, qdisp::MemoryGovernor::Attempt& attempt) {
+    _releaseReserved();
+    std::int64_t bytes = _growth(_targetSize, interactive);
+    if (!qdisp::MemoryGovernor::get().tryReserve(bytes, interactive, attempt)) {
+        return false;
+    }
+    _reserved = bytes;
+    _reservedInteractive = interactive;
+    return true;
 }
 
 
 void MergeBuffer::zero() {
     setTargetSize(0);
+    _releaseReserved();
     if (_buff != nullptr && _buff->size() != 0) {
+        qdisp::MemoryGovernor::get().release(_buff->size(), _interactive);
         _totalBytes -= _buff->size();
         LOGS(_log, LOG_LVL_DEBUG, _id << " zero totalBytes=" << _totalBytes);
     }
@@ -323,9 +568,26 @@ void MergeBuffer::zero() {
  }
 
 
- void MergeBuffer::_resize(int sz) {
-     if (sz != (int)_buff->size()) {
-         _totalBytes += sz - _buff->size();
+ void MergeBuffer::_resize(int sz, bool interactive) {
+     int oldSz = _buff->size();
+     if (_reserved != 0 && (_reservedInteractive != interactive || _reserved != _growth(sz, interactive))) {
+         _releaseReserved();
+     }
+     if (sz != oldSz) {
+         // Only growth waits, a buffer that keeps its size between fragments
+         // of a streamed message never does, nor does growth reserved beforehand.
+         auto& governor = qdisp::MemoryGovernor::get();
+         if (interactive != _interactive) {
+             governor.release(oldSz, _interactive);
+         } else if (sz < oldSz) {
+             governor.release(oldSz - sz, interactive);
+         }
+         if (_reserved == 0) {
+             governor.reserve(_growth(sz, interactive), interactive);
+         }
+         _reserved = 0;
+         _interactive = interactive;
+         _totalBytes += sz - oldSz;
          _buff->resize(sz);
          LOGS(_log, LOG_LVL_DEBUG, _id << " resize totalBytes=" << _totalBytes);
      } else if (sz != 0) {
@@ -333,4 +595,21 @@ void MergeBuffer::zero() {
      }
  }
 
+/// @return the bytes _resize(sz, interactive) reserves from the governor.
+std::int64_t MergeBuffer::_growth(int sz, bool interactive) const {
+    int oldSz = _buff->size();
+    if (sz == oldSz) return 0;
+    if (interactive != _interactive) return sz;
+    return std::max(sz - oldSz, 0);
+}
+
+
+/// Give back the bytes reserved by reserveTargetSize() and not used.
+void MergeBuffer::_releaseReserved() {
+    if (_reserved != 0) {
+        qdisp::MemoryGovernor::get().release(_reserved, _reservedInteractive);
+        _reserved = 0;
+    }
+}
+
 }}} // lsst::qserv::ccontrol
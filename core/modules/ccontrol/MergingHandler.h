@@ -25,10 +25,12 @@
 
 // System headers
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 
 // Qserv headers
+#include "qdisp/MemoryGovernor.h"
 #include "qdisp/ResponseHandler.h"
 
 // Forward decl
@@ -36,10 +38,16 @@ namespace lsst {
 namespace qserv {
   class MsgReceiver;
 namespace proto {
+  class ResultDecompressor;
+  class ResultStreamDecoder;
   struct WorkerResponse;
 }
 namespace rproc {
   class InfileMerger;
+}
+namespace util {
+  class Crc32cStream;
+  class Md5Stream;
 }}}
 
 namespace lsst {
@@ -51,6 +59,10 @@ namespace ccontrol {
 /// set using setTargetSize(int sz), and the buffer of that size is
 /// created by calling resizeToTargetSize(). When a buffer is no longer
 /// needed, zero() should be called to free the memory.
+///
+/// The memory is reserved from the qdisp::MemoryGovernor before it is
+/// allocated, so resizeToTargetSize() may wait for other buffers to be freed,
+/// unless reserveTargetSize() reserved it beforehand.
 class MergeBuffer {
 public:
     using bufType = std::vector<char>;
@@ -68,16 +80,27 @@ public:
     /// @return the size the buffer needs to be when data is ready.
     size_t getTargetSize() { return _targetSize; }
     void setTargetSize(int sz);
-    void resizeToTargetSize();
+    /// @param interactive true if the buffer is for an interactive query,
+    ///                    which may use the memory kept for those.
+    void resizeToTargetSize(bool interactive);
+    /// Reserve the memory resizeToTargetSize() needs without waiting.
+    /// @return false if the memory was not reserved, this should be called
+    ///         again with the same attempt when attempt.retry is called.
+    bool reserveTargetSize(bool interactive, qdisp::MemoryGovernor::Attempt& attempt);
     void zero(); ///< Set buffer size and _targetSize to zero, ensure memory is freed.
 
 
 private:
-    void _resize(int sz);
+    void _resize(int sz, bool interactive);
+    std::int64_t _growth(int sz, bool interactive) const;
+    void _releaseReserved();
 
     std::string _id;
     std::unique_ptr<bufType> _buff;
     int _targetSize{0};
+    bool _interactive{false}; ///< Governor share the current buffer was reserved from.
+    std::int64_t _reserved{0}; ///< Bytes reserved by reserveTargetSize() for the next resize.
+    bool _reservedInteractive{false}; ///< Governor share _reserved was reserved from.
     static std::atomic<std::int64_t> _totalBytes; ///< number of bytes held by all instances.
     static std::atomic<int> _sequence;
 };
@@ -89,15 +112,29 @@ private:
 /// fragment instead of performing buffer size and offset
 /// management. Fully-constructed protocol messages are then passed towards an
 /// InfileMerger.
+///
+/// Result messages larger than STREAM_FRAGMENT_SIZE are not buffered whole.
+/// They are pulled in fragments of that size, and the rows decoded from each
+/// fragment are passed to the InfileMerger right away. The checksum of such a
+/// message is computed along the way and checked once the last fragment has
+/// arrived; a mismatch fails the query as it does for buffered messages.
+///
+/// A compressed message is checksummed as sent, and decompressed before it is
+/// decoded, fragment by fragment if it is streamed. Whether it is streamed
+/// depends on its decompressed size.
 class MergingHandler : public qdisp::ResponseHandler {
 public:
     /// Possible MergingHandler message state
     enum class MsgState { INVALID, HEADER_SIZE_WAIT,
-                    RESULT_WAIT, RESULT_EXTRA,
+                    RESULT_WAIT, RESULT_STREAM, RESULT_EXTRA,
                     RESULT_RECV, 
                     HEADER_ERR, RESULT_ERR };
     static const char* getStateStr(MsgState const& st);
 
+    /// Result messages larger than this are decoded as they arrive, in
+    /// fragments of this size.
+    static const int STREAM_FRAGMENT_SIZE = 1024*1024;
+
     typedef std::shared_ptr<MergingHandler> Ptr;
     virtual ~MergingHandler();
 
@@ -113,10 +150,14 @@ public:
     /// before flush(), unless the response is completed (no more
     /// bytes) or there is an error.
     std::vector<char>& nextBuffer() override {
-        _mBuf.resizeToTargetSize();
+        _mBuf.resizeToTargetSize(_isInteractive());
         return _mBuf.getBuffer();
     }
 
+    bool reserveNextBuffer(qdisp::MemoryGovernor::Attempt& attempt) override {
+        return _mBuf.reserveTargetSize(_isInteractive(), attempt);
+    }
+
     size_t nextBufferSize() override {
         return _mBuf.getTargetSize();
     }
@@ -147,9 +188,23 @@ public:
     /// Prepare to scrub the results from jobId-attempt from the result table.
     void prepScrubResults(int jobId, int attempt) override;
 
+    /// @return false if rows of jobId-attempt were merged untagged, folded,
+    /// or published, see rproc::InfileMerger::canScrub().
+    bool canScrubResults(int jobId, int attempt) override;
+
+    /// @return a handler merging the responses to a duplicate request of the
+    /// job into the same table.
+    qdisp::ResponseHandler::Ptr makeHedge() override;
+
 private:
     void _initState();
-    bool _merge();
+    bool _isInteractive();
+    bool _waitForResult();
+    bool _flushResult(bool& last, bool& largeResult);
+    bool _flushStream(int bLen, bool& last, bool& largeResult);
+    bool _mergeStreamedRows();
+    bool _checkDigest(std::string const& digest);
+    bool _merge(std::shared_ptr<proto::WorkerResponse> const& response);
     void _setError(int code, std::string const& msg);
     bool _setResult();
     bool _verifyResult();
@@ -164,6 +219,12 @@ private:
     MsgState _state; ///< Received message state
     std::shared_ptr<proto::WorkerResponse> _response; ///< protobufs msg buf
     bool _flushed {false}; ///< flushed to InfileMerger?
+    std::unique_ptr<proto::ResultStreamDecoder> _decoder; ///< Decoder of a streamed message.
+    std::unique_ptr<util::Md5Stream> _md5; ///< MD5 of the streamed message so far.
+    std::unique_ptr<util::Crc32cStream> _crc32c; ///< Or its CRC32C, as the worker chose.
+    std::unique_ptr<proto::ResultDecompressor> _decompressor; ///< Made for the first compressed message.
+    int _streamLeft{0}; ///< Bytes of the streamed message still to come.
+    std::int64_t _attemptRows{0}; ///< Rows of the current attempt merged so far.
     std::string _wName {"~"}; /// worker name
 };
 
@@ -34,6 +34,7 @@
 #include "qmeta/Exceptions.h"
 #include "qmeta/QMeta.h"
 #include "qdisp/MessageStore.h"
+#include "rproc/InfileMerger.h"
 #include "sql/SqlConnection.h"
 #include "sql/SqlResults.h"
 
@@ -45,6 +46,9 @@ namespace lsst {
 namespace qserv {
 namespace ccontrol {
 
+char const* const UserQueryAsyncResult::END_OF_STREAM_MSG =
+    "End of streamed result, all rows were returned.";
+
 // Constructors
 UserQueryAsyncResult::UserQueryAsyncResult(QueryId queryId,
                                            qmeta::CzarId qMetaCzarId,
@@ -74,6 +78,86 @@ UserQueryAsyncResult::UserQueryAsyncResult(QueryId queryId,
         message += exc.what();
         _messageStore->addErrorMessage(message);
     }
+    if (_qInfo.resultLocation().compare(0, 6, "table:") == 0) {
+        _resultTable = _qInfo.resultLocation().substr(6);
+    }
+    // The proxy is given the result table name before submit() is called,
+    // which takes the batch.
+    _findBatch();
+}
+
+
+/// Replace the result table with the oldest unread batch of a streamed
+/// result, if the result is streamed and a batch is ready. The batch is
+/// only taken from the cursor table by submit().
+void UserQueryAsyncResult::_findBatch() {
+    auto status = _qInfo.queryStatus();
+    if (_messageStore->messageCount() > 0 || _qInfo.czarId() != _qMetaCzarId || _resultTable.empty()
+        || (status != qmeta::QInfo::EXECUTING && status != qmeta::QInfo::COMPLETED)) {
+        return;
+    }
+    std::string const cursorTable = rproc::InfileMerger::getCursorTableName(_resultTable);
+    sql::SqlErrorObject sqlErrObj;
+    if (!_resultDbConn->tableExists(cursorTable, sqlErrObj)) {
+        return;
+    }
+    _streaming = true;
+    _cursorTable = cursorTable;
+
+    std::string query = "SELECT batch, tableName FROM " + cursorTable + " ORDER BY batch LIMIT 1";
+    auto results = _resultDbConn->getQueryIter(query);
+    if (results->getErrorObject().isSet()) {
+        LOGS(_log, LOG_LVL_ERROR, "Failed to read cursor table: " << results->getErrorObject().errMsg());
+        _messageStore->addErrorMessage("Failed to read result batches.");
+        return;
+    }
+    std::string batch;
+    std::string batchTable;
+    for (; !results->done(); ++(*results)) {
+        batch = (**results)[0];
+        batchTable = (**results)[1];
+    }
+    if (batch.empty()) {
+        LOGS(_log, LOG_LVL_DEBUG, "No batch ready in " << cursorTable);
+        return;
+    }
+    if (batch == std::to_string(rproc::InfileMerger::CURSOR_END_BATCH)) {
+        LOGS(_log, LOG_LVL_DEBUG, "All batches of " << _resultTable << " were read");
+        _endOfStream = true;
+        _resultTable.clear();
+        return;
+    }
+    _resultTable = batchTable;
+    _batch = batch;
+    _isBatch = true;
+}
+
+
+/// Take the batch found by _findBatch() from the cursor table.
+/// @return false if it could not be.
+bool UserQueryAsyncResult::_takeBatch() {
+    // The proxy drops the batch table once it has read it.
+    std::string const query = "DELETE FROM " + _cursorTable + " WHERE batch=" + _batch;
+    sql::SqlErrorObject sqlErrObj;
+    if (!_resultDbConn->runQuery(query, sqlErrObj)) {
+        LOGS(_log, LOG_LVL_ERROR, "Failed to remove batch " << _batch << ": " << sqlErrObj.errMsg());
+        _messageStore->addErrorMessage("Failed to read result batches.");
+        return false;
+    }
+    LOGS(_log, LOG_LVL_DEBUG, "Returning batch " << _batch << " " << _resultTable);
+    return true;
+}
+
+
+/// Mark the end of a streamed result, whose last rows are being returned,
+/// for the next query of it to fail with END_OF_STREAM_MSG.
+void UserQueryAsyncResult::_endStream() {
+    std::string const query = "INSERT INTO " + _cursorTable + " (batch, tableName, rowCount) VALUES ("
+        + std::to_string(rproc::InfileMerger::CURSOR_END_BATCH) + ", '', 0)";
+    sql::SqlErrorObject sqlErrObj;
+    if (!_resultDbConn->runQuery(query, sqlErrObj)) {
+        LOGS(_log, LOG_LVL_ERROR, "Failed to mark the end of " << _cursorTable << ": " << sqlErrObj.errMsg());
+    }
 }
 
 // Destructor
@@ -102,6 +186,24 @@ void UserQueryAsyncResult::submit() {
         return;
     }
 
+    // Batches of a streamed result are returned while the query runs, without
+    // its messages, which come with the last rows.
+    if (_isBatch) {
+        if (_takeBatch()) {
+            _qState = SUCCESS;
+        }
+        return;
+    }
+    if (_endOfStream) {
+        LOGS(_log, LOG_LVL_DEBUG, END_OF_STREAM_MSG);
+        _messageStore->addErrorMessage(END_OF_STREAM_MSG);
+        sql::SqlErrorObject sqlErrObj;
+        if (!_resultDbConn->runQuery("DROP TABLE " + _cursorTable, sqlErrObj)) {
+            LOGS(_log, LOG_LVL_ERROR, "Failed to drop cursor table: " << sqlErrObj.errMsg());
+        }
+        return;
+    }
+
     // TODO: check user name, does not matter now as we are not keeping tack of users.
     // TODO: this is supposed to be used with ASYNC queries only but I can imagine that
     // it could be useful with SYNC too if/when we manage result lifetime properly
@@ -178,6 +280,9 @@ void UserQueryAsyncResult::submit() {
     } else {
         LOGS(_log, LOG_LVL_DEBUG, "Deleted message table " << _qInfo.msgTableName());
     }
+    if (_streaming) {
+        _endStream();
+    }
 
     // done
     _qState = SUCCESS;
@@ -198,11 +303,7 @@ std::shared_ptr<qdisp::MessageStore> UserQueryAsyncResult::getMessageStore() {
 }
 
 std::string UserQueryAsyncResult::getResultTableName() const {
-    if (_qInfo.resultLocation().compare(0, 6, "table:") == 0) {
-        return _qInfo.resultLocation().substr(6);
-    } else {
-        return std::string();
-    }
+    return _resultTable;
 }
 
 std::string UserQueryAsyncResult::getResultLocation() const {
@@ -54,10 +54,18 @@ namespace ccontrol {
  *  @ingroup ccontrol
  *
  *  @brief UserQuery implementation for returning results of async queries.
+ *
+ *  A streamed result (see rproc::InfileMerger) is returned one batch per
+ *  query while the original query runs, and its remaining rows once it
+ *  has completed. While no batch is ready, the query fails as for a result
+ *  that is not streamed. Once the remaining rows were returned, it fails
+ *  with END_OF_STREAM_MSG.
  */
 
 class UserQueryAsyncResult : public UserQuery {
 public:
+    /// Error of a query for a streamed result of which all rows were returned.
+    static char const* const END_OF_STREAM_MSG;
 
     /**
      *  Constructor for "SELECT * FROM QSERV_RESULT(QID)".
@@ -115,6 +123,9 @@ public:
 protected:
 
 private:
+    void _findBatch();
+    bool _takeBatch();
+    void _endStream();
 
     QueryId _queryId;
     qmeta::CzarId _qMetaCzarId;
@@ -123,6 +134,12 @@ private:
     qmeta::QInfo _qInfo;
     std::shared_ptr<qdisp::MessageStore> _messageStore;
     QueryState _qState = UNKNOWN;
+    std::string _resultTable; ///< Returned to the proxy, a batch table if _isBatch.
+    bool _streaming = false; ///< The result is read in batches.
+    std::string _cursorTable; ///< Lists the batches of a streamed result.
+    bool _isBatch = false; ///< _resultTable is a batch of a streamed result.
+    std::string _batch; ///< Number of the batch in _resultTable, if _isBatch.
+    bool _endOfStream = false; ///< All rows of the streamed result were returned.
 };
 
 }}} // namespace lsst::qserv::ccontrol
@@ -26,8 +26,12 @@
 
 // System headers
 #include <cassert>
+#include <cctype>
 #include <cstdlib>
+#include <mutex>
+#include <set>
 #include <string>
+#include <utility>
 
 // Third-party headers
 
@@ -50,6 +54,7 @@
 #include "mysql/MySqlConfig.h"
 #include "parser/ParseException.h"
 #include "parser/SelectParser.h"
+#include "proto/ResultCompressor.h"
 #include "qdisp/Executive.h"
 #include "qdisp/MessageStore.h"
 #include "qmeta/QMetaMysql.h"
@@ -57,12 +62,19 @@
 #include "qproc/QuerySession.h"
 #include "qproc/SecondaryIndex.h"
 #include "query/FromList.h"
+#include "query/JoinRef.h"
+#include "query/QueryTemplate.h"
 #include "query/SelectStmt.h"
+#include "query/TableRef.h"
 #include "rproc/InfileMerger.h"
 #include "sql/SqlConnection.h"
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.ccontrol.UserQueryFactory");
+
+// Functions whose value changes between runs of the same query.
+char const* const volatileFunctions[] = {"RAND(", "NOW(", "SYSDATE(", "UUID(", "CURRENT_",
+                                         "UNIX_TIMESTAMP(", "CURDATE(", "CURTIME(", "CONNECTION_ID("};
 }
 
 namespace lsst {
@@ -79,12 +91,27 @@ public:
     /// State shared between UserQueries
     qdisp::Executive::Config::Ptr executiveConfig;
     std::shared_ptr<css::CssAccess> css;
+    /// CSS connection of makeResultCacheKey, which runs without the czar lock,
+    /// null if results are not cached.
+    std::shared_ptr<css::CssAccess> cacheKeyCss;
+    std::mutex cacheKeyCssMtx;          ///< Serializes use of cacheKeyCss
     mysql::MySqlConfig const mysqlResultConfig;
     std::shared_ptr<qproc::SecondaryIndex> secondaryIndex;
     std::shared_ptr<qmeta::QMeta> queryMetadata;
     std::shared_ptr<qmeta::QMetaSelect> qMetaSelect;
     std::unique_ptr<sql::SqlConnection> resultDbConn;
     qmeta::CzarId qMetaCzarId = {0};   ///< Czar ID in QMeta database
+    int const resultMergeConnections;  ///< Concurrent merge connections per query
+    bool const stageJobAttempts;       ///< Stage results of multi-message job attempts
+    bool const nativeAggregation;      ///< Aggregate results in memory when possible
+    bool const nativeTopK;             ///< Keep only the first rows of ORDER BY LIMIT in memory
+    int const partialAggregateRows;    ///< Rows merged between partial aggregations
+    int const streamingBatchRows;      ///< Rows per early readable batch of async results
+    std::string const spillDir;        ///< Directory of spill files, empty if not spilling
+    std::int64_t const spillThresholdBytes; ///< Rows loaded before spilling
+    std::int64_t const spillQuotaBytes;     ///< Maximum spill file size of a query
+    int const resultCompressionLevel;  ///< zstd level for scan query results
+    bool const sendQueryTemplates;     ///< Workers generate chunk queries from templates
 };
 
 ////////////////////////////////////////////////////////////////////////
@@ -195,10 +222,23 @@ UserQueryFactory::newUserQuery(std::string const& aQuery,
             executive = qdisp::Executive::create(_impl->executiveConfig, messageStore,
                                                  qdispPool);
             infileMergerConfig = std::make_shared<rproc::InfileMergerConfig>(_impl->mysqlResultConfig);
+            infileMergerConfig->maxMergeConnections = _impl->resultMergeConnections;
+            infileMergerConfig->stageJobAttempts = _impl->stageJobAttempts;
+            infileMergerConfig->nativeAggregation = _impl->nativeAggregation;
+            infileMergerConfig->nativeTopK = _impl->nativeTopK;
+            infileMergerConfig->partialAggregateRows = _impl->partialAggregateRows;
+            if (async) {
+                infileMergerConfig->streamingBatchRows = _impl->streamingBatchRows;
+            }
+            infileMergerConfig->spillDir = _impl->spillDir;
+            infileMergerConfig->spillThresholdBytes = _impl->spillThresholdBytes;
+            infileMergerConfig->spillQuotaBytes = _impl->spillQuotaBytes;
         }
         auto uq = std::make_shared<UserQuerySelect>(qs, messageStore, executive, infileMergerConfig,
                                                     _impl->secondaryIndex, _impl->queryMetadata,
                                                     _impl->qMetaCzarId, qdispPool,
+                                                    _impl->resultCompressionLevel,
+                                                    _impl->sendQueryTemplates,
                                                     errorExtra, async);
         if (sessionValid) {
             uq->qMetaRegister(resultLocation, msgTableName);
@@ -248,10 +288,100 @@ UserQueryFactory::newUserQuery(std::string const& aQuery,
     }
 }
 
+std::string
+UserQueryFactory::makeResultCacheKey(std::string const& query,
+                                     std::string const& defaultDb) {
+    // Only plain SELECTs, SUBMIT results are read back in pieces.
+    if (_impl->cacheKeyCss == nullptr or not UserQueryType::isSelect(query)) {
+        return std::string();
+    }
+
+    std::shared_ptr<query::SelectStmt> stmt;
+    try {
+        auto parser = parser::SelectParser::newInstance(query);
+        parser->setup();
+        stmt = parser->getSelectStmt();
+    } catch(parser::ParseException const&) {
+        return std::string();
+    }
+
+    // The regenerated query text does not depend on spacing or keyword case.
+    std::string const text = stmt->getQueryTemplate().sqlFragment();
+    std::string upper(text);
+    for (auto& c : upper) c = std::toupper(static_cast<unsigned char>(c));
+    for (auto func : ::volatileFunctions) {
+        if (upper.find(func) != std::string::npos) {
+            return std::string();
+        }
+    }
+
+    std::set<std::string> dbs;
+    std::set<std::pair<std::string, std::string>> tables;
+    for (auto const& tblRef : stmt->getFromList().getTableRefList()) {
+        std::vector<query::TableRef::CPtr> refs(1, tblRef);
+        for (auto const& join : tblRef->getJoins()) {
+            refs.push_back(join->getRight());
+        }
+        for (auto const& ref : refs) {
+            std::string const db = ref->getDb().empty() ? defaultDb : ref->getDb();
+            if (UserQueryType::isProcessListTable(db, ref->getTable())) {
+                return std::string();
+            }
+            dbs.insert(db);
+            tables.insert(std::make_pair(db, ref->getTable()));
+        }
+    }
+
+    // The CSS definition of what the query reads is part of the key, so that
+    // entries are no longer found once tables are created, deleted or have
+    // their schema changed. CSS has no version of the data itself, data loaded
+    // into existing tables is covered by the expiration of cache entries.
+    std::string key = "css:";
+    try {
+        std::lock_guard<std::mutex> lock(_impl->cacheKeyCssMtx);
+        auto const dbStatus = _impl->cacheKeyCss->getDbStatus();
+        for (auto const& db : dbs) {
+            auto iter = dbStatus.find(db);
+            key += " " + db + "=" + (iter == dbStatus.end() ? std::string("?") : iter->second);
+            for (auto const& tblStatus : _impl->cacheKeyCss->getTableStatus(db)) {
+                key += " " + db + "." + tblStatus.first + "=" + tblStatus.second;
+            }
+        }
+        for (auto const& table : tables) {
+            key += "\n" + table.first + "." + table.second + ":"
+                + _impl->cacheKeyCss->getTableSchema(table.first, table.second);
+        }
+    } catch (std::exception const& exc) {
+        LOGS(_log, LOG_LVL_DEBUG, "not caching result, CSS failure: " << exc.what());
+        return std::string();
+    }
+    return key + "\ndb:" + defaultDb + "\n" + text;
+}
+
 UserQueryFactory::Impl::Impl(czar::CzarConfig const& czarConfig)
-    : mysqlResultConfig(czarConfig.getMySqlResultConfig()) {
+    : mysqlResultConfig(czarConfig.getMySqlResultConfig()),
+      resultMergeConnections(czarConfig.getResultMergeConnections()),
+      stageJobAttempts(czarConfig.getStageJobAttempts()),
+      nativeAggregation(czarConfig.getNativeAggregation()),
+      nativeTopK(czarConfig.getNativeTopK()),
+      partialAggregateRows(czarConfig.getPartialAggregateRows()),
+      streamingBatchRows(czarConfig.getStreamingBatchRows()),
+      spillDir(czarConfig.getSpillDir()),
+      spillThresholdBytes(std::int64_t(czarConfig.getSpillThresholdMB())*1024*1024),
+      spillQuotaBytes(std::int64_t(czarConfig.getSpillQuotaMB())*1024*1024),
+      // Workers must not send results this czar cannot decompress.
+      resultCompressionLevel(proto::ResultDecompressor::isSupported()
+                             ? czarConfig.getResultCompressionLevel() : 0),
+      sendQueryTemplates(czarConfig.getSendQueryTemplates()) {
+
+    if (czarConfig.getResultCompressionLevel() > 0 && resultCompressionLevel == 0) {
+        LOGS(_log, LOG_LVL_WARN, "resultCompressionLevel ignored, czar built without zstd");
+    }
 
     executiveConfig = std::make_shared<qdisp::Executive::Config>(czarConfig.getXrootdFrontendUrl());
+    executiveConfig->maxChunksPerRequest = czarConfig.getMaxChunksPerRequest();
+    executiveConfig->hedgeCompletedPercent = czarConfig.getHedgeCompletedPercent();
+    executiveConfig->hedgeLatencyFactor = czarConfig.getHedgeLatencyFactor();
     secondaryIndex = std::make_shared<qproc::SecondaryIndex>(mysqlResultConfig);
 
     // make one dedicated connection for results database
@@ -262,6 +392,10 @@ UserQueryFactory::Impl::Impl(czar::CzarConfig const& czarConfig)
 
     // create CssAccess instance
     css = css::CssAccess::createFromConfig(czarConfig.getCssConfigMap(), czarConfig.getEmptyChunkPath());
+    if (czarConfig.getResultCacheMaxSizeMB() > 0) {
+        cacheKeyCss = css::CssAccess::createFromConfig(czarConfig.getCssConfigMap(),
+                                                       czarConfig.getEmptyChunkPath());
+    }
 }
 
 }}} // lsst::qserv::ccontrol
@@ -74,6 +74,17 @@ public:
                                 std::string const& userQueryId,
                                 std::string const& msgTableName);
 
+    /// Make the key under which the result of a query may be cached, made of
+    /// the normalized query text, the default database, the CSS status of the
+    /// databases it reads and the CSS schema of the tables it reads, so that a
+    /// change of any of them makes a new key. Unlike newUserQuery(), this may
+    /// be called concurrently.
+    /// @param query:      Query text
+    /// @param defaultDb:  Default database name, may be empty
+    /// @return the key, or an empty string if the result may not be cached.
+    std::string makeResultCacheKey(std::string const& query,
+                                   std::string const& defaultDb);
+
 private:
     class Impl;
     std::shared_ptr<Impl> _impl;
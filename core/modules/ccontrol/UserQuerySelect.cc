@@ -76,6 +76,7 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "ccontrol/MergeScheduler.h"
 #include "ccontrol/MergingHandler.h"
 #include "ccontrol/TmpTableName.h"
 #include "ccontrol/UserQueryError.h"
@@ -157,11 +158,14 @@ UserQuerySelect::UserQuerySelect(std::shared_ptr<qproc::QuerySession> const& qs,
                                  std::shared_ptr<qmeta::QMeta> const& queryMetadata,
                                  qmeta::CzarId czarId,
                                  std::shared_ptr<qdisp::QdispPool> const& qdispPool,
+                                 int resultCompressionLevel,
+                                 bool sendQueryTemplates,
                                  std::string const& errorExtra,
                                  bool async)
     :  _qSession(qs), _messageStore(messageStore), _executive(executive),
        _infileMergerConfig(infileMergerConfig), _secondaryIndex(secondaryIndex),
        _queryMetadata(queryMetadata), _qMetaCzarId(czarId), _qdispPool(qdispPool),
+       _resultCompressionLevel(resultCompressionLevel), _sendQueryTemplates(sendQueryTemplates),
        _errorExtra(errorExtra), _async(async) {
 }
 
@@ -205,19 +209,36 @@ void UserQuerySelect::submit() {
 
     // has to be done after result table name
     _setupMerger();
+    MergeScheduler::get().addQuery(_qMetaQueryId);
 
     // Using the QuerySession, generate query specs (text, db, chunkId) and then
     // create query messages and send them to the async query manager.
     LOGS(_log, LOG_LVL_DEBUG, getQueryIdString() << " UserQuerySelect beginning submission");
     assert(_infileMerger);
 
-    auto taskMsgFactory = std::make_shared<qproc::TaskMsgFactory>(_qMetaQueryId);
+    auto taskMsgFactory = std::make_shared<qproc::TaskMsgFactory>(_qMetaQueryId, _resultCompressionLevel);
     TmpTableName ttn(_qMetaQueryId, _qSession->getOriginal());
     std::vector<int> chunks;
     std::mutex chunksMtx;
     int sequence = 0;
 
     auto queryTemplates = _qSession->makeQueryTemplates();
+    // If enabled, the chunk queries are generated by the workers, so that
+    // the text of the query is only held once for all chunks. Workers that
+    // predate query templates would run nothing on the chunk.
+    qproc::ChunkQueryTemplates::Ptr chunkQueryTemplates;
+    if (_sendQueryTemplates) {
+        chunkQueryTemplates = _qSession->makeChunkQueryTemplates(queryTemplates);
+    }
+    // Otherwise they are generated from templates compiled once for all chunks.
+    qproc::QuerySession::CompiledTemplates compiledTemplates;
+    if (chunkQueryTemplates == nullptr) {
+        compiledTemplates = _qSession->compileQueryTemplates(queryTemplates);
+    }
+
+    // Without ordering or aggregation, any LIMIT rows are the result, so
+    // the jobs still running can be squashed once that many are merged.
+    _executive->setRowLimit(_qSession->getEarlyLimit());
 
     std::atomic<int> addTimeSum; // TEMPORARY-timing
 
@@ -238,15 +259,17 @@ void UserQuerySelect::submit() {
 
         std::function<void(util::CmdData*)> funcBuildJob =
                 [this, sequence,     // sequence must be a copy
-                 &chunkSpec, &queryTemplates,
+                 &chunkSpec, &compiledTemplates, &chunkQueryTemplates,
                  &chunks, &chunksMtx, &ttn,
                  &taskMsgFactory, &addTimeSum](util::CmdData*) {
 
             auto startbuildQSJ = std::chrono::system_clock::now(); // TEMPORARY-timing
-            qproc::ChunkQuerySpec::Ptr cs;
+            // The QuerySession is not changed while jobs are built, so
+            // specs are built concurrently by all of the pool threads.
+            qproc::ChunkQuerySpec::Ptr cs =
+                    _qSession->buildChunkQuerySpec(compiledTemplates, chunkSpec, chunkQueryTemplates);
             {
                 std::lock_guard<std::mutex> lock(chunksMtx);
-                cs = _qSession->buildChunkQuerySpec(queryTemplates, chunkSpec);
                 chunks.push_back(cs->chunkId);
             }
             std::string chunkResultName = ttn.make(cs->chunkId);
@@ -302,8 +325,17 @@ void UserQuerySelect::submit() {
 /// @return the QueryState indicating success or failure
 QueryState UserQuerySelect::join() {
     bool successful = _executive->join(); // Wait for all data
+    auto mergeStats = MergeScheduler::get().removeQuery(_qMetaQueryId);
+    LOGS(_log, LOG_LVL_INFO, getQueryIdString() << " merges=" << mergeStats.merges
+         << " mergedBytes=" << mergeStats.mergedBytes << " merge time=" << mergeStats.mergeMicros
+         << "us wait time=" << mergeStats.waitMicros << "us");
     // Since all data are in, run final SQL commands like GROUP BY.
-    if (!_infileMerger->finalize()) {
+    auto startFinalize = std::chrono::system_clock::now();
+    bool finalizeOk = _infileMerger->finalize();
+    auto endFinalize = std::chrono::system_clock::now();
+    LOGS(_log, LOG_LVL_INFO, getQueryIdString() << " finalize time="
+         << timeDiff(startFinalize, endFinalize) << "us ok=" << finalizeOk);
+    if (!finalizeOk) {
         successful = false;
         LOGS(_log, LOG_LVL_ERROR, getQueryIdString() << " InfileMerger::finalize failed");
         // Error: 1105 SQLSTATE: HY000 (ER_UNKNOWN_ERROR) Message: Unknown error
@@ -370,6 +402,10 @@ void UserQuerySelect::_setupMerger() {
     LOGS(_log, LOG_LVL_TRACE, getQueryIdString() << " Setup merger");
     _infileMergerConfig->targetTable = _resultTable;
     _infileMergerConfig->mergeStmt = _qSession->getMergeStmt();
+    if (!_qSession->getProxyOrderBy().empty()) {
+        // The proxy sorts each batch it reads, not the whole result.
+        _infileMergerConfig->streamingBatchRows = 0;
+    }
     _infileMerger = std::make_shared<rproc::InfileMerger>(*_infileMergerConfig);
 }
 
@@ -90,6 +90,8 @@ public:
                     std::shared_ptr<qmeta::QMeta> const& queryMetadata,
                     qmeta::CzarId czarId,
                     std::shared_ptr<qdisp::QdispPool> const& qdispPool,
+                    int resultCompressionLevel,
+                    bool sendQueryTemplates,
                     std::string const& errorExtra,
                     bool async);
 
@@ -163,6 +165,8 @@ private:
     qmeta::CzarId _qMetaCzarId; ///< Czar ID in QMeta database
     QueryId _qMetaQueryId{0};      ///< Query ID in QMeta database
     std::shared_ptr<qdisp::QdispPool> _qdispPool;
+    int _resultCompressionLevel; ///< zstd level for results of scan queries.
+    bool _sendQueryTemplates; ///< Workers generate chunk queries from templates.
     /// QueryId in a standard string form, initially set to unknown.
     std::string _queryIdStr{QueryIdHelper::makeIdStr(0, true)};
     bool _killed{false};
@@ -0,0 +1,135 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Qserv headers
+#include "ccontrol/MergeScheduler.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE MergeScheduler_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::ccontrol::MergeScheduler;
+
+namespace {
+
+void waitForQueued(MergeScheduler& scheduler, lsst::qserv::QueryId queryId, std::int64_t bytes) {
+    while (scheduler.getQueryStats(queryId).queuedBytes < bytes) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(NoLimit) {
+    MergeScheduler scheduler;
+    scheduler.addQuery(1);
+    BOOST_CHECK(scheduler.run(1, false, 100, []() { return true; }));
+    BOOST_CHECK(!scheduler.run(1, false, 50, []() { return false; }));
+    auto stats = scheduler.getQueryStats(1);
+    BOOST_CHECK_EQUAL(stats.merges, 2u);
+    BOOST_CHECK_EQUAL(stats.mergedBytes, 150u);
+    BOOST_CHECK_EQUAL(stats.queuedBytes, 0);
+    BOOST_CHECK_EQUAL(scheduler.removeQuery(1).merges, 2u);
+    BOOST_CHECK_EQUAL(scheduler.getQueryStats(1).merges, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(FairOrder) {
+    MergeScheduler scheduler;
+    scheduler.configure(1, 10);
+    for (lsst::qserv::QueryId queryId = 1; queryId <= 3; ++queryId) {
+        scheduler.addQuery(queryId);
+    }
+
+    // Hold the only slot until all other merges are queued.
+    std::atomic<bool> release{false};
+    std::thread holder([&]() {
+        scheduler.run(1, false, 1, [&]() {
+            while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return true;
+        });
+    });
+    while (scheduler.getRunning() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::mutex orderMtx;
+    std::vector<int> order;
+    auto merge = [&](int id) {
+        return [&, id]() {
+            std::lock_guard<std::mutex> lock(orderMtx);
+            order.push_back(id);
+            return true;
+        };
+    };
+    std::vector<std::thread> threads;
+    // A scan query queues three merges, then an interactive one queues one
+    // of the same size, which weighs less than the first scan merge.
+    for (int i = 1; i <= 3; ++i) {
+        threads.emplace_back([&, i]() { scheduler.run(2, false, 100, merge(i)); });
+        waitForQueued(scheduler, 2, 100*i);
+    }
+    threads.emplace_back([&]() { scheduler.run(3, true, 100, merge(4)); });
+    waitForQueued(scheduler, 3, 100);
+
+    release = true;
+    holder.join();
+    for (auto& thread : threads) thread.join();
+    std::vector<int> const expected = {4, 1, 2, 3};
+    BOOST_CHECK(order == expected);
+    BOOST_CHECK(scheduler.getQueryStats(2).waitMicros > 0);
+    BOOST_CHECK_EQUAL(scheduler.getQueryStats(2).queuedBytes, 0);
+    BOOST_CHECK(scheduler.getQueryStats(3).interactive);
+}
+
+BOOST_AUTO_TEST_CASE(Exception) {
+    MergeScheduler scheduler;
+    scheduler.configure(1, 1);
+    BOOST_CHECK_THROW(scheduler.run(1, false, 1, []() -> bool { throw std::runtime_error("x"); }),
+                      std::runtime_error);
+    // The slot was given back.
+    BOOST_CHECK_EQUAL(scheduler.getRunning(), 0);
+    BOOST_CHECK(scheduler.run(1, false, 1, []() { return true; }));
+}
+
+BOOST_AUTO_TEST_CASE(RemovedQuery) {
+    MergeScheduler scheduler;
+    scheduler.addQuery(1);
+    BOOST_CHECK(scheduler.run(1, false, 100, []() { return true; }));
+    BOOST_CHECK_EQUAL(scheduler.removeQuery(1).merges, 1u);
+    // A late merge still runs, but does not track the query again.
+    BOOST_CHECK(scheduler.run(1, false, 100, []() { return true; }));
+    BOOST_CHECK_EQUAL(scheduler.getQueryStats(1).merges, 0u);
+    BOOST_CHECK_EQUAL(scheduler.removeQuery(1).merges, 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
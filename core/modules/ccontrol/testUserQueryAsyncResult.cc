@@ -0,0 +1,159 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "ccontrol/UserQueryAsyncResult.h"
+#include "qdisp/MessageStore.h"
+#include "qmeta/QMeta.h"
+#include "rproc/InfileMerger.h"
+#include "sql/MockSql.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE UserQueryAsyncResult_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+using namespace lsst::qserv;
+using ccontrol::UserQueryAsyncResult;
+
+namespace {
+
+/// Knows only the query being read.
+class MockQMeta : public qmeta::QMeta {
+public:
+    explicit MockQMeta(qmeta::QInfo const& qInfo) : _qInfo(qInfo) {}
+    qmeta::CzarId getCzarID(std::string const&) override { return 1; }
+    qmeta::CzarId registerCzar(std::string const&) override { return 1; }
+    void setCzarActive(qmeta::CzarId, bool) override {}
+    void cleanup(qmeta::CzarId) override {}
+    QueryId registerQuery(qmeta::QInfo const&, TableNames const&) override { return 0; }
+    void addChunks(QueryId, std::vector<int> const&) override {}
+    void assignChunk(QueryId, int, std::string const&) override {}
+    void finishChunk(QueryId, int) override {}
+    void completeQuery(QueryId, qmeta::QInfo::QStatus) override {}
+    void finishQuery(QueryId) override {}
+    std::vector<QueryId> findQueries(qmeta::CzarId, qmeta::QInfo::QType, std::string const&,
+                                     std::vector<qmeta::QInfo::QStatus> const&, int, int) override {
+        return std::vector<QueryId>();
+    }
+    std::vector<QueryId> getPendingQueries(qmeta::CzarId) override { return std::vector<QueryId>(); }
+    qmeta::QInfo getQueryInfo(QueryId) override { return _qInfo; }
+    std::vector<QueryId> getQueriesForDb(std::string const&) override { return std::vector<QueryId>(); }
+    std::vector<QueryId> getQueriesForTable(std::string const&, std::string const&) override {
+        return std::vector<QueryId>();
+    }
+private:
+    qmeta::QInfo _qInfo;
+};
+
+/// Result database with the cursor table of a streamed result, which
+/// records the statements run.
+class CursorSql : public sql::MockSql {
+public:
+    typedef std::vector<std::string> Tuple;
+    typedef std::vector<Tuple> TupleVector;
+    typedef MockSql::Iter<TupleVector::const_iterator> SqlIter;
+
+    bool tableExists(std::string const& tableName, sql::SqlErrorObject&, std::string const&) override {
+        return tables.count(tableName) > 0;
+    }
+    std::shared_ptr<sql::SqlResultIter> getQueryIter(std::string const& query) override {
+        return std::make_shared<SqlIter>(cursor.begin(), cursor.end());
+    }
+    bool runQuery(std::string const query, sql::SqlErrorObject&) override {
+        statements.push_back(query);
+        return true;
+    }
+
+    std::set<std::string> tables;
+    TupleVector cursor; ///< Rows (batch, tableName) of the first batch.
+    std::vector<std::string> statements;
+};
+
+struct Fixture {
+    Fixture() {
+        sql.tables = {"result_5", rproc::InfileMerger::getCursorTableName("result_5"), "message_5"};
+    }
+
+    std::shared_ptr<UserQueryAsyncResult> makeQuery(qmeta::QInfo::QStatus status) {
+        qmeta::QInfo qInfo(qmeta::QInfo::ASYNC, 1, "user", "SELECT", "", "", "",
+                           "table:result_5", "message_5", status);
+        return std::make_shared<UserQueryAsyncResult>(5, 1, std::make_shared<MockQMeta>(qInfo), &sql);
+    }
+
+    CursorSql sql;
+};
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(Suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(Batch) {
+    sql.cursor = {{"3", "result_5_b3"}};
+    auto uq = makeQuery(qmeta::QInfo::EXECUTING);
+    BOOST_CHECK_EQUAL(uq->getResultTableName(), "result_5_b3");
+    // The batch is only taken by submit().
+    BOOST_CHECK(sql.statements.empty());
+    uq->submit();
+    BOOST_CHECK_EQUAL(uq->join(), ccontrol::SUCCESS);
+    BOOST_CHECK(sql.statements == std::vector<std::string>{"DELETE FROM result_5_cursor WHERE batch=3"});
+}
+
+BOOST_AUTO_TEST_CASE(NoBatchReady) {
+    auto uq = makeQuery(qmeta::QInfo::EXECUTING);
+    uq->submit();
+    BOOST_CHECK_EQUAL(uq->join(), ccontrol::ERROR);
+    auto messages = uq->getMessageStore();
+    BOOST_REQUIRE_EQUAL(messages->messageCount(), 1);
+    BOOST_CHECK_EQUAL(messages->getMessage(0).description, "Query is still executing (or FAILED)");
+    BOOST_CHECK(sql.statements.empty());
+}
+
+BOOST_AUTO_TEST_CASE(EndOfStream) {
+    sql.cursor = {{std::to_string(rproc::InfileMerger::CURSOR_END_BATCH), ""}};
+    auto uq = makeQuery(qmeta::QInfo::COMPLETED);
+    BOOST_CHECK(uq->getResultTableName().empty());
+    uq->submit();
+    BOOST_CHECK_EQUAL(uq->join(), ccontrol::ERROR);
+    auto messages = uq->getMessageStore();
+    BOOST_REQUIRE_EQUAL(messages->messageCount(), 1);
+    BOOST_CHECK_EQUAL(messages->getMessage(0).description, UserQueryAsyncResult::END_OF_STREAM_MSG);
+    BOOST_CHECK(sql.statements == std::vector<std::string>{"DROP TABLE result_5_cursor"});
+}
+
+BOOST_AUTO_TEST_CASE(NotStreamed) {
+    sql.tables.erase(rproc::InfileMerger::getCursorTableName("result_5"));
+    sql.cursor = {{"3", "result_5_b3"}};
+    auto uq = makeQuery(qmeta::QInfo::EXECUTING);
+    BOOST_CHECK_EQUAL(uq->getResultTableName(), "result_5");
+    uq->submit();
+    BOOST_CHECK_EQUAL(uq->join(), ccontrol::ERROR);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
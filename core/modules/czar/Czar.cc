@@ -36,10 +36,14 @@
 
 // Qserv headers
 #include "ccontrol/ConfigMap.h"
+#include "ccontrol/MergeScheduler.h"
 #include "ccontrol/UserQueryType.h"
 #include "czar/CzarErrors.h"
 #include "czar/MessageTable.h"
+#include "qdisp/MemoryGovernor.h"
+#include "qdisp/WorkerLimiter.h"
 #include "rproc/InfileMerger.h"
+#include "rproc/SpillFile.h"
 #include "sql/SqlConnection.h"
 #include "util/IterableFormatter.h"
 #include "XrdSsi/XrdSsiProvider.hh"
@@ -93,6 +97,26 @@ Czar::Czar(std::string const& configPath, std::string const& czarName)
     LOGS(_log, LOG_LVL_INFO, "config largeResultConcurrent=" << largeResultConcurrent);
     _qdispPool = std::make_shared<qdisp::QdispPool>(); // TODO:configuration add to configuration
 
+    int resultMemoryMB = _czarConfig.getResultMemoryMB();
+    LOGS(_log, LOG_LVL_INFO, "config resultMemoryMB=" << resultMemoryMB);
+    qdisp::MemoryGovernor::get().configure(std::int64_t(resultMemoryMB)*1024*1024,
+                                           _czarConfig.getInteractiveMemoryPercent());
+
+    int concurrentMerges = _czarConfig.getConcurrentMerges();
+    LOGS(_log, LOG_LVL_INFO, "config concurrentMerges=" << concurrentMerges);
+    ccontrol::MergeScheduler::get().configure(concurrentMerges, _czarConfig.getInteractiveMergeWeight());
+
+    int maxJobsPerWorker = _czarConfig.getMaxJobsPerWorker();
+    LOGS(_log, LOG_LVL_INFO, "config maxJobsPerWorker=" << maxJobsPerWorker);
+    qdisp::WorkerLimiter::get().configure(maxJobsPerWorker);
+
+    std::string const& spillDir = _czarConfig.getSpillDir();
+    LOGS(_log, LOG_LVL_INFO, "config spillDir=" << spillDir);
+    if (not spillDir.empty()) {
+        rproc::SpillFile::removeAll(spillDir);
+        rproc::SpillFile::setTotalQuota(std::uint64_t(_czarConfig.getSpillTotalQuotaMB())*1024*1024);
+    }
+
     int xrootdCBThreadsMax = _czarConfig.getXrootdCBThreadsMax();
     int xrootdCBThreadsInit = _czarConfig.getXrootdCBThreadsInit();
     LOGS(_log, LOG_LVL_INFO, "config xrootdCBThreadsMax=" << xrootdCBThreadsMax);
@@ -103,6 +127,15 @@ Czar::Czar(std::string const& configPath, std::string const& czarName)
     LOGS(_log, LOG_LVL_DEBUG, "Czar config: " << _czarConfig);
 
     _uqFactory.reset(new ccontrol::UserQueryFactory(_czarConfig, _czarName));
+
+    int resultCacheMaxSizeMB = _czarConfig.getResultCacheMaxSizeMB();
+    LOGS(_log, LOG_LVL_INFO, "config resultCacheMaxSizeMB=" << resultCacheMaxSizeMB);
+    if (resultCacheMaxSizeMB > 0) {
+        std::uint64_t const MB = 1024*1024;
+        _resultCache = std::make_shared<ResultCache>(_czarConfig.getMySqlResultConfig(),
+                resultCacheMaxSizeMB*MB, _czarConfig.getResultCacheMaxEntrySizeMB()*MB,
+                std::chrono::seconds(_czarConfig.getResultCacheTtlSeconds()));
+    }
 }
 
 SubmitResult
@@ -136,6 +169,29 @@ Czar::submitQuery(std::string const& query,
 
     // instantiate message table manager
     MessageTable msgTable(lockName, _czarConfig.getMySqlResultConfig());
+
+    // a result copied from the cache is ready, so the message table is not locked
+    std::string cacheKey;
+    if (_resultCache) {
+        cacheKey = _uqFactory->makeResultCacheKey(query, defaultDb);
+        std::string const cachedTableName = "result_cache_" + userQueryId;
+        std::string orderBy;
+        if (not cacheKey.empty() and _resultCache->get(cacheKey, cachedTableName, orderBy)) {
+            try {
+                msgTable.create();
+            } catch (std::exception const& exc) {
+                result.errorMessage = exc.what();
+                return result;
+            }
+            result.resultTable = resultDb + "." + cachedTableName;
+            result.messageTable = lockName;
+            result.orderBy = orderBy;
+            LOGS(_log, LOG_LVL_INFO, "Query result served from cache: resultTable="
+                 << result.resultTable << " messageTable=" << result.messageTable);
+            return result;
+        }
+    }
+
     try {
         msgTable.lock();
     } catch (std::exception const& exc) {
@@ -161,11 +217,17 @@ Czar::submitQuery(std::string const& query,
     }
 
     // spawn background thread to wait until query finishes to unlock,
-    // note that lambda stores copies of uq and msgTable.
-    auto finalizer = [uq, msgTable]() mutable {
+    // note that lambda stores copies of uq and msgTable. The result is
+    // cached before unlocking, as the proxy drops it once read.
+    ResultCache::Ptr resultCache = uq->isAsync() ? nullptr : _resultCache;
+    auto finalizer = [uq, msgTable, resultCache, cacheKey]() mutable {
         LOGS(_log, LOG_LVL_DEBUG, uq->getQueryIdString() << " submitting new query");
         uq->submit();
-        uq->join();
+        auto state = uq->join();
+        if (resultCache and not cacheKey.empty() and state == ccontrol::SUCCESS
+            and not uq->getResultTableName().empty()) {
+            resultCache->put(cacheKey, uq->getResultTableName(), uq->getProxyOrderBy());
+        }
         try {
             msgTable.unlock(uq);
             if (uq) uq->discard();
@@ -38,6 +38,7 @@
 #include "ccontrol/UserQuery.h"
 #include "ccontrol/UserQueryFactory.h"
 #include "czar/CzarConfig.h"
+#include "czar/ResultCache.h"
 #include "czar/SubmitResult.h"
 #include "global/stringTypes.h"
 #include "mysql/MySqlConfig.h"
@@ -141,9 +142,11 @@ private:
     std::unique_ptr<ccontrol::UserQueryFactory> _uqFactory;
     ClientToQuery _clientToQuery;       ///< maps client ID to query
     IdToQuery _idToQuery;               ///< maps query ID to query (for currently running queries)
-    std::mutex _mutex;                  ///< protects _uqFactory, _clientToQuery, and _idToQuery
+    std::mutex _mutex;                  ///< protects _uqFactory queries, _clientToQuery, and _idToQuery
 
     qdisp::QdispPool::Ptr _qdispPool; ///< Thread pool for handling Responses from XrdSsi.
+
+    ResultCache::Ptr _resultCache;    ///< Results of earlier queries, nullptr if disabled.
 };
 
 }}} // namespace lsst::qserv::czar
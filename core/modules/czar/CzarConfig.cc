@@ -72,6 +72,9 @@ CzarConfig::CzarConfig(util::ConfigStore const& configStore)
             configStore.get("resultdb.db","qservResult"),
             configStore.getInt("resultdb.maxtablesize_mb", 5001)),
       _logConfig(configStore.get("log.logConfig")),
+      _resultCacheMaxSizeMB(configStore.getInt("resultcache.maxSizeMB", 0)),
+      _resultCacheMaxEntrySizeMB(configStore.getInt("resultcache.maxEntrySizeMB", 100)),
+      _resultCacheTtlSeconds(configStore.getInt("resultcache.ttlSeconds", 3600)),
       _cssConfigMap(configStore.getSectionConfigMap("css")),
       _mySqlQmetaConfig(configStore.get( "qmeta.user", "qsmaster"),
                         configStore.get("qmeta.passwd"),
@@ -82,6 +85,26 @@ CzarConfig::CzarConfig(util::ConfigStore const& configStore)
        _xrootdFrontendUrl(configStore.get("frontend.xrootd", "localhost:1094")),
        _emptyChunkPath(configStore.get("partitioner.emptyChunkPath", ".")),
        _largeResultConcurrentMerges(configStore.getInt("tuning.largeResultConcurrentMerges", 3)),
+       _resultMergeConnections(configStore.getInt("tuning.resultMergeConnections", 1)),
+       _stageJobAttempts(configStore.getInt("tuning.stageJobAttempts", 1) != 0),
+       _nativeAggregation(configStore.getInt("tuning.nativeAggregation", 0) != 0),
+       _nativeTopK(configStore.getInt("tuning.nativeTopK", 1) != 0),
+       _partialAggregateRows(configStore.getInt("tuning.partialAggregateRows", 0)),
+       _streamingBatchRows(configStore.getInt("tuning.streamingBatchRows", 0)),
+       _resultCompressionLevel(configStore.getInt("tuning.resultCompressionLevel", 0)),
+       _sendQueryTemplates(configStore.getInt("tuning.sendQueryTemplates", 0) != 0),
+       _resultMemoryMB(configStore.getInt("tuning.resultMemoryMB", 0)),
+       _interactiveMemoryPercent(configStore.getInt("tuning.interactiveMemoryPercent", 20)),
+       _concurrentMerges(configStore.getInt("tuning.concurrentMerges", 0)),
+       _interactiveMergeWeight(configStore.getInt("tuning.interactiveMergeWeight", 10)),
+       _maxChunksPerRequest(configStore.getInt("tuning.maxChunksPerRequest", 1)),
+       _hedgeCompletedPercent(configStore.getInt("tuning.hedgeCompletedPercent", 0)),
+       _hedgeLatencyFactor(configStore.getInt("tuning.hedgeLatencyFactor", 3)),
+       _maxJobsPerWorker(configStore.getInt("tuning.maxJobsPerWorker", 0)),
+       _spillDir(configStore.get("tuning.spillDir")),
+       _spillThresholdMB(configStore.getInt("tuning.spillThresholdMB", 2000)),
+       _spillQuotaMB(configStore.getInt("tuning.spillQuotaMB", 100000)),
+       _spillTotalQuotaMB(configStore.getInt("tuning.spillTotalQuotaMB", 0)),
        _xrootdCBThreadsMax(configStore.getInt("tuning.xrootdCBThreadsMax", 500)),
        _xrootdCBThreadsInit(configStore.getInt("tuning.xrootdCBThreadsInit", 50)) {
 }
@@ -92,6 +115,29 @@ std::ostream& operator<<(std::ostream &out, CzarConfig const& czarConfig) {
            ", logConfig=" << czarConfig._logConfig <<
            ", mySqlQmetaConfig=" << czarConfig._mySqlQmetaConfig <<
            ", mySqlResultConfig=" << czarConfig._mySqlResultConfig <<
+           ", nativeAggregation=" << czarConfig._nativeAggregation <<
+           ", nativeTopK=" << czarConfig._nativeTopK <<
+           ", partialAggregateRows=" << czarConfig._partialAggregateRows <<
+           ", streamingBatchRows=" << czarConfig._streamingBatchRows <<
+           ", resultCompressionLevel=" << czarConfig._resultCompressionLevel <<
+           ", sendQueryTemplates=" << czarConfig._sendQueryTemplates <<
+           ", resultMemoryMB=" << czarConfig._resultMemoryMB <<
+           ", interactiveMemoryPercent=" << czarConfig._interactiveMemoryPercent <<
+           ", concurrentMerges=" << czarConfig._concurrentMerges <<
+           ", interactiveMergeWeight=" << czarConfig._interactiveMergeWeight <<
+           ", maxChunksPerRequest=" << czarConfig._maxChunksPerRequest <<
+           ", hedgeCompletedPercent=" << czarConfig._hedgeCompletedPercent <<
+           ", hedgeLatencyFactor=" << czarConfig._hedgeLatencyFactor <<
+           ", maxJobsPerWorker=" << czarConfig._maxJobsPerWorker <<
+           ", spillDir=" << czarConfig._spillDir <<
+           ", spillThresholdMB=" << czarConfig._spillThresholdMB <<
+           ", spillQuotaMB=" << czarConfig._spillQuotaMB <<
+           ", spillTotalQuotaMB=" << czarConfig._spillTotalQuotaMB <<
+           ", resultMergeConnections=" << czarConfig._resultMergeConnections <<
+           ", stageJobAttempts=" << czarConfig._stageJobAttempts <<
+           ", resultCacheMaxSizeMB=" << czarConfig._resultCacheMaxSizeMB <<
+           ", resultCacheMaxEntrySizeMB=" << czarConfig._resultCacheMaxEntrySizeMB <<
+           ", resultCacheTtlSeconds=" << czarConfig._resultCacheTtlSeconds <<
            ", xrootdFrontendUrl=" << czarConfig._xrootdFrontendUrl <<
            "]";
 
@@ -120,6 +120,213 @@ public:
          return _largeResultConcurrentMerges;
     }
 
+    /* Get the number of mysql connections each user query may use to merge
+     * results into its result table concurrently.
+     *
+     * @return the maximum number of concurrent merges for one user query.
+     */
+    int getResultMergeConnections() const {
+        return _resultMergeConnections;
+    }
+
+    /* Get whether worker results of a job attempt that span several
+     * messages are loaded into a staging table of the attempt until the
+     * last one arrives.
+     *
+     * @return true if results of job attempts are staged.
+     */
+    bool getStageJobAttempts() const {
+        return _stageJobAttempts;
+    }
+
+    /* Get whether results of queries using only COUNT, SUM, MIN, MAX and AVG
+     * aggregates should be merged in memory rather than by the result database.
+     *
+     * @return true if native aggregation is enabled.
+     */
+    bool getNativeAggregation() const {
+        return _nativeAggregation;
+    }
+
+    /* Get whether ORDER BY ... LIMIT k queries should keep only the first
+     * k rows of worker results in memory, rather than loading all of them
+     * into the result database.
+     *
+     * @return true if the in-memory top-k merge is enabled.
+     */
+    bool getNativeTopK() const {
+        return _nativeTopK;
+    }
+
+    /* Get the number of rows loaded into a merge table between folds of
+     * its rows into a partial aggregate, 0 meaning never
+     *
+     * @return the number of rows between partial aggregations.
+     */
+    int getPartialAggregateRows() const {
+        return _partialAggregateRows;
+    }
+
+    /* Get the number of rows of each batch of an async query result that
+     * can be read before the query completes, 0 meaning results are only
+     * readable once complete
+     *
+     * @return the number of rows per streamed result batch.
+     */
+    int getStreamingBatchRows() const {
+        return _streamingBatchRows;
+    }
+
+    /* Get the zstd level workers should compress results of scan queries
+     * with. Results of interactive queries are never compressed.
+     *
+     * @return the compression level, 0 or less for no compression.
+     */
+    int getResultCompressionLevel() const {
+        return _resultCompressionLevel;
+    }
+
+    /* Get whether workers are sent the query templates of a chunk, in
+     * place of its queries. Workers that do not expand templates run
+     * nothing on such a chunk, so this is only set once all can.
+     *
+     * @return true if query templates are sent to workers.
+     */
+    bool getSendQueryTemplates() const {
+        return _sendQueryTemplates;
+    }
+
+    /* Get the number of merges of worker results that may run at once,
+     * across all queries, 0 meaning no limit
+     *
+     * @return the maximum number of concurrent merges.
+     */
+    int getConcurrentMerges() const {
+        return _concurrentMerges;
+    }
+
+    /* Get the weight of interactive queries when merges are scheduled,
+     * scans weighing 1
+     *
+     * @return the merge weight of interactive queries.
+     */
+    int getInteractiveMergeWeight() const {
+        return _interactiveMergeWeight;
+    }
+
+    /* Get the number of jobs of a scan on chunks of the same worker sent
+     * together in one request, 1 or less sending each on its own
+     *
+     * @return the maximum number of chunks per worker request.
+     */
+    int getMaxChunksPerRequest() const {
+        return _maxChunksPerRequest;
+    }
+
+    /* Get the percentage of the jobs of a query that must be complete
+     * before straggling jobs get a duplicate request, 0 disabling them
+     *
+     * @return the percentage of completed jobs.
+     */
+    int getHedgeCompletedPercent() const {
+        return _hedgeCompletedPercent;
+    }
+
+    /* Get how many times longer than the median job a job must run to
+     * get a duplicate request
+     *
+     * @return the latency factor.
+     */
+    int getHedgeLatencyFactor() const {
+        return _hedgeLatencyFactor;
+    }
+
+    /* Get the maximum number of scan jobs of all queries in flight on
+     * one worker, 0 meaning no limit
+     *
+     * @return the maximum number of jobs per worker.
+     */
+    int getMaxJobsPerWorker() const {
+        return _maxJobsPerWorker;
+    }
+
+    /* Get the directory of the spill files of large results, empty
+     * meaning results are never spilled
+     *
+     * @return the spill directory.
+     */
+    std::string const& getSpillDir() const {
+        return _spillDir;
+    }
+
+    /* Get the size of the rows of a result loaded into the result
+     * database before the rest is spilled
+     *
+     * @return the spill threshold, in MB.
+     */
+    int getSpillThresholdMB() const {
+        return _spillThresholdMB;
+    }
+
+    /* Get the maximum size of the spill file of a query, 0 meaning no limit
+     *
+     * @return the spill quota of a query, in MB.
+     */
+    int getSpillQuotaMB() const {
+        return _spillQuotaMB;
+    }
+
+    /* Get the maximum size of all spill files, 0 meaning no limit
+     *
+     * @return the spill quota of the czar, in MB.
+     */
+    int getSpillTotalQuotaMB() const {
+        return _spillTotalQuotaMB;
+    }
+
+    /* Get the budget for the memory of result buffers of all queries,
+     * 0 meaning no limit
+     *
+     * @return the maximum size of all result buffers, in MB.
+     */
+    int getResultMemoryMB() const {
+        return _resultMemoryMB;
+    }
+
+    /* Get the percentage of the result buffer budget that only
+     * interactive queries may use
+     *
+     * @return the share of interactive queries, in percent.
+     */
+    int getInteractiveMemoryPercent() const {
+        return _interactiveMemoryPercent;
+    }
+
+    /* Get the size budget of the query result cache, 0 meaning results
+     * are not cached
+     *
+     * @return the maximum size of all cached results, in MB.
+     */
+    int getResultCacheMaxSizeMB() const {
+        return _resultCacheMaxSizeMB;
+    }
+
+    /* Get the size above which a query result is not cached
+     *
+     * @return the maximum size of a cached result, in MB.
+     */
+    int getResultCacheMaxEntrySizeMB() const {
+        return _resultCacheMaxEntrySizeMB;
+    }
+
+    /* Get the time after which a cached query result is no longer used
+     *
+     * @return the lifetime of cached results, in seconds.
+     */
+    int getResultCacheTtlSeconds() const {
+        return _resultCacheTtlSeconds;
+    }
+
     /* Get the maximum number of threads for xrootd to use.
      *
      * @return the maximum number of threads for xrootd to use.
@@ -143,6 +350,9 @@ private:
     // Parameters below used in czar::Czar
     mysql::MySqlConfig const _mySqlResultConfig;
     std::string const _logConfig;
+    int const _resultCacheMaxSizeMB;
+    int const _resultCacheMaxEntrySizeMB;
+    int const _resultCacheTtlSeconds;
 
     // Parameters below used in ccontrol::UserQueryFactory
     std::map<std::string, std::string> const _cssConfigMap;
@@ -150,6 +360,26 @@ private:
     std::string const _xrootdFrontendUrl;
     std::string const _emptyChunkPath;
     int const _largeResultConcurrentMerges;
+    int const _resultMergeConnections;
+    bool const _stageJobAttempts;
+    bool const _nativeAggregation;
+    bool const _nativeTopK;
+    int const _partialAggregateRows;
+    int const _streamingBatchRows;
+    int const _resultCompressionLevel;
+    bool const _sendQueryTemplates;
+    int const _resultMemoryMB;
+    int const _concurrentMerges;
+    int const _interactiveMergeWeight;
+    int const _maxChunksPerRequest;
+    int const _hedgeCompletedPercent;
+    int const _hedgeLatencyFactor;
+    int const _maxJobsPerWorker;
+    std::string const _spillDir;
+    int const _spillThresholdMB;
+    int const _spillQuotaMB;
+    int const _spillTotalQuotaMB;
+    int const _interactiveMemoryPercent;
     int const _xrootdCBThreadsMax;
     int const _xrootdCBThreadsInit;
 };
@@ -0,0 +1,299 @@
+/*
+ * LSST Data Management System
+ * Copyright 2018 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <https://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "czar/ResultCache.h"
+
+// System headers
+#include <vector>
+
+// Third-party headers
+#include "boost/format.hpp"
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "rproc/InfileMerger.h"
+#include "sql/SqlConnection.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.czar.ResultCache");
+
+std::string const tablePrefix("qcache_");
+
+// Result tables may be views, which CREATE TABLE ... LIKE cannot copy.
+std::string const copyTmpl("CREATE TABLE %2%.%3% ENGINE=MyISAM SELECT * FROM %2%.%1%");
+
+// The rows of a view are in the merge table, a view itself has no size.
+std::string const sizeTmpl("SELECT COALESCE(SUM(data_length + index_length), 0) "
+    "FROM information_schema.TABLES WHERE table_schema = '%1%' AND table_name IN ('%2%', '%3%')");
+
+std::chrono::seconds const LOG_INTERVAL(60);
+
+}
+
+namespace lsst {
+namespace qserv {
+namespace czar {
+
+ResultCache::ResultCache(mysql::MySqlConfig const& resultConfig, std::uint64_t maxBytes,
+                         std::uint64_t maxEntryBytes, std::chrono::seconds ttl)
+    : ResultCache(std::make_shared<sql::SqlConnection>(resultConfig), resultConfig.dbName,
+                  maxBytes, maxEntryBytes, ttl) {
+}
+
+
+ResultCache::ResultCache(std::shared_ptr<sql::SqlConnection> const& sqlConn, std::string const& dbName,
+                         std::uint64_t maxBytes, std::uint64_t maxEntryBytes, std::chrono::seconds ttl)
+    : _dbName(dbName),
+      _maxBytes(maxBytes),
+      _maxEntryBytes(maxEntryBytes),
+      _ttl(ttl),
+      _sqlConn(sqlConn),
+      _lastLog(std::chrono::steady_clock::now()) {
+    // Cache tables of a previous czar instance are unknown to this one.
+    std::vector<std::string> tables;
+    sql::SqlErrorObject sqlErr;
+    if (not _sqlConn->listTables(tables, sqlErr, ::tablePrefix, _dbName)) {
+        LOGS(_log, LOG_LVL_WARN, "ResultCache failed to list old cache tables: " << sqlErr.printErrMsg());
+        return;
+    }
+    for (auto const& table : tables) {
+        LOGS(_log, LOG_LVL_DEBUG, "ResultCache dropping old cache table " << table);
+        if (not _sqlConn->dropTable(table, sqlErr, false, _dbName)) {
+            LOGS(_log, LOG_LVL_WARN, "ResultCache failed to drop " << table << ": " << sqlErr.printErrMsg());
+        }
+    }
+}
+
+
+bool ResultCache::get(std::string const& key, std::string const& resultTable, std::string& orderBy) {
+    std::string table;
+    std::string entryOrderBy;
+    std::vector<std::string> dropTables;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _logStats();
+        auto iter = _entries.find(key);
+        if (iter == _entries.end()) {
+            ++_stats.misses;
+            return false;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - iter->second.created > _ttl) {
+            _evict(iter, dropTables);
+            ++_stats.misses;
+        } else {
+            // Used now, so that it is not the next entry evicted.
+            iter->second.lastUsed = now;
+            table = iter->second.table;
+            entryOrderBy = iter->second.orderBy;
+        }
+    }
+    if (table.empty()) {
+        _dropTables(dropTables);
+        return false;
+    }
+
+    bool copied;
+    {
+        std::lock_guard<std::mutex> sqlLock(_sqlMtx);
+        copied = _copyTable(table, resultTable);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (not copied) {
+            // The cache table may have been dropped behind our back, forget it
+            // unless it was already replaced.
+            auto iter = _entries.find(key);
+            if (iter != _entries.end() and iter->second.table == table) {
+                _evict(iter, dropTables);
+            }
+            ++_stats.misses;
+        } else {
+            ++_stats.hits;
+        }
+    }
+    if (not copied) {
+        _dropTables(dropTables);
+        return false;
+    }
+    orderBy = entryOrderBy;
+    LOGS(_log, LOG_LVL_DEBUG, "ResultCache hit, " << resultTable << " copied from " << table);
+    return true;
+}
+
+
+void ResultCache::put(std::string const& key, std::string const& resultTable, std::string const& orderBy) {
+    std::uint64_t bytes;
+    {
+        std::lock_guard<std::mutex> sqlLock(_sqlMtx);
+        bytes = _getTableBytes(resultTable);
+    }
+    if (bytes == 0 or bytes > _maxEntryBytes or bytes > _maxBytes) {
+        LOGS(_log, LOG_LVL_DEBUG, "ResultCache not caching " << resultTable << ", size " << bytes);
+        return;
+    }
+
+    // Reserve a table name and room for the table. The entry of another
+    // result for the same key is kept until this one replaces it.
+    std::string table;
+    std::vector<std::string> dropTables;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        // Make room, expired entries first, then the least recently used ones.
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = _entries.begin(); it != _entries.end();) {
+            auto cur = it++;
+            if (now - cur->second.created > _ttl) {
+                _evict(cur, dropTables);
+            }
+        }
+        while (not _entries.empty() and _stats.bytes + bytes > _maxBytes) {
+            auto lru = _entries.begin();
+            for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+                if (it->second.lastUsed < lru->second.lastUsed) lru = it;
+            }
+            _evict(lru, dropTables);
+        }
+        table = ::tablePrefix + std::to_string(++_tableCounter);
+        _stats.bytes += bytes;
+    }
+    _dropTables(dropTables);
+    dropTables.clear();
+
+    bool copied;
+    {
+        std::lock_guard<std::mutex> sqlLock(_sqlMtx);
+        copied = _copyTable(resultTable, table);
+    }
+
+    // Publish the entry.
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (not copied) {
+            _stats.bytes -= bytes;
+            return;
+        }
+        auto iter = _entries.find(key);
+        if (iter != _entries.end()) {
+            // Another run of the same query finished first, keep the newer result.
+            _evict(iter, dropTables);
+        }
+        auto now = std::chrono::steady_clock::now();
+        _entries[key] = Entry{table, orderBy, bytes, now, now};
+        _stats.entries = _entries.size();
+    }
+    _dropTables(dropTables);
+    LOGS(_log, LOG_LVL_DEBUG, "ResultCache added " << table << " from " << resultTable
+         << ", size " << bytes);
+}
+
+
+ResultCache::Stats ResultCache::getStats() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _stats;
+}
+
+
+bool ResultCache::_runQuery(std::string const& query) {
+    sql::SqlErrorObject sqlErr;
+    if (not _sqlConn->runQuery(query, sqlErr)) {
+        LOGS(_log, LOG_LVL_WARN, "ResultCache query failed: " << query << " " << sqlErr.printErrMsg());
+        return false;
+    }
+    return true;
+}
+
+
+/// Copy table from to a new table to. On failure to is dropped if it was created.
+/// _sqlMtx must be held.
+bool ResultCache::_copyTable(std::string const& from, std::string const& to) {
+    std::string query = (boost::format(::copyTmpl) % from % _dbName % to).str();
+    if (_runQuery(query)) {
+        return true;
+    }
+    sql::SqlErrorObject sqlErr;
+    _sqlConn->dropTable(to, sqlErr, false, _dbName);
+    return false;
+}
+
+
+/// @return the size of table in bytes, 0 if it is unknown. _sqlMtx must be held.
+std::uint64_t ResultCache::_getTableBytes(std::string const& table) {
+    // Both names are made by qserv, they need no escaping.
+    std::string query = (boost::format(::sizeTmpl) % _dbName % table
+                         % rproc::InfileMerger::getMergeTableName(table)).str();
+    auto results = _sqlConn->runQueryIter(query);
+    if (results->getErrorObject().isSet() or results->done()) {
+        LOGS(_log, LOG_LVL_WARN, "ResultCache failed to get the size of " << table << ": "
+             << results->getErrorObject().printErrMsg());
+        return 0;
+    }
+    try {
+        return std::stoull((**results)[0]);
+    } catch (std::exception const&) {
+        return 0;
+    }
+}
+
+
+/// Remove an entry, adding its table to dropTables. _mtx must be held.
+void ResultCache::_evict(std::map<std::string, Entry>::iterator iter, std::vector<std::string>& dropTables) {
+    dropTables.push_back(iter->second.table);
+    _stats.bytes -= iter->second.bytes;
+    ++_stats.evictions;
+    _entries.erase(iter);
+    _stats.entries = _entries.size();
+}
+
+
+/// Drop the tables of evicted entries, _mtx must not be held.
+void ResultCache::_dropTables(std::vector<std::string> const& tables) {
+    if (tables.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> sqlLock(_sqlMtx);
+    for (auto const& table : tables) {
+        sql::SqlErrorObject sqlErr;
+        if (not _sqlConn->dropTable(table, sqlErr, false, _dbName)) {
+            LOGS(_log, LOG_LVL_WARN, "ResultCache failed to drop " << table << ": "
+                 << sqlErr.printErrMsg());
+        }
+    }
+}
+
+
+/// Log the counters now and then, _mtx must be held.
+void ResultCache::_logStats() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - _lastLog >= ::LOG_INTERVAL) {
+        _lastLog = now;
+        LOGS(_log, LOG_LVL_INFO, "ResultCache hits=" << _stats.hits << " misses=" << _stats.misses
+             << " evictions=" << _stats.evictions << " entries=" << _stats.entries
+             << " bytes=" << _stats.bytes);
+    }
+}
+
+}}} // namespace lsst::qserv::czar
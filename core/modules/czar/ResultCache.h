@@ -0,0 +1,158 @@
+/*
+ * LSST Data Management System
+ * Copyright 2018 AURA/LSST.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <https://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_CZAR_RESULTCACHE_H
+#define LSST_QSERV_CZAR_RESULTCACHE_H
+
+// System headers
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "mysql/MySqlConfig.h"
+
+
+namespace lsst {
+namespace qserv {
+namespace sql {
+class SqlConnection;
+}}}
+
+namespace lsst {
+namespace qserv {
+namespace czar {
+
+/// @addtogroup czar
+
+/**
+ *  @ingroup czar
+ *
+ *  @brief Cache of query result tables in the results database.
+ *
+ *  The result table of a query is copied to a cache table once the query
+ *  completes, and later queries with the same key get a copy of it, which
+ *  the proxy reads and drops like any result table. Keys are made by
+ *  ccontrol::UserQueryFactory::makeResultCacheKey().
+ *
+ *  Entries expire after a fixed time, and the least recently used ones are
+ *  evicted to keep the cache tables within a size budget. A failure of the
+ *  cache is never a failure of the query, it is treated as a miss.
+ *
+ *  Tables are copied without holding the lock of the entries, so that
+ *  lookups of other queries do not wait for them.
+ */
+
+class ResultCache {
+public:
+    using Ptr = std::shared_ptr<ResultCache>;
+
+    /// Counters for monitoring.
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;  ///< Entries dropped for age or space
+        std::uint64_t entries = 0;    ///< Current number of entries
+        std::uint64_t bytes = 0;      ///< Current size of the cache tables
+    };
+
+    /**
+     *  @param resultConfig:   Results database connection parameters.
+     *  @param maxBytes:       Budget for the total size of the cache tables.
+     *  @param maxEntryBytes:  Results larger than this are not cached.
+     *  @param ttl:            Time after which an entry is no longer used.
+     */
+    ResultCache(mysql::MySqlConfig const& resultConfig, std::uint64_t maxBytes,
+                std::uint64_t maxEntryBytes, std::chrono::seconds ttl);
+
+    /**
+     *  @param sqlConn:        Connection to the results database.
+     *  @param dbName:         Name of the results database.
+     *  @param maxBytes:       Budget for the total size of the cache tables.
+     *  @param maxEntryBytes:  Results larger than this are not cached.
+     *  @param ttl:            Time after which an entry is no longer used.
+     */
+    ResultCache(std::shared_ptr<sql::SqlConnection> const& sqlConn, std::string const& dbName,
+                std::uint64_t maxBytes, std::uint64_t maxEntryBytes, std::chrono::seconds ttl);
+
+    ResultCache(ResultCache const&) = delete;
+    ResultCache& operator=(ResultCache const&) = delete;
+
+    /**
+     *  Copy the cached result for key to a new table.
+     *
+     *  @param key:          Cache key of the query.
+     *  @param resultTable:  Name of the table to create, in the results database.
+     *  @param orderBy:      Set to the ORDER BY clause the proxy applies to the result.
+     *  @return true on a hit, false if resultTable was not created.
+     */
+    bool get(std::string const& key, std::string const& resultTable, std::string& orderBy);
+
+    /**
+     *  Keep a copy of the result table of a completed query, if it is small enough.
+     *
+     *  @param key:          Cache key of the query.
+     *  @param resultTable:  Result table, in the results database.
+     *  @param orderBy:      ORDER BY clause the proxy applies to the result.
+     */
+    void put(std::string const& key, std::string const& resultTable, std::string const& orderBy);
+
+    /// @return the current counters.
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        std::string table;
+        std::string orderBy;
+        std::uint64_t bytes;
+        std::chrono::steady_clock::time_point created;
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    bool _runQuery(std::string const& query);
+    bool _copyTable(std::string const& from, std::string const& to);
+    std::uint64_t _getTableBytes(std::string const& table);
+    void _evict(std::map<std::string, Entry>::iterator iter, std::vector<std::string>& dropTables);
+    void _dropTables(std::vector<std::string> const& tables);
+    void _logStats();
+
+    std::string const _dbName;
+    std::uint64_t const _maxBytes;
+    std::uint64_t const _maxEntryBytes;
+    std::chrono::seconds const _ttl;
+
+    std::mutex _sqlMtx;  ///< Serializes use of _sqlConn, never held with _mtx.
+    std::shared_ptr<sql::SqlConnection> _sqlConn;
+
+    mutable std::mutex _mtx;  ///< Protects all members below.
+    std::map<std::string, Entry> _entries;  ///< By key
+    std::uint64_t _tableCounter = 0;        ///< For cache table names
+    Stats _stats;  ///< bytes includes those of tables being added
+    std::chrono::steady_clock::time_point _lastLog;
+};
+
+}}} // namespace lsst::qserv::czar
+
+#endif // LSST_QSERV_CZAR_RESULTCACHE_H
@@ -0,0 +1,236 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Qserv headers
+#include "czar/ResultCache.h"
+#include "sql/MockSql.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE ResultCache_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+using namespace lsst::qserv;
+using czar::ResultCache;
+
+namespace {
+
+/// Results database knowing only the size of each of its tables.
+class TableSql : public sql::MockSql {
+public:
+    typedef std::vector<std::string> Tuple;
+    typedef std::vector<Tuple> TupleVector;
+    typedef MockSql::Iter<TupleVector::const_iterator> SqlIter;
+
+    /// Run "CREATE TABLE db.to ENGINE=MyISAM SELECT * FROM db.from" as a copy of the table.
+    bool runQuery(std::string const query, sql::SqlErrorObject&) override {
+        if (copyStarted != nullptr) {
+            copyStarted->set_value();
+            copyStarted = nullptr;
+            copyDone.wait();
+        }
+        auto toPos = query.find('.') + 1;
+        auto to = query.substr(toPos, query.find(' ', toPos) - toPos);
+        auto fromPos = query.find('.', query.find(" FROM ")) + 1;
+        auto from = query.substr(fromPos);
+        auto iter = tables.find(from);
+        if (iter == tables.end()) return false;
+        tables[to] = iter->second;
+        return true;
+    }
+    bool dropTable(std::string const& tableName, sql::SqlErrorObject&, bool, std::string const&) override {
+        tables.erase(tableName);
+        return true;
+    }
+    bool listTables(std::vector<std::string>&, sql::SqlErrorObject&,
+                    std::string const&, std::string const&) override {
+        return true;
+    }
+    /// Answer the size query of a table, the sum of the sizes of the tables it names.
+    std::shared_ptr<sql::SqlResultIter> getQueryIter(std::string const& query) override {
+        auto names = query.substr(query.find("table_name IN ("));
+        std::uint64_t bytes = 0;
+        for (auto const& table : tables) {
+            if (names.find("'" + table.first + "'") != std::string::npos) bytes += table.second;
+        }
+        _rows.clear();
+        _rows.push_back(Tuple{std::to_string(bytes)});
+        return std::make_shared<SqlIter>(_rows.begin(), _rows.end());
+    }
+
+    std::map<std::string, std::uint64_t> tables; ///< Bytes by table name
+    /// If set, the next copy sets it, and waits for copyDone to be ready.
+    std::promise<void>* copyStarted = nullptr;
+    std::shared_future<void> copyDone;
+private:
+    TupleVector _rows;
+};
+
+struct Fixture {
+    Fixture() : sql(std::make_shared<TableSql>()) {}
+
+    std::shared_ptr<ResultCache> makeCache(std::uint64_t maxBytes, std::chrono::seconds ttl) {
+        return std::make_shared<ResultCache>(sql, "qservResult", maxBytes, 50, ttl);
+    }
+
+    /// Let the clock advance so that uses of entries are ordered.
+    void tick() { std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+
+    std::shared_ptr<TableSql> sql;
+};
+
+std::chrono::seconds const HOUR(3600);
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(Suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(Hit) {
+    auto cache = makeCache(100, HOUR);
+    sql->tables = {{"result_1", 10}};
+    cache->put("key", "result_1", "ORDER BY a");
+    std::string orderBy;
+    BOOST_CHECK(cache->get("key", "result_2", orderBy));
+    BOOST_CHECK_EQUAL(orderBy, "ORDER BY a");
+    BOOST_CHECK_EQUAL(sql->tables.count("result_2"), 1U);
+    BOOST_CHECK(not cache->get("other key", "result_3", orderBy));
+    BOOST_CHECK_EQUAL(sql->tables.count("result_3"), 0U);
+    auto stats = cache->getStats();
+    BOOST_CHECK_EQUAL(stats.hits, 1U);
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+    BOOST_CHECK_EQUAL(stats.entries, 1U);
+    BOOST_CHECK_EQUAL(stats.bytes, 10U);
+}
+
+BOOST_AUTO_TEST_CASE(KeyCollision) {
+    auto cache = makeCache(100, HOUR);
+    sql->tables = {{"result_1", 10}, {"result_2", 20}, {"result_3", 30}};
+    // Keys differing only in the default database are different entries.
+    cache->put("css: db=READY\ndb:A\nSELECT * FROM T", "result_1", "");
+    cache->put("css: db=READY\ndb:B\nSELECT * FROM T", "result_2", "");
+    BOOST_CHECK_EQUAL(cache->getStats().entries, 2U);
+    BOOST_CHECK_EQUAL(cache->getStats().bytes, 30U);
+
+    // Another result for the same key replaces the previous one.
+    cache->put("css: db=READY\ndb:A\nSELECT * FROM T", "result_3", "ORDER BY b");
+    auto stats = cache->getStats();
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+    BOOST_CHECK_EQUAL(stats.bytes, 50U);
+    BOOST_CHECK_EQUAL(stats.evictions, 1U);
+    std::string orderBy;
+    BOOST_CHECK(cache->get("css: db=READY\ndb:A\nSELECT * FROM T", "result_4", orderBy));
+    BOOST_CHECK_EQUAL(orderBy, "ORDER BY b");
+    BOOST_CHECK_EQUAL(sql->tables["result_4"], 30U);
+    // Results, two cache tables and the copy.
+    BOOST_CHECK_EQUAL(sql->tables.size(), 6U);
+}
+
+BOOST_AUTO_TEST_CASE(Eviction) {
+    auto cache = makeCache(25, HOUR);
+    sql->tables = {{"result_1", 10}, {"result_2", 10}, {"result_3", 10}, {"result_4", 60}};
+    cache->put("a", "result_1", "");
+    tick();
+    cache->put("b", "result_2", "");
+    tick();
+    std::string orderBy;
+    BOOST_CHECK(cache->get("a", "result_5", orderBy));
+    tick();
+    // Over the budget, b is the least recently used.
+    cache->put("c", "result_3", "");
+    auto stats = cache->getStats();
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+    BOOST_CHECK_EQUAL(stats.bytes, 20U);
+    BOOST_CHECK_EQUAL(stats.evictions, 1U);
+    BOOST_CHECK(cache->get("a", "result_6", orderBy));
+    BOOST_CHECK(not cache->get("b", "result_7", orderBy));
+    BOOST_CHECK(cache->get("c", "result_8", orderBy));
+
+    // Larger than an entry may be, nothing is evicted for it.
+    cache->put("d", "result_4", "");
+    BOOST_CHECK_EQUAL(cache->getStats().entries, 2U);
+    BOOST_CHECK(not cache->get("d", "result_9", orderBy));
+}
+
+BOOST_AUTO_TEST_CASE(Expiration) {
+    auto cache = makeCache(100, std::chrono::seconds(0));
+    sql->tables = {{"result_1", 10}};
+    cache->put("key", "result_1", "");
+    BOOST_CHECK_EQUAL(sql->tables.size(), 2U);
+    tick();
+    std::string orderBy;
+    BOOST_CHECK(not cache->get("key", "result_2", orderBy));
+    auto stats = cache->getStats();
+    BOOST_CHECK_EQUAL(stats.entries, 0U);
+    BOOST_CHECK_EQUAL(stats.bytes, 0U);
+    BOOST_CHECK_EQUAL(stats.evictions, 1U);
+    // The cache table was dropped, the result is left alone.
+    BOOST_CHECK_EQUAL(sql->tables.size(), 1U);
+    BOOST_CHECK_EQUAL(sql->tables.count("result_1"), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(ViewResult) {
+    auto cache = makeCache(100, HOUR);
+    // A view has no size of its own, its rows are in the merge table.
+    sql->tables = {{"result_1", 0}, {"result_1_m", 10}};
+    cache->put("key", "result_1", "");
+    auto stats = cache->getStats();
+    BOOST_CHECK_EQUAL(stats.entries, 1U);
+    BOOST_CHECK_EQUAL(stats.bytes, 10U);
+}
+
+BOOST_AUTO_TEST_CASE(LookupDuringCopy) {
+    auto cache = makeCache(100, HOUR);
+    sql->tables = {{"result_1", 10}, {"result_2", 20}};
+    cache->put("a", "result_1", "");
+
+    std::promise<void> copyStarted;
+    std::promise<void> copyDone;
+    sql->copyStarted = &copyStarted;
+    sql->copyDone = copyDone.get_future().share();
+    std::thread putThread([&cache]() { cache->put("b", "result_2", ""); });
+    copyStarted.get_future().wait();
+    // While the result of b is copied, lookups of other keys are answered,
+    // and b is not an entry yet.
+    std::string orderBy;
+    BOOST_CHECK(not cache->get("b", "result_3", orderBy));
+    BOOST_CHECK(not cache->get("c", "result_3", orderBy));
+    BOOST_CHECK_EQUAL(cache->getStats().entries, 1U);
+    BOOST_CHECK_EQUAL(cache->getStats().bytes, 30U);
+    copyDone.set_value();
+    putThread.join();
+
+    BOOST_CHECK_EQUAL(cache->getStats().entries, 2U);
+    BOOST_CHECK(cache->get("b", "result_4", orderBy));
+    BOOST_CHECK_EQUAL(sql->tables["result_4"], 20U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
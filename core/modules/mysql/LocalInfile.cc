@@ -75,13 +75,13 @@ LocalInfile::LocalInfile(char const* filename,
                          std::shared_ptr<RowBuffer> rowBuffer)
     : _filename(filename),
       _rowBuffer(rowBuffer) {
-    // Should have buffer >= sizeof(single row)
-    const int defaultBuffer = infileBufferSize;
-    _buffer = new char[defaultBuffer];
+    assert(_rowBuffer);
+    // Should have buffer >= sizeof(single row), unless rows can be split.
+    const int defaultBuffer = _rowBuffer->fetchesPartialRows() ? 0 : infileBufferSize;
+    _buffer = (defaultBuffer > 0) ? new char[defaultBuffer] : nullptr;
     _bufferSize = defaultBuffer;
     _leftover = 0;
     _leftoverSize = 0;
-    assert(_rowBuffer);
 }
 
 LocalInfile::~LocalInfile() {
@@ -106,7 +106,10 @@ int LocalInfile::read(char* buf, unsigned int bufLen) {
         _leftover += copySize;
         _leftoverSize -= copySize;
     }
-    if (bufLen > 0) { // continue?
+    if (bufLen > 0 && _rowBuffer->fetchesPartialRows()) {
+        // No need for the internal buffer, rows go straight to mysql.
+        copied += _rowBuffer->fetch(buf, bufLen);
+    } else if (bufLen > 0) { // continue?
         // Leftover couldn't satisfy bufLen, so it's empty.
         // Re-fill the buffer.
 
@@ -85,7 +85,8 @@ private:
 };
 
 /// Do not inherit or copy. Used in mysql_set_local_infile_handler
-/// Can only be attached to one MYSQL*
+/// May be attached to several MYSQL* at once. They share the map of
+/// prepared sources, which is protected by _mapMutex.
 /// Client code should use this interface in nearly all cases rather
 /// than managing LocalInfile instances manually.
 /// See:
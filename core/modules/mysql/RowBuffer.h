@@ -77,6 +77,11 @@ public:
     /// fetched. Returning less than bufLen does NOT indicate EOF.
     virtual unsigned fetch(char* buffer, unsigned bufLen) = 0;
 
+    /// @return true if fetch() fills buffers of any size, splitting rows
+    /// across calls as needed, and only returns 0 once all rows are fetched.
+    /// LocalInfile then fetches straight into the buffer provided by mysql.
+    virtual bool fetchesPartialRows() const { return false; }
+
     /// Construct a RowBuffer tied to a MySQL query result
     static Ptr newResRowBuffer(MYSQL_RES* result);
 
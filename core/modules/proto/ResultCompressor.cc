@@ -0,0 +1,299 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "proto/ResultCompressor.h"
+
+// System headers
+#include <new>
+
+// Third-party headers
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.proto.ResultCompressor");
+
+std::chrono::seconds const LOG_INTERVAL(60);
+
+#ifdef HAVE_ZSTD
+std::uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+#endif
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+void CompressionTotals::add(size_t rawBytes, size_t wireBytes, std::uint64_t micros) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    ++_messages;
+    _rawBytes += rawBytes;
+    _wireBytes += wireBytes;
+    _micros += micros;
+    auto now = std::chrono::steady_clock::now();
+    if (now - _lastLog >= LOG_INTERVAL) {
+        _lastLog = now;
+        LOGS(_log, LOG_LVL_INFO, "Result " << _what << " totals: messages=" << _messages
+             << " rawBytes=" << _rawBytes << " wireBytes=" << _wireBytes
+             << " savedBytes=" << static_cast<std::int64_t>(_rawBytes - _wireBytes)
+             << " seconds=" << _micros / 1.0e6);
+    }
+}
+
+
+std::uint64_t CompressionTotals::getMessages() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _messages;
+}
+
+
+std::uint64_t CompressionTotals::getRawBytes() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _rawBytes;
+}
+
+
+std::uint64_t CompressionTotals::getWireBytes() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _wireBytes;
+}
+
+
+std::uint64_t CompressionTotals::getMicros() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _micros;
+}
+
+
+#ifdef HAVE_ZSTD
+
+bool ResultCompressor::isSupported() {
+    return true;
+}
+
+
+ResultCompressor::ResultCompressor() : _ctx(ZSTD_createCCtx()) {
+    if (_ctx == nullptr) {
+        throw std::bad_alloc();
+    }
+}
+
+
+ResultCompressor::~ResultCompressor() {
+    ZSTD_freeCCtx(_ctx);
+}
+
+
+bool ResultCompressor::compress(std::string const& msg, int level, std::string& out) {
+    auto start = std::chrono::steady_clock::now();
+    out.resize(ZSTD_compressBound(msg.size()));
+    size_t n = ZSTD_compressCCtx(_ctx, &out[0], out.size(), msg.data(), msg.size(), level);
+    bool smaller = !ZSTD_isError(n) && n < msg.size();
+    if (ZSTD_isError(n)) {
+        LOGS(_log, LOG_LVL_WARN, "ResultCompressor failed: " << ZSTD_getErrorName(n));
+    }
+    out.resize(smaller ? n : 0);
+    // Messages that did not shrink are sent as they are, but still cost time.
+    getTotals().add(msg.size(), smaller ? n : msg.size(), microsSince(start));
+    return smaller;
+}
+
+#else
+
+bool ResultCompressor::isSupported() {
+    return false;
+}
+
+
+ResultCompressor::ResultCompressor() : _ctx(nullptr) {}
+
+
+ResultCompressor::~ResultCompressor() {}
+
+
+bool ResultCompressor::compress(std::string const&, int, std::string& out) {
+    out.clear();
+    return false;
+}
+
+#endif // HAVE_ZSTD
+
+
+CompressionTotals& ResultCompressor::getTotals() {
+    static CompressionTotals totals("compression");
+    return totals;
+}
+
+
+const size_t ResultDecompressor::OUT_SIZE;
+
+
+#ifdef HAVE_ZSTD
+
+bool ResultDecompressor::isSupported() {
+    return true;
+}
+
+
+ResultDecompressor::ResultDecompressor() : _ctx(ZSTD_createDCtx()) {
+    if (_ctx == nullptr) {
+        throw std::bad_alloc();
+    }
+}
+
+
+ResultDecompressor::~ResultDecompressor() {
+    ZSTD_freeDCtx(_ctx);
+}
+
+
+bool ResultDecompressor::decompress(char const* data, size_t len, size_t rawSize, std::string& out) {
+    auto start = std::chrono::steady_clock::now();
+    out.resize(rawSize);
+    size_t n = ZSTD_decompressDCtx(_ctx, &out[0], rawSize, data, len);
+    if (ZSTD_isError(n) || n != rawSize) {
+        LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor failed: "
+             << (ZSTD_isError(n) ? ZSTD_getErrorName(n) : "wrong size") << " expected " << rawSize);
+        out.clear();
+        return false;
+    }
+    getTotals().add(rawSize, len, microsSince(start));
+    return true;
+}
+
+
+void ResultDecompressor::startStream(size_t rawSize) {
+    ZSTD_initDStream(_ctx);
+    _rawSize = rawSize;
+    _produced = 0;
+    _consumed = 0;
+    _frameDone = false;
+    _micros = 0;
+}
+
+
+bool ResultDecompressor::addToStream(char const* data, size_t len, Sink const& sink) {
+    _out.resize(OUT_SIZE);
+    ZSTD_inBuffer in{data, len, 0};
+    while (in.pos < in.size || !_frameDone) {
+        if (_frameDone) {
+            LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor data after the end of the message");
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        ZSTD_outBuffer out{&_out[0], _out.size(), 0};
+        size_t ret = ZSTD_decompressStream(_ctx, &out, &in);
+        _micros += microsSince(start);
+        if (ZSTD_isError(ret)) {
+            LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor failed: " << ZSTD_getErrorName(ret));
+            return false;
+        }
+        _frameDone = (ret == 0);
+        _produced += out.pos;
+        if (_produced > _rawSize) {
+            LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor message longer than " << _rawSize);
+            return false;
+        }
+        if (out.pos > 0 && !sink(_out.data(), out.pos)) {
+            return false;
+        }
+        // The output buffer was not filled, so all input that can be is consumed.
+        if (out.pos < out.size && in.pos == in.size) {
+            break;
+        }
+    }
+    _consumed += len;
+    return true;
+}
+
+
+bool ResultDecompressor::finishStream() {
+    _out.clear();
+    _out.shrink_to_fit();
+    if (!_frameDone || _produced != _rawSize) {
+        LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor message truncated, got " << _produced
+             << " of " << _rawSize << " bytes");
+        return false;
+    }
+    getTotals().add(_rawSize, _consumed, _micros);
+    return true;
+}
+
+#else
+
+bool ResultDecompressor::isSupported() {
+    return false;
+}
+
+
+ResultDecompressor::ResultDecompressor() : _ctx(nullptr) {}
+
+
+ResultDecompressor::~ResultDecompressor() {}
+
+
+bool ResultDecompressor::decompress(char const*, size_t, size_t, std::string& out) {
+    LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor failed: built without zstd");
+    out.clear();
+    return false;
+}
+
+
+void ResultDecompressor::startStream(size_t rawSize) {
+    _rawSize = rawSize;
+    _produced = 0;
+    _consumed = 0;
+    _frameDone = false;
+    _micros = 0;
+}
+
+
+bool ResultDecompressor::addToStream(char const*, size_t, Sink const&) {
+    LOGS(_log, LOG_LVL_ERROR, "ResultDecompressor failed: built without zstd");
+    return false;
+}
+
+
+bool ResultDecompressor::finishStream() {
+    return false;
+}
+
+#endif // HAVE_ZSTD
+
+
+CompressionTotals& ResultDecompressor::getTotals() {
+    static CompressionTotals totals("decompression");
+    return totals;
+}
+
+}}} // namespace lsst::qserv::proto
@@ -0,0 +1,145 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_PROTO_RESULTCOMPRESSOR_H
+#define LSST_QSERV_PROTO_RESULTCOMPRESSOR_H
+
+// System headers
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// Forward declarations
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+/// Totals over the Result messages compressed, or decompressed, by this
+/// process. They are logged at most once a minute, so operators can see
+/// how many bytes compression saves and how much time it costs.
+class CompressionTotals {
+public:
+    explicit CompressionTotals(std::string const& what) : _what(what) {}
+    CompressionTotals(CompressionTotals const&) = delete;
+    CompressionTotals& operator=(CompressionTotals const&) = delete;
+
+    /// Count a message of rawBytes that took wireBytes on the wire and
+    /// micros microseconds to compress or decompress.
+    void add(size_t rawBytes, size_t wireBytes, std::uint64_t micros);
+
+    std::uint64_t getMessages() const;
+    std::uint64_t getRawBytes() const;
+    std::uint64_t getWireBytes() const;
+    std::uint64_t getMicros() const;
+
+private:
+    std::string const _what;
+    mutable std::mutex _mtx; ///< Protects all members below.
+    std::uint64_t _messages{0};
+    std::uint64_t _rawBytes{0};
+    std::uint64_t _wireBytes{0};
+    std::uint64_t _micros{0};
+    std::chrono::steady_clock::time_point _lastLog{std::chrono::steady_clock::now()};
+};
+
+/// ResultCompressor compresses serialized Result messages with zstd. An
+/// instance is not thread safe, but can be reused for any number of messages.
+/// Without zstd (HAVE_ZSTD undefined at build time) messages are never
+/// compressed.
+class ResultCompressor {
+public:
+    /// @return true if this build can compress messages.
+    static bool isSupported();
+
+    ResultCompressor();
+    ~ResultCompressor();
+    ResultCompressor(ResultCompressor const&) = delete;
+    ResultCompressor& operator=(ResultCompressor const&) = delete;
+
+    /// Compress msg into out with zstd at level.
+    /// @return false if compression failed, would not make msg smaller, or
+    ///         is not supported, in which case msg should be sent as it is.
+    bool compress(std::string const& msg, int level, std::string& out);
+
+    /// @return the totals of all messages compressed by this process.
+    static CompressionTotals& getTotals();
+
+private:
+    ZSTD_CCtx_s* _ctx;
+};
+
+/// ResultDecompressor decompresses messages from ResultCompressor, either
+/// whole, or fragment by fragment as they arrive. Without zstd every
+/// message is rejected as corrupt.
+class ResultDecompressor {
+public:
+    /// @return true if this build can decompress messages.
+    static bool isSupported();
+
+    /// Receives decompressed bytes. Returns false to stop decompression.
+    using Sink = std::function<bool(char const* data, size_t len)>;
+
+    /// Maximum number of bytes passed to a Sink at once.
+    static const size_t OUT_SIZE = 1024*1024;
+
+    ResultDecompressor();
+    ~ResultDecompressor();
+    ResultDecompressor(ResultDecompressor const&) = delete;
+    ResultDecompressor& operator=(ResultDecompressor const&) = delete;
+
+    /// Decompress a whole message of rawSize bytes into out.
+    /// @return false if the message is corrupt or not rawSize bytes.
+    bool decompress(char const* data, size_t len, size_t rawSize, std::string& out);
+
+    /// Start decompressing a message of rawSize bytes that arrives in fragments.
+    void startStream(size_t rawSize);
+
+    /// Decompress the next fragment, passing the output to sink.
+    /// @return false if the message is corrupt or longer than rawSize bytes,
+    ///         or sink returned false.
+    bool addToStream(char const* data, size_t len, Sink const& sink);
+
+    /// @return false if the message did not end after exactly rawSize bytes.
+    bool finishStream();
+
+    /// @return the totals of all messages decompressed by this process.
+    static CompressionTotals& getTotals();
+
+private:
+    ZSTD_DCtx_s* _ctx;
+    std::string _out; ///< Output buffer for fragments.
+    size_t _rawSize{0}; ///< Expected size of the streamed message.
+    size_t _produced{0}; ///< Bytes of the streamed message decompressed so far.
+    size_t _consumed{0}; ///< Compressed bytes of the streamed message so far.
+    bool _frameDone{false}; ///< True once the end of the zstd frame is seen.
+    std::uint64_t _micros{0}; ///< Time spent decompressing the streamed message.
+};
+
+}}} // namespace lsst::qserv::proto
+
+#endif // LSST_QSERV_PROTO_RESULTCOMPRESSOR_H
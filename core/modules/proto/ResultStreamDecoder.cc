@@ -0,0 +1,140 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "proto/ResultStreamDecoder.h"
+
+// System headers
+#include <cstdint>
+#include <limits>
+
+// Third-party headers
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace gio = google::protobuf::io;
+using google::protobuf::internal::WireFormatLite;
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.proto.ResultStreamDecoder");
+
+int const ROW_FIELD = lsst::qserv::proto::Result::kRowFieldNumber;
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+bool ResultStreamDecoder::add(char const* data, size_t len, Result& result) {
+    if (len > static_cast<size_t>(std::numeric_limits<int>::max() - _held.size())) {
+        LOGS(_log, LOG_LVL_ERROR, "ResultStreamDecoder fragment too large " << len);
+        return false;
+    }
+    int consumed;
+    if (_held.empty()) {
+        // Decode straight from the fragment and only keep its tail.
+        consumed = _decode(data, len, result);
+        if (consumed < 0) return false;
+        _held.assign(data + consumed, len - consumed);
+    } else {
+        _held.append(data, len);
+        consumed = _decode(_held.data(), _held.size(), result);
+        if (consumed < 0) return false;
+        _held.erase(0, consumed);
+    }
+    return true;
+}
+
+
+bool ResultStreamDecoder::finish(Result const& result) const {
+    if (!_held.empty()) {
+        LOGS(_log, LOG_LVL_ERROR, "ResultStreamDecoder message truncated, "
+             << _held.size() << " bytes left");
+        return false;
+    }
+    return result.IsInitialized();
+}
+
+
+int ResultStreamDecoder::_decode(char const* data, int len, Result& result) {
+    auto bytes = reinterpret_cast<std::uint8_t const*>(data);
+    gio::CodedInputStream in(bytes, len);
+    int consumed = 0;
+    while (consumed < len) {
+        // Stop at the first field that is not complete.
+        std::uint32_t tag = in.ReadTag();
+        if (tag == 0) break;
+        switch (WireFormatLite::GetTagWireType(tag)) {
+        case WireFormatLite::WIRETYPE_VARINT:
+            {
+                std::uint64_t v;
+                if (!in.ReadVarint64(&v)) return consumed;
+            }
+            break;
+        case WireFormatLite::WIRETYPE_FIXED64:
+            if (!in.Skip(8)) return consumed;
+            break;
+        case WireFormatLite::WIRETYPE_FIXED32:
+            if (!in.Skip(4)) return consumed;
+            break;
+        case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+            {
+                std::uint32_t fieldLen;
+                if (!in.ReadVarint32(&fieldLen)) return consumed;
+                if (fieldLen > static_cast<std::uint32_t>(len - in.CurrentPosition())) {
+                    return consumed;
+                }
+                if (WireFormatLite::GetTagFieldNumber(tag) == ROW_FIELD) {
+                    if (!result.add_row()->ParseFromArray(bytes + in.CurrentPosition(), fieldLen)) {
+                        LOGS(_log, LOG_LVL_ERROR, "ResultStreamDecoder bad row");
+                        return -1;
+                    }
+                    in.Skip(fieldLen);
+                    consumed = in.CurrentPosition();
+                    continue;
+                }
+                in.Skip(fieldLen);
+            }
+            break;
+        default:
+            LOGS(_log, LOG_LVL_ERROR, "ResultStreamDecoder unexpected wire type in tag " << tag);
+            return -1;
+        }
+        // Any other field is merged into result as it is.
+        int end = in.CurrentPosition();
+        gio::CodedInputStream fieldIn(bytes + consumed, end - consumed);
+        if (!result.MergePartialFromCodedStream(&fieldIn)) {
+            LOGS(_log, LOG_LVL_ERROR, "ResultStreamDecoder bad field in tag " << tag);
+            return -1;
+        }
+        consumed = end;
+    }
+    return consumed;
+}
+
+}}} // namespace lsst::qserv::proto
@@ -0,0 +1,74 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_PROTO_RESULTSTREAMDECODER_H
+#define LSST_QSERV_PROTO_RESULTSTREAMDECODER_H
+
+// System headers
+#include <cstddef>
+#include <string>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+/// ResultStreamDecoder decodes a serialized Result message that arrives in
+/// arbitrary fragments, without waiting for the whole message.
+///
+/// Each complete field is merged into the target Result as soon as its last
+/// byte has arrived, so rows can be taken out of the target and merged while
+/// the rest of the message is still in transit. Only an incomplete trailing
+/// field is kept between calls. Fields of a Result are serialized in field
+/// number order, so the schema and any error precede the rows, and the job
+/// identification fields follow protocol 2 rows.
+class ResultStreamDecoder {
+public:
+    ResultStreamDecoder() {}
+    ResultStreamDecoder(ResultStreamDecoder const&) = delete;
+    ResultStreamDecoder& operator=(ResultStreamDecoder const&) = delete;
+
+    /// Decode the next fragment of the message into result.
+    /// @return false if the bytes cannot be part of a Result message.
+    bool add(char const* data, size_t len, Result& result);
+
+    /// @return false if the message ended in the middle of a field, or
+    ///         result is missing required fields.
+    bool finish(Result const& result) const;
+
+    /// @return the number of bytes held for an incomplete field.
+    size_t getHeldBytes() const { return _held.size(); }
+
+    void reset() { _held.clear(); }
+
+private:
+    /// @return the number of bytes consumed, or -1 on error.
+    int _decode(char const* data, int len, Result& result);
+
+    std::string _held; ///< Start of a field whose end has not arrived yet.
+};
+
+}}} // namespace lsst::qserv::proto
+
+#endif // LSST_QSERV_PROTO_RESULTSTREAMDECODER_H
@@ -0,0 +1,181 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "proto/RowBatch.h"
+
+// System headers
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+/// Write the decimal digits of v to dest.
+/// @return the number of bytes written.
+int formatUnsigned(std::uint64_t v, char* dest) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    for (int i = 0; i < n; ++i) {
+        dest[i] = digits[n - 1 - i];
+    }
+    return n;
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+void RowBatchWriter::start(RowBatch* batch) {
+    _batch = batch;
+    _columns.clear();
+    _batchBytes = 0;
+    if (_batch == nullptr) {
+        return;
+    }
+    _batch->set_rowcount(0);
+    for (auto kind : _kinds) {
+        ColumnBatch* col = _batch->add_column();
+        col->set_kind(kind);
+        _columns.push_back(col);
+    }
+}
+
+
+size_t RowBatchWriter::addRow(char const* const* values, unsigned long const* lengths) {
+    unsigned int const row = _batch->rowcount();
+    size_t added = 0;
+    for (size_t i = 0, e = _columns.size(); i != e; ++i) {
+        ColumnBatch* col = _columns[i];
+        char const* value = values[i];
+        if (value == nullptr) {
+            std::string* nulls = col->mutable_nulls();
+            if (nulls->size() <= row / 8) {
+                nulls->resize(row / 8 + 1, '\0');
+            }
+            (*nulls)[row / 8] |= 1 << (row % 8);
+        }
+        switch (col->kind()) {
+        case ColumnBatch::INT64:
+            col->add_int64value(value ? std::strtoll(value, nullptr, 10) : 0);
+            added += 8;
+            break;
+        case ColumnBatch::UINT64:
+            col->add_uint64value(value ? std::strtoull(value, nullptr, 10) : 0);
+            added += 8;
+            break;
+        case ColumnBatch::DOUBLE:
+            col->add_doublevalue(value ? std::strtod(value, nullptr) : 0.0);
+            added += 8;
+            break;
+        default:
+            if (value != nullptr) {
+                col->mutable_blob()->append(value, lengths[i]);
+                added += lengths[i];
+            }
+            col->add_endoffset(col->blob().size());
+            added += 4;
+            break;
+        }
+    }
+    _batch->set_rowcount(row + 1);
+    _batchBytes += added;
+    return added;
+}
+
+
+int countRows(Result const& result) {
+    int rows = result.row_size();
+    for (auto const& batch : result.batch()) {
+        rows += batch.rowcount();
+    }
+    return rows;
+}
+
+
+bool checkBatches(Result const& result) {
+    int const numColumns = result.rowschema().columnschema_size();
+    for (auto const& batch : result.batch()) {
+        if (batch.rowcount() == 0) {
+            continue; // Nothing is read from an empty batch.
+        }
+        if (batch.column_size() != numColumns) {
+            return false;
+        }
+        int const rows = batch.rowcount();
+        for (auto const& col : batch.column()) {
+            switch (col.kind()) {
+            case ColumnBatch::INT64:
+                if (col.int64value_size() != rows) return false;
+                break;
+            case ColumnBatch::UINT64:
+                if (col.uint64value_size() != rows) return false;
+                break;
+            case ColumnBatch::DOUBLE:
+                if (col.doublevalue_size() != rows) return false;
+                break;
+            default:
+                if (col.endoffset_size() != rows) return false;
+                // Offsets must not decrease, nor go past the blob.
+                unsigned int prev = 0;
+                for (auto end : col.endoffset()) {
+                    if (end < prev) return false;
+                    prev = end;
+                }
+                if (prev > col.blob().size()) return false;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+
+int formatNumber(ColumnBatch const& col, int row, char* dest) {
+    switch (col.kind()) {
+    case ColumnBatch::INT64:
+        {
+            std::int64_t v = col.int64value(row);
+            if (v < 0) {
+                *dest = '-';
+                // Negate as unsigned, which also works for the minimum value.
+                return 1 + formatUnsigned(-static_cast<std::uint64_t>(v), dest + 1);
+            }
+            return formatUnsigned(v, dest);
+        }
+    case ColumnBatch::UINT64:
+        return formatUnsigned(col.uint64value(row), dest);
+    case ColumnBatch::DOUBLE:
+        return snprintf(dest, MAX_NUMBER_SIZE, "%.17g", col.doublevalue(row));
+    default:
+        return 0;
+    }
+}
+
+}}} // namespace lsst::qserv::proto
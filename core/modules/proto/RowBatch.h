@@ -0,0 +1,105 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_PROTO_ROWBATCH_H
+#define LSST_QSERV_PROTO_ROWBATCH_H
+
+// System headers
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+/// Result protocol 3 sends rows column by column in RowBatch messages, with
+/// integer and floating point columns as packed binary arrays. This saves
+/// the per row and per value overhead of RowBundle, and the conversion of
+/// numbers to and from text for every protobuf message.
+
+/// RowBatchWriter appends rows, in the text form returned by mysql_fetch_row,
+/// to RowBatch messages.
+class RowBatchWriter {
+public:
+    /// @param kinds encoding of each column.
+    explicit RowBatchWriter(std::vector<ColumnBatch::Kind> const& kinds) : _kinds(kinds) {}
+    RowBatchWriter(RowBatchWriter const&) = delete;
+    RowBatchWriter& operator=(RowBatchWriter const&) = delete;
+
+    /// Start writing rows to batch, which must be empty. nullptr stops
+    /// writing to the previous batch without starting a new one.
+    void start(RowBatch* batch);
+
+    /// Append a row to the current batch. values[i] is nullptr for NULL, and
+    /// otherwise points to lengths[i] bytes followed by a '\0'.
+    /// @return the approximate number of bytes added to the serialized batch.
+    size_t addRow(char const* const* values, unsigned long const* lengths);
+
+    /// @return true if there is a batch to add rows to.
+    bool isStarted() const { return _batch != nullptr; }
+
+    /// @return the approximate serialized size of the current batch.
+    size_t getBatchBytes() const { return _batchBytes; }
+
+private:
+    std::vector<ColumnBatch::Kind> const _kinds;
+    RowBatch* _batch{nullptr};
+    std::vector<ColumnBatch*> _columns;
+    size_t _batchBytes{0};
+};
+
+/// @return the number of rows in result, whichever protocol it uses.
+int countRows(Result const& result);
+
+/// @return false if a non-empty batch of result does not have a column for
+///         each column of the schema, or a value for each row.
+bool checkBatches(Result const& result);
+
+/// @return true if row is NULL in col.
+inline bool isNull(ColumnBatch const& col, int row) {
+    std::string const& nulls = col.nulls();
+    size_t byte = row >> 3;
+    return byte < nulls.size() && ((static_cast<unsigned char>(nulls[byte]) >> (row & 7)) & 1);
+}
+
+/// Maximum number of bytes written by formatNumber().
+int const MAX_NUMBER_SIZE = 32;
+
+/// Write the text form of row of a non-BYTES column to dest. Doubles are
+/// written with enough digits to be read back exactly.
+/// @return the number of bytes written.
+int formatNumber(ColumnBatch const& col, int row, char* dest);
+
+/// Locate the value of row in a BYTES column.
+inline void getBytes(ColumnBatch const& col, int row, char const*& data, size_t& len) {
+    unsigned int begin = (row > 0) ? col.endoffset(row - 1) : 0;
+    data = col.blob().data() + begin;
+    len = col.endoffset(row) - begin;
+}
+
+}}} // namespace lsst::qserv::proto
+
+#endif // LSST_QSERV_PROTO_ROWBATCH_H
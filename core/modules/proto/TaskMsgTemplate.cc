@@ -0,0 +1,76 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "proto/TaskMsgTemplate.h"
+
+// System headers
+#include <string>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+namespace {
+
+/// Replace each occurrence of tag in s by value.
+void replaceTag(std::string& s, std::string const& tag, std::string const& value) {
+    if (tag.empty()) return;
+    for (auto pos = s.find(tag); pos != std::string::npos; pos = s.find(tag, pos + value.size())) {
+        s.replace(pos, tag.size(), value);
+    }
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace proto {
+
+void expandQueryTemplates(TaskMsg& m) {
+    std::string const chunkId = std::to_string(m.chunkid());
+    for (auto& frag : *m.mutable_fragment()) {
+        if (frag.querytemplate_size() == 0) continue;
+        // The order the czar used to generate queries in: all of the
+        // templates for one subchunk, then for the next.
+        if (m.has_subchunktag()) {
+            for (auto subChunkId : frag.subchunks().id()) {
+                std::string const subChunk = std::to_string(subChunkId);
+                for (auto const& tmpl : frag.querytemplate()) {
+                    std::string query = tmpl;
+                    replaceTag(query, m.chunktag(), chunkId);
+                    replaceTag(query, m.subchunktag(), subChunk);
+                    frag.add_query(query);
+                }
+            }
+        } else {
+            for (auto const& tmpl : frag.querytemplate()) {
+                std::string query = tmpl;
+                replaceTag(query, m.chunktag(), chunkId);
+                frag.add_query(query);
+            }
+        }
+        frag.clear_querytemplate();
+    }
+}
+
+}}} // namespace lsst::qserv::proto
@@ -37,8 +37,11 @@
 
 // Qserv headers
 #include "proto/ProtoHeaderWrap.h"
+#include "proto/ResultCompressor.h"
+#include "proto/ResultStreamDecoder.h"
 #include "proto/ScanTableInfo.h"
 #include "proto/TaskMsgDigest.h"
+#include "proto/TaskMsgTemplate.h"
 #include "proto/worker.pb.h"
 #include "proto/WorkerResponse.h"
 
@@ -193,6 +196,152 @@ BOOST_AUTO_TEST_CASE(ProtoHeaderWrap) {
     BOOST_CHECK(compareProtoHeaders(response->protoHeader, *ph));
 }
 
+BOOST_AUTO_TEST_CASE(ResultStreamDecoder) {
+    proto::Result r1;
+    r1.set_continues(false);
+    auto cs = r1.mutable_rowschema()->add_columnschema();
+    cs->set_name("name");
+    cs->set_sqltype("TEXT");
+    cs->set_deprecated_hasdefault(false);
+    for (int i = 0; i < 50; ++i) {
+        auto row = r1.add_row();
+        row->add_column(std::string(i*i, 'a' + i % 26));
+        row->add_isnull(false);
+    }
+    r1.set_queryid(7);
+    r1.set_jobid(3);
+    r1.set_largeresult(false);
+    r1.set_rowcount(50);
+    r1.set_transmitsize(0);
+    r1.set_attemptcount(1);
+    std::string str;
+    r1.SerializeToString(&str);
+
+    for (size_t fragSize : {1, 3, 100, 1000, 100000}) {
+        proto::ResultStreamDecoder decoder;
+        proto::Result r2;
+        std::vector<std::string> columns;
+        for (size_t pos = 0; pos < str.size(); pos += fragSize) {
+            BOOST_REQUIRE(!decoder.finish(r2));
+            BOOST_REQUIRE(decoder.add(str.data() + pos, std::min(fragSize, str.size() - pos), r2));
+            // Take the rows out as they are decoded.
+            for (auto const& row : r2.row()) {
+                columns.push_back(row.column(0));
+            }
+            r2.clear_row();
+        }
+        BOOST_CHECK(decoder.finish(r2));
+        BOOST_CHECK_EQUAL(decoder.getHeldBytes(), 0U);
+        BOOST_CHECK_EQUAL(r2.rowschema().columnschema(0).name(), "name");
+        BOOST_CHECK_EQUAL(r2.jobid(), 3);
+        BOOST_CHECK_EQUAL(r2.attemptcount(), 1);
+        BOOST_REQUIRE_EQUAL(columns.size(), 50U);
+        for (int i = 0; i < 50; ++i) {
+            BOOST_CHECK(columns[i] == r1.row(i).column(0));
+        }
+    }
+
+    // A truncated message is detected.
+    proto::ResultStreamDecoder decoder;
+    proto::Result r3;
+    BOOST_CHECK(decoder.add(str.data(), str.size() - 1, r3));
+    BOOST_CHECK(!decoder.finish(r3));
+}
+
+BOOST_AUTO_TEST_CASE(ResultCompressor) {
+    // Several times ResultDecompressor::OUT_SIZE, and compressible.
+    std::string msg;
+    for (int i = 0; msg.size() < 3*proto::ResultDecompressor::OUT_SIZE; ++i) {
+        msg += "row " + std::to_string(i) + " value " + std::to_string(i * 7 % 1000) + ";";
+    }
+    proto::ResultCompressor compressor;
+    std::string compressed;
+    if (!proto::ResultCompressor::isSupported()) {
+        // Without zstd messages are sent as they are, and compressed ones rejected.
+        BOOST_CHECK(!compressor.compress(msg, 1, compressed));
+        proto::ResultDecompressor decompressor;
+        std::string raw;
+        BOOST_CHECK(!decompressor.decompress(msg.data(), msg.size(), msg.size(), raw));
+        return;
+    }
+    auto messages = proto::ResultCompressor::getTotals().getMessages();
+    BOOST_REQUIRE(compressor.compress(msg, 1, compressed));
+    BOOST_CHECK_LT(compressed.size(), msg.size() / 2);
+    BOOST_CHECK_EQUAL(proto::ResultCompressor::getTotals().getMessages(), messages + 1);
+
+    proto::ResultDecompressor decompressor;
+    std::string raw;
+    BOOST_CHECK(decompressor.decompress(compressed.data(), compressed.size(), msg.size(), raw));
+    BOOST_CHECK(raw == msg);
+    BOOST_CHECK(!decompressor.decompress(compressed.data(), compressed.size(), msg.size() + 1, raw));
+    BOOST_CHECK(!decompressor.decompress(compressed.data(), compressed.size() - 1, msg.size(), raw));
+
+    for (size_t fragSize : {1, 1000, 1000000}) {
+        std::string out;
+        auto sink = [&out](char const* data, size_t len) {
+            BOOST_CHECK_LE(len, proto::ResultDecompressor::OUT_SIZE);
+            out.append(data, len);
+            return true;
+        };
+        decompressor.startStream(msg.size());
+        for (size_t pos = 0; pos < compressed.size(); pos += fragSize) {
+            size_t len = std::min(fragSize, compressed.size() - pos);
+            BOOST_REQUIRE(decompressor.addToStream(compressed.data() + pos, len, sink));
+        }
+        BOOST_CHECK(decompressor.finishStream());
+        BOOST_CHECK(out == msg);
+    }
+
+    // A truncated stream is detected, and so is a sink that gives up.
+    auto ignore = [](char const*, size_t) { return true; };
+    decompressor.startStream(msg.size());
+    BOOST_CHECK(decompressor.addToStream(compressed.data(), compressed.size() - 1, ignore));
+    BOOST_CHECK(!decompressor.finishStream());
+    auto refuse = [](char const*, size_t) { return false; };
+    decompressor.startStream(msg.size());
+    BOOST_CHECK(!decompressor.addToStream(compressed.data(), compressed.size(), refuse));
+
+    // Data that does not compress is left alone.
+    std::string noise;
+    unsigned int x = 12345;
+    for (int i = 0; i < 10000; ++i) {
+        x = x * 1103515245 + 12345;
+        noise.push_back(static_cast<char>(x >> 16));
+    }
+    BOOST_CHECK(!compressor.compress(noise, 1, compressed));
+}
+
+BOOST_AUTO_TEST_CASE(QueryTemplates) {
+    proto::TaskMsg t;
+    t.set_chunkid(1234);
+    t.set_chunktag("%CC%");
+    t.set_subchunktag("%SS%");
+    auto frag = t.add_fragment();
+    frag->add_querytemplate("SELECT * FROM Sub_%CC%.Object_%CC%_%SS% AS o1");
+    frag->add_querytemplate("SELECT 1 FROM Object_%CC%");
+    frag->mutable_subchunks()->add_id(5);
+    frag->mutable_subchunks()->add_id(7);
+    proto::expandQueryTemplates(t);
+    BOOST_CHECK_EQUAL(frag->querytemplate_size(), 0);
+    BOOST_REQUIRE_EQUAL(frag->query_size(), 4);
+    BOOST_CHECK_EQUAL(frag->query(0), "SELECT * FROM Sub_1234.Object_1234_5 AS o1");
+    BOOST_CHECK_EQUAL(frag->query(1), "SELECT 1 FROM Object_1234");
+    BOOST_CHECK_EQUAL(frag->query(2), "SELECT * FROM Sub_1234.Object_1234_7 AS o1");
+    BOOST_CHECK_EQUAL(frag->query(3), "SELECT 1 FROM Object_1234");
+
+    // Without a subchunk tag, there is one query per template.
+    t.clear_subchunktag();
+    frag->clear_query();
+    frag->add_querytemplate("SELECT COUNT(*) FROM Object_%CC%");
+    auto plain = t.add_fragment();
+    plain->add_query("SELECT 1");
+    proto::expandQueryTemplates(t);
+    BOOST_REQUIRE_EQUAL(frag->query_size(), 1);
+    BOOST_CHECK_EQUAL(frag->query(0), "SELECT COUNT(*) FROM Object_1234");
+    BOOST_REQUIRE_EQUAL(plain->query_size(), 1);
+    BOOST_CHECK_EQUAL(plain->query(0), "SELECT 1");
+}
+
 BOOST_AUTO_TEST_CASE(ScanTableInfo) {
     lsst::qserv::proto::ScanTableInfo stiA{"dba", "fruit", false, 1};
     lsst::qserv::proto::ScanTableInfo stiB{"dba", "fruit", true, 1};
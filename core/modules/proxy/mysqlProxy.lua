@@ -435,8 +435,15 @@ function queryProcessing()
 
     local dropResults = function(proxy)
 
+        -- Without a merge statement, the result table is a view of the
+        -- table the czar merged worker rows into, named with "_m" appended
+        -- (see rproc::InfileMerger::getMergeTableName()).
         if self.resultTableName ~= "" then
-            local q4 = "DROP TABLE " .. self.resultTableName
+            local q4 = "DROP VIEW IF EXISTS " .. self.resultTableName
+            proxy.queries:append(4, string.char(proxy.COM_QUERY) .. q4,
+                                 {resultset_is_needed = true})
+            q4 = "DROP TABLE IF EXISTS " .. self.resultTableName .. ", " ..
+                 self.resultTableName .. "_m"
             proxy.queries:append(4, string.char(proxy.COM_QUERY) .. q4,
                                  {resultset_is_needed = true})
         end
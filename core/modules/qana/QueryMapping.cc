@@ -35,6 +35,7 @@
 #include "qana/QueryMapping.h"
 
 // System headers
+#include <algorithm>
 #include <deque>
 #include <sstream>
 #include <stdexcept>
@@ -183,6 +184,76 @@ std::string QueryMapping::apply(qproc::ChunkSpecSingle const& s, query::QueryTem
 }
 
 
+QueryMapping::CompiledTemplate QueryMapping::compile(query::QueryTemplate const& t) const {
+    CompiledTemplate compiled;
+    std::string const text = t.sqlFragment();
+    size_t i = 0;
+    while(true) {
+        // Find the markup that comes first.
+        size_t j = std::string::npos;
+        auto found = _subs.end();
+        for(auto sub = _subs.begin(); sub != _subs.end(); ++sub) {
+            if (sub->first.empty()) continue;
+            size_t pos = text.find(sub->first, i);
+            if (pos < j) {
+                j = pos;
+                found = sub;
+            }
+        }
+        compiled.literals.push_back(text.substr(i, j - i));
+        compiled.literalSize += compiled.literals.back().size();
+        if (found == _subs.end()) {
+            break;
+        }
+        compiled.params.push_back(found->second);
+        i = j + found->first.size();
+    }
+    return compiled;
+}
+
+
+std::string QueryMapping::apply(qproc::ChunkSpec const& s, CompiledTemplate const& t) const {
+    std::string subChunkString;
+    if (!s.subChunks.empty()) {
+        subChunkString = std::to_string(s.subChunks.front());
+    }
+    return _generate(t, std::to_string(s.chunkId), subChunkString);
+}
+
+
+std::string QueryMapping::apply(qproc::ChunkSpecSingle const& s, CompiledTemplate const& t) const {
+    return _generate(t, std::to_string(s.chunkId), std::to_string(s.subChunkId));
+}
+
+
+std::string QueryMapping::_generate(CompiledTemplate const& t, std::string const& chunkString,
+                                    std::string const& subChunkString) const {
+    auto lookup = [&chunkString, &subChunkString](Parameter p) -> std::string const& {
+        static std::string const invalid("INVALID");
+        switch(p) {
+        case CHUNK:
+            return chunkString;
+        case SUBCHUNK:
+            return subChunkString;
+        case INVALID:
+            return invalid;
+        case HTM1:
+            throw std::range_error("HTM unimplemented");
+        default:
+            throw std::range_error("Unknown mapping parameter");
+        }
+    };
+    std::string str;
+    str.reserve(t.literalSize + t.params.size() * std::max(chunkString.size(), subChunkString.size()));
+    str.append(t.literals.front());
+    for(size_t k = 0; k < t.params.size(); ++k) {
+        str.append(lookup(t.params[k]));
+        str.append(t.literals[k + 1]);
+    }
+    return str;
+}
+
+
 bool
 QueryMapping::hasParameter(Parameter p) const {
     ParameterMap::const_iterator i;
@@ -192,4 +263,16 @@ QueryMapping::hasParameter(Parameter p) const {
     return false;
 }
 
+
+std::string QueryMapping::getTag(Parameter p) const {
+    std::string tag;
+    for(auto const& sub : _subs) {
+        if (sub.second == p) {
+            if (!tag.empty()) return std::string();
+            tag = sub.first;
+        }
+    }
+    return tag;
+}
+
 }}} // namespace lsst::qserv::qana
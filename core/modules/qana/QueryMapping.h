@@ -33,6 +33,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 // Qserv headers
 #include "global/DbTable.h"
@@ -80,6 +81,15 @@ public:
     typedef std::map<std::string,Parameter> ParameterMap;
 
 
+    /// A QueryTemplate rendered once, and split at the text markup of the
+    /// mapping, so that the query for a chunk is a single string build
+    /// instead of a mapping of every template entry.
+    struct CompiledTemplate {
+        std::vector<std::string> literals; ///< Text around params, one more than params.
+        std::vector<Parameter> params; ///< Parameter substituted after each literal.
+        size_t literalSize{0}; ///< Total size of literals.
+    };
+
     QueryMapping();
 
     std::string apply(qproc::ChunkSpec const& s,
@@ -87,6 +97,12 @@ public:
     std::string apply(qproc::ChunkSpecSingle const& s,
                       query::QueryTemplate const& t) const;
 
+    /// @return t, compiled for the apply() functions below, which generate
+    ///         the same queries as those above.
+    CompiledTemplate compile(query::QueryTemplate const& t) const;
+    std::string apply(qproc::ChunkSpec const& s, CompiledTemplate const& t) const;
+    std::string apply(qproc::ChunkSpecSingle const& s, CompiledTemplate const& t) const;
+
     // Modifiers
     void insertSubChunkTable(DbTable const& dbTable) { _subChunkTables.insert(dbTable); }
     void insertEntry(std::string const& s, Parameter p) { _subs[s] = p; }
@@ -97,9 +113,15 @@ public:
     bool hasChunks() const { return hasParameter(CHUNK); }
     bool hasSubChunks() const { return hasParameter(SUBCHUNK); }
     bool hasParameter(Parameter p) const;
+    /// @return the text markup standing for p, or an empty string if p has
+    ///         none, or more than one.
+    std::string getTag(Parameter p) const;
     DbTableSet const& getSubChunkTables() const { return _subChunkTables; }
 
 private:
+    std::string _generate(CompiledTemplate const& t, std::string const& chunkString,
+                          std::string const& subChunkString) const;
+
     ParameterMap _subs;
     DbTableSet _subChunkTables;
 };
@@ -0,0 +1,106 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+/**
+  *
+  * @brief Test generating chunk queries with QueryMapping.
+  *
+  */
+
+// System headers
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "qana/QueryMapping.h"
+#include "qproc/ChunkSpec.h"
+#include "query/QueryTemplate.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE QueryMapping_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::qana::QueryMapping;
+using lsst::qserv::qproc::ChunkSpec;
+using lsst::qserv::qproc::ChunkSpecSingle;
+using lsst::qserv::query::QueryTemplate;
+
+struct TestFixture {
+    TestFixture(void) {
+        mapping.insertChunkEntry("%CC%");
+        mapping.insertSubChunkEntry("%SS%");
+        // SELECT o1.ra FROM Subchunks_LSST_%CC%.Object_%CC%_%SS% AS o1,
+        //   Subchunks_LSST_%CC%.Object_%CC%_%SS% AS o2 WHERE o1.chunkId=%CC%
+        qTemplate.append("SELECT");
+        qTemplate.append("o1.ra");
+        qTemplate.append("FROM");
+        qTemplate.append(std::make_shared<QueryTemplate::TableEntry>("Subchunks_LSST_%CC%",
+                                                                     "Object_%CC%_%SS%"));
+        qTemplate.append("AS");
+        qTemplate.append("o1");
+        qTemplate.append(",");
+        qTemplate.append(std::make_shared<QueryTemplate::TableEntry>("Subchunks_LSST_%CC%",
+                                                                     "Object_%CC%_%SS%"));
+        qTemplate.append("AS");
+        qTemplate.append("o2");
+        qTemplate.append("WHERE");
+        qTemplate.append("o1.chunkId=%CC%");
+    }
+
+    QueryMapping mapping;
+    QueryTemplate qTemplate;
+};
+
+
+BOOST_FIXTURE_TEST_SUITE(Suite, TestFixture)
+
+BOOST_AUTO_TEST_CASE(Compiled) {
+    auto compiled = mapping.compile(qTemplate);
+    BOOST_CHECK_EQUAL(compiled.params.size(), 7u);
+    BOOST_CHECK_EQUAL(compiled.literals.size(), compiled.params.size() + 1);
+
+    ChunkSpec spec(1234, {5, 7});
+    BOOST_CHECK_EQUAL(mapping.apply(spec, compiled), mapping.apply(spec, qTemplate));
+    BOOST_CHECK_EQUAL(mapping.apply(spec, compiled),
+                      "SELECT o1.ra FROM Subchunks_LSST_1234.Object_1234_5 AS o1,"
+                      "Subchunks_LSST_1234.Object_1234_5 AS o2 WHERE o1.chunkId=1234");
+
+    ChunkSpec noSubChunks(10, {});
+    BOOST_CHECK_EQUAL(mapping.apply(noSubChunks, compiled), mapping.apply(noSubChunks, qTemplate));
+
+    for (auto const& single : ChunkSpecSingle::makeVector(spec)) {
+        BOOST_CHECK_EQUAL(mapping.apply(single, compiled), mapping.apply(single, qTemplate));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(NoMarkup) {
+    QueryTemplate plain;
+    plain.append("SELECT");
+    plain.append("1");
+    auto compiled = mapping.compile(plain);
+    BOOST_CHECK(compiled.params.empty());
+    BOOST_CHECK_EQUAL(mapping.apply(ChunkSpec(3, {}), compiled), "SELECT 1");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,236 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/ChunkGroupHandler.h"
+
+// System headers
+#include <algorithm>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "ccontrol/msgCode.h"
+#include "proto/ProtoHeaderWrap.h"
+#include "proto/WorkerResponse.h"
+#include "qdisp/JobQuery.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.ChunkGroupHandler");
+}
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+ChunkGroupHandler::ChunkGroupHandler(std::vector<std::shared_ptr<JobQuery>> const& jobs) {
+    for (auto const& job : jobs) {
+        _jobs[job->getIdInt()] = job;
+    }
+}
+
+
+std::vector<char>& ChunkGroupHandler::nextBuffer() {
+    std::shared_ptr<JobQuery> current;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_current == nullptr) {
+            _headerBuf.resize(proto::ProtoHeaderWrap::PROTO_HEADER_SIZE);
+            return _headerBuf;
+        }
+        current = _current;
+    }
+    // The buffer of the job may wait for memory, which must not block finishJobs().
+    return current->getDescription()->respHandler()->nextBuffer();
+}
+
+
+bool ChunkGroupHandler::reserveNextBuffer(MemoryGovernor::Attempt& attempt) {
+    std::shared_ptr<JobQuery> current;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_current == nullptr) {
+            return true;
+        }
+        current = _current;
+    }
+    return current->getDescription()->respHandler()->reserveNextBuffer(attempt);
+}
+
+
+size_t ChunkGroupHandler::nextBufferSize() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_jobs.empty()) return 0;
+    if (_current == nullptr) return proto::ProtoHeaderWrap::PROTO_HEADER_SIZE;
+    return _current->getDescription()->respHandler()->nextBufferSize();
+}
+
+
+bool ChunkGroupHandler::flush(int bLen, bool& last, bool& largeResult) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    bool ok = (_current == nullptr) ? _flushHeader(bLen, largeResult) : _flushBody(bLen, largeResult);
+    // Jobs still expecting messages when the worker ends the stream are left to finishJobs().
+    last = last || _jobs.empty();
+    return ok;
+}
+
+
+/// Pass the ProtoHeader in _headerBuf on to the job it names, _mtx must be held.
+bool ChunkGroupHandler::_flushHeader(int bLen, bool& largeResult) {
+    auto response = std::make_shared<proto::WorkerResponse>();
+    if (bLen != static_cast<int>(_headerBuf.size())
+        || !proto::ProtoHeaderWrap::unwrap(response, _headerBuf)
+        || !response->protoHeader.has_jobid()) {
+        _error = Error(ccontrol::MSG_RESULT_DECODE, "Error decoding proto header of a multi-chunk request");
+        return false;
+    }
+    int jobId = response->protoHeader.jobid();
+    auto iter = _jobs.find(jobId);
+    if (iter == _jobs.end()) {
+        _error = Error(ccontrol::MSG_RESULT_ERROR, "Multi-chunk request got a result of unexpected job "
+                       + std::to_string(jobId));
+        return false;
+    }
+    auto job = iter->second;
+    auto handler = job->getDescription()->respHandler();
+    std::vector<char>& buffer = handler->nextBuffer();
+    if (buffer.size() != _headerBuf.size()) {
+        _error = Error(ccontrol::MSG_RESULT_ERROR, job->getIdStr() + " got a header while expecting "
+                       + std::to_string(buffer.size()) + " bytes of results");
+        return false;
+    }
+    std::copy(_headerBuf.begin(), _headerBuf.end(), buffer.begin());
+    bool jobLast = false;
+    if (!handler->flush(buffer.size(), jobLast, largeResult)) {
+        return _fail(job, handler->getError());
+    }
+    _current = job;
+    _bodyLeft = response->protoHeader.size();
+    return true;
+}
+
+
+/// Pass bLen bytes of a Result message on to _current, _mtx must be held.
+bool ChunkGroupHandler::_flushBody(int bLen, bool& largeResult) {
+    auto job = _current;
+    auto handler = job->getDescription()->respHandler();
+    bool jobLast = false;
+    if (!handler->flush(bLen, jobLast, largeResult)) {
+        return _fail(job, handler->getError());
+    }
+    _bodyLeft -= bLen;
+    if (_bodyLeft > 0) {
+        return true;
+    }
+    _current.reset();
+    if (jobLast) {
+        LOGS(_log, LOG_LVL_DEBUG, job->getIdStr() << " complete in multi-chunk request, "
+             << _jobs.size() - 1 << " jobs left");
+        _jobs.erase(job->getIdInt());
+        job->getStatus()->updateInfo(job->getIdStr(), JobStatus::COMPLETE);
+        job->getMarkCompleteFunc()->operator()(true);
+    }
+    return true;
+}
+
+
+/// Record that the results of job failed to merge, _mtx must be held.
+bool ChunkGroupHandler::_fail(std::shared_ptr<JobQuery> const& job, Error const& error) {
+    _failedJob = job;
+    _error = error;
+    return false;
+}
+
+
+void ChunkGroupHandler::errorFlush(std::string const& msg, int code) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _error = Error(code, msg);
+    LOGS(_log, LOG_LVL_WARN, "Multi-chunk request error " << _error);
+}
+
+
+bool ChunkGroupHandler::finished() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _jobs.empty();
+}
+
+
+bool ChunkGroupHandler::reset() {
+    // Only the first attempt is run. The request is not retried, its incomplete
+    // jobs are, by finishJobs().
+    std::lock_guard<std::mutex> lock(_mtx);
+    bool first = !_started;
+    _started = true;
+    return first;
+}
+
+
+std::ostream& ChunkGroupHandler::print(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return os << "ChunkGroupHandler(jobsLeft=" << _jobs.size() << ")";
+}
+
+
+ResponseHandler::Error ChunkGroupHandler::getError() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _error;
+}
+
+
+void ChunkGroupHandler::prepScrubResults(int jobId, int attempt) {
+    // Rows are merged by the handlers of the jobs, under their own attempts.
+}
+
+
+void ChunkGroupHandler::finishJobs(bool success) {
+    std::map<int, std::shared_ptr<JobQuery>> jobs;
+    std::shared_ptr<JobQuery> failedJob;
+    Error error;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        jobs.swap(_jobs);
+        failedJob.swap(_failedJob);
+        _current.reset();
+        error = _error;
+    }
+    if (failedJob != nullptr) {
+        // As for a job on its own, results that cannot be merged are not retried.
+        jobs.erase(failedJob->getIdInt());
+        failedJob->getStatus()->updateInfo(failedJob->getIdStr(), JobStatus::MERGE_ERROR,
+                                           error.getCode(), error.getMsg());
+        failedJob->getMarkCompleteFunc()->operator()(false);
+    }
+    if (jobs.empty()) return;
+    LOGS(_log, LOG_LVL_WARN, "Multi-chunk request " << (success ? "ended" : "failed")
+         << " before " << jobs.size() << " of its jobs completed, running them on their own. "
+         << error);
+    for (auto const& entry : jobs) {
+        auto const& job = entry.second;
+        if (!job->runJob()) {
+            job->getMarkCompleteFunc()->operator()(false);
+        }
+    }
+}
+
+}}} // namespace lsst::qserv::qdisp
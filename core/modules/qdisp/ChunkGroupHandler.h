@@ -0,0 +1,105 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_CHUNKGROUPHANDLER_H
+#define LSST_QSERV_QDISP_CHUNKGROUPHANDLER_H
+
+// System headers
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "qdisp/Executive.h"
+#include "qdisp/ResponseHandler.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+class JobQuery;
+
+/// ChunkGroupHandler handles the responses to a multi-chunk request, which
+/// runs the jobs of several chunks on one worker. The worker sends the
+/// messages of all of them on one stream, each ProtoHeader naming the job
+/// of the Result message following it, and the handler passes each message
+/// on to the ResponseHandler of its job. A job is complete once its last
+/// message was flushed.
+///
+/// If the request fails, or ends without the last message of some jobs,
+/// those jobs are retried on their own by finishJobs(), each with a new
+/// attempt, so the rows already merged for them are scrubbed.
+class ChunkGroupHandler : public ResponseHandler {
+public:
+    typedef std::shared_ptr<ChunkGroupHandler> Ptr;
+
+    /// Calls finishJobs() when the multi-chunk request is done.
+    class CompleteFunc : public MarkCompleteFunc {
+    public:
+        CompleteFunc(std::shared_ptr<ChunkGroupHandler> const& handler)
+            : MarkCompleteFunc(nullptr, 0), _handler(handler) {}
+        void operator()(bool success) override { _handler->finishJobs(success); }
+    private:
+        std::shared_ptr<ChunkGroupHandler> _handler;
+    };
+
+    /// @param jobs the jobs of the request, prepared with JobQuery::runInGroup().
+    explicit ChunkGroupHandler(std::vector<std::shared_ptr<JobQuery>> const& jobs);
+
+    std::vector<char>& nextBuffer() override;
+    size_t nextBufferSize() override;
+    /// Headers need no reservation, the buffer of a Result message is
+    /// reserved by the ResponseHandler of its job.
+    bool reserveNextBuffer(MemoryGovernor::Attempt& attempt) override;
+    bool flush(int bLen, bool& last, bool& largeResult) override;
+    void errorFlush(std::string const& msg, int code) override;
+    bool finished() const override;
+    bool reset() override;
+    std::ostream& print(std::ostream& os) const override;
+    Error getError() const override;
+    void prepScrubResults(int jobId, int attempt) override;
+
+    /// Complete the jobs whose last message did not arrive, by running each
+    /// of them on its own. A job whose results failed to merge fails instead.
+    /// @param success true if the request ended without an error.
+    void finishJobs(bool success);
+
+private:
+    bool _flushHeader(int bLen, bool& largeResult);
+    bool _flushBody(int bLen, bool& largeResult);
+    bool _fail(std::shared_ptr<JobQuery> const& job, Error const& error);
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    std::map<int, std::shared_ptr<JobQuery>> _jobs; ///< Jobs still expecting messages, by id.
+    std::vector<char> _headerBuf;
+    std::shared_ptr<JobQuery> _current; ///< Job of the Result message being received.
+    int _bodyLeft{0}; ///< Bytes of the Result message of _current still to come.
+    std::shared_ptr<JobQuery> _failedJob; ///< Job whose results could not be merged.
+    bool _started{false}; ///< Set by reset() before the request is sent.
+    Error _error;
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_CHUNKGROUPHANDLER_H
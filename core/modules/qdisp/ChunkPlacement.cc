@@ -0,0 +1,50 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/ChunkPlacement.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+void ChunkPlacement::set(std::string const& db, int chunk, std::string const& worker) {
+    if (worker.empty()) return;
+    std::lock_guard<std::mutex> lock(_mtx);
+    _workers[std::make_pair(db, chunk)] = worker;
+}
+
+
+std::string ChunkPlacement::find(std::string const& db, int chunk) const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto it = _workers.find(std::make_pair(db, chunk));
+    return it == _workers.end() ? std::string() : it->second;
+}
+
+
+ChunkPlacement& ChunkPlacement::get() {
+    static ChunkPlacement placement;
+    return placement;
+}
+
+}}} // namespace lsst::qserv::qdisp
@@ -0,0 +1,65 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_CHUNKPLACEMENT_H
+#define LSST_QSERV_QDISP_CHUNKPLACEMENT_H
+
+// System headers
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// ChunkPlacement remembers which worker answered the last request for
+/// each chunk, as learned from the XrdSsi endpoint of the responses, so
+/// that the Executive can send the jobs of later queries on chunks of the
+/// same worker together in one multi-chunk request. It is only a hint: a
+/// worker rejects a multi-chunk request with a chunk it does not have, and
+/// the jobs are then sent one by one.
+class ChunkPlacement {
+public:
+    ChunkPlacement() = default;
+    ChunkPlacement(ChunkPlacement const&) = delete;
+    ChunkPlacement& operator=(ChunkPlacement const&) = delete;
+
+    /// Record that worker answered a request for chunk of db.
+    void set(std::string const& db, int chunk, std::string const& worker);
+
+    /// @return the worker that last answered for chunk of db, or an empty
+    ///         string if none did.
+    std::string find(std::string const& db, int chunk) const;
+
+    /// @return the instance shared by all queries of the czar.
+    static ChunkPlacement& get();
+
+private:
+    mutable std::mutex _mtx; ///< Protects _workers.
+    std::map<std::pair<std::string, int>, std::string> _workers;
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_CHUNKPLACEMENT_H
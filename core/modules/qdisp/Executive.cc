@@ -60,10 +60,14 @@
 #include "ccontrol/msgCode.h"
 #include "global/Bug.h"
 #include "global/ResourceUnit.h"
+#include "qdisp/ChunkGroupHandler.h"
+#include "qdisp/ChunkPlacement.h"
+#include "qdisp/HedgedJob.h"
 #include "qdisp/JobQuery.h"
 #include "qdisp/MessageStore.h"
 #include "qdisp/QueryRequest.h"
 #include "qdisp/ResponseHandler.h"
+#include "qdisp/WorkerLimiter.h"
 #include "qdisp/XrdSsiMocks.h"
 #include "util/EventThread.h"
 
@@ -81,6 +85,10 @@ std::string getErrorText(XrdSsiErrInfo & e) {
     return os.str();
 }
 
+/// Jobs running for less than this do not get a duplicate request, which
+/// would not gain much.
+double const HEDGE_MIN_SECONDS = 5.0;
+
 } // anonymous namespace
 
 namespace lsst {
@@ -176,11 +184,130 @@ JobQuery::Ptr Executive::add(JobDescription::Ptr const& jobDesc) {
         endQSEASum += timeDiff(trackQSEA, endQSEA);
     }
     //_queueJobStart(jobQuery);
-    jobQuery->runJob();
+    _runOrGroup(jobQuery);
     return jobQuery;
 }
 
 
+/// Run jobQuery, or for a scan, add it to the multi-chunk request for the worker
+/// known to have its chunk, which is sent once it has maxChunksPerRequest jobs.
+/// Scans on a known worker run once the WorkerLimiter lets them.
+void Executive::_runOrGroup(JobQuery::Ptr const& jobQuery) {
+    if (jobQuery->getDescription()->getScanInteractive()) {
+        jobQuery->runJob();
+        return;
+    }
+    auto const& resource = jobQuery->getDescription()->resource();
+    std::string worker = ChunkPlacement::get().find(resource.db(), resource.chunk());
+    if (_config.maxChunksPerRequest > 1 && !worker.empty()) {
+        std::vector<JobQuery::Ptr> group;
+        {
+            std::lock_guard<std::mutex> lock(_groupsMtx);
+            auto& pending = _pendingGroups[worker];
+            pending.push_back(jobQuery);
+            if (static_cast<int>(pending.size()) < _config.maxChunksPerRequest) return;
+            group.swap(pending);
+        }
+        _runLimited(worker, group);
+        return;
+    }
+    _runLimited(worker, {jobQuery});
+}
+
+
+/// Run jobs, a single one on its own or several in a multi-chunk request, once
+/// the WorkerLimiter lets that many more jobs be in flight on worker. Deferred
+/// starts are queued on the QdispPool, as they come from completing jobs.
+void Executive::_runLimited(std::string const& worker, std::vector<JobQuery::Ptr> const& jobs) {
+    std::weak_ptr<Executive> weakThis = shared_from_this();
+    QueryId const queryId = _id;
+    auto deferredStart = [weakThis, worker, jobs, queryId]() {
+        auto exec = weakThis.lock();
+        if (exec == nullptr) {
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                WorkerLimiter::get().release(worker, queryId, 0, false);
+            }
+            return;
+        }
+        auto cmd = std::make_shared<PriorityCommand>([exec, worker, jobs](util::CmdData*) {
+            exec->_runGranted(worker, jobs);
+        });
+        exec->_qdispPool->queCmdHigh(cmd);
+    };
+    if (WorkerLimiter::get().start(worker, jobs.size(), deferredStart)) {
+        _runGranted(worker, jobs);
+    }
+}
+
+
+/// Run jobs the WorkerLimiter counted as in flight on worker, until they complete.
+void Executive::_runGranted(std::string const& worker, std::vector<JobQuery::Ptr> const& jobs) {
+    if (!worker.empty()) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(_slotsMtx);
+        for (auto const& job : jobs) {
+            _slots[job->getIdInt()] = std::make_pair(worker, now);
+        }
+    }
+    if (jobs.size() > 1) {
+        _runGroup(jobs);
+    } else if (!jobs.front()->runJob()) {
+        _releaseSlot(jobs.front()->getIdInt(), false);
+    }
+}
+
+
+/// Let the WorkerLimiter know that a job it counted is no longer in flight.
+void Executive::_releaseSlot(int jobId, bool success) {
+    std::string worker;
+    std::chrono::duration<double> latency;
+    {
+        std::lock_guard<std::mutex> lock(_slotsMtx);
+        auto iter = _slots.find(jobId);
+        if (iter == _slots.end()) return;
+        worker = iter->second.first;
+        latency = std::chrono::steady_clock::now() - iter->second.second;
+        _slots.erase(iter);
+    }
+    WorkerLimiter::get().release(worker, _id, latency.count(), success);
+}
+
+
+/// Send jobs in one multi-chunk request. Their results are passed on to
+/// their own handlers by a ChunkGroupHandler.
+void Executive::_runGroup(std::vector<JobQuery::Ptr> const& jobs) {
+    std::vector<JobQuery::Ptr> members;
+    std::vector<JobDescription::Ptr> descs;
+    for (auto const& job : jobs) {
+        if (job->runInGroup()) {
+            members.push_back(job);
+            descs.push_back(job->getDescription());
+        } else {
+            _releaseSlot(job->getIdInt(), false);
+        }
+    }
+    if (members.empty()) return;
+    int groupId;
+    {
+        std::lock_guard<std::mutex> lock(_groupsMtx);
+        groupId = -(++_groupCount); // Job ids are not negative.
+    }
+    auto handler = std::make_shared<ChunkGroupHandler>(members);
+    auto groupDesc = JobDescription::createGroup(_id, groupId, descs, handler);
+    auto mcf = std::make_shared<ChunkGroupHandler::CompleteFunc>(handler);
+    auto groupJob = JobQuery::create(shared_from_this(), groupDesc, std::make_shared<JobStatus>(), mcf, _id);
+    {
+        std::lock_guard<std::mutex> lock(_groupsMtx);
+        _groupJobs.push_back(groupJob);
+    }
+    LOGS(_log, LOG_LVL_DEBUG, groupJob->getIdStr() << " multi-chunk request of " << members.size()
+         << " jobs with path=" << groupDesc->resource().path());
+    if (!groupJob->runJob()) {
+        handler->finishJobs(false);
+    }
+}
+
+
 void Executive::queueJobStart(PriorityCommand::Ptr const& cmd, bool scanInteractive) {
     _jobStartCmdList.push_back(cmd);
     if (scanInteractive) {
@@ -201,6 +328,17 @@ void Executive::waitForAllJobsToStart() {
         _jobStartCmdList.pop_front();
         cmd->waitComplete();
     }
+    // No more jobs will join the multi-chunk requests that are not full.
+    std::map<std::string, std::vector<JobQuery::Ptr>> pendingGroups;
+    {
+        std::lock_guard<std::mutex> lock(_groupsMtx);
+        pendingGroups.swap(_pendingGroups);
+    }
+    for (auto const& entry : pendingGroups) {
+        if (!entry.second.empty()) {
+            _runLimited(entry.first, entry.second);
+        }
+    }
     LOGS(_log, LOG_LVL_INFO, _idStr << " waitForAllJobsToStart done");
 }
 
@@ -209,7 +347,7 @@ void Executive::waitForAllJobsToStart() {
 // If the executive has not been cancelled, then we simply start the query.
 // @return true if query was actually started (i.e. we were not cancelled)
 //
-bool Executive::startQuery(std::shared_ptr<JobQuery> const& jobQuery) {
+bool Executive::startQuery(std::shared_ptr<JobQuery> const& jobQuery, std::string const& avoidHost) {
 
     std::lock_guard<std::recursive_mutex> lock(_cancelled.getMutex());
 
@@ -221,6 +359,7 @@ bool Executive::startQuery(std::shared_ptr<JobQuery> const& jobQuery) {
     // For now, we don't set any other attributes except the resource name.
     //
     XrdSsiResource jobResource(jobQuery->getDescription()->resource().path());
+    jobResource.hAvoid = avoidHost;
 
     // Now construct the actual query request and tie it to the jobQuery. The
     // shared pointer is used by QueryRequest to keep itself alive, sloppy design.
@@ -229,6 +368,10 @@ bool Executive::startQuery(std::shared_ptr<JobQuery> const& jobQuery) {
     QueryRequest::Ptr qr = QueryRequest::create(jobQuery);
     jobQuery->setQueryRequest(qr);
 
+    if (_config.hedgeCompletedPercent > 0) {
+        _recordStart(jobQuery);
+    }
+
     // Start the query. The rest is magically done in the background.
     //
     getXrdSsiService()->ProcessRequest(*(qr.get()), jobResource);
@@ -263,15 +406,18 @@ bool Executive::join() {
         std::lock_guard<std::recursive_mutex> lockJobMap(_jobMapMtx);
         sCount = std::count_if(_jobMap.begin(), _jobMap.end(), successF::f);
     }
+    bool empty = (sCount == _requestCount) || _limitRowComplete;
     if (sCount == _requestCount) {
         LOGS(_log, LOG_LVL_DEBUG, "Query execution succeeded: " << _requestCount
              << " jobs dispatched and completed.");
+    } else if (_limitRowComplete) {
+        LOGS(_log, LOG_LVL_DEBUG, "Query execution succeeded: " << _resultRows
+             << " rows found by " << sCount << " of " << _requestCount << " jobs dispatched.");
     } else {
         LOGS(_log, LOG_LVL_ERROR, "Query execution failed: " << _requestCount
              << " jobs dispatched, but only " << sCount << " jobs completed");
     }
     _updateProxyMessages();
-    bool empty = (sCount == _requestCount);
     _empty.store(empty);
     LOGS(_log, LOG_LVL_DEBUG, "Flag set to _empty=" << empty << ", sCount=" << sCount
          << ", requestCount=" << _requestCount);
@@ -279,6 +425,24 @@ bool Executive::join() {
 }
 
 void Executive::markCompleted(int jobId, bool success) {
+    if (_completesHedged(jobId, false, success)) {
+        _markCompleted(jobId, success);
+    }
+}
+
+
+void Executive::markHedgeCompleted(int jobId, bool success) {
+    if (_completesHedged(jobId, true, success)) {
+        _markCompleted(jobId, success);
+    }
+}
+
+
+void Executive::_markCompleted(int jobId, bool success) {
+    _releaseSlot(jobId, success);
+    if (_config.hedgeCompletedPercent > 0) {
+        _recordEnd(jobId, success);
+    }
     ResponseHandler::Error err;
     std::string idStr = QueryIdHelper::makeIdStr(_id, jobId);
     LOGS(_log, LOG_LVL_DEBUG, "Executive::markCompleted " << idStr
@@ -304,6 +468,13 @@ void Executive::markCompleted(int jobId, bool success) {
                 return;
             }
         }
+        if (_limitRowComplete) {
+            // Squashed because enough rows were found, nothing was lost.
+            LOGS(_log, LOG_LVL_DEBUG, "Executive: " << idStr << " cancelled after row limit "
+                 << _rowLimit << " was reached");
+            _unTrack(jobId);
+            return;
+        }
         LOGS(_log, LOG_LVL_ERROR, "Executive: error executing " << idStr
              << " " << err << " (status: " << err.getStatus() << ")");
         {
@@ -328,6 +499,23 @@ void Executive::markCompleted(int jobId, bool success) {
 }
 
 
+void Executive::addResultRows(std::int64_t rows) {
+    int rowLimit = _rowLimit;
+    if (rowLimit == NOTSET) return;
+    std::int64_t total = (_resultRows += rows);
+    if (total < rowLimit) return;
+    {
+        std::lock_guard<std::recursive_mutex> lock(_cancelled.getMutex());
+        // A query that already failed or was killed keeps its error.
+        if (_cancelled || _limitRowComplete) return;
+        _limitRowComplete = true;
+    }
+    LOGS(_log, LOG_LVL_INFO, getIdStr() << " Executive: " << total << " rows reached LIMIT "
+         << rowLimit << ", squashing remaining jobs");
+    squash();
+}
+
+
 void Executive::squash() {
     bool alreadyCancelled = _cancelled.exchange(true);
     if (alreadyCancelled) {
@@ -343,6 +531,16 @@ void Executive::squash() {
             jobsToCancel.push_back(jobEntry.second);
         }
     }
+    {
+        std::lock_guard<std::mutex> lock(_groupsMtx);
+        jobsToCancel.insert(jobsToCancel.end(), _groupJobs.begin(), _groupJobs.end());
+    }
+    {
+        std::lock_guard<std::mutex> lock(_hedgeMtx);
+        for (auto const& entry : _hedgedJobs) {
+            jobsToCancel.push_back(entry.second->getHedge());
+        }
+    }
 
     for (auto const& job : jobsToCancel) {
             job->cancel();
@@ -497,6 +695,9 @@ void Executive::_waitAllUntilEmpty() {
     int moreDetailThreshold = 5;
     int complainCount = 0;
     const std::chrono::seconds statePrintDelay(5);
+    // Stragglers are looked for more often than the state is printed.
+    bool const hedging = _config.hedgeCompletedPercent > 0;
+    const std::chrono::seconds hedgeDelay(1);
     while(!_incompleteJobs.empty()) {
         count = _incompleteJobs.size();
         if (count != lastCount) {
@@ -515,7 +716,107 @@ void Executive::_waitAllUntilEmpty() {
                 lock.lock();
             }
         }
-        _allJobsComplete.wait_for(lock, statePrintDelay);
+        if (hedging) {
+            _allJobsComplete.wait_for(lock, hedgeDelay);
+            lock.unlock();
+            _hedgeStragglers();
+            lock.lock();
+        } else {
+            _allJobsComplete.wait_for(lock, statePrintDelay);
+        }
+    }
+}
+
+
+/// @return true if the completion of a request of jobId completes the job,
+/// which it does unless the job has a duplicate request that decides.
+bool Executive::_completesHedged(int jobId, bool fromHedge, bool success) {
+    HedgedJob::Ptr hedged;
+    {
+        std::lock_guard<std::mutex> lock(_hedgeMtx);
+        auto iter = _hedgedJobs.find(jobId);
+        if (iter == _hedgedJobs.end()) return true;
+        hedged = iter->second;
+    }
+    return hedged->complete(fromHedge, success);
+}
+
+
+/// Record when a job running on its own was sent. Jobs of multi-chunk
+/// requests and duplicate requests are not in _jobMap under their own id.
+void Executive::_recordStart(JobQuery::Ptr const& jobQuery) {
+    int jobId = jobQuery->getIdInt();
+    {
+        std::lock_guard<std::recursive_mutex> lockJobMap(_jobMapMtx);
+        auto iter = _jobMap.find(jobId);
+        if (iter == _jobMap.end() || iter->second != jobQuery) return;
+    }
+    std::lock_guard<std::mutex> lock(_hedgeMtx);
+    _startTimes[jobId] = std::chrono::steady_clock::now(); // A retry starts over.
+}
+
+
+/// Record how long a job that ran on its own took, if it succeeded.
+void Executive::_recordEnd(int jobId, bool success) {
+    std::lock_guard<std::mutex> lock(_hedgeMtx);
+    auto iter = _startTimes.find(jobId);
+    if (iter == _startTimes.end()) return;
+    if (success) {
+        std::chrono::duration<double> latency = std::chrono::steady_clock::now() - iter->second;
+        _latencies.push_back(latency.count());
+    }
+    _startTimes.erase(iter);
+}
+
+
+/// Once hedgeCompletedPercent of the jobs completed, send a duplicate request
+/// of each job running hedgeLatencyFactor times longer than the median job.
+/// Not done with a row limit, where the rows of both requests would be counted.
+void Executive::_hedgeStragglers() {
+    if (_cancelled || _rowLimit != NOTSET) return;
+    int requestCount = _requestCount;
+    int completed = requestCount - getNumInflight();
+    if (requestCount == 0 || completed * 100 < requestCount * _config.hedgeCompletedPercent) return;
+
+    std::vector<int> stragglers;
+    {
+        std::lock_guard<std::mutex> lock(_hedgeMtx);
+        if (_latencies.empty()) return;
+        auto median = _latencies.begin() + _latencies.size() / 2;
+        std::nth_element(_latencies.begin(), median, _latencies.end());
+        std::chrono::duration<double> limit(std::max(*median * _config.hedgeLatencyFactor, HEDGE_MIN_SECONDS));
+        auto now = std::chrono::steady_clock::now();
+        for (auto const& entry : _startTimes) {
+            if (now - entry.second > limit && _hedgedJobs.count(entry.first) == 0) {
+                stragglers.push_back(entry.first);
+            }
+        }
+    }
+    for (int jobId : stragglers) {
+        JobQuery::Ptr job;
+        {
+            std::lock_guard<std::recursive_mutex> lockJobMap(_jobMapMtx);
+            job = _jobMap[jobId];
+        }
+        _hedge(job);
+    }
+}
+
+
+/// Send a duplicate request of job to another worker, see HedgedJob.
+void Executive::_hedge(JobQuery::Ptr const& job) {
+    auto desc = job->getDescription();
+    auto handler = desc->respHandler()->makeHedge();
+    if (handler == nullptr) return;
+    auto hedgeDesc = JobDescription::createHedge(desc, handler);
+    auto hedged = std::make_shared<HedgedJob>(job, HedgedJob::createHedgeJob(shared_from_this(), hedgeDesc));
+    {
+        // Registered before it is sent, so the completion of either request finds it.
+        std::lock_guard<std::mutex> lock(_hedgeMtx);
+        if (!_hedgedJobs.emplace(job->getIdInt(), hedged).second) return;
+    }
+    if (!hedged->start()) {
+        markHedgeCompleted(job->getIdInt(), false);
     }
 }
 
@@ -28,12 +28,16 @@
 
 // System headers
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <mutex>
 #include <sstream>
 #include <unordered_map>
 #include <vector>
 
 // Qserv headers
+#include "global/constants.h"
 #include "global/intTypes.h"
 #include "global/ResourceUnit.h"
 #include "global/stringTypes.h"
@@ -54,6 +58,7 @@ namespace lsst {
 namespace qserv {
 namespace qdisp {
 
+class HedgedJob;
 class JobQuery;
 class LargeResultMgr;
 class MessageStore;
@@ -73,6 +78,13 @@ public:
         Config(int,int) : serviceUrl(getMockStr()) {}
 
         std::string serviceUrl; ///< XrdSsi service URL, e.g. localhost:1094
+        /// Jobs on chunks of the same worker sent together in one multi-chunk request.
+        int maxChunksPerRequest{1};
+        /// Once this percentage of jobs completed, jobs running hedgeLatencyFactor
+        /// times longer than the median job get a duplicate request, see HedgedJob.
+        /// 0 disables duplicate requests.
+        int hedgeCompletedPercent{0};
+        int hedgeLatencyFactor{3};
         static std::string getMockStr() {return "Mock";};
     };
 
@@ -90,7 +102,8 @@ public:
     /// Queue a job to be sent to a worker so it can be started.
     void queueJobStart(PriorityCommand::Ptr const& cmd, bool scanInteractive);
 
-    /// Waits for all jobs on _jobStartCmdList to start. This should not be called
+    /// Waits for all jobs on _jobStartCmdList to start, and sends the
+    /// multi-chunk requests still waiting for jobs. This should not be called
     /// before ALL jobs have been added to the pool.
     void waitForAllJobsToStart();
 
@@ -102,9 +115,25 @@ public:
     /// Notify the executive that an item has completed
     void markCompleted(int refNum, bool success);
 
+    /// Notify the executive that the duplicate request of a job has completed.
+    void markHedgeCompleted(int refNum, bool success);
+
     /// Squash all the jobs.
     void squash();
 
+    /// Set the number of rows that completes the result, or NOTSET to
+    /// require all jobs. Only valid when any rows the jobs return are a
+    /// correct result, i.e. for a LIMIT without ordering or aggregation.
+    void setRowLimit(int rowLimit) { _rowLimit = rowLimit; }
+
+    /// Count the rows of a completely merged job attempt. Once the row limit
+    /// is reached, the remaining jobs are squashed, and their cancellation
+    /// is not an error.
+    void addResultRows(std::int64_t rows);
+
+    /// @return true if the jobs were squashed because the row limit was reached.
+    bool isLimitRowComplete() { return _limitRowComplete; }
+
     bool getEmpty() { return _empty; }
 
     void setQueryId(QueryId id);
@@ -124,7 +153,8 @@ public:
 
     std::shared_ptr<QdispPool> getQdispPool() { return _qdispPool; }
 
-    bool startQuery(std::shared_ptr<JobQuery> const& jobQuery);
+    /// @param avoidHost a worker host the request should not be sent to, if not empty.
+    bool startQuery(std::shared_ptr<JobQuery> const& jobQuery, std::string const& avoidHost=std::string());
 
     std::mutex sumMtx; // TEMPORARY-timing
     int cancelLockQSEASum{0}; // TEMPORARY-timing
@@ -139,6 +169,12 @@ private:
 
     void _setup();
 
+    void _runOrGroup(std::shared_ptr<JobQuery> const& jobQuery);
+    void _runLimited(std::string const& worker, std::vector<std::shared_ptr<JobQuery>> const& jobs);
+    void _runGranted(std::string const& worker, std::vector<std::shared_ptr<JobQuery>> const& jobs);
+    void _runGroup(std::vector<std::shared_ptr<JobQuery>> const& jobs);
+    void _releaseSlot(int jobId, bool success);
+
     bool _track(int refNum, std::shared_ptr<JobQuery> const& r);
     void _unTrack(int refNum);
     bool _addJobToMap(std::shared_ptr<JobQuery> const& job);
@@ -148,6 +184,13 @@ private:
 
     void _waitAllUntilEmpty();
 
+    void _markCompleted(int jobId, bool success);
+    bool _completesHedged(int jobId, bool fromHedge, bool success);
+    void _recordStart(std::shared_ptr<JobQuery> const& jobQuery);
+    void _recordEnd(int jobId, bool success);
+    void _hedgeStragglers();
+    void _hedge(std::shared_ptr<JobQuery> const& job);
+
     // for debugging
     void _printState(std::ostream& os);
 
@@ -161,12 +204,32 @@ private:
 
     std::deque<PriorityCommand::Ptr> _jobStartCmdList; ///< list of jobs to start.
 
+    std::mutex _groupsMtx; ///< Protects _pendingGroups, _groupJobs, and _groupCount.
+    /// Jobs waiting to be sent in a multi-chunk request, by worker.
+    std::map<std::string, std::vector<std::shared_ptr<JobQuery>>> _pendingGroups;
+    std::vector<std::shared_ptr<JobQuery>> _groupJobs; ///< Multi-chunk requests, to squash.
+    int _groupCount{0};
+
+    std::mutex _slotsMtx; ///< Protects _slots.
+    /// Worker and start time of the jobs counted by the WorkerLimiter, by job id.
+    std::map<int, std::pair<std::string, std::chrono::steady_clock::time_point>> _slots;
+
+    std::mutex _hedgeMtx; ///< Protects _startTimes, _latencies, and _hedgedJobs.
+    /// Start times of the jobs running on their own, by job id.
+    std::map<int, std::chrono::steady_clock::time_point> _startTimes;
+    std::vector<double> _latencies; ///< Seconds taken by completed jobs that ran on their own.
+    std::map<int, std::shared_ptr<HedgedJob>> _hedgedJobs; ///< Jobs with a duplicate request, by id.
+
     /** Execution errors */
     util::MultiError _multiError;
 
     std::atomic<int> _requestCount; ///< Count of submitted jobs
     util::Flag<bool> _cancelled {false}; ///< Has execution been cancelled.
 
+    std::atomic<int> _rowLimit{NOTSET}; ///< Rows that complete the result, if set.
+    std::atomic<std::int64_t> _resultRows{0}; ///< Rows of completely merged attempts.
+    std::atomic<bool> _limitRowComplete{false}; ///< Squashed for reaching _rowLimit.
+
     // Mutexes
     std::mutex _incompleteJobsMutex; ///< protect incompleteJobs map.
 
@@ -0,0 +1,187 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/HedgedJob.h"
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "qdisp/ChunkPlacement.h"
+#include "qdisp/JobQuery.h"
+#include "qdisp/QueryRequest.h"
+#include "qdisp/ResponseHandler.h"
+
+namespace {
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.HedgedJob");
+}
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+namespace {
+
+/// The JobQuery of a duplicate request. Its payload is built once by
+/// JobDescription::createHedge(), and it is not retried, as a retry would
+/// take its attempt number beyond the maximum.
+class HedgeJobQuery : public JobQuery {
+public:
+    using JobQuery::JobQuery;
+
+    static std::shared_ptr<HedgeJobQuery> create(Executive::Ptr const& executive,
+            JobDescription::Ptr const& jobDescription, std::shared_ptr<MarkCompleteFunc> const& mcf) {
+        auto jq = std::make_shared<HedgeJobQuery>(executive, jobDescription, std::make_shared<JobStatus>(),
+                                                  mcf, executive->getId());
+        jq->_setup();
+        return jq;
+    }
+
+    bool runJob() override {
+        LOGS(_log, LOG_LVL_DEBUG, _idStr << " duplicate request is not retried");
+        return false;
+    }
+
+    /// Send the request, to a worker other than avoidHost if it is not empty.
+    bool start(std::string const& avoidHost) {
+        auto executive = _executive.lock();
+        if (executive == nullptr || _cancelled || !_jobDescription->respHandler()->reset()) {
+            return false;
+        }
+        std::lock_guard<std::recursive_mutex> lock(_rmutex);
+        _inSsi = true;
+        if (executive->startQuery(shared_from_this(), avoidHost)) {
+            _jobStatus->updateInfo(_idStr, JobStatus::REQUEST);
+            return true;
+        }
+        _inSsi = false;
+        return false;
+    }
+};
+
+} // anonymous namespace
+
+
+std::shared_ptr<JobQuery> HedgedJob::createHedgeJob(Executive::Ptr const& executive,
+                                                    JobDescription::Ptr const& hedgeDesc) {
+    auto mcf = std::make_shared<CompleteFunc>(executive, hedgeDesc->id());
+    return HedgeJobQuery::create(executive, hedgeDesc, mcf);
+}
+
+
+HedgedJob::HedgedJob(std::shared_ptr<JobQuery> const& job, std::shared_ptr<JobQuery> const& hedge)
+    : _job(job), _hedge(hedge) {
+}
+
+
+bool HedgedJob::start() {
+    std::weak_ptr<HedgedJob> weakThis = shared_from_this();
+    _hedge->getDescription()->respHandler()->setMergeGate([weakThis]() {
+        auto hedged = weakThis.lock();
+        return hedged != nullptr && hedged->_claimMerge(true);
+    });
+    bool const gated = _job->getDescription()->respHandler()->setMergeGate([weakThis]() {
+        auto hedged = weakThis.lock();
+        return hedged == nullptr || hedged->_claimMerge(false);
+    });
+    if (!gated) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _merging = Merging::JOB;
+        LOGS(_log, LOG_LVL_INFO, _job->getIdStr() << " rows are being merged, no duplicate request");
+        return false;
+    }
+    auto hedge = std::dynamic_pointer_cast<HedgeJobQuery>(_hedge);
+    if (hedge == nullptr) return false;
+    std::string avoidHost = _getJobHost();
+    LOGS(_log, LOG_LVL_INFO, _job->getIdStr() << " sending a duplicate request, avoiding worker "
+         << (avoidHost.empty() ? "unknown" : avoidHost));
+    return hedge->start(avoidHost);
+}
+
+
+bool HedgedJob::complete(bool fromHedge, bool success) {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_decided) return false;
+        if (!success) {
+            (fromHedge ? _hedgeFailed : _jobFailed) = true;
+            if (!_hedgeFailed || !_jobFailed) {
+                LOGS(_log, LOG_LVL_WARN, _job->getIdStr() << (fromHedge ? " duplicate" : " original")
+                     << " request failed, waiting for the other one");
+                return false;
+            }
+        }
+        _decided = true;
+    }
+    if (!success) return true;
+
+    // The other request was normally cancelled when this one claimed the merge.
+    LOGS(_log, LOG_LVL_INFO, _job->getIdStr() << " completed by the "
+         << (fromHedge ? "duplicate" : "original") << " request");
+    (fromHedge ? _job : _hedge)->cancel();
+    if (fromHedge) {
+        _job->getStatus()->updateInfo(_job->getIdStr(), JobStatus::COMPLETE);
+    }
+    return true;
+}
+
+
+/// Let the first request to merge rows merge them all, and cancel the other.
+/// @return false if the rows of the request must not be merged.
+bool HedgedJob::_claimMerge(bool fromHedge) {
+    Merging const claimant = fromHedge ? Merging::HEDGE : Merging::JOB;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_merging != Merging::NONE) {
+            return _merging == claimant;
+        }
+        _merging = claimant;
+    }
+    LOGS(_log, LOG_LVL_INFO, _job->getIdStr() << " merging rows of the "
+         << (fromHedge ? "duplicate" : "original") << " request, cancelling the other one");
+    (fromHedge ? _job : _hedge)->cancel();
+    return true;
+}
+
+
+/// @return the host of the worker running the job, or an empty string if unknown.
+std::string HedgedJob::_getJobHost() const {
+    std::string endPoint;
+    auto qr = _job->getQueryRequest();
+    if (qr != nullptr) {
+        endPoint = qr->GetEndPoint();
+    }
+    if (endPoint.empty()) {
+        auto const& resource = _job->getDescription()->resource();
+        endPoint = ChunkPlacement::get().find(resource.db(), resource.chunk());
+    }
+    // XrdSsiResource::hAvoid lists host names, without ports.
+    auto colon = endPoint.rfind(':');
+    if (colon != std::string::npos && endPoint.find(']', colon) == std::string::npos) {
+        endPoint.erase(colon);
+    }
+    return endPoint;
+}
+
+}}} // namespace lsst::qserv::qdisp
@@ -0,0 +1,114 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_HEDGEDJOB_H
+#define LSST_QSERV_QDISP_HEDGEDJOB_H
+
+// System headers
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Qserv headers
+#include "qdisp/Executive.h"
+#include "qdisp/JobDescription.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+class JobQuery;
+
+/// HedgedJob pairs a straggling job, one still running long after most jobs
+/// of the user query completed, with a duplicate request of it sent to
+/// another worker holding a replica of its chunk. The duplicate is attempt
+/// JobDescription::HEDGE_ATTEMPT of the job, with its own ResponseHandler.
+/// The first of them to merge rows claims the job, through the merge gates
+/// of their ResponseHandlers, and the other is cancelled before any of its
+/// rows are merged. Rows of a losing request never need to be scrubbed,
+/// which InfileMerger cannot do once rows are loaded untagged, folded, or
+/// published. A job whose rows are already being merged is not hedged.
+/// The job only fails if both requests fail.
+class HedgedJob : public std::enable_shared_from_this<HedgedJob> {
+public:
+    typedef std::shared_ptr<HedgedJob> Ptr;
+
+    /// Passes the completion of the duplicate request to the Executive.
+    class CompleteFunc : public MarkCompleteFunc {
+    public:
+        CompleteFunc(std::shared_ptr<Executive> const& executive, int jobId)
+            : MarkCompleteFunc(nullptr, 0), _executive(executive), _jobId(jobId) {}
+        void operator()(bool success) override {
+            auto exec = _executive.lock();
+            if (exec != nullptr) {
+                exec->markHedgeCompleted(_jobId, success);
+            }
+        }
+    private:
+        std::weak_ptr<Executive> _executive;
+        int _jobId;
+    };
+
+    /// @return the JobQuery of a duplicate request, which is sent once by
+    /// start() and is not retried.
+    static std::shared_ptr<JobQuery> createHedgeJob(std::shared_ptr<Executive> const& executive,
+                                                    JobDescription::Ptr const& hedgeDesc);
+
+    /// @param job the straggling job.
+    /// @param hedge its duplicate, see createHedgeJob().
+    HedgedJob(std::shared_ptr<JobQuery> const& job, std::shared_ptr<JobQuery> const& hedge);
+
+    HedgedJob(HedgedJob const&) = delete;
+    HedgedJob& operator=(HedgedJob const&) = delete;
+
+    std::shared_ptr<JobQuery> getHedge() const { return _hedge; }
+
+    /// Send the duplicate request, to a worker other than the one running the job.
+    /// @return false if it could not be sent, or the rows of the job are
+    ///         being merged already.
+    bool start();
+
+    /// Record the completion of the job's request or of the duplicate. If it
+    /// is the first success, the other request is cancelled.
+    /// @param fromHedge true if the duplicate request completed.
+    /// @return true if this completes the job, with the outcome success.
+    bool complete(bool fromHedge, bool success);
+
+private:
+    enum class Merging { NONE, JOB, HEDGE };
+
+    bool _claimMerge(bool fromHedge);
+    std::string _getJobHost() const;
+
+    std::shared_ptr<JobQuery> const _job;
+    std::shared_ptr<JobQuery> const _hedge;
+
+    std::mutex _mtx; ///< Protects all members below.
+    Merging _merging{Merging::NONE}; ///< The request whose rows are merged, if any.
+    bool _decided{false}; ///< Set once the job is complete.
+    bool _jobFailed{false};
+    bool _hedgeFailed{false};
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_HEDGEDJOB_H
@@ -27,6 +27,7 @@
 #include "qdisp/JobDescription.h"
 
 // System headers
+#include <algorithm>
 #include <sstream>
 
 // LSST headers
@@ -50,6 +51,9 @@ namespace qserv {
 namespace qdisp {
 
 
+int const JobDescription::HEDGE_ATTEMPT;
+
+
 JobDescription::JobDescription(QueryId qId, int jobId, ResourceUnit const& resource,
     std::shared_ptr<ResponseHandler> const& respHandler,
     std::shared_ptr<qproc::TaskMsgFactory> const& taskMsgFactory,
@@ -62,6 +66,29 @@ JobDescription::JobDescription(QueryId qId, int jobId, ResourceUnit const& resou
 }
 
 
+JobDescription::Ptr JobDescription::createGroup(QueryId qId, int groupId,
+        std::vector<JobDescription::Ptr> const& jobs,
+        std::shared_ptr<ResponseHandler> const& respHandler) {
+    auto const& first = jobs.front();
+    JobDescription::Ptr jd(new JobDescription(qId, groupId, first->_resource, respHandler,
+                                              nullptr, first->_chunkQuerySpec,
+                                              first->_chunkResultName, first->_mock));
+    jd->_groupJobs = jobs;
+    return jd;
+}
+
+
+JobDescription::Ptr JobDescription::createHedge(JobDescription::Ptr const& job,
+        std::shared_ptr<ResponseHandler> const& respHandler) {
+    JobDescription::Ptr jd(new JobDescription(job->_queryId, job->_jobId, job->_resource, respHandler,
+                                              job->_taskMsgFactory, job->_chunkQuerySpec,
+                                              job->_chunkResultName, job->_mock));
+    jd->_attemptCount = HEDGE_ATTEMPT;
+    jd->buildPayload();
+    return jd;
+}
+
+
 bool JobDescription::incrAttemptCountScrubResults() {
     if (_attemptCount >= 0) {
         _respHandler->prepScrubResults(_jobId, _attemptCount); // Registers the job-attempt as invalid
@@ -77,15 +104,53 @@ bool JobDescription::incrAttemptCountScrubResults() {
 
 
 void JobDescription::buildPayload() {
+    if (!_groupJobs.empty()) {
+        // The TaskMsg of the first job carries those of the others.
+        proto::TaskMsg msg;
+        bool parsed = msg.ParseFromString(_groupJobs.front()->payload());
+        for (auto it = _groupJobs.begin() + 1; it != _groupJobs.end(); ++it) {
+            auto chunkMsg = msg.add_chunkmsg();
+            parsed = chunkMsg->ParseFromString((*it)->payload()) && parsed;
+            _dropSharedTemplates(msg, *chunkMsg);
+        }
+        if (!parsed && !_mock) {
+            LOGS(_log, LOG_LVL_ERROR, _qIdStr << " Error parsing TaskMsg of a job of the group.");
+        }
+        for (auto const& job : _groupJobs) {
+            job->takePayload();
+        }
+        msg.SerializeToString(&_payload);
+        return;
+    }
     std::ostringstream os;
     _taskMsgFactory->serializeMsg(*_chunkQuerySpec, _chunkResultName, _queryId, _jobId, _attemptCount, os);
-    _payloads[_attemptCount] = os.str();
+    _payload = os.str();
+}
+
+
+std::string JobDescription::takePayload() {
+    std::string payload;
+    payload.swap(_payload);
+    return payload;
+}
+
+
+void JobDescription::_dropSharedTemplates(proto::TaskMsg const& msg, proto::TaskMsg& chunkMsg) {
+    int const nFrags = std::min(msg.fragment_size(), chunkMsg.fragment_size());
+    for (int i = 0; i < nFrags; ++i) {
+        auto const& templates = msg.fragment(i).querytemplate();
+        auto chunkFrag = chunkMsg.mutable_fragment(i);
+        if (templates.size() > 0 && chunkFrag->querytemplate_size() == templates.size()
+            && std::equal(templates.begin(), templates.end(), chunkFrag->querytemplate().begin())) {
+            chunkFrag->clear_querytemplate();
+        }
+    }
 }
 
 
 bool JobDescription::verifyPayload() const {
     proto::ProtoImporter<proto::TaskMsg> pi;
-    if (!_mock && !pi.messageAcceptable(_payloads.at(_attemptCount))) {
+    if (!_mock && !pi.messageAcceptable(_payload)) {
         LOGS(_log, LOG_LVL_DEBUG, _qIdStr << " Error serializing TaskMsg.");
         return false;
     }
@@ -99,7 +164,7 @@ bool JobDescription::getScanInteractive() const {
 
 
 std::ostream& operator<<(std::ostream& os, JobDescription const& jd) {
-    os << "job(id=" << jd._jobId << " payloads.size=" << jd._payloads.size()
+    os << "job(id=" << jd._jobId << " payload.size=" << jd._payload.size()
        << " ru=" << jd._resource.path() << " attemptCount="  << jd._attemptCount << ")";
     return os;
 }
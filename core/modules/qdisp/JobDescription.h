@@ -30,6 +30,7 @@
 // System headers
 #include <memory>
 #include <sstream>
+#include <vector>
 
 // Qserv headers
 #include "global/constants.h"
@@ -41,6 +42,10 @@
 namespace lsst {
 namespace qserv {
 
+namespace proto {
+class TaskMsg;
+} // namespace proto
+
 namespace qproc {
 
 class ChunkQuerySpec;
@@ -69,13 +74,34 @@ public:
         return jd;
     }
 
+    /// @return the description of a multi-chunk request running jobs, all on
+    /// the same worker, whose payloads must already be built. The request
+    /// goes to the resource of the first job, and its responses are handled
+    /// by respHandler.
+    static JobDescription::Ptr createGroup(QueryId qId, int groupId,
+                std::vector<JobDescription::Ptr> const& jobs,
+                std::shared_ptr<ResponseHandler> const& respHandler);
+
+    /// Attempt number of a duplicate request, beyond those of the retries.
+    static int const HEDGE_ATTEMPT = MAX_JOB_ATTEMPTS - 1;
+
+    /// @return the description of a duplicate request of job, see HedgedJob,
+    /// whose responses are handled by respHandler. Its payload is built for
+    /// attempt HEDGE_ATTEMPT, so its rows are told apart from those of job.
+    static JobDescription::Ptr createHedge(JobDescription::Ptr const& job,
+                std::shared_ptr<ResponseHandler> const& respHandler);
+
     JobDescription(JobDescription const&) = delete;
     JobDescription& operator=(JobDescription const&) = delete;
 
     void buildPayload(); ///< Must be run after construction to avoid problems with unit tests.
+    QueryId getQueryId() const { return _queryId; }
     int id() const { return _jobId; }
     ResourceUnit const& resource() const { return _resource; }
-    std::string const& payload()  { return _payloads[_attemptCount]; }
+    std::string const& payload()  { return _payload; }
+    /// @return the payload of the current attempt, which is left empty. The
+    /// request sending it owns it from then on, and releases it once sent.
+    std::string takePayload();
     std::shared_ptr<ResponseHandler> respHandler() { return _respHandler; }
     int getAttemptCount() const { return _attemptCount; }
 
@@ -94,24 +120,29 @@ private:
             std::shared_ptr<qproc::TaskMsgFactory> const& taskMsgFactory,
             std::shared_ptr<qproc::ChunkQuerySpec> const& chunkQuerySpec,
             std::string const& chunkResultName, bool mock=false);
+
+    /// Clear the query templates of the fragments of chunkMsg that are the
+    /// same as those of msg, which the worker uses in their place.
+    static void _dropSharedTemplates(proto::TaskMsg const& msg, proto::TaskMsg& chunkMsg);
+
     QueryId _queryId;
     int _jobId; ///< Job's Id number.
     std::string const _qIdStr;
     int _attemptCount{-1}; ///< Start at -1 so that first attempt will be 0, see incrAttemptCount().
     ResourceUnit _resource; ///< path, e.g. /q/LSST/23125
 
-    /// _payloads - encoded requests, one per attempt. No guarantee that xrootd is done
-    /// with the payload buffer, so hang onto all of them until the query is finished.
-    /// Also, using a map so the strings wont be moved.
-    /// The xrootd callback function QueryRequest::GetRequest should
-    /// return something other than a char*.
-    std::map<int, std::string> _payloads;
+    /// Encoded request of the current attempt, built by buildPayload() just
+    /// before it is sent, and taken by the QueryRequest sending it, see
+    /// takePayload(). The payloads of a multi-chunk request are released
+    /// once the request carrying them is built.
+    std::string _payload;
     std::shared_ptr<ResponseHandler> _respHandler; // probably MergingHandler
     std::shared_ptr<qproc::TaskMsgFactory> _taskMsgFactory;
     std::shared_ptr<qproc::ChunkQuerySpec> _chunkQuerySpec;
     std::string _chunkResultName;
 
     bool _mock{false}; ///< True if this is a mock in a unit test.
+    std::vector<Ptr> _groupJobs; ///< Jobs of a multi-chunk request, see createGroup().
 };
 std::ostream& operator<<(std::ostream& os, JobDescription const& jd);
 
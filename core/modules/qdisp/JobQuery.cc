@@ -73,27 +73,8 @@ bool JobQuery::runJob() {
     bool cancelled = executive->getCancelled();
     bool handlerReset = _jobDescription->respHandler()->reset();
     if (!cancelled && handlerReset) {
-        auto criticalErr = [this, &executive](std::string const& msg) {
-            LOGS(_log, LOG_LVL_ERROR, _idStr << " " << msg << " "
-                 << _jobDescription << " Canceling user query!");
-            executive->squash(); // This should kill all jobs in this user query.
-        };
-
-        LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob checking attempt=" << _jobDescription->getAttemptCount());
         std::lock_guard<std::recursive_mutex> lock(_rmutex);
-        if (_jobDescription->getAttemptCount() < _getMaxAttempts()) {
-            bool okCount = _jobDescription->incrAttemptCountScrubResults();
-            if (!okCount) {
-                criticalErr("hit structural max of retries");
-                return false;
-            }
-            if (!_jobDescription->verifyPayload()) {
-                criticalErr("bad payload");
-                return false;
-            }
-        } else {
-            LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob max retries");
-            criticalErr("hit maximum number of retries");
+        if (!_nextAttempt(executive)) {
             return false;
         }
 
@@ -116,6 +97,66 @@ bool JobQuery::runJob() {
     return false;
 }
 
+/** Prepare the next attempt of the job, to be sent to the worker in the
+ * multi-chunk request of a group of jobs instead of on its own.
+ * @return - false if the job cannot be run, as for runJob().
+ */
+bool JobQuery::runInGroup() {
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " runInGroup " << *this);
+    auto executive = _executive.lock();
+    if (executive == nullptr) {
+        LOGS(_log, LOG_LVL_ERROR, _idStr << "runInGroup failed executive==nullptr");
+        return false;
+    }
+    bool cancelled = executive->getCancelled();
+    bool handlerReset = _jobDescription->respHandler()->reset();
+    if (!cancelled && handlerReset) {
+        std::lock_guard<std::recursive_mutex> lock(_rmutex);
+        if (!_nextAttempt(executive)) {
+            return false;
+        }
+        _jobStatus->updateInfo(_idStr, JobStatus::REQUEST);
+        return true;
+    }
+    LOGS(_log, LOG_LVL_WARN, _idStr << " runInGroup failed. cancelled=" << cancelled
+              << " reset=" << handlerReset);
+    return false;
+}
+
+/// Build the payload of the next attempt, _rmutex must be held.
+/// @return false if there cannot be another attempt, in which case the user query is squashed.
+bool JobQuery::_nextAttempt(Executive::Ptr const& executive) {
+    auto criticalErr = [this, &executive](std::string const& msg) {
+        LOGS(_log, LOG_LVL_ERROR, _idStr << " " << msg << " "
+             << _jobDescription << " Canceling user query!");
+        executive->squash(); // This should kill all jobs in this user query.
+    };
+
+    int const attempt = _jobDescription->getAttemptCount();
+    LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob checking attempt=" << attempt);
+    if (attempt >= 0 && !_jobDescription->respHandler()->canScrubResults(_jobDescription->id(), attempt)) {
+        // Retrying would return the rows of both attempts.
+        criticalErr("rows of the failed attempt cannot be removed from the result, no retry");
+        return false;
+    }
+    if (attempt < _getMaxAttempts()) {
+        bool okCount = _jobDescription->incrAttemptCountScrubResults();
+        if (!okCount) {
+            criticalErr("hit structural max of retries");
+            return false;
+        }
+        if (!_jobDescription->verifyPayload()) {
+            criticalErr("bad payload");
+            return false;
+        }
+    } else {
+        LOGS(_log, LOG_LVL_DEBUG, _idStr << " runJob max retries");
+        criticalErr("hit maximum number of retries");
+        return false;
+    }
+    return true;
+}
+
 /// Cancel response handling. Return true if this is the first time cancel has been called.
 bool JobQuery::cancel() {
     LOGS(_log, LOG_LVL_DEBUG, _idStr << " JobQuery::cancel()");
@@ -138,12 +179,7 @@ bool JobQuery::cancel() {
             os << _idStr <<" cancel QueryRequest=" << _queryRequestPtr ;
             LOGS(_log, LOG_LVL_DEBUG, os.str());
             getDescription()->respHandler()->errorFlush(os.str(), -1);
-            auto executive = _executive.lock();
-            if (executive == nullptr) {
-                LOGS(_log, LOG_LVL_ERROR, " can't markComplete cancelled, executive == nullptr");
-                return false;
-            }
-            executive->markCompleted(getIdInt(), false);
+            _markCompleteFunc->operator()(false);
         }
         _jobDescription->respHandler()->processCancel();
         return true;
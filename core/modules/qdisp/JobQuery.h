@@ -62,6 +62,7 @@ public:
 
     virtual ~JobQuery();
     virtual bool runJob();
+    bool runInGroup();
 
     int getIdInt() const { return _jobDescription->id(); }
     std::string const& getIdStr() const { return _idStr; }
@@ -99,6 +100,8 @@ protected:
         _jobDescription->respHandler()->setJobQuery(shared_from_this());
     }
 
+    bool _nextAttempt(Executive::Ptr const& executive);
+
     int _getRunAttemptsCount() const {
         std::lock_guard<std::recursive_mutex> lock(_rmutex);
         return _jobDescription->getAttemptCount();
@@ -0,0 +1,70 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_QSERV_QDISP_JOBTESTFIXTURE_H
+#define LSST_QSERV_QDISP_JOBTESTFIXTURE_H
+
+// System headers
+#include <memory>
+#include <vector>
+
+// Qserv headers
+#include "qdisp/Executive.h"
+#include "qdisp/JobQuery.h"
+#include "qdisp/MessageStore.h"
+#include "qdisp/XrdSsiMocks.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// Records the completion of a job.
+class MockCompleteFunc : public MarkCompleteFunc {
+public:
+    MockCompleteFunc() : MarkCompleteFunc(nullptr, 0) {}
+    void operator()(bool success) override { calls.push_back(success); }
+    std::vector<bool> calls;
+};
+
+/// A mock Executive for the unit tests of the jobs it runs.
+struct JobTestFixture {
+    JobTestFixture() {
+        XrdSsiServiceMock::Reset();
+        auto conf = std::make_shared<Executive::Config>(Executive::Config::getMockStr());
+        executive = Executive::create(conf, std::make_shared<MessageStore>(),
+                                      std::make_shared<QdispPool>());
+    }
+
+    /// @return a job of executive for desc, whose completion is recorded by complete.
+    JobQuery::Ptr createJob(JobDescription::Ptr const& desc,
+                            std::shared_ptr<MockCompleteFunc> const& complete) {
+        return JobQuery::create(executive, desc, std::make_shared<JobStatus>(), complete,
+                                executive->getId());
+    }
+
+    Executive::Ptr executive;
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_JOBTESTFIXTURE_H
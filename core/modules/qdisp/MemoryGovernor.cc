@@ -0,0 +1,212 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/MemoryGovernor.h"
+
+// System headers
+#include <algorithm>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.MemoryGovernor");
+
+std::chrono::seconds const LOG_INTERVAL(60);
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+std::chrono::seconds const MemoryGovernor::MAX_WAIT(60);
+
+
+void MemoryGovernor::configure(std::int64_t maxBytes, int interactivePercent) {
+    std::vector<std::function<void()>> retries;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        interactivePercent = std::min(std::max(interactivePercent, 0), 100);
+        _maxBytes = std::max(maxBytes, std::int64_t(0));
+        _scanMaxBytes = _maxBytes - _maxBytes * interactivePercent / 100;
+        LOGS(_log, LOG_LVL_INFO, "MemoryGovernor maxBytes=" << _maxBytes
+             << " scanMaxBytes=" << _scanMaxBytes);
+        retries = _takeWaiters();
+    }
+    _cv.notify_all();
+    _retry(retries);
+}
+
+
+void MemoryGovernor::reserve(std::int64_t bytes, bool interactive) {
+    if (bytes <= 0) return;
+    std::unique_lock<std::mutex> lock(_mtx);
+    auto start = std::chrono::steady_clock::now();
+    bool granted = _fits(bytes, interactive);
+    bool const waited = !granted;
+    if (waited) {
+        LOGS(_log, LOG_LVL_DEBUG, "MemoryGovernor waiting for " << bytes << " bytes, used="
+             << _stats.usedBytes << " interactive=" << interactive);
+        granted = _cv.wait_for(lock, MAX_WAIT, [this, bytes, interactive]() {
+            return _fits(bytes, interactive);
+        });
+    }
+    _grant(bytes, interactive, waited, start, !granted);
+}
+
+
+bool MemoryGovernor::tryReserve(std::int64_t bytes, bool interactive, Attempt& attempt) {
+    if (bytes <= 0) return true;
+    std::vector<std::function<void()>> retries;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        bool const granted = _fits(bytes, interactive);
+        bool const late = std::chrono::steady_clock::now() - attempt.start >= MAX_WAIT;
+        if (granted || late) {
+            _grant(bytes, interactive, attempt.waited, attempt.start, !granted);
+            return true;
+        }
+        if (!attempt.waited) {
+            LOGS(_log, LOG_LVL_DEBUG, "MemoryGovernor waiting for " << bytes << " bytes, used="
+                 << _stats.usedBytes << " interactive=" << interactive);
+        }
+        attempt.waited = true;
+        if (attempt.retry) {
+            _waiters.push_back(Waiter{bytes, interactive, attempt.start, attempt.retry});
+        }
+        // Attempts parked since MAX_WAIT go through now, rather than with the next release().
+        retries = _takeWaiters();
+    }
+    _retry(retries);
+    return false;
+}
+
+
+void MemoryGovernor::release(std::int64_t bytes, bool interactive) {
+    if (bytes <= 0) return;
+    std::vector<std::function<void()>> retries;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _stats.usedBytes -= bytes;
+        if (interactive) _stats.interactiveBytes -= bytes;
+        retries = _takeWaiters();
+    }
+    _cv.notify_all();
+    _retry(retries);
+}
+
+
+MemoryGovernor::Stats MemoryGovernor::getStats() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _stats;
+}
+
+
+MemoryGovernor& MemoryGovernor::get() {
+    static MemoryGovernor governor;
+    return governor;
+}
+
+
+/// @return true if bytes can be reserved now, _mtx must be held.
+bool MemoryGovernor::_fits(std::int64_t bytes, bool interactive) const {
+    if (_maxBytes == 0 || _stats.usedBytes == 0) {
+        // A buffer larger than the budget is let through once nothing else is held.
+        return true;
+    }
+    if (_stats.usedBytes + bytes > _maxBytes) {
+        return false;
+    }
+    // Interactive reservations beyond their share use the scan share.
+    std::int64_t scanBytes = _stats.usedBytes - _stats.interactiveBytes;
+    return interactive || scanBytes + bytes <= _scanMaxBytes;
+}
+
+
+/// Remove the parked attempts whose bytes fit now, or that were started
+/// MAX_WAIT ago, _mtx must be held.
+/// @return the retry functions of the removed attempts, to call once _mtx
+///         is released.
+std::vector<std::function<void()>> MemoryGovernor::_takeWaiters() {
+    std::vector<std::function<void()>> retries;
+    auto now = std::chrono::steady_clock::now();
+    for (auto iter = _waiters.begin(); iter != _waiters.end();) {
+        if (_fits(iter->bytes, iter->interactive) || now - iter->start >= MAX_WAIT) {
+            retries.push_back(std::move(iter->retry));
+            iter = _waiters.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    return retries;
+}
+
+
+/// Call the retry functions taken by _takeWaiters(), _mtx must not be held.
+void MemoryGovernor::_retry(std::vector<std::function<void()>> const& retries) {
+    for (auto const& retry : retries) {
+        retry();
+    }
+}
+
+
+/// Count bytes as reserved, _mtx must be held.
+/// @param waited whether the reservation had to wait since start.
+/// @param overcommit whether bytes are granted over budget.
+void MemoryGovernor::_grant(std::int64_t bytes, bool interactive, bool waited,
+                            std::chrono::steady_clock::time_point start, bool overcommit) {
+    if (waited) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        ++_stats.waits;
+        _stats.waitMicros += micros;
+        _stats.maxWaitMicros = std::max(_stats.maxWaitMicros, std::uint64_t(micros));
+    }
+    if (overcommit) {
+        ++_stats.overcommits;
+        LOGS(_log, LOG_LVL_WARN, "MemoryGovernor granting " << bytes << " bytes over budget, used="
+             << _stats.usedBytes << " maxBytes=" << _maxBytes);
+    }
+    _stats.usedBytes += bytes;
+    if (interactive) _stats.interactiveBytes += bytes;
+    _logStats();
+}
+
+
+/// Log the counters now and then, _mtx must be held.
+void MemoryGovernor::_logStats() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - _lastLog >= LOG_INTERVAL) {
+        _lastLog = now;
+        LOGS(_log, LOG_LVL_INFO, "MemoryGovernor usedBytes=" << _stats.usedBytes
+             << " interactiveBytes=" << _stats.interactiveBytes << " waits=" << _stats.waits
+             << " waitSeconds=" << _stats.waitMicros / 1.0e6
+             << " maxWaitSeconds=" << _stats.maxWaitMicros / 1.0e6
+             << " overcommits=" << _stats.overcommits);
+    }
+}
+
+}}} // namespace lsst::qserv::qdisp
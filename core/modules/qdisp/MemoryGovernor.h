@@ -0,0 +1,135 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_MEMORYGOVERNOR_H
+#define LSST_QSERV_QDISP_MEMORYGOVERNOR_H
+
+// System headers
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <vector>
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+namespace test {
+    class MemoryGovernorTestHelper;
+}
+
+/// MemoryGovernor bounds the memory all result buffers of the czar hold
+/// while they are filled by XrdSsi and decoded. A buffer reserves its size
+/// before QueryRequest asks XrdSsi for the data to fill it with. While the
+/// budget is exhausted, tryReserve() parks the command asking for the data
+/// instead of holding a dispatch thread, and release() queues it again once
+/// its bytes fit. As the worker is not asked for more data in the meantime,
+/// this backpressures the workers.
+///
+/// A share of the budget is kept for interactive queries, so that scans
+/// holding buffers do not delay them. A reservation that cannot be granted
+/// within MAX_WAIT is granted anyway, to guarantee progress, and counted as
+/// an overcommit.
+class MemoryGovernor {
+    friend class test::MemoryGovernorTestHelper;
+public:
+    /// Counters for monitoring.
+    struct Stats {
+        std::int64_t usedBytes = 0;        ///< Currently reserved
+        std::int64_t interactiveBytes = 0; ///< Currently reserved by interactive queries
+        std::uint64_t waits = 0;           ///< Reservations that had to wait
+        std::uint64_t waitMicros = 0;      ///< Total time spent waiting
+        std::uint64_t maxWaitMicros = 0;   ///< Longest wait
+        std::uint64_t overcommits = 0;     ///< Reservations granted over budget after MAX_WAIT
+    };
+
+    /// Progress of a reservation tried several times with tryReserve().
+    struct Attempt {
+        std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+        bool waited = false; ///< Set once a try found the budget exhausted.
+        /// Called without the governor locked when the bytes may fit, to
+        /// try again. Without it, the caller has to poll tryReserve().
+        std::function<void()> retry;
+    };
+
+    static std::chrono::seconds const MAX_WAIT;
+
+    MemoryGovernor() = default;
+    MemoryGovernor(MemoryGovernor const&) = delete;
+    MemoryGovernor& operator=(MemoryGovernor const&) = delete;
+
+    /// Set the budget. 0 maxBytes means no limit.
+    /// @param interactivePercent percentage of maxBytes only interactive
+    ///                           queries may use.
+    void configure(std::int64_t maxBytes, int interactivePercent);
+
+    /// Reserve bytes, waiting until the budget allows it.
+    void reserve(std::int64_t bytes, bool interactive);
+
+    /// Reserve bytes if the budget allows it now, or once attempt started
+    /// MAX_WAIT ago. This never waits.
+    /// @return false if the bytes were not reserved. attempt.retry is then
+    ///         parked until release() or configure() frees enough memory,
+    ///         or MAX_WAIT has passed, and the caller should try again with
+    ///         the same attempt when it is called.
+    bool tryReserve(std::int64_t bytes, bool interactive, Attempt& attempt);
+
+    /// Give back bytes reserved with the same interactive flag, and call the
+    /// retry of the parked attempts that fit now.
+    void release(std::int64_t bytes, bool interactive);
+
+    Stats getStats() const;
+
+    /// @return the instance shared by all result buffers of the czar.
+    static MemoryGovernor& get();
+
+private:
+    /// An attempt parked by tryReserve().
+    struct Waiter {
+        std::int64_t bytes;
+        bool interactive;
+        std::chrono::steady_clock::time_point start;
+        std::function<void()> retry;
+    };
+
+    bool _fits(std::int64_t bytes, bool interactive) const;
+    std::vector<std::function<void()>> _takeWaiters();
+    static void _retry(std::vector<std::function<void()>> const& retries);
+    void _grant(std::int64_t bytes, bool interactive, bool waited,
+                std::chrono::steady_clock::time_point start, bool overcommit);
+    void _logStats();
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    std::condition_variable _cv;
+    std::int64_t _maxBytes{0};
+    std::int64_t _scanMaxBytes{0}; ///< Part of _maxBytes non interactive queries may use.
+    Stats _stats;
+    std::list<Waiter> _waiters; ///< Parked attempts, oldest first.
+    std::chrono::steady_clock::time_point _lastLog{std::chrono::steady_clock::now()};
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_MEMORYGOVERNOR_H
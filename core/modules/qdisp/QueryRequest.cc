@@ -42,6 +42,8 @@
 
 // Qserv headers
 #include "czar/Czar.h"
+#include "global/ResourceUnit.h"
+#include "qdisp/ChunkPlacement.h"
 #include "qdisp/JobStatus.h"
 #include "qdisp/ResponseHandler.h"
 #include "util/common.h"
@@ -56,7 +58,8 @@ namespace qdisp {
 
 
 // Run action() when the system expects to have time to accept data.
-class QueryRequest::AskForResponseDataCmd : public PriorityCommand {
+class QueryRequest::AskForResponseDataCmd : public PriorityCommand,
+        public std::enable_shared_from_this<QueryRequest::AskForResponseDataCmd> {
 public:
     typedef std::shared_ptr<AskForResponseDataCmd> Ptr;
     enum class State { STARTED0, DATAREADY1, DONE2 };
@@ -81,7 +84,36 @@ public:
                 _setState(State::DONE2);
                 return;
             }
+            // The memory of the buffer is reserved from the MemoryGovernor. While there
+            // is none, the command is parked in the governor rather than holding a pool
+            // thread, the worker is not asked for more data, and the governor queues
+            // the command again once memory is released.
+            if (!_memoryAttempt.retry) {
+                std::weak_ptr<AskForResponseDataCmd> cmdWeak = shared_from_this();
+                _memoryAttempt.retry = [cmdWeak]() {
+                    auto cmd = cmdWeak.lock();
+                    if (cmd == nullptr) return;
+                    auto jq = cmd->_jQuery.lock();
+                    auto qr = cmd->_qRequest.lock();
+                    if (jq == nullptr || qr == nullptr) {
+                        LOGS(_log, LOG_LVL_WARN, cmd->_idStr << " AskForResponseData null while waiting for memory");
+                        cmd->_setState(State::DONE2);
+                        return;
+                    }
+                    qr->_queueAskForResponse(cmd, jq);
+                };
+            }
+            if (!jq->getDescription()->respHandler()->reserveNextBuffer(_memoryAttempt)) {
+                LOGS(_log, LOG_LVL_TRACE, _idStr << " AskForResponseData waiting for memory");
+                return;
+            }
             std::vector<char>& buffer = jq->getDescription()->respHandler()->nextBuffer();
+            if (qr->isQueryCancelled()) {
+                LOGS(_log, LOG_LVL_DEBUG, _idStr << " AskForResponseData query was cancelled");
+                qr->_errorFinish(true);
+                _setState(State::DONE2);
+                return;
+            }
             LOGS(_log, LOG_LVL_DEBUG, _idStr << " Asking for GetResponseData size=" << buffer.size());
             qr->GetResponseData(&buffer[0], buffer.size());
         }
@@ -160,6 +192,7 @@ private:
 
     int _blen{-1};
     bool _last{true};
+    MemoryGovernor::Attempt _memoryAttempt; ///< Reservation of the buffer memory, across requeues.
     util::InstanceCount _ic{"AskForResponseDataCmd"};
 };
 
@@ -196,10 +229,21 @@ char* QueryRequest::GetRequest(int& requestLength) {
         requestLength = 0;
         return const_cast<char*>("");
     }
-    requestLength = jq->getDescription()->payload().size();
+    // The payload is only kept until SSI is done with it, rather than by the
+    // JobDescription for the whole query.
+    if (_payload.empty()) {
+        _payload = jq->getDescription()->takePayload();
+    }
+    requestLength = _payload.size();
     LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " Requesting, payload size: " << requestLength);
     // Andy promises that his code won't corrupt it.
-    return const_cast<char*>(jq->getDescription()->payload().data());
+    return const_cast<char*>(_payload.data());
+}
+
+
+void QueryRequest::RelRequestBuffer() {
+    std::lock_guard<std::mutex> lock(_finishStatusMutex);
+    std::string().swap(_payload);
 }
 
 // precondition: rInfo.rType != isNone
@@ -255,6 +299,13 @@ bool QueryRequest::ProcessResponse(XrdSsiErrInfo  const& eInfo, XrdSsiRespInfo c
         break;
     case XrdSsiRespInfo::isStream: // All remote requests
         jq->getStatus()->updateInfo(_jobIdStr, JobStatus::RESPONSE_READY);
+        {
+            // The worker has the chunk, later jobs on it may be sent there with others.
+            auto const& resource = jq->getDescription()->resource();
+            if (resource.unitType() == ResourceUnit::DBCHUNK) {
+                ChunkPlacement::get().set(resource.db(), resource.chunk(), GetEndPoint());
+            }
+        }
         return _importStream(jq);
     default:
         errorDesc += "Out of range XrdSsiRespInfo.rType";
@@ -280,14 +331,14 @@ bool QueryRequest::_importStream(JobQuery::Ptr const& jq) {
 void QueryRequest::_queueAskForResponse(AskForResponseDataCmd::Ptr const& cmd, JobQuery::Ptr const& jq) {
     if (_largeResult) {
         LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " queueing priority low");
-        _qdispPool->queCmdLow(_askForResponseDataCmd);
+        _qdispPool->queCmdLow(cmd);
     } else {
         if (jq->getDescription()->getScanInteractive()) {
             LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " queueing priority vhigh");
-            _qdispPool->queCmdVeryHigh(_askForResponseDataCmd);
+            _qdispPool->queCmdVeryHigh(cmd);
         } else {
             LOGS(_log, LOG_LVL_DEBUG, _jobIdStr << " queueing priority norm");
-            _qdispPool->queCmdNorm(_askForResponseDataCmd);
+            _qdispPool->queCmdNorm(cmd);
         }
     }
 }
@@ -107,10 +107,8 @@ public:
     /// @return content of request data
     char* GetRequest(int& requestLength) override;
 
-    /// Called by SSI to release the allocated request payload. As we don't
-    /// own the buffer, so we can't release it. Therefore, we accept the
-    /// default implementation that does nothing.
-    /// void RelRequestBuffer() override;
+    /// Called by SSI to release the request payload once it was sent.
+    void RelRequestBuffer() override;
 
     /// Called by SSI when a response is ready
     /// precondition: rInfo.rType != isNone
@@ -162,6 +160,8 @@ private:
 
     std::mutex _finishStatusMutex; ///< used to protect _cancelled, _finishStatus, and _jobQuery.
     enum FinishStatus { ACTIVE, FINISHED, ERROR } _finishStatus {ACTIVE}; // _finishStatusMutex
+    /// Payload taken from the JobDescription by GetRequest(), protected by _finishStatusMutex.
+    std::string _payload;
     bool _cancelled {false}; ///< true if cancelled, protected by _finishStatusMutex.
 
     std::shared_ptr<QueryRequest> _keepAlive; ///< Used to keep this object alive during race condition.
@@ -24,12 +24,14 @@
 #define LSST_QSERV_QDISP_RESPONSEHANDLER_H
 
 // System headers
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 
 // Qserv headers
+#include "qdisp/MemoryGovernor.h"
 #include "util/Error.h"
 
 namespace lsst {
@@ -62,6 +64,12 @@ public:
     /// @return the size of the nextBuffer() without allocating the memory for it.
     virtual size_t nextBufferSize() = 0;
 
+    /// Reserve the memory of nextBuffer() from the MemoryGovernor without
+    /// waiting for it.
+    /// @return false if the memory was not reserved, this should be called
+    ///         again with the same attempt when attempt.retry is called.
+    virtual bool reserveNextBuffer(MemoryGovernor::Attempt& attempt) { return true; }
+
     /// Flush the retrieved buffer where bLen bytes were set. If last==true,
     /// then no more buffer() and flush() calls should occur.
     /// @return true if successful (no error)
@@ -86,10 +94,45 @@ public:
     /// Scrub the results from jobId-attempt from the result table.
     virtual void prepScrubResults(int jobId, int attempt) = 0;
 
+    /// @return false if results of jobId-attempt may be in the result table
+    /// in a way they cannot be scrubbed from, so that it cannot be retried.
+    virtual bool canScrubResults(int jobId, int attempt) { return true; }
+
+    /// @return a handler for the responses to a duplicate request of this
+    /// job, see HedgedJob, or nullptr if the job cannot have one.
+    virtual std::shared_ptr<ResponseHandler> makeHedge() { return nullptr; }
+
+    /// Called before rows of the request are first merged.
+    /// @return false if they must not be merged.
+    using MergeGate = std::function<bool()>;
+
+    /// Set the function deciding if rows of the request may be merged.
+    /// @return false if rows were merged already, the gate is not set.
+    bool setMergeGate(MergeGate const& gate) {
+        std::lock_guard<std::mutex> lock(_mergeGateMtx);
+        if (_mergeClaimed) return false;
+        _mergeGate = gate;
+        return true;
+    }
+
+    /// To be called before rows are merged.
+    /// @return false if the rows of the request must not be merged.
+    bool claimMerge() {
+        std::lock_guard<std::mutex> lock(_mergeGateMtx);
+        if (!_mergeClaimed) {
+            if (_mergeGate && !_mergeGate()) return false;
+            _mergeClaimed = true;
+        }
+        return true;
+    }
+
     std::weak_ptr<JobQuery> getJobQuery() { return _jobQuery; }
 
 private:
     std::weak_ptr<JobQuery> _jobQuery;
+    std::mutex _mergeGateMtx; ///< Protects _mergeGate and _mergeClaimed.
+    MergeGate _mergeGate;
+    bool _mergeClaimed{false}; ///< Set once rows may be merged.
 };
 
 inline std::ostream& operator<<(std::ostream& os, ResponseHandler const& r) {
@@ -0,0 +1,198 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "qdisp/WorkerLimiter.h"
+
+// System headers
+#include <algorithm>
+#include <vector>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.qdisp.WorkerLimiter");
+
+double const LATENCY_WEIGHT = 0.2;   ///< Weight of a new latency in the moving averages.
+double const MIN_LATENCY_DRIFT = 1.01; ///< Growth of the lowest latency per completion.
+double const CONGESTED_SLOWDOWN = 2.0; ///< Slowdown showing jobs wait.
+size_t const MAX_BASELINES = 32;     ///< Queries whose latencies are kept per worker.
+
+/// Add sample to the moving average avg, which is 0 before the first sample.
+void addSample(double& avg, double sample) {
+    if (avg == 0) {
+        avg = sample;
+    } else {
+        avg += LATENCY_WEIGHT * (sample - avg);
+    }
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+void WorkerLimiter::configure(int maxPerWorker) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _maxPerWorker = std::max(maxPerWorker, 0);
+    for (auto& entry : _workers) {
+        entry.second.limit = _maxPerWorker;
+        entry.second.completions = 0;
+    }
+    LOGS(_log, LOG_LVL_INFO, "WorkerLimiter maxPerWorker=" << _maxPerWorker);
+}
+
+
+bool WorkerLimiter::start(std::string const& worker, int jobs, StartFunc const& deferredStart) {
+    if (worker.empty()) return true;
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_maxPerWorker == 0) return true;
+    auto& w = _getWorker(worker);
+    // Starts already waiting go first.
+    if (w.queued.empty() && _fits(w, jobs)) {
+        w.inFlight += jobs;
+        return true;
+    }
+    w.queued.emplace_back(jobs, deferredStart);
+    LOGS(_log, LOG_LVL_DEBUG, "WorkerLimiter " << worker << " queued " << jobs << " jobs, inFlight="
+         << w.inFlight << " limit=" << w.limit << " queued=" << w.queued.size());
+    return false;
+}
+
+
+void WorkerLimiter::release(std::string const& worker, QueryId queryId, double latencySeconds,
+                            bool success) {
+    if (worker.empty()) return;
+    std::vector<StartFunc> starts;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto iter = _workers.find(worker);
+        if (iter == _workers.end()) return;
+        auto& w = iter->second;
+        w.inFlight = std::max(w.inFlight - 1, 0);
+        if (success) {
+            _adapt(worker, w, queryId, latencySeconds);
+        }
+        while (!w.queued.empty() && _fits(w, w.queued.front().first)) {
+            w.inFlight += w.queued.front().first;
+            starts.push_back(std::move(w.queued.front().second));
+            w.queued.pop_front();
+        }
+    }
+    // The starts may take time, and may call this again.
+    for (auto const& start : starts) {
+        start();
+    }
+}
+
+
+WorkerLimiter::Stats WorkerLimiter::getStats(std::string const& worker) const {
+    Stats stats;
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto iter = _workers.find(worker);
+    if (iter != _workers.end()) {
+        stats.inFlight = iter->second.inFlight;
+        stats.limit = iter->second.limit;
+        stats.queued = iter->second.queued.size();
+        stats.latencySeconds = iter->second.latency;
+        stats.slowdown = iter->second.slowdown;
+    }
+    return stats;
+}
+
+
+WorkerLimiter& WorkerLimiter::get() {
+    static WorkerLimiter limiter;
+    return limiter;
+}
+
+
+/// @return the state of worker, created if needed, _mtx must be held.
+WorkerLimiter::Worker& WorkerLimiter::_getWorker(std::string const& worker) {
+    auto iter = _workers.find(worker);
+    if (iter == _workers.end()) {
+        iter = _workers.emplace(worker, Worker()).first;
+        iter->second.limit = _maxPerWorker;
+    }
+    return iter->second;
+}
+
+
+/// @return true if jobs more jobs may be in flight on w.
+bool WorkerLimiter::_fits(Worker const& w, int jobs) {
+    return w.inFlight == 0 || w.inFlight + jobs <= w.limit;
+}
+
+
+/// @return the latencies of the jobs of queryId on w, created if needed,
+///         dropping those of the query with the oldest completion to keep
+///         at most MAX_BASELINES, _mtx must be held.
+WorkerLimiter::Baseline& WorkerLimiter::_getBaseline(Worker& w, QueryId queryId) {
+    auto iter = w.baselines.find(queryId);
+    if (iter == w.baselines.end()) {
+        if (w.baselines.size() >= MAX_BASELINES) {
+            auto oldest = std::min_element(w.baselines.begin(), w.baselines.end(),
+                [](std::pair<QueryId const, Baseline> const& a, std::pair<QueryId const, Baseline> const& b) {
+                    return a.second.lastUsed < b.second.lastUsed;
+                });
+            w.baselines.erase(oldest);
+        }
+        iter = w.baselines.emplace(queryId, Baseline()).first;
+    }
+    return iter->second;
+}
+
+
+/// Adapt the limit of w to the latency of a completed job of queryId,
+/// _mtx must be held.
+void WorkerLimiter::_adapt(std::string const& name, Worker& w, QueryId queryId, double latencySeconds) {
+    addSample(w.latency, latencySeconds);
+    Baseline& baseline = _getBaseline(w, queryId);
+    baseline.lastUsed = ++w.sequence;
+    addSample(baseline.latency, latencySeconds);
+    if (baseline.minLatency == 0) {
+        baseline.minLatency = baseline.latency;
+    } else {
+        baseline.minLatency = std::min(baseline.minLatency * MIN_LATENCY_DRIFT, baseline.latency);
+    }
+    if (baseline.minLatency > 0) {
+        addSample(w.slowdown, baseline.latency / baseline.minLatency);
+    }
+    if (++w.completions < w.limit) return;
+    w.completions = 0;
+    int limit = w.limit;
+    if (w.slowdown > CONGESTED_SLOWDOWN) {
+        w.limit = std::max(w.limit - (w.limit + 3) / 4, 1);
+    } else {
+        w.limit = std::min(w.limit + 1, _maxPerWorker);
+    }
+    if (w.limit != limit) {
+        LOGS(_log, LOG_LVL_DEBUG, "WorkerLimiter " << name << " limit=" << w.limit
+             << " latencySeconds=" << w.latency << " slowdown=" << w.slowdown);
+    }
+}
+
+}}} // namespace lsst::qserv::qdisp
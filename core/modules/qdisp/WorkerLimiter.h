@@ -0,0 +1,132 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_QDISP_WORKERLIMITER_H
+#define LSST_QSERV_QDISP_WORKERLIMITER_H
+
+// System headers
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+// Qserv headers
+#include "global/intTypes.h"
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+
+/// WorkerLimiter bounds the scan jobs of all queries of the czar in flight
+/// on each worker, so that queries whose chunks are skewed toward a few
+/// workers do not flood them with requests, each holding worker memory and
+/// czar XrdSsi callbacks, while other workers idle. A job is in flight from
+/// its start until it completes, retries included. Starts beyond the limit
+/// of a worker are queued, and run in order as its jobs complete.
+///
+/// The limit of each worker adapts to how its jobs complete, starting from
+/// the configured maximum. As jobs of different queries take very different
+/// times, the latency of a job is only compared to that of the jobs of the
+/// same query on the worker: its slowdown is the moving average latency of
+/// the query over the lowest one seen for it. After as many completions as
+/// the limit, the limit drops by a quarter if the moving average slowdown
+/// is over two, as the jobs then wait on the worker, and otherwise grows by
+/// one, up to the maximum. The lowest latencies slowly drift up, so that
+/// they follow the load of the worker.
+///
+/// Workers are known from ChunkPlacement. Jobs on chunks not placed yet,
+/// like interactive jobs, are not limited.
+class WorkerLimiter {
+public:
+    /// Counters of a worker, for monitoring.
+    struct Stats {
+        int inFlight = 0;          ///< Jobs in flight
+        int limit = 0;             ///< Current limit of jobs in flight
+        int queued = 0;            ///< Starts waiting for the jobs in flight to complete
+        double latencySeconds = 0; ///< Moving average of the latency of the jobs
+        double slowdown = 0;       ///< Moving average of the slowdown of the jobs
+    };
+
+    using StartFunc = std::function<void()>;
+
+    WorkerLimiter() = default;
+    WorkerLimiter(WorkerLimiter const&) = delete;
+    WorkerLimiter& operator=(WorkerLimiter const&) = delete;
+
+    /// Set the maximum number of jobs in flight per worker, 0 meaning no
+    /// limit. Meant to be called before any job starts.
+    void configure(int maxPerWorker);
+
+    /// Count jobs more jobs in flight on worker, if they fit its limit. A
+    /// multi-chunk request larger than the limit fits once nothing else is
+    /// in flight on the worker.
+    /// @return true if they do, false if they are counted later, when
+    ///         deferredStart is called to start them.
+    bool start(std::string const& worker, int jobs, StartFunc const& deferredStart);
+
+    /// Record that a job counted by start() completed, and call the
+    /// deferred starts that now fit.
+    /// @param queryId the user query of the job.
+    /// @param latencySeconds time since the job was counted.
+    /// @param success false if the job failed, whose latency is not used.
+    void release(std::string const& worker, QueryId queryId, double latencySeconds, bool success);
+
+    Stats getStats(std::string const& worker) const;
+
+    /// @return the instance shared by all queries of the czar.
+    static WorkerLimiter& get();
+
+private:
+    /// Latencies of the jobs of a query on a worker, in seconds.
+    struct Baseline {
+        double latency = 0; ///< Moving average
+        double minLatency = 0;
+        std::uint64_t lastUsed = 0; ///< Sequence number of the last completion.
+    };
+
+    struct Worker {
+        int inFlight = 0;
+        int limit = 0;
+        int completions = 0; ///< Successful completions since the limit was last adapted.
+        double latency = 0;  ///< Moving average of job latencies, in seconds.
+        double slowdown = 0; ///< Moving average of job slowdowns.
+        std::uint64_t sequence = 0; ///< Successful completions.
+        std::map<QueryId, Baseline> baselines; ///< Of the queries with the latest completions.
+        std::deque<std::pair<int, StartFunc>> queued; ///< Deferred starts, with their job counts.
+    };
+
+    Worker& _getWorker(std::string const& worker);
+    static bool _fits(Worker const& w, int jobs);
+    static Baseline& _getBaseline(Worker& w, QueryId queryId);
+    void _adapt(std::string const& name, Worker& w, QueryId queryId, double latencySeconds);
+
+    mutable std::mutex _mtx; ///< Protects all members below.
+    int _maxPerWorker{0};
+    std::map<std::string, Worker> _workers;
+};
+
+}}} // namespace lsst::qserv::qdisp
+
+#endif // LSST_QSERV_QDISP_WORKERLIMITER_H
@@ -0,0 +1,204 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "global/ResourceUnit.h"
+#include "proto/ProtoHeaderWrap.h"
+#include "proto/WorkerResponse.h"
+#include "proto/worker.pb.h"
+#include "qdisp/ChunkGroupHandler.h"
+#include "qdisp/JobTestFixture.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE ChunkGroupHandler_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+using namespace lsst::qserv;
+
+namespace {
+
+/// Expects a header, then a body whose first byte is 'L' in the last message.
+class MockHandler : public qdisp::ResponseHandler {
+public:
+    std::vector<char>& nextBuffer() override {
+        _buf.resize(nextBufferSize());
+        return _buf;
+    }
+    size_t nextBufferSize() override {
+        return _bodySize < 0 ? proto::ProtoHeaderWrap::PROTO_HEADER_SIZE : _bodySize;
+    }
+    bool reserveNextBuffer(qdisp::MemoryGovernor::Attempt&) override {
+        ++reserves;
+        return !noMemory;
+    }
+    bool flush(int bLen, bool& last, bool& largeResult) override {
+        if (_bodySize < 0) {
+            auto response = std::make_shared<proto::WorkerResponse>();
+            if (!proto::ProtoHeaderWrap::unwrap(response, _buf)) return false;
+            _bodySize = response->protoHeader.size();
+            return true;
+        }
+        bodies.push_back(std::string(_buf.begin(), _buf.begin() + bLen));
+        last = (_buf[0] == 'L');
+        _bodySize = -1;
+        return !fail;
+    }
+    void errorFlush(std::string const& msg, int code) override {}
+    bool finished() const override { return false; }
+    bool reset() override { return true; }
+    std::ostream& print(std::ostream& os) const override { return os << "MockHandler"; }
+    Error getError() const override { return Error(fail ? 99 : 0, fail ? "mock failure" : ""); }
+    void prepScrubResults(int jobId, int attempt) override {}
+
+    std::vector<std::string> bodies;
+    bool fail = false;
+    int reserves = 0;
+    bool noMemory = false;
+
+private:
+    std::vector<char> _buf;
+    int _bodySize = -1;
+};
+
+using qdisp::MockCompleteFunc;
+
+struct Fixture : qdisp::JobTestFixture {
+    Fixture() {
+        for (int jobId = 0; jobId < 2; ++jobId) {
+            ResourceUnit ru;
+            ru.setAsDbChunk("Mock", 100 + jobId);
+            handlers.push_back(std::make_shared<MockHandler>());
+            completeFuncs.push_back(std::make_shared<MockCompleteFunc>());
+            auto desc = qdisp::JobDescription::create(executive->getId(), jobId, ru, handlers.back(),
+                                                      nullptr, nullptr, "mock", true);
+            jobs.push_back(createJob(desc, completeFuncs.back()));
+        }
+        groupHandler = std::make_shared<qdisp::ChunkGroupHandler>(jobs);
+    }
+
+    /// Pass the header of a message of jobId through the group handler.
+    /// @return false if the flush failed.
+    bool sendHeader(int jobId, size_t bodySize, bool& last) {
+        proto::ProtoHeader header;
+        header.set_size(bodySize);
+        header.set_largeresult(false);
+        header.set_jobid(jobId);
+        std::string headerString;
+        header.SerializeToString(&headerString);
+        std::string wrapped = proto::ProtoHeaderWrap::wrap(headerString);
+        bool largeResult = false;
+        auto& headerBuf = groupHandler->nextBuffer();
+        BOOST_REQUIRE_EQUAL(headerBuf.size(), wrapped.size());
+        std::copy(wrapped.begin(), wrapped.end(), headerBuf.begin());
+        return groupHandler->flush(headerBuf.size(), last, largeResult);
+    }
+
+    /// Pass a message of jobId through the group handler, as the worker sends it.
+    /// @return false if a flush failed.
+    bool send(int jobId, std::string const& body, bool& last) {
+        if (!sendHeader(jobId, body.size(), last)) return false;
+        bool largeResult = false;
+        auto& bodyBuf = groupHandler->nextBuffer();
+        BOOST_REQUIRE_EQUAL(bodyBuf.size(), body.size());
+        std::copy(body.begin(), body.end(), bodyBuf.begin());
+        return groupHandler->flush(bodyBuf.size(), last, largeResult);
+    }
+
+    std::vector<std::shared_ptr<MockHandler>> handlers;
+    std::vector<std::shared_ptr<MockCompleteFunc>> completeFuncs;
+    std::vector<qdisp::JobQuery::Ptr> jobs;
+    qdisp::ChunkGroupHandler::Ptr groupHandler;
+};
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(Suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(RouteMessages) {
+    bool last = false;
+    BOOST_CHECK(send(1, "a1", last));
+    BOOST_CHECK(send(0, "b0", last));
+    BOOST_CHECK(send(1, "L1", last));
+    BOOST_CHECK(!last);
+    BOOST_CHECK(completeFuncs[0]->calls.empty());
+    BOOST_CHECK(completeFuncs[1]->calls == std::vector<bool>{true});
+    BOOST_CHECK_EQUAL(jobs[1]->getStatus()->getInfo().state, qdisp::JobStatus::COMPLETE);
+    BOOST_CHECK(send(0, "L0", last));
+    BOOST_CHECK(last);
+    BOOST_CHECK(groupHandler->finished());
+    BOOST_CHECK_EQUAL(groupHandler->nextBufferSize(), 0u);
+    BOOST_CHECK(handlers[0]->bodies == (std::vector<std::string>{"b0", "L0"}));
+    BOOST_CHECK(handlers[1]->bodies == (std::vector<std::string>{"a1", "L1"}));
+    BOOST_CHECK(completeFuncs[0]->calls == std::vector<bool>{true});
+
+    // Nothing is left to finish.
+    groupHandler->finishJobs(true);
+    BOOST_CHECK_EQUAL(completeFuncs[0]->calls.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(ReserveBody) {
+    qdisp::MemoryGovernor::Attempt attempt;
+    handlers[0]->noMemory = true;
+    // Headers are not reserved.
+    BOOST_CHECK(groupHandler->reserveNextBuffer(attempt));
+    BOOST_CHECK_EQUAL(handlers[0]->reserves, 0);
+    bool last = false;
+    BOOST_REQUIRE(sendHeader(0, 2, last));
+    // The body is reserved by the handler of its job.
+    BOOST_CHECK(!groupHandler->reserveNextBuffer(attempt));
+    BOOST_CHECK_EQUAL(handlers[0]->reserves, 1);
+    BOOST_CHECK_EQUAL(handlers[1]->reserves, 0);
+}
+
+BOOST_AUTO_TEST_CASE(UnknownJob) {
+    bool last = false;
+    BOOST_CHECK(!send(7, "L7", last));
+    BOOST_CHECK(groupHandler->getError().getCode() != 0);
+    BOOST_CHECK(!groupHandler->finished());
+}
+
+BOOST_AUTO_TEST_CASE(MergeFailure) {
+    bool last = false;
+    BOOST_CHECK(send(1, "L1", last));
+    handlers[0]->fail = true;
+    BOOST_CHECK(!send(0, "L0", last));
+    BOOST_CHECK_EQUAL(groupHandler->getError().getCode(), 99);
+    // Merge failures are not retried.
+    groupHandler->finishJobs(false);
+    BOOST_CHECK(completeFuncs[0]->calls == std::vector<bool>{false});
+    BOOST_CHECK_EQUAL(jobs[0]->getStatus()->getInfo().state, qdisp::JobStatus::MERGE_ERROR);
+    BOOST_CHECK(completeFuncs[1]->calls == std::vector<bool>{true});
+}
+
+BOOST_AUTO_TEST_CASE(ResetOnce) {
+    BOOST_CHECK(groupHandler->reset());
+    BOOST_CHECK(!groupHandler->reset());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
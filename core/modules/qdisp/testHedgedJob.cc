@@ -0,0 +1,163 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <string>
+#include <utility>
+#include <vector>
+
+// Qserv headers
+#include "global/ResourceUnit.h"
+#include "qdisp/HedgedJob.h"
+#include "qdisp/JobTestFixture.h"
+#include "qproc/ChunkQuerySpec.h"
+#include "qproc/TaskMsgFactory.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE HedgedJob_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+using namespace lsst::qserv;
+
+namespace {
+
+class MockTaskMsgFactory : public qproc::TaskMsgFactory {
+public:
+    MockTaskMsgFactory() : qproc::TaskMsgFactory(0) {}
+    void serializeMsg(qproc::ChunkQuerySpec const& s, std::string const& chunkResultName,
+                      uint64_t queryId, int jobId, int attemptCount, std::ostream& os) override {
+        os << "mock";
+    }
+};
+
+/// Records the attempts scrubbed, none are expected.
+class MockHandler : public qdisp::ResponseHandler {
+public:
+    std::vector<char>& nextBuffer() override { return _buf; }
+    size_t nextBufferSize() override { return 0; }
+    bool flush(int bLen, bool& last, bool& largeResult) override { return true; }
+    void errorFlush(std::string const& msg, int code) override {}
+    bool finished() const override { return false; }
+    bool reset() override { return true; }
+    std::ostream& print(std::ostream& os) const override { return os << "MockHandler"; }
+    Error getError() const override { return Error(); }
+    void prepScrubResults(int jobId, int attempt) override { scrubbed.emplace_back(jobId, attempt); }
+
+    std::vector<std::pair<int, int>> scrubbed;
+
+private:
+    std::vector<char> _buf;
+};
+
+using qdisp::MockCompleteFunc;
+
+struct Fixture : qdisp::JobTestFixture {
+    Fixture() {
+        ResourceUnit ru;
+        ru.setAsDbChunk("Mock", 100);
+        auto desc = qdisp::JobDescription::create(executive->getId(), 7, ru, jobHandler,
+                                                  std::make_shared<MockTaskMsgFactory>(),
+                                                  std::make_shared<qproc::ChunkQuerySpec>(), "mock", true);
+        desc->incrAttemptCountScrubResults();
+        desc->incrAttemptCountScrubResults();
+        jobHandler->scrubbed.clear(); // Those of the retry.
+        auto hedgeDesc = qdisp::JobDescription::createHedge(desc, hedgeHandler);
+        job = createJob(desc, jobComplete);
+        hedge = createJob(hedgeDesc, hedgeComplete);
+        hedged = std::make_shared<qdisp::HedgedJob>(job, hedge);
+    }
+
+    std::shared_ptr<MockHandler> jobHandler = std::make_shared<MockHandler>();
+    std::shared_ptr<MockHandler> hedgeHandler = std::make_shared<MockHandler>();
+    std::shared_ptr<MockCompleteFunc> jobComplete = std::make_shared<MockCompleteFunc>();
+    std::shared_ptr<MockCompleteFunc> hedgeComplete = std::make_shared<MockCompleteFunc>();
+    qdisp::JobQuery::Ptr job;
+    qdisp::JobQuery::Ptr hedge;
+    qdisp::HedgedJob::Ptr hedged;
+};
+
+} // anonymous namespace
+
+BOOST_FIXTURE_TEST_SUITE(Suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(JobWins) {
+    BOOST_CHECK_EQUAL(hedge->getDescription()->getAttemptCount(), qdisp::JobDescription::HEDGE_ATTEMPT);
+    BOOST_CHECK(!hedged->start()); // Sets the merge gates, the mock duplicate is not sent.
+    // The duplicate is cancelled once rows of the job are merged, and none of its rows are.
+    BOOST_CHECK(jobHandler->claimMerge());
+    BOOST_CHECK(hedgeComplete->calls == std::vector<bool>{false});
+    BOOST_CHECK(!hedgeHandler->claimMerge());
+    BOOST_CHECK(jobHandler->claimMerge());
+    BOOST_CHECK(!hedged->complete(true, false));
+    BOOST_CHECK(hedged->complete(false, true));
+    BOOST_CHECK(hedgeHandler->scrubbed.empty());
+    BOOST_CHECK(jobHandler->scrubbed.empty());
+    BOOST_CHECK(jobComplete->calls.empty());
+}
+
+BOOST_AUTO_TEST_CASE(HedgeWins) {
+    BOOST_CHECK(!hedged->start());
+    BOOST_CHECK(hedgeHandler->claimMerge());
+    BOOST_CHECK(jobComplete->calls == std::vector<bool>{false});
+    BOOST_CHECK(!jobHandler->claimMerge());
+    BOOST_CHECK(!hedged->complete(false, false));
+    BOOST_CHECK(hedged->complete(true, true));
+    BOOST_CHECK(jobHandler->scrubbed.empty());
+    BOOST_CHECK(hedgeHandler->scrubbed.empty());
+    BOOST_CHECK_EQUAL(job->getStatus()->getInfo().state, qdisp::JobStatus::COMPLETE);
+}
+
+BOOST_AUTO_TEST_CASE(JobAlreadyMerged) {
+    // Rows of the job merged before it straggled cannot be replaced by
+    // those of a duplicate, which is not sent.
+    BOOST_CHECK(jobHandler->claimMerge());
+    BOOST_CHECK(!hedged->start());
+    BOOST_CHECK(!hedgeHandler->claimMerge());
+    BOOST_CHECK(jobHandler->claimMerge());
+    BOOST_CHECK(jobComplete->calls.empty());
+    BOOST_CHECK(!hedged->complete(true, false));
+    BOOST_CHECK(hedged->complete(false, true));
+}
+
+BOOST_AUTO_TEST_CASE(OneFails) {
+    // The job waits for the duplicate, which completes it.
+    BOOST_CHECK(!hedged->start());
+    BOOST_CHECK(!hedged->complete(false, false));
+    BOOST_CHECK(hedgeHandler->claimMerge());
+    BOOST_CHECK(hedged->complete(true, true));
+    BOOST_CHECK(!hedged->complete(false, true));
+    BOOST_CHECK(jobHandler->scrubbed.empty());
+}
+
+BOOST_AUTO_TEST_CASE(BothFail) {
+    BOOST_CHECK(!hedged->start());
+    BOOST_CHECK(!hedged->complete(true, false));
+    BOOST_CHECK(hedged->complete(false, false));
+    BOOST_CHECK(jobHandler->scrubbed.empty());
+    BOOST_CHECK(hedgeHandler->scrubbed.empty());
+    BOOST_CHECK(jobComplete->calls.empty());
+    BOOST_CHECK(hedgeComplete->calls.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
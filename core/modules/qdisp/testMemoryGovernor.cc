@@ -0,0 +1,210 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Qserv headers
+#include "qdisp/MemoryGovernor.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE MemoryGovernor_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::qdisp::MemoryGovernor;
+
+namespace lsst {
+namespace qserv {
+namespace qdisp {
+namespace test {
+
+/// Gives the tests access to the private members of MemoryGovernor.
+class MemoryGovernorTestHelper {
+public:
+    explicit MemoryGovernorTestHelper(MemoryGovernor& governor) : _governor(governor) {}
+
+    bool fits(std::int64_t bytes, bool interactive) {
+        std::lock_guard<std::mutex> lock(_governor._mtx);
+        return _governor._fits(bytes, interactive);
+    }
+
+private:
+    MemoryGovernor& _governor;
+};
+
+}}}} // namespace lsst::qserv::qdisp::test
+
+using lsst::qserv::qdisp::test::MemoryGovernorTestHelper;
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(NoLimit) {
+    MemoryGovernor governor;
+    governor.reserve(1000, false);
+    governor.reserve(1000, true);
+    auto stats = governor.getStats();
+    BOOST_CHECK_EQUAL(stats.usedBytes, 2000);
+    BOOST_CHECK_EQUAL(stats.interactiveBytes, 1000);
+    BOOST_CHECK_EQUAL(stats.waits, 0u);
+    governor.release(1000, false);
+    governor.release(1000, true);
+    BOOST_CHECK_EQUAL(governor.getStats().usedBytes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(WaitForRelease) {
+    MemoryGovernor governor;
+    governor.configure(100, 0);
+    governor.reserve(80, false);
+    std::atomic<bool> reserved{false};
+    std::thread waiter([&governor, &reserved]() {
+        governor.reserve(40, false);
+        reserved = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(!reserved);
+    governor.release(80, false);
+    waiter.join();
+    BOOST_CHECK(reserved);
+    auto stats = governor.getStats();
+    BOOST_CHECK_EQUAL(stats.usedBytes, 40);
+    BOOST_CHECK_EQUAL(stats.waits, 1u);
+    BOOST_CHECK(stats.waitMicros > 0);
+    BOOST_CHECK_EQUAL(stats.overcommits, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(InteractiveShare) {
+    MemoryGovernor governor;
+    governor.configure(100, 30);
+    governor.reserve(70, false);
+    // Scans are at their limit, interactive queries still get their share.
+    governor.reserve(30, true);
+    BOOST_CHECK_EQUAL(governor.getStats().waits, 0u);
+    std::atomic<bool> reserved{false};
+    std::thread waiter([&governor, &reserved]() {
+        governor.reserve(10, false);
+        reserved = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // Freeing interactive memory does not help scans.
+    governor.release(30, true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(!reserved);
+    governor.release(70, false);
+    waiter.join();
+    BOOST_CHECK(reserved);
+}
+
+BOOST_AUTO_TEST_CASE(LargerThanBudget) {
+    MemoryGovernor governor;
+    governor.configure(100, 0);
+    // Nothing else is held, so a buffer larger than the budget goes through.
+    governor.reserve(500, false);
+    BOOST_CHECK_EQUAL(governor.getStats().usedBytes, 500);
+    BOOST_CHECK_EQUAL(governor.getStats().waits, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(FitsShares) {
+    MemoryGovernor governor;
+    MemoryGovernorTestHelper helper(governor);
+    governor.configure(100, 30);
+    // Anything fits while nothing is held.
+    BOOST_CHECK(helper.fits(500, false));
+    governor.reserve(50, false);
+    // Scans may use 70, interactive queries all 100.
+    BOOST_CHECK(helper.fits(20, false));
+    BOOST_CHECK(!helper.fits(21, false));
+    BOOST_CHECK(helper.fits(50, true));
+    BOOST_CHECK(!helper.fits(51, true));
+    governor.reserve(40, true);
+    // Interactive bytes do not count against the scan share, only the total.
+    BOOST_CHECK(helper.fits(10, false));
+    BOOST_CHECK(!helper.fits(11, false));
+    BOOST_CHECK(helper.fits(10, true));
+    BOOST_CHECK(!helper.fits(11, true));
+    governor.release(50, false);
+    // Interactive queries beyond their share take from the scan share.
+    governor.reserve(40, true);
+    BOOST_CHECK(helper.fits(20, false));
+    BOOST_CHECK(!helper.fits(21, false));
+}
+
+BOOST_AUTO_TEST_CASE(TryReserve) {
+    MemoryGovernor governor;
+    governor.configure(100, 0);
+    governor.reserve(80, false);
+    MemoryGovernor::Attempt attempt;
+    // The caller gets the thread back while the budget is exhausted.
+    BOOST_CHECK(!governor.tryReserve(40, false, attempt));
+    BOOST_CHECK(attempt.waited);
+    BOOST_CHECK_EQUAL(governor.getStats().usedBytes, 80);
+    BOOST_CHECK_EQUAL(governor.getStats().waits, 0u);
+    governor.release(80, false);
+    BOOST_CHECK(governor.tryReserve(40, false, attempt));
+    auto stats = governor.getStats();
+    BOOST_CHECK_EQUAL(stats.usedBytes, 40);
+    BOOST_CHECK_EQUAL(stats.waits, 1u);
+    BOOST_CHECK_EQUAL(stats.overcommits, 0u);
+
+    // Past MAX_WAIT, the bytes are granted over budget.
+    governor.reserve(60, false);
+    MemoryGovernor::Attempt late;
+    late.start -= MemoryGovernor::MAX_WAIT;
+    BOOST_CHECK(governor.tryReserve(40, false, late));
+    stats = governor.getStats();
+    BOOST_CHECK_EQUAL(stats.usedBytes, 140);
+    BOOST_CHECK_EQUAL(stats.overcommits, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(RetryOnRelease) {
+    MemoryGovernor governor;
+    governor.configure(100, 30);
+    governor.reserve(60, false);
+    governor.reserve(30, true);
+    int scanRetries = 0;
+    MemoryGovernor::Attempt scan;
+    scan.retry = [&scanRetries]() { ++scanRetries; };
+    int interactiveRetries = 0;
+    MemoryGovernor::Attempt interactive;
+    interactive.retry = [&interactiveRetries]() { ++interactiveRetries; };
+    // Both attempts are parked instead of waiting.
+    BOOST_CHECK(!governor.tryReserve(20, false, scan));
+    BOOST_CHECK(!governor.tryReserve(20, true, interactive));
+    // Only the attempts that fit after a release are retried, once.
+    governor.release(10, true);
+    BOOST_CHECK_EQUAL(scanRetries, 0);
+    BOOST_CHECK_EQUAL(interactiveRetries, 1);
+    BOOST_CHECK(governor.tryReserve(20, true, interactive));
+    governor.release(20, false);
+    BOOST_CHECK_EQUAL(scanRetries, 1);
+    governor.release(10, false);
+    BOOST_CHECK_EQUAL(scanRetries, 1);
+    BOOST_CHECK(governor.tryReserve(20, false, scan));
+    BOOST_CHECK_EQUAL(governor.getStats().waits, 2u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
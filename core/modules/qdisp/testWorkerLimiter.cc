@@ -0,0 +1,128 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <vector>
+
+// Qserv headers
+#include "qdisp/WorkerLimiter.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE WorkerLimiter_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::qdisp::WorkerLimiter;
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(NoLimit) {
+    WorkerLimiter limiter;
+    int calls = 0;
+    auto start = [&calls]() { ++calls; };
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK(limiter.start("w1", 1, start));
+    }
+    limiter.configure(2);
+    // Jobs on unknown workers are not limited.
+    BOOST_CHECK(limiter.start("", 5, start));
+    BOOST_CHECK_EQUAL(calls, 0);
+}
+
+BOOST_AUTO_TEST_CASE(QueueUntilRelease) {
+    WorkerLimiter limiter;
+    limiter.configure(2);
+    std::vector<int> started;
+    BOOST_CHECK(limiter.start("w1", 1, [&started]() { started.push_back(1); }));
+    BOOST_CHECK(limiter.start("w1", 1, [&started]() { started.push_back(2); }));
+    BOOST_CHECK(!limiter.start("w1", 1, [&started]() { started.push_back(3); }));
+    BOOST_CHECK(!limiter.start("w1", 1, [&started]() { started.push_back(4); }));
+    // Other workers are not held up.
+    BOOST_CHECK(limiter.start("w2", 1, [&started]() { started.push_back(5); }));
+    auto stats = limiter.getStats("w1");
+    BOOST_CHECK_EQUAL(stats.inFlight, 2);
+    BOOST_CHECK_EQUAL(stats.limit, 2);
+    BOOST_CHECK_EQUAL(stats.queued, 2);
+
+    limiter.release("w1", 1, 1.0, true);
+    BOOST_CHECK(started == std::vector<int>{3});
+    limiter.release("w1", 1, 1.0, false);
+    BOOST_CHECK((started == std::vector<int>{3, 4}));
+    stats = limiter.getStats("w1");
+    BOOST_CHECK_EQUAL(stats.inFlight, 2);
+    BOOST_CHECK_EQUAL(stats.queued, 0);
+}
+
+BOOST_AUTO_TEST_CASE(LargeRequest) {
+    WorkerLimiter limiter;
+    limiter.configure(4);
+    int calls = 0;
+    BOOST_CHECK(limiter.start("w1", 1, [&calls]() { ++calls; }));
+    BOOST_CHECK(!limiter.start("w1", 6, [&calls]() { ++calls; }));
+    // Queued starts keep their turn.
+    BOOST_CHECK(!limiter.start("w1", 1, [&calls]() { ++calls; }));
+    limiter.release("w1", 1, 1.0, true);
+    BOOST_CHECK_EQUAL(calls, 1);
+    BOOST_CHECK_EQUAL(limiter.getStats("w1").inFlight, 6);
+}
+
+BOOST_AUTO_TEST_CASE(AdaptLimit) {
+    WorkerLimiter limiter;
+    limiter.configure(8);
+    auto runJobs = [&limiter](int count, double latency, bool success) {
+        for (int i = 0; i < count; ++i) {
+            BOOST_REQUIRE(limiter.start("w1", 1, []() {}));
+            limiter.release("w1", 1, latency, success);
+        }
+    };
+    runJobs(8, 1.0, true);
+    BOOST_CHECK_EQUAL(limiter.getStats("w1").limit, 8);
+    // Latencies of failed jobs are not used.
+    runJobs(40, 10.0, false);
+    BOOST_CHECK_EQUAL(limiter.getStats("w1").limit, 8);
+    // Jobs taking much longer lower the limit.
+    runJobs(16, 10.0, true);
+    int limit = limiter.getStats("w1").limit;
+    BOOST_CHECK(limit < 8);
+    BOOST_CHECK(limit >= 1);
+    BOOST_CHECK(limiter.getStats("w1").latencySeconds > 2.0);
+    // It grows back to the maximum once they speed up.
+    runJobs(200, 1.0, true);
+    BOOST_CHECK_EQUAL(limiter.getStats("w1").limit, 8);
+}
+
+BOOST_AUTO_TEST_CASE(AdaptPerQuery) {
+    WorkerLimiter limiter;
+    limiter.configure(8);
+    // Jobs of a query taking much longer than those of another do not
+    // lower the limit, as each is compared to jobs of its own query.
+    for (int i = 0; i < 64; ++i) {
+        BOOST_REQUIRE(limiter.start("w1", 1, []() {}));
+        limiter.release("w1", i % 2 + 1, i % 2 == 0 ? 1.0 : 10.0, true);
+    }
+    BOOST_CHECK_EQUAL(limiter.getStats("w1").limit, 8);
+    BOOST_CHECK(limiter.getStats("w1").slowdown < 2.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
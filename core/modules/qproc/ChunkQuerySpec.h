@@ -46,6 +46,17 @@ namespace lsst {
 namespace qserv {
 namespace qproc {
 
+/// ChunkQueryTemplates holds the text of the query templates of a user
+/// query, shared by all of its ChunkQuerySpecs, with the tags the worker
+/// substitutes the chunk and subchunk ids for.
+struct ChunkQueryTemplates {
+    using Ptr = std::shared_ptr<ChunkQueryTemplates const>;
+
+    std::vector<std::string> queries;
+    std::string chunkTag;
+    std::string subChunkTag; ///< Empty if the queries are not subchunked.
+};
+
 /// ChunkQuerySpec is a value class that bundles a set of queries with their
 /// dependent db, chunkId, and set of subChunkIds. It has a pointer to another
 /// ChunkQuerySpec as a means of allowing Specs to be easily fragmented for
@@ -70,6 +81,9 @@ public:
     DbTableSet subChunkTables;
     std::vector<int> subChunkIds;
     std::vector<std::string> queries;
+    /// If set, the worker generates the queries from these templates, and
+    /// queries is left empty in this spec and in those of nextFragment.
+    ChunkQueryTemplates::Ptr queryTemplates;
     // Consider promoting the concept of container of ChunkQuerySpec
     // in the hopes of increased code cleanliness.
     std::shared_ptr<ChunkQuerySpec> nextFragment; ///< ad-hoc linked list (consider removal)
@@ -74,6 +74,7 @@
 #include "query/SelectStmt.h"
 #include "query/SelectList.h"
 #include "query/typedefs.h"
+#include "query/ValueExpr.h"
 #include "util/IterableFormatter.h"
 
 namespace {
@@ -249,6 +250,20 @@ QuerySession::getMergeStmt() const {
     }
 }
 
+int QuerySession::getEarlyLimit() const {
+    query::SelectStmt const& stmt = *_stmt;
+    if (!stmt.hasLimit() || stmt.hasOrderBy() || stmt.hasGroupBy()
+        || stmt.hasHaving() || stmt.getDistinct()) {
+        return NOTSET;
+    }
+    for (auto const& valueExpr : *stmt.getSelectList().getValueExprList()) {
+        if (valueExpr->hasAggregation()) {
+            return NOTSET;
+        }
+    }
+    return stmt.getLimit();
+}
+
 void QuerySession::finalize() {
     if (_isFinal) {
         return;
@@ -366,7 +381,20 @@ std::vector<query::QueryTemplate> QuerySession::makeQueryTemplates() {
 }
 
 
-std::vector<std::string> QuerySession::_buildChunkQueries(query::QueryTemplate::Vect const& queryTemplates,
+QuerySession::CompiledTemplates
+QuerySession::compileQueryTemplates(query::QueryTemplate::Vect const& queryTemplates) const {
+    if (!_context->queryMapping) {
+        throw QueryProcessingBug("Missing QueryMapping in _context");
+    }
+    CompiledTemplates compiledTemplates;
+    for(auto const& qTemplate : queryTemplates) {
+        compiledTemplates.push_back(_context->queryMapping->compile(qTemplate));
+    }
+    return compiledTemplates;
+}
+
+
+std::vector<std::string> QuerySession::_buildChunkQueries(CompiledTemplates const& compiledTemplates,
                                                           ChunkSpec const& chunkSpec) const {
     std::vector<std::string> chunkQueries;
     // This logic may be pushed over to the qserv worker in the future.
@@ -380,15 +408,15 @@ std::vector<std::string> QuerySession::_buildChunkQueries(query::QueryTemplate::
     qana::QueryMapping const& queryMapping = *_context->queryMapping;
 
     if (!queryMapping.hasSubChunks()) { // Non-subchunked
-        for(auto tupleIter=queryTemplates.begin(), e=queryTemplates.end(); tupleIter != e; ++tupleIter) {
-            std::string str = _context->queryMapping->apply(chunkSpec, *tupleIter);
-            chunkQueries.push_back(str);
+        for(auto const& qTemplate : compiledTemplates) {
+            chunkQueries.push_back(queryMapping.apply(chunkSpec, qTemplate));
         }
     } else { // subchunked:
         ChunkSpecSingle::Vector sVector = ChunkSpecSingle::makeVector(chunkSpec);
+        chunkQueries.reserve(sVector.size() * compiledTemplates.size());
         for(auto& chunkStr : sVector) {
-            for(auto& qTemplate : queryTemplates) {
-                std::string str = _context->queryMapping->apply(chunkStr, qTemplate);
+            for(auto const& qTemplate : compiledTemplates) {
+                std::string str = queryMapping.apply(chunkStr, qTemplate);
                 LOGS(_log, LOG_LVL_DEBUG, "adding query " << str);
                 chunkQueries.push_back(str);
             }
@@ -404,27 +432,71 @@ std::ostream& operator<<(std::ostream& out, QuerySession const& querySession) {
 }
 
 
+ChunkQueryTemplates::Ptr
+QuerySession::makeChunkQueryTemplates(query::QueryTemplate::Vect const& queryTemplates) const {
+    if (!_context->queryMapping) {
+        throw QueryProcessingBug("Missing QueryMapping in _context");
+    }
+    qana::QueryMapping const& queryMapping = *_context->queryMapping;
+    if (queryMapping.hasParameter(qana::QueryMapping::INVALID)
+        || queryMapping.hasParameter(qana::QueryMapping::HTM1)) {
+        return nullptr;
+    }
+    auto chunkQueryTemplates = std::make_shared<ChunkQueryTemplates>();
+    chunkQueryTemplates->chunkTag = queryMapping.getTag(qana::QueryMapping::CHUNK);
+    if (queryMapping.hasChunks() && chunkQueryTemplates->chunkTag.empty()) {
+        return nullptr;
+    }
+    if (queryMapping.hasSubChunks()) {
+        chunkQueryTemplates->subChunkTag = queryMapping.getTag(qana::QueryMapping::SUBCHUNK);
+        if (chunkQueryTemplates->subChunkTag.empty()) {
+            return nullptr;
+        }
+    }
+    // The worker replaces the markup in the whole text, as
+    // QueryMapping::apply() does in each template entry.
+    for (auto const& qTemplate : queryTemplates) {
+        chunkQueryTemplates->queries.push_back(qTemplate.sqlFragment());
+    }
+    return chunkQueryTemplates;
+}
+
+
 ChunkQuerySpec::Ptr QuerySession::buildChunkQuerySpec(query::QueryTemplate::Vect const& queryTemplates,
-                                                 ChunkSpec const& chunkSpec) const {
+                                                 ChunkSpec const& chunkSpec,
+                                                 ChunkQueryTemplates::Ptr const& chunkQueryTemplates) const {
+    CompiledTemplates compiledTemplates;
+    if (chunkQueryTemplates == nullptr) {
+        compiledTemplates = compileQueryTemplates(queryTemplates);
+    }
+    return buildChunkQuerySpec(compiledTemplates, chunkSpec, chunkQueryTemplates);
+}
+
+
+ChunkQuerySpec::Ptr QuerySession::buildChunkQuerySpec(CompiledTemplates const& compiledTemplates,
+                                                 ChunkSpec const& chunkSpec,
+                                                 ChunkQueryTemplates::Ptr const& chunkQueryTemplates) const {
     auto cQSpec = std::make_shared<ChunkQuerySpec>(_context->dominantDb, chunkSpec.chunkId,
                                                   _context->scanInfo, _scanInteractive);
+    cQSpec->queryTemplates = chunkQueryTemplates;
+    bool const buildQueries = chunkQueryTemplates == nullptr;
     // Reset subChunkTables
     qana::QueryMapping const& queryMapping = *(_context->queryMapping);
     DbTableSet const& sTables = queryMapping.getSubChunkTables();
     cQSpec->subChunkTables = sTables;
     // Build queries.
     if (!_context->hasSubChunks()) {
-        cQSpec->queries = _buildChunkQueries(queryTemplates, chunkSpec);
+        if (buildQueries) cQSpec->queries = _buildChunkQueries(compiledTemplates, chunkSpec);
     } else {
         if (chunkSpec.shouldSplit()) {
             ChunkSpecFragmenter frag(chunkSpec);
             ChunkSpec s = frag.get();
-            cQSpec->queries = _buildChunkQueries(queryTemplates, s);
+            if (buildQueries) cQSpec->queries = _buildChunkQueries(compiledTemplates, s);
             cQSpec->subChunkIds.assign(s.subChunks.begin(), s.subChunks.end());
             frag.next();
-            cQSpec->nextFragment = _buildFragment(queryTemplates, frag);
+            cQSpec->nextFragment = _buildFragment(compiledTemplates, frag, buildQueries);
         } else {
-            cQSpec->queries = _buildChunkQueries(queryTemplates, chunkSpec);
+            if (buildQueries) cQSpec->queries = _buildChunkQueries(compiledTemplates, chunkSpec);
             cQSpec->subChunkIds.assign(chunkSpec.subChunks.begin(),
                                       chunkSpec.subChunks.end());
         }
@@ -434,8 +506,8 @@ ChunkQuerySpec::Ptr QuerySession::buildChunkQuerySpec(query::QueryTemplate::Vect
 
 
 std::shared_ptr<ChunkQuerySpec>
-QuerySession::_buildFragment(query::QueryTemplate::Vect const& queryTemplates,
-                             ChunkSpecFragmenter& f) const {
+QuerySession::_buildFragment(CompiledTemplates const& compiledTemplates,
+                             ChunkSpecFragmenter& f, bool buildQueries) const {
     std::shared_ptr<ChunkQuerySpec> first;
     std::shared_ptr<ChunkQuerySpec> last;
     while(!f.isDone()) {
@@ -448,7 +520,7 @@ QuerySession::_buildFragment(query::QueryTemplate::Vect const& queryTemplates,
         }
         ChunkSpec s = f.get();
         last->subChunkIds.assign(s.subChunks.begin(), s.subChunks.end());
-        last->queries = _buildChunkQueries(queryTemplates, s);
+        if (buildQueries) last->queries = _buildChunkQueries(compiledTemplates, s);
         f.next();
     }
     return first;
@@ -43,6 +43,7 @@
 #include "css/CssAccess.h"
 #include "global/intTypes.h"
 #include "mysql/MySqlConfig.h"
+#include "qana/QueryMapping.h"
 #include "qana/QueryPlugin.h"
 #include "qproc/ChunkQuerySpec.h"
 #include "qproc/ChunkSpec.h"
@@ -133,8 +134,35 @@ public:
 
     std::shared_ptr<query::SelectStmt> getMergeStmt() const;
 
+    /// @return the LIMIT of a query for which any that many rows of the chunk
+    ///         results are a complete result, or NOTSET if the merge has to
+    ///         see all rows (to sort, aggregate, or remove duplicates).
+    int getEarlyLimit() const;
+
+    /// @return the queryTemplates in the form the worker generates chunk
+    ///         queries from, or nullptr if the query mapping has markup the
+    ///         worker cannot substitute.
+    ChunkQueryTemplates::Ptr makeChunkQueryTemplates(query::QueryTemplate::Vect const& queryTemplates) const;
+
+    /// queryTemplates compiled for generating chunk queries quickly.
+    typedef std::vector<qana::QueryMapping::CompiledTemplate> CompiledTemplates;
+
+    /// @return queryTemplates, as returned by makeQueryTemplates(), compiled
+    ///         once for building the queries of many chunks.
+    CompiledTemplates compileQueryTemplates(query::QueryTemplate::Vect const& queryTemplates) const;
+
+    /// Build the spec of the queries on a chunk, leaving their generation
+    /// to the worker if chunkQueryTemplates is set. This only reads the
+    /// analysis state of the session, so it may be called from several
+    /// threads at the same time.
+    ChunkQuerySpec::Ptr buildChunkQuerySpec(CompiledTemplates const& compiledTemplates,
+                                       ChunkSpec const& chunkSpec,
+                                       ChunkQueryTemplates::Ptr const& chunkQueryTemplates=nullptr) const;
+
+    /// Build the spec of the queries on a chunk, compiling queryTemplates for it.
     ChunkQuerySpec::Ptr buildChunkQuerySpec(query::QueryTemplate::Vect const& queryTemplates,
-                                       ChunkSpec const& chunkSpec) const;
+                                       ChunkSpec const& chunkSpec,
+                                       ChunkQueryTemplates::Ptr const& chunkQueryTemplates=nullptr) const;
 
     /// Finalize a query after chunk coverage has been updated
     void finalize();
@@ -176,10 +204,10 @@ private:
     void _generateConcrete();
     void _applyConcretePlugins();
 
-    std::vector<std::string> _buildChunkQueries(query::QueryTemplate::Vect const& queryTemplates,
+    std::vector<std::string> _buildChunkQueries(CompiledTemplates const& compiledTemplates,
                                                 ChunkSpec const& chunkSpec) const;
-    std::shared_ptr<ChunkQuerySpec> _buildFragment(query::QueryTemplate::Vect const& queryTemplates,
-                                                   ChunkSpecFragmenter& f) const;
+    std::shared_ptr<ChunkQuerySpec> _buildFragment(CompiledTemplates const& compiledTemplates,
+                                                   ChunkSpecFragmenter& f, bool buildQueries) const;
 
     // Fields
     std::shared_ptr<css::CssAccess> _css; ///< Metadata access
@@ -64,9 +64,12 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
     taskMsg->set_session(_session);
     taskMsg->set_db(chunkQuerySpec.db);
     taskMsg->set_protocol(2);
+    taskMsg->set_maxprotocol(3); // Row batches, if the worker supports them.
     taskMsg->set_queryid(queryId);
     taskMsg->set_jobid(jobId);
     taskMsg->set_attemptcount(attemptCount);
+    // Much cheaper than MD5, workers that do not support it still use MD5.
+    taskMsg->set_checksumtype(proto::CHECKSUM_CRC32C);
     // scanTables (for shared scans)
     // check if more than 1 db in scanInfo
     std::string db;
@@ -83,9 +86,21 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
 
     taskMsg->set_scanpriority(chunkQuerySpec.scanInfo.scanRating);
     taskMsg->set_scaninteractive(chunkQuerySpec.scanInteractive);
+    // Interactive results are small, and waiting on them should be short.
+    if (!chunkQuerySpec.scanInteractive && _resultCompressionLevel > 0) {
+        taskMsg->set_compressionlevel(_resultCompressionLevel);
+    }
 
     // per-chunk
     taskMsg->set_chunkid(chunkQuerySpec.chunkId);
+    // The worker generates the queries of the chunk.
+    ChunkQueryTemplates const* queryTemplates = chunkQuerySpec.queryTemplates.get();
+    if (queryTemplates != nullptr) {
+        taskMsg->set_chunktag(queryTemplates->chunkTag);
+        if (!queryTemplates->subChunkTag.empty()) {
+            taskMsg->set_subchunktag(queryTemplates->subChunkTag);
+        }
+    }
     // per-fragment
     // TODO refactor to simplify
     if (chunkQuerySpec.nextFragment.get()) {
@@ -98,7 +113,7 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
             // Linked fragments will not have valid subChunkTables vectors,
             // So, we reuse the root fragment's vector.
             _addFragment(*taskMsg, resultTable, chunkQuerySpec.subChunkTables,
-                         sPtr->subChunkIds, sPtr->queries);
+                         sPtr->subChunkIds, sPtr->queries, queryTemplates);
             sPtr = sPtr->nextFragment.get();
         }
     } else {
@@ -107,7 +122,7 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
             LOGS(_log, LOG_LVL_DEBUG, (chunkQuerySpec.queries).at(t));
         }
         _addFragment(*taskMsg, resultTable, chunkQuerySpec.subChunkTables,
-                     chunkQuerySpec.subChunkIds, chunkQuerySpec.queries);
+                     chunkQuerySpec.subChunkIds, chunkQuerySpec.queries, queryTemplates);
     }
     return taskMsg;
 }
@@ -116,12 +131,19 @@ std::shared_ptr<proto::TaskMsg> TaskMsgFactory::_makeMsg(ChunkQuerySpec const& c
 void TaskMsgFactory::_addFragment(proto::TaskMsg& taskMsg, std::string const& resultName,
                                   DbTableSet const& subChunkTables,
                                   std::vector<int> const& subChunkIds,
-                                  std::vector<std::string> const& queries) {
+                                  std::vector<std::string> const& queries,
+                                  ChunkQueryTemplates const* queryTemplates) {
      proto::TaskMsg::Fragment* frag = taskMsg.add_fragment();
      frag->set_resulttable(resultName);
 
-     for(auto& qry : queries)  {
-         frag->add_query(qry);
+     if (queryTemplates != nullptr) {
+         for(auto& qry : queryTemplates->queries)  {
+             frag->add_querytemplate(qry);
+         }
+     } else {
+         for(auto& qry : queries)  {
+             frag->add_query(qry);
+         }
      }
 
      proto::TaskMsg_Subchunk sc;
@@ -44,6 +44,7 @@ namespace qserv {
 namespace qproc {
 
 class ChunkQuerySpec;
+struct ChunkQueryTemplates;
 
 /// TaskMsgFactory is a factory for TaskMsg (protobuf) objects.
 /// All member variables must be thread safe.
@@ -51,7 +52,10 @@ class TaskMsgFactory {
 public:
     using Ptr = std::shared_ptr<TaskMsgFactory>;
 
-    TaskMsgFactory(uint64_t session) : _session(session) {}
+    /// @param resultCompressionLevel zstd level for results of scan queries,
+    ///        0 or less for no compression.
+    TaskMsgFactory(uint64_t session, int resultCompressionLevel=0)
+        : _session(session), _resultCompressionLevel(resultCompressionLevel) {}
     virtual ~TaskMsgFactory() {}
 
     /// Construct a TaskMsg and serialize it to a stream
@@ -65,12 +69,15 @@ private:
                                              std::string const& chunkResultName,
                                              uint64_t queryId, int jobId, int attemptCount);
 
+    /// Add a fragment of queries, or of query templates if queryTemplates is set.
     void _addFragment(proto::TaskMsg& taskMsg, std::string const& resultName,
                       DbTableSet const& subChunkTables, std::vector<int> const& subChunkIds,
-                      std::vector<std::string> const& queries);
+                      std::vector<std::string> const& queries,
+                      ChunkQueryTemplates const* queryTemplates);
 
     /// All member variable need to be thread safe.
     uint64_t const _session;
+    int const _resultCompressionLevel;
 };
 
 }}} // namespace lsst::qserv::qproc
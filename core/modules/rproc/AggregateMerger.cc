@@ -0,0 +1,746 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/AggregateMerger.h"
+
+// System headers
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "proto/RowBatch.h"
+#include "proto/worker.pb.h"
+#include "query/ColumnRef.h"
+#include "query/FuncExpr.h"
+#include "query/GroupByClause.h"
+#include "query/SelectList.h"
+#include "query/SelectStmt.h"
+#include "query/ValueExpr.h"
+#include "query/ValueFactor.h"
+#include "rproc/ProtoRowBuffer.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.AggregateMerger");
+
+/// Approximate bookkeeping cost of one hash table entry, in bytes.
+size_t const ENTRY_OVERHEAD = 64;
+
+/// Sums of integer columns are exact, as they are for mysql, which returns
+/// them as DECIMAL. Values of integer columns fit in 65 bits, so no sum of
+/// fewer than 2^62 of them overflows.
+typedef __int128 Int;
+
+/// Digits after the decimal point of the DECIMAL quotient of integer sums,
+/// for the default div_precision_increment of mysql.
+int const DIV_PRECISION_INCREMENT = 4;
+
+/// Value is an accumulator for one aggregate. Values of integer columns are
+/// handled as Int, those of FLOAT and DOUBLE columns as a double.
+struct Value {
+    bool isNull{true};
+    bool isInt{true};
+    Int i{0};
+    double d{0.0};
+
+    double asDouble() const { return isInt ? static_cast<double>(i) : d; }
+};
+
+/// Parse the text form of a numeric column, as sent by the worker.
+/// @param isFloat true for FLOAT and DOUBLE columns.
+void parseValue(std::string const& str, bool isFloat, Value& v) {
+    v.isNull = false;
+    char const* begin = str.c_str();
+    if (!isFloat) {
+        // Integer columns fit in 20 digits, and a sign.
+        char const* digit = (*begin == '-') ? begin + 1 : begin;
+        Int i = 0;
+        char const* c = digit;
+        for (; *c >= '0' && *c <= '9' && c - digit < 20; ++c) {
+            i = i * 10 + (*c - '0');
+        }
+        if (c != digit && *c == '\0') {
+            v.isInt = true;
+            v.i = (digit == begin) ? i : -i;
+            return;
+        }
+    }
+    v.isInt = false;
+    v.d = std::strtod(begin, nullptr);
+}
+
+
+/// Append the decimal form of i to str.
+void appendInt(std::string& str, Int i) {
+    char buf[48];
+    char* end = buf + sizeof(buf);
+    char* c = end;
+    bool const negative = i < 0;
+    do {
+        int digit = static_cast<int>(i % 10);
+        *--c = '0' + (negative ? -digit : digit);
+        i /= 10;
+    } while (i != 0);
+    if (negative) {
+        *--c = '-';
+    }
+    str.append(c, end - c);
+}
+
+
+/// Append sum/count to str as mysql formats the DECIMAL quotient of integer
+/// sums, rounded half away from zero to DIV_PRECISION_INCREMENT digits.
+void appendQuotient(std::string& str, Int sum, Int count) {
+    Int scale = 1;
+    for (int j = 0; j < DIV_PRECISION_INCREMENT; ++j) {
+        scale *= 10;
+    }
+    if (count < 0) {
+        sum = -sum;
+        count = -count;
+    }
+    Int q = sum * scale / count;
+    Int r = sum * scale % count;
+    if (2 * (r < 0 ? -r : r) >= count) {
+        q += (sum < 0) ? -1 : 1;
+    }
+    if (q < 0) {
+        str += '-';
+        q = -q;
+    }
+    appendInt(str, q / scale);
+    std::string fraction;
+    appendInt(fraction, q % scale);
+    str += '.';
+    str.append(DIV_PRECISION_INCREMENT - fraction.size(), '0');
+    str += fraction;
+}
+
+
+bool lessThan(Value const& a, Value const& b) {
+    if (a.isInt && b.isInt) {
+        return a.i < b.i;
+    }
+    return a.asDouble() < b.asDouble();
+}
+
+
+/// Combine in into acc, using SQL semantics: NULL inputs are ignored and the
+/// result is NULL only if all inputs are NULL.
+void combine(lsst::qserv::rproc::AggregateMerger::Kind kind, Value& acc, Value const& in) {
+    using lsst::qserv::rproc::AggregateMerger;
+    if (in.isNull) {
+        return;
+    }
+    if (acc.isNull) {
+        acc = in;
+        return;
+    }
+    switch (kind) {
+    case AggregateMerger::MIN:
+        if (lessThan(in, acc)) acc = in;
+        break;
+    case AggregateMerger::MAX:
+        if (lessThan(acc, in)) acc = in;
+        break;
+    default: // SUM, and the parts of AVG
+        if (acc.isInt && in.isInt) {
+            acc.i += in.i;
+        } else {
+            acc.d = acc.asDouble() + in.asDouble();
+            acc.isInt = false;
+        }
+        break;
+    }
+}
+
+
+/// Append a column value to a GROUP BY key. Each value is encoded as a null
+/// flag, followed by the length and bytes of non-null values, so that keys
+/// are unambiguous and can be decoded for output.
+void appendKey(std::string& key, char const* data, std::uint32_t len) {
+    if (data == nullptr) {
+        key += '\1';
+        return;
+    }
+    key += '\0';
+    key.append(reinterpret_cast<char const*>(&len), sizeof(len));
+    key.append(data, len);
+}
+
+
+/// BundleRow gives access to the values of a protocol 2 row.
+struct BundleRow {
+    lsst::qserv::proto::RowBundle const& rb;
+
+    bool isNull(int pos) const { return rb.isnull(pos); }
+
+    void getValue(int pos, bool isFloat, Value& v) const { parseValue(rb.column(pos), isFloat, v); }
+
+    /// Floating point values are keyed by the same text as in a BatchRow,
+    /// so that results of both protocols can be merged together.
+    void appendKey(std::string& key, int pos, bool isFloat) const {
+        if (rb.isnull(pos)) {
+            ::appendKey(key, nullptr, 0);
+        } else if (isFloat) {
+            char buf[lsst::qserv::proto::MAX_NUMBER_SIZE];
+            int len = snprintf(buf, sizeof(buf), "%.17g", std::strtod(rb.column(pos).c_str(), nullptr));
+            ::appendKey(key, buf, len);
+        } else {
+            std::string const& col = rb.column(pos);
+            ::appendKey(key, col.data(), col.size());
+        }
+    }
+};
+
+
+/// BatchRow gives access to the values of a row of a protocol 3 batch.
+struct BatchRow {
+    lsst::qserv::proto::RowBatch const& batch;
+    int row;
+
+    bool isNull(int pos) const { return lsst::qserv::proto::isNull(batch.column(pos), row); }
+
+    void getValue(int pos, bool isFloat, Value& v) const {
+        using lsst::qserv::proto::ColumnBatch;
+        ColumnBatch const& col = batch.column(pos);
+        v.isNull = false;
+        switch (col.kind()) {
+        case ColumnBatch::INT64:
+            v.isInt = true;
+            v.i = col.int64value(row);
+            break;
+        case ColumnBatch::UINT64:
+            v.isInt = true;
+            v.i = col.uint64value(row);
+            break;
+        case ColumnBatch::DOUBLE:
+            v.isInt = false;
+            v.d = col.doublevalue(row);
+            break;
+        default:
+            {
+                char const* data;
+                size_t len;
+                lsst::qserv::proto::getBytes(col, row, data, len);
+                parseValue(std::string(data, len), isFloat, v);
+            }
+            break;
+        }
+    }
+
+    void appendKey(std::string& key, int pos, bool) const {
+        using lsst::qserv::proto::ColumnBatch;
+        ColumnBatch const& col = batch.column(pos);
+        if (lsst::qserv::proto::isNull(col, row)) {
+            ::appendKey(key, nullptr, 0);
+        } else if (col.kind() == ColumnBatch::BYTES) {
+            char const* data;
+            size_t len;
+            lsst::qserv::proto::getBytes(col, row, data, len);
+            ::appendKey(key, data, len);
+        } else {
+            char buf[lsst::qserv::proto::MAX_NUMBER_SIZE];
+            ::appendKey(key, buf, lsst::qserv::proto::formatNumber(col, row, buf));
+        }
+    }
+};
+
+
+/// @return true if values of mysqlType are floating point numbers.
+bool isFloat(int mysqlType) {
+    return mysqlType == MYSQL_TYPE_FLOAT || mysqlType == MYSQL_TYPE_DOUBLE;
+}
+
+
+/// @return true if values of mysqlType can be parsed by parseValue() and
+///         aggregated without losing precision. DECIMAL values are exact
+///         beyond what Int and double hold, so they are left to mysql.
+bool isNumeric(int mysqlType) {
+    switch (mysqlType) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_YEAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+/// @return true if equal values of mysqlType always have the same text form,
+///         so that GROUP BY can compare bytes instead of applying a collation.
+bool isGroupable(int mysqlType) {
+    switch (mysqlType) {
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL:
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_NEWDATE:
+    case MYSQL_TYPE_TIME:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+        return true;
+    default:
+        return isNumeric(mysqlType);
+    }
+}
+
+
+/// @return the name of the column that is the only argument of the function
+///         in vf, or an empty string if vf is anything else.
+std::string getFuncArg(lsst::qserv::query::ValueFactor const& vf, std::string& funcName) {
+    using lsst::qserv::query::ValueFactor;
+    if (vf.getType() != ValueFactor::FUNCTION && vf.getType() != ValueFactor::AGGFUNC) {
+        return std::string();
+    }
+    auto fe = vf.getFuncExpr();
+    if (fe == nullptr || fe->params.size() != 1 || fe->params.front() == nullptr) {
+        return std::string();
+    }
+    auto cr = fe->params.front()->getColumnRef();
+    if (cr == nullptr) {
+        return std::string();
+    }
+    funcName = fe->getName();
+    std::transform(funcName.begin(), funcName.end(), funcName.begin(), ::toupper);
+    return cr->column;
+}
+
+} // anonymous namespace
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// Table maps encoded GROUP BY keys to their accumulators.
+class AggregateMerger::Table {
+public:
+    std::mutex mtx; ///< Protects the members of a pending table.
+    std::unordered_map<std::string, std::vector<Value>> groups;
+    size_t sizeBytes{0};
+};
+
+
+/// RowSource writes the committed rows of an AggregateMerger in the format
+/// expected by LOAD DATA, one row at a time.
+class AggregateMerger::RowSource : public mysql::RowBuffer {
+public:
+    explicit RowSource(AggregateMerger::Ptr const& merger)
+        : _merger(merger),
+          _iter(merger->_table->groups.begin()),
+          _end(merger->_table->groups.end()) {}
+
+    unsigned fetch(char* buffer, unsigned bufLen) override {
+        while (_rowPos >= _row.size()) {
+            if (!_nextRow()) {
+                return 0;
+            }
+        }
+        unsigned fetched = std::min<size_t>(bufLen, _row.size() - _rowPos);
+        memcpy(buffer, _row.data() + _rowPos, fetched);
+        _rowPos += fetched;
+        return fetched;
+    }
+
+    bool fetchesPartialRows() const override { return true; }
+
+    std::string dump() const override {
+        return "AggregateMerger::RowSource groups=" + std::to_string(_merger->_table->groups.size());
+    }
+
+private:
+    bool _nextRow();
+    void _appendValue(Value const& v);
+
+    AggregateMerger::Ptr _merger;
+    std::unordered_map<std::string, std::vector<Value>>::const_iterator _iter;
+    std::unordered_map<std::string, std::vector<Value>>::const_iterator _end;
+    std::string _row;
+    size_t _rowPos{0};
+    std::vector<std::pair<char const*, std::uint32_t>> _keyCols; ///< nullptr for NULL.
+};
+
+
+bool AggregateMerger::RowSource::_nextRow() {
+    if (_iter == _end) {
+        return false;
+    }
+    std::string const& key = _iter->first;
+    std::vector<Value> const& accs = _iter->second;
+    ++_iter;
+
+    _keyCols.clear();
+    for (size_t pos = 0; pos < key.size();) {
+        if (key[pos++] == '\1') {
+            _keyCols.emplace_back(nullptr, 0);
+            continue;
+        }
+        std::uint32_t len;
+        memcpy(&len, key.data() + pos, sizeof(len));
+        pos += sizeof(len);
+        _keyCols.emplace_back(key.data() + pos, len);
+        pos += len;
+    }
+
+    _row.clear();
+    _rowPos = 0;
+    auto const& columns = _merger->_columns;
+    for (size_t j = 0; j < columns.size(); ++j) {
+        if (j > 0) {
+            _row += '\t';
+        }
+        int slot = _merger->_outSlot[j];
+        switch (columns[j].kind) {
+        case GROUP:
+            if (_keyCols[slot].first == nullptr) {
+                _row += "\\N";
+            } else {
+                ProtoRowBuffer::copyColumn(_row, std::string(_keyCols[slot].first, _keyCols[slot].second));
+            }
+            break;
+        case AVG:
+            {
+                Value const& sum = accs[slot];
+                Value const& count = accs[slot + 1];
+                if (sum.isNull || count.isNull || count.asDouble() == 0) {
+                    _row += "\\N";
+                } else if (sum.isInt && count.isInt) {
+                    appendQuotient(_row, sum.i, count.i);
+                } else {
+                    Value avg;
+                    avg.isNull = false;
+                    avg.isInt = false;
+                    avg.d = sum.asDouble() / count.asDouble();
+                    _appendValue(avg);
+                }
+            }
+            break;
+        default:
+            _appendValue(accs[slot]);
+            break;
+        }
+    }
+    _row += '\n';
+    return true;
+}
+
+
+void AggregateMerger::RowSource::_appendValue(Value const& v) {
+    if (v.isNull) {
+        _row += "\\N";
+    } else if (v.isInt) {
+        appendInt(_row, v.i);
+    } else {
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "%.17g", v.d);
+        _row.append(buf, len);
+    }
+}
+
+
+AggregateMerger::AggregateMerger(std::vector<Column> const& columns, std::vector<std::string> const& groupBy)
+    : _columns(columns), _groupBy(groupBy), _table(std::make_shared<Table>()) {
+}
+
+
+AggregateMerger::Ptr AggregateMerger::newIfSupported(query::SelectStmt& mergeStmt) {
+    if (mergeStmt.getDistinct() || mergeStmt.hasWhereClause() || mergeStmt.hasHaving()
+        || mergeStmt.hasOrderBy() || mergeStmt.hasLimit()) {
+        return nullptr;
+    }
+    std::vector<std::string> groupBy;
+    if (mergeStmt.hasGroupBy()) {
+        query::ValueExprPtrVector groupExprs;
+        mergeStmt.getGroupBy().findValueExprs(groupExprs);
+        for (auto const& ve : groupExprs) {
+            auto cr = (ve == nullptr) ? nullptr : ve->getColumnRef();
+            if (cr == nullptr) {
+                return nullptr;
+            }
+            groupBy.push_back(cr->column);
+        }
+    }
+
+    auto selectList = mergeStmt.getSelectList().getValueExprList();
+    if (selectList == nullptr || selectList->empty()) {
+        return nullptr;
+    }
+    std::vector<Column> columns;
+    for (auto const& ve : *selectList) {
+        if (ve == nullptr || ve->getFactorOps().size() != 1) {
+            return nullptr;
+        }
+        auto const& vf = ve->getFactorOps().front().factor;
+        if (vf == nullptr) {
+            return nullptr;
+        }
+        std::string funcName;
+        if (vf->getType() == query::ValueFactor::COLUMNREF) {
+            // Plain columns must be GROUP BY columns, otherwise the value
+            // mysql would pick is arbitrary.
+            std::string const& name = vf->getColumnRef()->column;
+            if (std::find(groupBy.begin(), groupBy.end(), name) == groupBy.end()) {
+                return nullptr;
+            }
+            columns.emplace_back(GROUP, name);
+        } else if (vf->getType() == query::ValueFactor::EXPR) {
+            // AVG is merged as SUM(sum column)/SUM(count column)
+            auto expr = vf->getExpr();
+            if (expr == nullptr || expr->getFactorOps().size() != 2) {
+                return nullptr;
+            }
+            auto const& sumOp = expr->getFactorOps()[0];
+            auto const& countOp = expr->getFactorOps()[1];
+            if (sumOp.op != query::ValueExpr::DIVIDE || countOp.op != query::ValueExpr::NONE
+                || sumOp.factor == nullptr || countOp.factor == nullptr) {
+                return nullptr;
+            }
+            std::string countFunc;
+            std::string sumCol = getFuncArg(*sumOp.factor, funcName);
+            std::string countCol = getFuncArg(*countOp.factor, countFunc);
+            if (sumCol.empty() || countCol.empty() || funcName != "SUM" || countFunc != "SUM") {
+                return nullptr;
+            }
+            columns.emplace_back(AVG, sumCol, countCol);
+        } else {
+            std::string col = getFuncArg(*vf, funcName);
+            if (col.empty()) {
+                return nullptr;
+            }
+            // COUNT is merged as a SUM of the worker counts.
+            if (funcName == "SUM") {
+                columns.emplace_back(SUM, col);
+            } else if (funcName == "MIN") {
+                columns.emplace_back(MIN, col);
+            } else if (funcName == "MAX") {
+                columns.emplace_back(MAX, col);
+            } else {
+                return nullptr;
+            }
+        }
+    }
+    return std::make_shared<AggregateMerger>(columns, groupBy);
+}
+
+
+bool AggregateMerger::setSchema(proto::RowSchema const& rowSchema) {
+    // @return the position of column name, or -1 if it is missing or its
+    //         type is not acceptable.
+    auto findColumn = [&rowSchema](std::string const& name, bool group) -> int {
+        for (int i = 0, e = rowSchema.columnschema_size(); i != e; ++i) {
+            proto::ColumnSchema const& cs = rowSchema.columnschema(i);
+            if (cs.name() != name) continue;
+            if (!cs.has_mysqltype()) return -1;
+            bool ok = group ? isGroupable(cs.mysqltype()) : isNumeric(cs.mysqltype());
+            return ok ? i : -1;
+        }
+        return -1;
+    };
+
+    _groupPos.clear();
+    _groupIsFloat.clear();
+    _accPos.clear();
+    _accKind.clear();
+    _accIsFloat.clear();
+    _outSlot.clear();
+    for (auto const& name : _groupBy) {
+        int pos = findColumn(name, true);
+        if (pos < 0) {
+            LOGS(_log, LOG_LVL_DEBUG, "AggregateMerger cannot group by " << name);
+            return false;
+        }
+        _groupPos.push_back(pos);
+        _groupIsFloat.push_back(isFloat(rowSchema.columnschema(pos).mysqltype()));
+    }
+    for (auto const& col : _columns) {
+        if (col.kind == GROUP) {
+            auto iter = std::find(_groupBy.begin(), _groupBy.end(), col.input);
+            if (iter == _groupBy.end()) {
+                return false;
+            }
+            _outSlot.push_back(iter - _groupBy.begin());
+            continue;
+        }
+        int pos = findColumn(col.input, false);
+        int countPos = (col.kind == AVG) ? findColumn(col.count, false) : 0;
+        if (pos < 0 || countPos < 0) {
+            LOGS(_log, LOG_LVL_DEBUG, "AggregateMerger cannot aggregate " << col.input);
+            return false;
+        }
+        _outSlot.push_back(_accPos.size());
+        _accPos.push_back(pos);
+        _accIsFloat.push_back(isFloat(rowSchema.columnschema(pos).mysqltype()));
+        if (col.kind == AVG) {
+            // Sum of sums, followed by sum of counts.
+            _accKind.push_back(SUM);
+            _accPos.push_back(countPos);
+            _accIsFloat.push_back(isFloat(rowSchema.columnschema(countPos).mysqltype()));
+            _accKind.push_back(SUM);
+        } else {
+            _accKind.push_back(col.kind);
+        }
+    }
+    return true;
+}
+
+
+std::shared_ptr<AggregateMerger::Table> AggregateMerger::_getPending(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& pending = _pending[jobIdAttempt];
+    if (pending == nullptr) {
+        pending = std::make_shared<Table>();
+    }
+    return pending;
+}
+
+
+void AggregateMerger::fold(proto::Result const& result, int jobIdAttempt) {
+    if (proto::countRows(result) > 0) {
+        auto pending = _getPending(jobIdAttempt);
+        std::lock_guard<std::mutex> lock(pending->mtx);
+        size_t added = 0;
+        std::string key;
+        for (auto const& rb : result.row()) {
+            added += _foldRow(*pending, BundleRow{rb}, key);
+        }
+        for (auto const& batch : result.batch()) {
+            for (int r = 0, e = batch.rowcount(); r != e; ++r) {
+                added += _foldRow(*pending, BatchRow{batch, r}, key);
+            }
+        }
+        pending->sizeBytes += added;
+        _sizeBytes += added;
+    }
+    if (!result.continues()) {
+        _commit(jobIdAttempt);
+    }
+}
+
+
+/// Fold a row into table. key is scratch space.
+/// @return the number of bytes added to table.
+template <typename Row>
+size_t AggregateMerger::_foldRow(Table& table, Row const& row, std::string& key) {
+    size_t const nAcc = _accPos.size();
+    size_t added = 0;
+    key.clear();
+    for (size_t g = 0; g < _groupPos.size(); ++g) {
+        row.appendKey(key, _groupPos[g], _groupIsFloat[g]);
+    }
+    auto iter = table.groups.find(key);
+    if (iter == table.groups.end()) {
+        iter = table.groups.emplace(key, std::vector<Value>(nAcc)).first;
+        added += key.size() + nAcc * sizeof(Value) + ENTRY_OVERHEAD;
+    }
+    std::vector<Value>& accs = iter->second;
+    Value v;
+    for (size_t a = 0; a < nAcc; ++a) {
+        int pos = _accPos[a];
+        if (row.isNull(pos)) continue;
+        row.getValue(pos, _accIsFloat[a], v);
+        combine(_accKind[a], accs[a], v);
+    }
+    return added;
+}
+
+
+/// Move the rows of a completed job attempt into the shared table.
+void AggregateMerger::_commit(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _committed.insert(jobIdAttempt);
+    auto pIter = _pending.find(jobIdAttempt);
+    if (pIter == _pending.end()) {
+        return; // No rows.
+    }
+    std::shared_ptr<Table> pending = pIter->second;
+    _pending.erase(pIter);
+
+    std::lock_guard<std::mutex> pLock(pending->mtx);
+    size_t const nAcc = _accKind.size();
+    size_t freed = 0;
+    for (auto& entry : pending->groups) {
+        auto iter = _table->groups.find(entry.first);
+        if (iter == _table->groups.end()) {
+            _table->groups.emplace(entry.first, std::move(entry.second));
+            continue;
+        }
+        for (size_t a = 0; a < nAcc; ++a) {
+            combine(_accKind[a], iter->second[a], entry.second[a]);
+        }
+        freed += entry.first.size() + nAcc * sizeof(Value) + ENTRY_OVERHEAD;
+    }
+    _sizeBytes -= freed;
+    LOGS(_log, LOG_LVL_TRACE, "AggregateMerger committed " << jobIdAttempt
+         << " groups=" << _table->groups.size());
+}
+
+
+bool AggregateMerger::scrub(std::set<int> const& jobIdAttempts) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    bool ok = true;
+    for (int jobIdAttempt : jobIdAttempts) {
+        if (_committed.count(jobIdAttempt) > 0) {
+            LOGS(_log, LOG_LVL_ERROR, "AggregateMerger rows of " << jobIdAttempt
+                 << " already committed, cannot be removed");
+            ok = false;
+            continue;
+        }
+        auto iter = _pending.find(jobIdAttempt);
+        if (iter != _pending.end()) {
+            _sizeBytes -= iter->second->sizeBytes;
+            _pending.erase(iter);
+        }
+    }
+    return ok;
+}
+
+
+mysql::RowBuffer::Ptr AggregateMerger::newRowBuffer() {
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        // Without GROUP BY, aggregating no rows still produces a (NULL) row.
+        if (_groupBy.empty() && _table->groups.empty()) {
+            _table->groups.emplace(std::string(), std::vector<Value>(_accKind.size()));
+        }
+    }
+    return std::make_shared<RowSource>(shared_from_this());
+}
+
+}}} // namespace lsst::qserv::rproc
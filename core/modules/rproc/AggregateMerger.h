@@ -0,0 +1,139 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_RPROC_AGGREGATEMERGER_H
+#define LSST_QSERV_RPROC_AGGREGATEMERGER_H
+
+// System headers
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "mysql/RowBuffer.h"
+
+// Forward declarations
+namespace lsst {
+namespace qserv {
+namespace proto {
+    class Result;
+    class RowSchema;
+}
+namespace query {
+    class SelectStmt;
+}
+}} // End of forward declarations
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// AggregateMerger evaluates a merge statement made only of decomposable
+/// aggregates (the merge forms produced by query::AggOp for COUNT, SUM, MIN,
+/// MAX and AVG) and GROUP BY columns in memory. Worker result rows are folded
+/// into a hash table keyed by the GROUP BY values as they arrive, so only the
+/// final rows need to be written to the result table.
+///
+/// Rows of a job attempt are kept in a table of their own until the last
+/// message of the attempt has been folded, at which point they are committed
+/// to the shared table. Rows of a failed attempt can be dropped until then.
+class AggregateMerger : public std::enable_shared_from_this<AggregateMerger> {
+public:
+    typedef std::shared_ptr<AggregateMerger> Ptr;
+
+    /// Function applied to a worker result column.
+    enum Kind { GROUP, SUM, MIN, MAX, AVG };
+
+    /// Description of one column of the merge statement select list.
+    struct Column {
+        Column(Kind kind_, std::string const& input_, std::string const& count_=std::string())
+            : kind(kind_), input(input_), count(count_) {}
+        Kind kind;
+        std::string input; ///< Worker result column (the sum column for AVG).
+        std::string count; ///< Worker result count column, AVG only.
+    };
+
+    AggregateMerger(std::vector<Column> const& columns, std::vector<std::string> const& groupBy);
+    AggregateMerger(AggregateMerger const&) = delete;
+    AggregateMerger& operator=(AggregateMerger const&) = delete;
+
+    /// @return an AggregateMerger for mergeStmt, or nullptr if mergeStmt
+    ///         contains anything that cannot be evaluated by this class, in
+    ///         which case the merge has to be done by the database.
+    static Ptr newIfSupported(query::SelectStmt& mergeStmt);
+
+    /// Locate the input columns in the worker result schema.
+    /// @return false if a column is missing or has a type that cannot be
+    ///         handled. No rows may be folded in that case.
+    bool setSchema(proto::RowSchema const& rowSchema);
+
+    /// Fold the rows of a worker result into the table of jobIdAttempt, and
+    /// commit that table if the result is the last one of the attempt.
+    void fold(proto::Result const& result, int jobIdAttempt);
+
+    /// Drop the rows of failed job attempts.
+    /// @return false if rows of any of them were already committed and can
+    ///         no longer be removed.
+    bool scrub(std::set<int> const& jobIdAttempts);
+
+    /// @return a RowBuffer producing the final rows, in merge statement
+    ///         column order, for LOAD DATA. Uncommitted rows are ignored.
+    mysql::RowBuffer::Ptr newRowBuffer();
+
+    /// @return the approximate memory used by committed and pending rows.
+    size_t getSizeBytes() const { return _sizeBytes; }
+
+private:
+    class Table;
+    class RowSource;
+
+    std::shared_ptr<Table> _getPending(int jobIdAttempt);
+    template <typename Row>
+    size_t _foldRow(Table& table, Row const& row, std::string& key);
+    void _commit(int jobIdAttempt);
+
+    std::vector<Column> const _columns;
+    std::vector<std::string> const _groupBy;
+
+    // Positions in the worker result schema, set by setSchema().
+    std::vector<int> _groupPos; ///< Position of each GROUP BY column.
+    std::vector<bool> _groupIsFloat; ///< True for FLOAT and DOUBLE GROUP BY columns.
+    std::vector<int> _accPos; ///< Position of the input of each accumulator.
+    std::vector<Kind> _accKind; ///< Function of each accumulator.
+    std::vector<bool> _accIsFloat; ///< True for FLOAT and DOUBLE accumulator inputs.
+    std::vector<int> _outSlot; ///< Key or accumulator index of each output column.
+
+    std::mutex _mtx; ///< Protects _table, _pending, and _committed.
+    std::shared_ptr<Table> _table; ///< Committed rows.
+    std::map<int, std::shared_ptr<Table>> _pending; ///< Rows of attempts still in progress.
+    std::set<int> _committed; ///< Job attempts whose rows are in _table.
+    std::atomic<size_t> _sizeBytes{0};
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_AGGREGATEMERGER_H
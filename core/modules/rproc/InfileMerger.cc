@@ -39,8 +39,10 @@
 #include "rproc/InfileMerger.h"
 
 // System headers
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <sys/time.h>
@@ -59,6 +61,7 @@
 #include "global/intTypes.h"
 #include "proto/WorkerResponse.h"
 #include "proto/ProtoImporter.h"
+#include "proto/RowBatch.h"
 #include "query/SelectStmt.h"
 #include "rproc/ProtoRowBuffer.h"
 #include "sql/Schema.h"
@@ -78,6 +81,9 @@ using lsst::qserv::rproc::InfileMergerConfig;
 using lsst::qserv::rproc::InfileMergerError;
 using lsst::qserv::util::ErrorCode;
 
+/// jobId of rows folded into the partial aggregate table.
+int const FOLDED_JOB_ID = -1;
+
 /// @return a timestamp id for use in generating temporary result table names.
 std::string getTimeStampId() {
     struct timeval now;
@@ -92,36 +98,85 @@ std::string getTimeStampId() {
     // Alternative (for production?) Use boost::uuid to construct ids that are
     // guaranteed to be unique.
 }
+
+/// Rows of spill file segments, handed to LOAD DATA as they are.
+class SpillRowBuffer : public lsst::qserv::mysql::RowBuffer {
+public:
+    void add(char const* data, size_t len) {
+        _spans.emplace_back(data, len);
+        _size += len;
+    }
+    size_t getSize() const { return _size; }
+
+    unsigned fetch(char* buffer, unsigned bufLen) override {
+        unsigned n = 0;
+        while (n < bufLen && _span < _spans.size()) {
+            auto const& span = _spans[_span];
+            size_t len = std::min<size_t>(bufLen - n, span.second - _pos);
+            std::memcpy(buffer + n, span.first + _pos, len);
+            n += len;
+            _pos += len;
+            if (_pos == span.second) {
+                ++_span;
+                _pos = 0;
+            }
+        }
+        return n;
+    }
+    bool fetchesPartialRows() const override { return true; }
+    std::string dump() const override { return "SpillRowBuffer size=" + std::to_string(_size); }
+
+private:
+    std::vector<std::pair<char const*, size_t>> _spans;
+    size_t _size{0};
+    size_t _span{0}; ///< Span being fetched.
+    size_t _pos{0};  ///< Bytes of it already fetched.
+};
 } // anonymous namespace
 
 namespace lsst {
 namespace qserv {
 namespace rproc {
 
+int const InfileMerger::CURSOR_END_BATCH;
 
 ////////////////////////////////////////////////////////////////////////
 // InfileMerger public
 ////////////////////////////////////////////////////////////////////////
 InfileMerger::InfileMerger(InfileMergerConfig const& c)
     : _config(c),
-      _mysqlConn(_config.mySqlConfig) {
+      _maxMergeConnections(std::max(1, c.maxMergeConnections)) {
     _alterJobIdColName(); // initialize jobIdColName.
     _fixupTargetName();
     _maxResultTableSizeMB = _config.mySqlConfig.maxTableSizeMB;
 
-    // Assume worst case of 10,000 bytes per row, what's the earliest row to test?
-    // Subtract that from the count so the first check doesn't happen for a while.
-    // Subsequent checks should happen at reasonable intervals.
-    // At 5000MB max size, the first check is made at 550,000 rows, with subsequent checks
-    // about every 50,000 rows.
-    _sizeCheckRowCount = -100*(_maxResultTableSizeMB);  //  100 = 1,000,000/10,000
+    // The size of the result table is estimated from the bytes loaded into it,
+    // and is only read from the database once the estimate is near the limit.
+    // From then on, checks are made at reasonable intervals, about every
+    // 50,000 rows at 5000MB max size.
+    _sizeCheckBytes = static_cast<std::uint64_t>(_maxResultTableSizeMB * SIZE_CHECK_FRACTION * MB_SIZE_BYTES);
     _checkSizeEveryXRows = 10*_maxResultTableSizeMB;
+    _sizeCheckRowCount = _checkSizeEveryXRows;
     LOGS(_log, LOG_LVL_DEBUG, "InfileMerger maxResultTableSizeMB=" << _maxResultTableSizeMB
-                              << " sizeCheckRowCount=" << _sizeCheckRowCount
-                              << " checkSizeEveryXRows=" << _checkSizeEveryXRows);
+                              << " sizeCheckBytes=" << _sizeCheckBytes
+                              << " checkSizeEveryXRows=" << _checkSizeEveryXRows
+                              << " maxMergeConnections=" << _maxMergeConnections);
     if (_config.mergeStmt) {
         _config.mergeStmt->setFromListAsTable(_mergeTable);
+        if (_config.nativeAggregation) {
+            _aggMerger = AggregateMerger::newIfSupported(*_config.mergeStmt);
+        }
+        if (_config.nativeTopK && _aggMerger == nullptr) {
+            _topKMerger = TopKMerger::newIfSupported(*_config.mergeStmt);
+        }
+        // Only used if neither of the above is, see _setupTable().
+        if (_config.partialAggregateRows > 0) {
+            _partialAgg = PartialAggregator::newIfSupported(*_config.mergeStmt);
+        }
     }
+    LOGS(_log, LOG_LVL_DEBUG, "InfileMerger nativeAggregation=" << (_aggMerger != nullptr)
+         << " nativeTopK=" << (_topKMerger != nullptr)
+         << " partialAggregation=" << (_partialAgg != nullptr));
 
     _invalidJobAttemptMgr.setDeleteFunc([this](InvalidJobAttemptMgr::jASetType const& jobAttempts) -> bool {
         return _deleteInvalidRows(jobAttempts);
@@ -132,9 +187,31 @@ InfileMerger::InfileMerger(InfileMergerConfig const& c)
         return !_needCreateTable;
     });
 
-    if (!_setupConnection()) {
+    // Make the first merge connection now so that a bad configuration is found early.
+    // Additional connections are made when concurrent merges need them.
+    std::unique_ptr<mysql::MySqlConnection> conn(new mysql::MySqlConnection(_config.mySqlConfig));
+    if (!_setupConnection(*conn)) {
         throw InfileMergerError(util::ErrorCode::MYSQLCONNECT, "InfileMerger mysql connect failure.");
     }
+    _mysqlConnPool.push_back(std::move(conn));
+    _mysqlConnCount = 1;
+
+    // Readers of a streamed result look for batches in the cursor table, which
+    // tells them that the result is streamed even before the first batch.
+    // Only rows loaded as they are into the result table can be read early,
+    // so it has no jobId column, and the job attempts are staged, see merge().
+    if (!_config.mergeStmt && _config.streamingBatchRows > 0) {
+        std::string const createCursor = "CREATE TABLE " + getCursorTableName(_config.targetTable)
+            + " (batch INT NOT NULL PRIMARY KEY, tableName VARCHAR(255) NOT NULL,"
+            " rowCount BIGINT NOT NULL) ENGINE=MyISAM";
+        if (_applyMysql(createCursor)) {
+            _mergeTable = _config.targetTable;
+            _jobIdColName.clear();
+            _streamingBatchRows = _config.streamingBatchRows;
+        } else {
+            LOGS(_log, LOG_LVL_WARN, "InfileMerger failed to create cursor table, not streaming");
+        }
+    }
 }
 
 
@@ -172,7 +249,7 @@ bool InfileMerger::merge(std::shared_ptr<proto::WorkerResponse> response) {
          << " sizes=" << static_cast<short>(response->headerSize)
          << ", " << response->protoHeader.size()
          << ", rowCount=" << response->result.rowcount()
-         << ", row_size=" << response->result.row_size()
+         << ", row_size=" << proto::countRows(response->result)
          << ", attemptCount=" << response-> result.attemptcount()
          << ", errCode=" << response->result.has_errorcode()
          << " hasErMsg=" << response->result.has_errormsg() << ")");
@@ -182,43 +259,116 @@ bool InfileMerger::merge(std::shared_ptr<proto::WorkerResponse> response) {
         LOGS(_log, LOG_LVL_ERROR, "Error in response data: " << _error);
         return false;
     }
+    if (!proto::checkBatches(response->result)) {
+        _error = util::Error(-1, "Malformed row batch in response data", -1);
+        LOGS(_log, LOG_LVL_ERROR, queryIdJobStr << " " << _error);
+        return false;
+    }
     if (_needCreateTable) {
         if (!_setupTable(*response)) {
             return false;
         }
     }
 
-    // Nothing to do if size is zero.
-    if (response->result.row_size() == 0) {
-        return true;
+    int resultJobId = makeJobIdAttempt(response->result.jobid(), response->result.attemptcount());
+    AggregateMerger::Ptr aggMerger = _getAggMerger();
+    if (aggMerger != nullptr) {
+        // Even results without rows are folded, as the last one of an attempt
+        // commits the rows of that attempt.
+        if (_invalidJobAttemptMgr.incrConcurrentMergeCount(resultJobId)) {
+            return true;
+        }
+        aggMerger->fold(response->result, resultJobId);
+        _invalidJobAttemptMgr.decrConcurrentMergeCount();
+        return _checkMemorySize(aggMerger->getSizeBytes(), queryIdJobStr);
+    }
+    TopKMerger::Ptr topKMerger = _getTopKMerger();
+    if (topKMerger != nullptr) {
+        // As above, the last result of an attempt commits its rows.
+        if (_invalidJobAttemptMgr.incrConcurrentMergeCount(resultJobId)) {
+            return true;
+        }
+        topKMerger->add(response->result, resultJobId);
+        _invalidJobAttemptMgr.decrConcurrentMergeCount();
+        return _checkMemorySize(topKMerger->getSizeBytes(), queryIdJobStr);
     }
-    _sizeCheckRowCount += response->result.row_size();
+
+    // Results of an attempt that span several messages are staged until the
+    // last one has arrived. They must be, whatever the configuration, when
+    // rows of the merge table cannot be deleted once published or folded.
+    // Otherwise, without a merge statement to read the staging table as it
+    // is, its rows would be written twice, and they are loaded as they arrive.
+    bool const last = !response->result.continues();
+    bool const mustStage = _streamingBatchRows > 0 || _getPartialAggregator() != nullptr;
+    bool const staged = (mustStage || (_config.stageJobAttempts && _config.mergeStmt))
+        && (!last || _hasStagingTable(resultJobId));
+
+    // Once spilling, rows of attempts not already staged go to the spill file.
+    SpillFile::Ptr spillFile = _getSpillFile();
+    if (spillFile != nullptr && !_hasStagingTable(resultJobId)) {
+        return _spill(*spillFile, response->result, resultJobId, last, queryIdJobStr);
+    }
+
+    // Nothing to do if size is zero, unless it completes a staged attempt.
+    int const rowCount = proto::countRows(response->result);
+    if (rowCount == 0) {
+        return staged ? _mergeStaged(nullptr, 0, resultJobId, last, queryIdJobStr) : true;
+    }
+    _sizeCheckRowCount += rowCount;
 
     bool ret = false;
     // Add columns to rows in virtFile.
-    int resultJobId = makeJobIdAttempt(response->result.jobid(), response->result.attemptcount());
-    ProtoRowBuffer::Ptr pRowBuffer = std::make_shared<ProtoRowBuffer>(response->result,
+    auto pRowBuffer = std::make_shared<ProtoRowBuffer>(response->result,
                                      resultJobId, _jobIdColName, _jobIdSqlType, _jobIdMysqlType);
-    std::string const virtFile = _infileMgr.prepareSrc(pRowBuffer, queryIdJobStr);
-    std::string const infileStatement = sql::formLoadInfile(_mergeTable, virtFile);
     auto start = std::chrono::system_clock::now();
-    // If the job attempt is invalid, exit without adding rows.
-    // It will wait here if rows need to be deleted.
-    if (_invalidJobAttemptMgr.incrConcurrentMergeCount(resultJobId)) {
-        return true;
+    if (staged) {
+        ret = _mergeStaged(pRowBuffer, rowCount, resultJobId, last, queryIdJobStr);
+    } else {
+        std::string const virtFile = _infileMgr.prepareSrc(pRowBuffer, queryIdJobStr);
+        std::string const infileStatement = sql::formLoadInfile(_mergeTable, virtFile);
+        // If the job attempt is invalid, exit without adding rows.
+        // It will wait here if rows need to be deleted.
+        if (_invalidJobAttemptMgr.incrConcurrentMergeCount(resultJobId)) {
+            return true;
+        }
+        _addUntaggedAttempt(resultJobId);
+        ret = _applyMysql(infileStatement);
+        _invalidJobAttemptMgr.decrConcurrentMergeCount();
     }
-    ret = _applyMysql(infileStatement);
-    _invalidJobAttemptMgr.decrConcurrentMergeCount();
     auto end = std::chrono::system_clock::now();
     auto mergeDur = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    LOGS(_log, LOG_LVL_DEBUG, queryIdJobStr << " mergeDur=" << mergeDur.count());
-    /// Check the size of the result table.
-    if (_sizeCheckRowCount >= _checkSizeEveryXRows) {
+    if (ret) {
+        _mergedRows += rowCount;
+        _mergedBytes += pRowBuffer->getBytesFetched();
+        // Fold or publish the merge table once enough rows have been loaded
+        // into it. Other merges go on loading while one of them does it.
+        PartialAggregator::Ptr partialAgg = _getPartialAggregator();
+        if (staged) {
+            // The rows are not in the merge table.
+        } else if (partialAgg != nullptr && _startSwap(rowCount, _config.partialAggregateRows)) {
+            ret = _foldMergeTable(*partialAgg, queryIdJobStr);
+            _swapping = false;
+        } else if (_streamingBatchRows > 0 && _startSwap(rowCount, _streamingBatchRows)) {
+            ret = _publishBatch(queryIdJobStr);
+            _swapping = false;
+        }
+        if (!_config.spillDir.empty() && _mergedBytes >= std::uint64_t(_config.spillThresholdBytes)
+            && spillFile == nullptr) {
+            _startSpill(queryIdJobStr);
+        }
+    }
+    LOGS(_log, LOG_LVL_DEBUG, queryIdJobStr << " mergeDur=" << mergeDur.count()
+         << " mergedBytes=" << _mergedBytes);
+    /// Check the size of the result table once the bytes loaded are near the
+    /// limit. Only one of the concurrent merges that cross the threshold
+    /// resets the count and does the check.
+    int rowsSinceCheck = _sizeCheckRowCount;
+    if (_mergedBytes >= _sizeCheckBytes && rowsSinceCheck >= _checkSizeEveryXRows
+        && _sizeCheckRowCount.compare_exchange_strong(rowsSinceCheck, 0)) {
         auto tSize = _getResultTableSizeMB();
         LOGS(_log, LOG_LVL_DEBUG, queryIdJobStr << "checking ResultTableSize " << _mergeTable
                                   << " " << tSize
                                   << " max=" << _maxResultTableSizeMB);
-        _sizeCheckRowCount = 0;
         if (tSize > _maxResultTableSizeMB) {
             // Try deleting invalid rows if there are any, then check size again
             bool validResult = _invalidJobAttemptMgr.holdMergingForRowDelete("Checking size");
@@ -241,23 +391,391 @@ bool InfileMerger::merge(std::shared_ptr<proto::WorkerResponse> response) {
 }
 
 
+bool InfileMerger::_hasStagingTable(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_stagingMtx);
+    return _stagingTables.count(jobIdAttempt) > 0;
+}
+
+
+/// Load the rowCount rows in rowBuffer, if any, into the staging table of
+/// jobIdAttempt, creating it as needed. If last is true, the staging table is
+/// then kept for the merge statement to read, or, without one, published as a
+/// batch of the streamed result.
+/// @return false if a statement failed.
+bool InfileMerger::_mergeStaged(std::shared_ptr<mysql::RowBuffer> const& rowBuffer, int rowCount,
+                                int jobIdAttempt, bool last, std::string const& queryIdJobStr) {
+    std::shared_ptr<StagingTable> staging;
+    {
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        auto& entry = _stagingTables[jobIdAttempt];
+        if (entry == nullptr) {
+            entry = std::make_shared<StagingTable>();
+        }
+        staging = entry;
+    }
+    std::lock_guard<std::mutex> lock(staging->mtx);
+    if (staging->dropped || _invalidJobAttemptMgr.isJobAttemptInvalid(jobIdAttempt)) {
+        LOGS(_log, LOG_LVL_INFO, queryIdJobStr << " " << jobIdAttempt << " invalid, not merging");
+        return true;
+    }
+    std::string const stagingTable = _getStagingTableName(jobIdAttempt);
+    if (!staging->created && rowBuffer != nullptr) {
+        if (!_applyMysql("CREATE TABLE " + stagingTable + " LIKE " + _mergeTable)) {
+            _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
+                                       "Error creating table (" + stagingTable + ")");
+            return false;
+        }
+        staging->created = true;
+    }
+    if (rowBuffer != nullptr) {
+        std::string const virtFile = _infileMgr.prepareSrc(rowBuffer, queryIdJobStr);
+        if (!_applyMysql(sql::formLoadInfile(stagingTable, virtFile))) {
+            return false;
+        }
+        staging->rows += rowCount;
+    }
+    if (!last) {
+        return true;
+    }
+
+    bool ok = true;
+    bool kept = false;
+    if (staging->created) {
+        if (!_invalidJobAttemptMgr.incrConcurrentMergeCount(jobIdAttempt)) {
+            // Rather than being written a second time, the rows are read
+            // from the staging table by the merge statement, or readers of
+            // the streamed result.
+            if (_config.mergeStmt) {
+                std::lock_guard<std::mutex> mapLock(_stagingMtx);
+                _keptAttempts.insert(jobIdAttempt);
+                kept = true;
+            } else {
+                ok = _publishStaged(stagingTable, staging->rows, jobIdAttempt, queryIdJobStr);
+                kept = ok;
+            }
+            _invalidJobAttemptMgr.decrConcurrentMergeCount();
+            LOGS(_log, LOG_LVL_DEBUG, queryIdJobStr << " kept " << stagingTable << " ok=" << ok);
+        }
+        if (!kept && !_applyMysql("DROP TABLE IF EXISTS " + stagingTable)) {
+            LOGS(_log, LOG_LVL_WARN, queryIdJobStr << " failed to drop " << stagingTable);
+        }
+    }
+    staging->dropped = true;
+    std::lock_guard<std::mutex> mapLock(_stagingMtx);
+    _stagingTables.erase(jobIdAttempt);
+    return ok;
+}
+
+
+/// Drop the staging table of a failed job attempt, once any load into it is done.
+void InfileMerger::_dropStagingTable(int jobIdAttempt) {
+    std::shared_ptr<StagingTable> staging;
+    {
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        auto iter = _stagingTables.find(jobIdAttempt);
+        if (iter == _stagingTables.end()) {
+            return;
+        }
+        staging = iter->second;
+        _stagingTables.erase(iter);
+    }
+    std::lock_guard<std::mutex> lock(staging->mtx);
+    if (staging->created && !staging->dropped) {
+        std::string const stagingTable = _getStagingTableName(jobIdAttempt);
+        LOGS(_log, LOG_LVL_INFO, _getQueryIdStr() << " dropping " << stagingTable);
+        if (!_applyMysql("DROP TABLE IF EXISTS " + stagingTable)) {
+            LOGS(_log, LOG_LVL_WARN, _getQueryIdStr() << " failed to drop " << stagingTable);
+        }
+    }
+    staging->dropped = true;
+}
+
+
+/// Drop the staging tables of attempts that never completed.
+void InfileMerger::_dropStagingTables() {
+    std::vector<int> jobIdAttempts;
+    {
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        for (auto const& entry : _stagingTables) {
+            jobIdAttempts.push_back(entry.first);
+        }
+    }
+    for (int jobIdAttempt : jobIdAttempts) {
+        _dropStagingTable(jobIdAttempt);
+    }
+}
+
+
+/// @return the merge table, followed by the staging tables kept for the merge
+///         statement.
+std::vector<std::string> InfileMerger::_getMergedTableNames() {
+    std::vector<std::string> tables(1, _mergeTable);
+    std::lock_guard<std::mutex> lock(_stagingMtx);
+    for (int jobIdAttempt : _keptAttempts) {
+        tables.push_back(_getStagingTableName(jobIdAttempt));
+    }
+    return tables;
+}
+
+
+/// Create a MERGE table over tables, which all have the columns of the merge
+/// table, for the merge statement to read all of their rows at once.
+/// @return false, setting the error, if it could not be created.
+bool InfileMerger::_createUnionTable(std::vector<std::string> const& tables) {
+    std::string createUnion;
+    {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        createUnion = sql::formCreateTable(_getUnionTableName(), _mergeSchema);
+    }
+    createUnion += " ENGINE=MERGE INSERT_METHOD=NO UNION=(";
+    for (auto iter = tables.begin(); iter != tables.end(); ++iter) {
+        if (iter != tables.begin()) {
+            createUnion += ",";
+        }
+        createUnion += *iter;
+    }
+    createUnion += ")";
+    if (!_applySqlLocal(createUnion, "createUnion")) {
+        _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
+                                   "Error creating table (" + _getUnionTableName() + ")");
+        return false;
+    }
+    return true;
+}
+
+
+/// Make the result table a view of the columns of the merge table other than
+/// the jobId column, if the merge table was created.
+/// @return false, setting the error, if it could not be created.
+bool InfileMerger::_createResultView() {
+    std::string columns;
+    {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        if (_needCreateTable) {
+            return true;
+        }
+        for (auto const& col : _mergeSchema.columns) {
+            if (col.name != _jobIdColName) {
+                columns += (columns.empty() ? "`" : ",`") + col.name + "`";
+            }
+        }
+    }
+    std::string const createView = "CREATE VIEW " + _config.targetTable + " AS SELECT "
+        + columns + " FROM " + _mergeTable;
+    if (!_applySqlLocal(createView, "createView")) {
+        _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
+                                   "Error creating view (" + _config.targetTable + ")");
+        return false;
+    }
+    return true;
+}
+
+
+/// Create the spill file, unless rows must be in the merge table as they
+/// arrive to be folded or published.
+void InfileMerger::_startSpill(std::string const& queryIdJobStr) {
+    if (_getPartialAggregator() != nullptr || _streamingBatchRows > 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_spillMtx);
+    if (_spillFile != nullptr || _spillFailed) {
+        return;
+    }
+    _spillFile = SpillFile::create(_config.spillDir, _mergeTable, _config.spillQuotaBytes);
+    if (_spillFile == nullptr) {
+        LOGS(_log, LOG_LVL_WARN, queryIdJobStr << " failed to create spill file, loading all rows");
+        _spillFailed = true;
+        return;
+    }
+    LOGS(_log, LOG_LVL_INFO, queryIdJobStr << " spilling rows of " << _mergeTable << " to "
+         << _spillFile->getPath() << " after mergedBytes=" << _mergedBytes);
+}
+
+
+/// Append the rows of a worker result to the spill file.
+/// @return false, setting the error, if they could not be written.
+bool InfileMerger::_spill(SpillFile& spillFile, proto::Result& result, int jobIdAttempt, bool last,
+                          std::string const& queryIdJobStr) {
+    if (_invalidJobAttemptMgr.isJobAttemptInvalid(jobIdAttempt)) {
+        LOGS(_log, LOG_LVL_INFO, queryIdJobStr << " " << jobIdAttempt << " invalid, not spilling");
+        return true;
+    }
+    int const rowCount = proto::countRows(result);
+    if (rowCount > 0) {
+        ProtoRowBuffer rowBuffer(result, jobIdAttempt, _jobIdColName, _jobIdSqlType, _jobIdMysqlType);
+        if (!spillFile.append(jobIdAttempt, rowCount, rowBuffer)) {
+            std::string msg = queryIdJobStr + " cancelling query, " + spillFile.getError();
+            LOGS(_log, LOG_LVL_ERROR, msg);
+            _error = util::Error(-1, msg, -1);
+            return false;
+        }
+        _mergedRows += rowCount;
+    }
+    if (last) {
+        std::lock_guard<std::mutex> lock(_spillMtx);
+        _spillCompleted.insert(jobIdAttempt);
+    }
+    return true;
+}
+
+
+/// Load the spilled rows of job attempts that completed and did not fail
+/// into the merge table, SPILL_LOAD_BYTES at a time, and remove the spill file.
+/// @return false, setting the error, on failure.
+bool InfileMerger::_loadSpilledRows() {
+    SpillFile::Ptr spillFile;
+    std::set<int> completed;
+    {
+        std::lock_guard<std::mutex> lock(_spillMtx);
+        spillFile = std::move(_spillFile);
+        _spillFile = nullptr;
+        completed.swap(_spillCompleted);
+    }
+    if (spillFile == nullptr) {
+        return true;
+    }
+    auto start = std::chrono::system_clock::now();
+    std::shared_ptr<SpillRowBuffer> batch;
+    std::uint64_t loadedRows = 0;
+    int batches = 0;
+    bool ok = true;
+    bool tooLarge = false;
+    auto loadBatch = [&]() -> bool {
+        if (batch == nullptr) return true;
+        std::uint64_t const batchBytes = batch->getSize();
+        std::string const virtFile = _infileMgr.prepareSrc(batch, _getQueryIdStr());
+        batch.reset();
+        ++batches;
+        if (!_applyMysql(sql::formLoadInfile(_mergeTable, virtFile))) {
+            return false;
+        }
+        // The rows were not counted against the maximum result table size
+        // while they arrived. As in merge(), the size of the table is only
+        // read once the bytes loaded are near the limit.
+        _mergedBytes += batchBytes;
+        if (_mergedBytes < _sizeCheckBytes) {
+            return true;
+        }
+        auto tSize = _getResultTableSizeMB();
+        if (tSize > _maxResultTableSizeMB) {
+            std::ostringstream os;
+            os << _getQueryIdStr() << " cancelling query, result table " << _mergeTable
+               << " too large at " << tSize << "MB max allowed=" << _maxResultTableSizeMB;
+            LOGS(_log, LOG_LVL_ERROR, os.str());
+            _error = util::Error(-1, os.str(), -1);
+            tooLarge = true;
+            return false;
+        }
+        return true;
+    };
+    bool readOk = spillFile->forEachSegment([&](SpillFile::SegmentHeader const& header, char const* rows) {
+        if (completed.count(header.jobIdAttempt) == 0
+            || _invalidJobAttemptMgr.isJobAttemptInvalid(header.jobIdAttempt)) {
+            return true;
+        }
+        if (batch == nullptr) batch = std::make_shared<SpillRowBuffer>();
+        batch->add(rows, header.length);
+        loadedRows += header.rowCount;
+        if (batch->getSize() >= SPILL_LOAD_BYTES) {
+            ok = loadBatch();
+        }
+        return ok;
+    }, [&]() {
+        // The last batch refers to the mapped file as well.
+        ok = ok && loadBatch();
+    });
+    ok = ok && readOk;
+    auto loadDur = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() - start);
+    LOGS(_log, LOG_LVL_INFO, _getQueryIdStr() << " loaded spilled rows into " << _mergeTable
+         << " rows=" << loadedRows << " batches=" << batches << " spillBytes=" << spillFile->getBytes()
+         << " loadDur=" << loadDur.count() << " ok=" << ok);
+    if (!ok && !tooLarge) {
+        std::string msg = readOk ? "failed to load spilled rows into " + _mergeTable : spillFile->getError();
+        _error = util::Error(-1, msg, -1);
+    }
+    return ok;
+}
+
+
+/// @return false, setting the error, if rows merged in memory use more than
+///         the maximum result table size.
+bool InfileMerger::_checkMemorySize(size_t sizeBytes, std::string const& queryIdJobStr) {
+    size_t sizeMB = sizeBytes / (1024*1024);
+    if (sizeMB > _maxResultTableSizeMB) {
+        std::ostringstream os;
+        os << queryIdJobStr << " cancelling query, merged result too large at "
+           << sizeMB << "MB max allowed=" << _maxResultTableSizeMB;
+        LOGS(_log, LOG_LVL_ERROR, os.str());
+        _error = util::Error(-1, os.str(), -1);
+        return false;
+    }
+    return true;
+}
+
+
 bool InfileMerger::_applyMysql(std::string const& query) {
-    std::lock_guard<std::mutex> lock(_mysqlMutex);
-    if (!_mysqlConn.connected()) {
-        // should have connected during construction
+    auto conn = _getMergeConn();
+    if (conn == nullptr) {
+        return false;
+    }
+    if (!conn->connected()) {
         // Try reconnecting--maybe we timed out.
-        if (!_setupConnection()) {
+        if (!_setupConnection(*conn)) {
             LOGS(_log, LOG_LVL_ERROR, "InfileMerger::_applyMysql _setupConnection() failed!!!");
+            _releaseMergeConn(std::move(conn));
             return false; // Reconnection failed. This is an error.
         }
     }
 
-    int rc = mysql_real_query(_mysqlConn.getMySql(),
-                              query.data(), query.size());
+    int rc = mysql_real_query(conn->getMySql(), query.data(), query.size());
+    if (rc != 0) {
+        LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << " InfileMerger::_applyMysql failed "
+             << conn->getErrno() << " " << conn->getError());
+    }
+    _releaseMergeConn(std::move(conn));
     return rc == 0;
 }
 
 
+/// @return a connection for the exclusive use of the caller, waiting for one
+///         to be returned to the pool if _maxMergeConnections are in use.
+///         nullptr is returned if a new connection could not be made.
+std::unique_ptr<mysql::MySqlConnection> InfileMerger::_getMergeConn() {
+    std::unique_lock<std::mutex> lock(_mysqlMutex);
+    if (_mysqlConnPool.empty() && _mysqlConnCount < _maxMergeConnections) {
+        ++_mysqlConnCount;
+        lock.unlock(); // Don't hold the mutex while connecting.
+        std::unique_ptr<mysql::MySqlConnection> conn(new mysql::MySqlConnection(_config.mySqlConfig));
+        if (_setupConnection(*conn)) {
+            LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << " InfileMerger new merge connection, count="
+                 << _mysqlConnCount);
+            return conn;
+        }
+        LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << " InfileMerger failed to make merge connection");
+        lock.lock();
+        --_mysqlConnCount;
+        if (_mysqlConnCount == 0) {
+            return nullptr; // Nothing to wait for.
+        }
+    }
+    _mysqlConnCv.wait(lock, [this](){ return !_mysqlConnPool.empty(); });
+    std::unique_ptr<mysql::MySqlConnection> conn = std::move(_mysqlConnPool.back());
+    _mysqlConnPool.pop_back();
+    return conn;
+}
+
+
+/// Return a connection obtained from _getMergeConn() to the pool.
+void InfileMerger::_releaseMergeConn(std::unique_ptr<mysql::MySqlConnection> conn) {
+    {
+        std::lock_guard<std::mutex> lock(_mysqlMutex);
+        _mysqlConnPool.push_back(std::move(conn));
+    }
+    _mysqlConnCv.notify_one();
+}
+
+
 bool InfileMerger::finalize() {
     bool finalizeOk = true;
     // TODO: Should check for error condition before continuing.
@@ -269,14 +787,55 @@ bool InfileMerger::finalize() {
         LOGS(_log, LOG_LVL_ERROR, " failed to remove invalid rows.");
         return false;
     }
-    if (_mergeTable != _config.targetTable) {
-        // Aggregation needed: Do the aggregation.
-        std::string mergeSelect = _config.mergeStmt->getQueryTemplate().sqlFragment();
-        // Using MyISAM as single thread writing with no need to recover from errors.
-        std::string createMerge = "CREATE TABLE " + _config.targetTable
-            + " ENGINE=MyISAM " + mergeSelect;
-        LOGS(_log, LOG_LVL_DEBUG, "Merging w/" << createMerge);
-        finalizeOk = _applySqlLocal(createMerge, "createMerge");
+    _dropStagingTables();
+    if (!_loadSpilledRows()) {
+        return false;
+    }
+    if (_config.mergeStmt) {
+        std::vector<std::string> mergedTables = _getMergedTableNames();
+        AggregateMerger::Ptr aggMerger = _getAggMerger();
+        if (aggMerger != nullptr) {
+            // Rows were aggregated as they arrived.
+            finalizeOk = _loadAggregateResult(*aggMerger);
+        } else {
+            // Only the rows kept by the top-k merger are loaded, for the
+            // merge statement to sort.
+            TopKMerger::Ptr topKMerger = _getTopKMerger();
+            if (topKMerger != nullptr) {
+                finalizeOk = _loadTopKRows(*topKMerger);
+            }
+            // Rows folded while results arrived are aggregated along with
+            // those loaded since.
+            if (_partialTableCreated) {
+                std::string const partialTable = _getPartialTableName();
+                finalizeOk = _applySqlLocal("INSERT INTO " + _mergeTable + " SELECT * FROM "
+                                            + partialTable, "mergePartial")
+                    && _applySqlLocal("DROP TABLE " + partialTable, "dropPartial");
+            }
+            // Staging tables of completed job attempts are read along with
+            // the merge table.
+            if (mergedTables.size() > 1 && finalizeOk) {
+                finalizeOk = _createUnionTable(mergedTables);
+                _config.mergeStmt->setFromListAsTable(_getUnionTableName());
+            }
+            // Aggregation needed: Do the aggregation.
+            std::string mergeSelect = _config.mergeStmt->getQueryTemplate().sqlFragment();
+            // Using MyISAM as single thread writing with no need to recover from errors.
+            std::string createMerge = "CREATE TABLE " + _config.targetTable
+                + " ENGINE=MyISAM " + mergeSelect;
+            LOGS(_log, LOG_LVL_DEBUG, "Merging w/" << createMerge);
+            finalizeOk = finalizeOk && _applySqlLocal(createMerge, "createMerge");
+        }
+        if (mergedTables.size() > 1) {
+            // The MERGE table goes first, it refers to the others.
+            std::string dropKept = "DROP TABLE IF EXISTS " + _getUnionTableName();
+            for (size_t i = 1; i < mergedTables.size(); ++i) {
+                dropKept += "," + mergedTables[i];
+            }
+            if (!_applySqlLocal(dropKept, "dropKept")) {
+                LOGS(_log, LOG_LVL_WARN, "Failure dropping kept staging tables of " << _mergeTable);
+            }
+        }
 
         // Cleanup merge table.
         sql::SqlErrorObject eObj;
@@ -292,25 +851,116 @@ bool InfileMerger::finalize() {
         if (!cleanupOk) {
             LOGS(_log, LOG_LVL_DEBUG, "Failure cleaning up table " << _mergeTable);
         }
-    } else {
-        // Remove jobId and attemptCount information from the result table.
-        // Returning a view could be faster, but is more complicated.
-        std::string sqlDropCol = std::string("ALTER TABLE ") + _mergeTable
-                               + " DROP COLUMN " +  _jobIdColName;
-        LOGS(_log, LOG_LVL_DEBUG, "Removing w/" << sqlDropCol);
-        finalizeOk = _applySqlLocal(sqlDropCol, "dropCol Removing");
-    }
-    LOGS(_log, LOG_LVL_DEBUG, "Merged " << _mergeTable << " into " << _config.targetTable);
+    } else if (_mergeTable != _config.targetTable) {
+        // The merge table is the result, less its jobId column.
+        finalizeOk = _createResultView();
+    }
+    // Otherwise, the rows were loaded into the result table as they are.
+    LOGS(_log, LOG_LVL_INFO, _getQueryIdStr() << " Merged " << _mergeTable << " into "
+         << _config.targetTable << " mergedRows=" << _mergedRows << " mergedBytes=" << _mergedBytes);
     _isFinished = true;
     return finalizeOk;
 }
 
+/// Write the rows aggregated by aggMerger to the target table.
+bool InfileMerger::_loadAggregateResult(AggregateMerger& aggMerger) {
+    // Let mysql derive the column names and types of the target table by
+    // running the merge statement over the merge table, which is empty.
+    std::string mergeSelect = _config.mergeStmt->getQueryTemplate().sqlFragment();
+    std::string createTarget = "CREATE TABLE " + _config.targetTable
+        + " ENGINE=MyISAM " + mergeSelect + " LIMIT 0";
+    LOGS(_log, LOG_LVL_DEBUG, "Creating aggregate result table w/" << createTarget);
+    if (!_applySqlLocal(createTarget, "createAggregateTarget")) {
+        return false;
+    }
+    std::string const virtFile = _infileMgr.prepareSrc(aggMerger.newRowBuffer(), _getQueryIdStr());
+    auto start = std::chrono::system_clock::now();
+    if (!_applyMysql(sql::formLoadInfile(_config.targetTable, virtFile))) {
+        _error = InfileMergerError(util::ErrorCode::MYSQLEXEC,
+                                   "Error loading aggregated rows into " + _config.targetTable);
+        return false;
+    }
+    auto end = std::chrono::system_clock::now();
+    LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << " loadAggregateResult microseconds="
+         << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    return true;
+}
+
+
+/// Load the rows kept by topKMerger into the merge table.
+bool InfileMerger::_loadTopKRows(TopKMerger& topKMerger) {
+    proto::Result result;
+    topKMerger.takeRows(result);
+    if (result.row_size() == 0) {
+        return true;
+    }
+    ProtoRowBuffer::Ptr rowBuffer;
+    {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        // Rows of failed attempts are already gone, so the jobId column is unused.
+        rowBuffer = std::make_shared<ProtoRowBuffer>(result, 0, _jobIdColName,
+                                                     _jobIdSqlType, _jobIdMysqlType);
+    }
+    std::string const virtFile = _infileMgr.prepareSrc(rowBuffer, _getQueryIdStr());
+    auto start = std::chrono::system_clock::now();
+    if (!_applyMysql(sql::formLoadInfile(_mergeTable, virtFile))) {
+        _error = InfileMergerError(util::ErrorCode::MYSQLEXEC,
+                                   "Error loading top rows into " + _mergeTable);
+        return false;
+    }
+    auto end = std::chrono::system_clock::now();
+    LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << " loadTopKRows rows=" << result.row_size()
+         << " of " << topKMerger.getRowsSeen() << " microseconds="
+         << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    return true;
+}
+
+
 bool InfileMerger::isFinished() const {
     return _isFinished;
 }
 
 
 bool InfileMerger::_deleteInvalidRows(InvalidJobAttemptMgr::jASetType const& jobIdAttempts) {
+    AggregateMerger::Ptr aggMerger = _getAggMerger();
+    if (aggMerger != nullptr) {
+        // The rows are not in the merge table.
+        return aggMerger->scrub(jobIdAttempts);
+    }
+    TopKMerger::Ptr topKMerger = _getTopKMerger();
+    if (topKMerger != nullptr) {
+        return topKMerger->scrub(jobIdAttempts);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_permanentMtx);
+        for (int jobIdAttempt : jobIdAttempts) {
+            if (_permanentAttempts.count(jobIdAttempt) > 0) {
+                LOGS(_log, LOG_LVL_ERROR, _getQueryIdStr() << " cannot remove rows of "
+                     << jobIdAttempt << " from " << _mergeTable);
+                return false;
+            }
+        }
+    }
+    if (_jobIdColName.empty()) {
+        // None of the attempts loaded rows.
+        return true;
+    }
+    // Rows of attempts kept in their staging table go with it.
+    std::vector<std::string> keptTables;
+    {
+        std::lock_guard<std::mutex> lock(_stagingMtx);
+        for (int jobIdAttempt : jobIdAttempts) {
+            if (_keptAttempts.erase(jobIdAttempt) > 0) {
+                keptTables.push_back(_getStagingTableName(jobIdAttempt));
+            }
+        }
+    }
+    for (auto const& keptTable : keptTables) {
+        if (!_applySqlLocal("DROP TABLE IF EXISTS " + keptTable, "dropKept")) {
+            LOGS(_log, LOG_LVL_ERROR, "Failed to drop " << keptTable);
+            return false;
+        }
+    }
     // delete several rows at a time
     unsigned int maxSize = 950000; /// default 1mb limit
     auto iter = jobIdAttempts.begin();
@@ -339,6 +989,135 @@ bool InfileMerger::_deleteInvalidRows(InvalidJobAttemptMgr::jASetType const& job
 }
 
 
+void InfileMerger::_addUntaggedAttempt(int jobIdAttempt) {
+    if (_jobIdColName.empty()) {
+        std::lock_guard<std::mutex> lock(_permanentMtx);
+        _permanentAttempts.insert(jobIdAttempt);
+    }
+}
+
+
+bool InfileMerger::_startSwap(int rowCount, std::int64_t everyRows) {
+    if ((_rowsSinceSwap += rowCount) < everyRows) {
+        return false;
+    }
+    bool notSwapping = false;
+    return _swapping.compare_exchange_strong(notSwapping, true);
+}
+
+
+bool InfileMerger::_swapOutMergeTable(std::string const& toTable, std::int64_t& rows,
+                                      std::string const& queryIdJobStr) {
+    std::string const nextTable = _mergeTable + "_next";
+    if (!_applyMysql("CREATE TABLE " + nextTable + " LIKE " + _mergeTable)) {
+        _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
+                                   "Error creating table (" + nextTable + ")");
+        return false;
+    }
+
+    // Swap in an empty merge table while nothing is loading, so that the rows
+    // of each job attempt are either all in toTable or all in the merge table.
+    bool swapped = _invalidJobAttemptMgr.holdMergingFor(
+        [this, &toTable, &nextTable, &rows](InvalidJobAttemptMgr::jASetType const& haveRows) -> bool {
+            if (!_applyMysql("RENAME TABLE " + _mergeTable + " TO " + toTable
+                             + ", " + nextTable + " TO " + _mergeTable)) {
+                return false;
+            }
+            rows = _rowsSinceSwap.exchange(0);
+            std::lock_guard<std::mutex> lock(_permanentMtx);
+            _permanentAttempts.insert(haveRows.begin(), haveRows.end());
+            return true;
+        });
+    if (!swapped) {
+        _applyMysql("DROP TABLE IF EXISTS " + nextTable);
+        _error = util::Error(-1, "Failed to swap merge table " + _mergeTable, -1);
+        LOGS(_log, LOG_LVL_ERROR, queryIdJobStr << " " << _error);
+        return false;
+    }
+    return true;
+}
+
+
+bool InfileMerger::_foldMergeTable(PartialAggregator const& partialAgg,
+                                   std::string const& queryIdJobStr) {
+    auto start = std::chrono::system_clock::now();
+    std::string const partialTable = _getPartialTableName();
+    std::string const foldTable = _mergeTable + "_fold";
+    if (!_partialTableCreated) {
+        if (!_applyMysql("CREATE TABLE " + partialTable + " LIKE " + _mergeTable)) {
+            _error = InfileMergerError(util::ErrorCode::CREATE_TABLE,
+                                       "Error creating table (" + partialTable + ")");
+            return false;
+        }
+        _partialTableCreated = true;
+    }
+    std::int64_t rows = 0;
+    if (!_swapOutMergeTable(foldTable, rows, queryIdJobStr)) {
+        return false;
+    }
+
+    // The partial aggregate is folded again with the new rows, so that it
+    // has at most one row per group.
+    std::string const foldSelect = partialAgg.makeFoldSelect(foldTable, _jobIdColName, FOLDED_JOB_ID);
+    bool ok = _applyMysql("INSERT INTO " + foldTable + " SELECT * FROM " + partialTable)
+        && _applyMysql("TRUNCATE TABLE " + partialTable)
+        && _applyMysql("INSERT INTO " + partialTable + " " + foldSelect)
+        && _applyMysql("DROP TABLE " + foldTable);
+    if (!ok) {
+        _error = util::Error(-1, "Failed to fold " + foldTable + " into " + partialTable, -1);
+        LOGS(_log, LOG_LVL_ERROR, queryIdJobStr << " " << _error);
+        return false;
+    }
+    auto foldDur = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now() - start);
+    LOGS(_log, LOG_LVL_INFO, queryIdJobStr << " folded " << rows << " rows of " << _mergeTable
+         << " into " << partialTable << " foldDur=" << foldDur.count());
+    return true;
+}
+
+
+bool InfileMerger::_publishBatch(std::string const& queryIdJobStr) {
+    int const batch = _batchCount++;
+    std::string const batchTable = getBatchTableName(_mergeTable, batch);
+    std::int64_t rows = 0;
+    if (!_swapOutMergeTable(batchTable, rows, queryIdJobStr)) {
+        return false;
+    }
+    return _listBatch(batch, batchTable, rows, queryIdJobStr);
+}
+
+
+/// Publish the complete staging table of jobIdAttempt, which has rows rows,
+/// as a batch of its own.
+bool InfileMerger::_publishStaged(std::string const& stagingTable, std::int64_t rows, int jobIdAttempt,
+                                  std::string const& queryIdJobStr) {
+    int const batch = _batchCount++;
+    std::string const batchTable = getBatchTableName(_mergeTable, batch);
+    if (!_applyMysql("RENAME TABLE " + stagingTable + " TO " + batchTable)) {
+        _error = util::Error(-1, "Failed to rename " + stagingTable, -1);
+        LOGS(_log, LOG_LVL_ERROR, queryIdJobStr << " " << _error);
+        return false;
+    }
+    _addUntaggedAttempt(jobIdAttempt);
+    return _listBatch(batch, batchTable, rows, queryIdJobStr);
+}
+
+
+/// Add batchTable to the cursor table, where readers find it.
+bool InfileMerger::_listBatch(int batch, std::string const& batchTable, std::int64_t rows,
+                              std::string const& queryIdJobStr) {
+    std::string const insertBatch = "INSERT INTO " + getCursorTableName(_mergeTable) + " VALUES ("
+        + std::to_string(batch) + ",'" + batchTable + "'," + std::to_string(rows) + ")";
+    if (!_applyMysql(insertBatch)) {
+        _error = util::Error(-1, "Failed to publish " + batchTable, -1);
+        LOGS(_log, LOG_LVL_ERROR, queryIdJobStr << " " << _error);
+        return false;
+    }
+    LOGS(_log, LOG_LVL_INFO, queryIdJobStr << " published " << batchTable << " rows=" << rows);
+    return true;
+}
+
+
 int InfileMerger::makeJobIdAttempt(int jobId, int attemptCount) {
     int jobIdAttempt = jobId * MAX_JOB_ATTEMPTS;
     if (attemptCount >= MAX_JOB_ATTEMPTS) {
@@ -354,7 +1133,17 @@ int InfileMerger::makeJobIdAttempt(int jobId, int attemptCount) {
 
 bool InfileMerger::prepScrub(int jobId, int attemptCount) {
     int jobIdAttempt = makeJobIdAttempt(jobId, attemptCount);
-    return _invalidJobAttemptMgr.prepScrub(jobIdAttempt);
+    bool invalidRowsInResult = _invalidJobAttemptMgr.prepScrub(jobIdAttempt);
+    // Staged rows are simply dropped, merges of the attempt are now refused.
+    _dropStagingTable(jobIdAttempt);
+    return invalidRowsInResult;
+}
+
+
+bool InfileMerger::canScrub(int jobId, int attemptCount) {
+    int jobIdAttempt = makeJobIdAttempt(jobId, attemptCount);
+    std::lock_guard<std::mutex> lock(_permanentMtx);
+    return _permanentAttempts.count(jobIdAttempt) == 0;
 }
 
 
@@ -405,11 +1194,16 @@ bool InfileMerger::_sqlConnect(sql::SqlErrorObject& errObj) {
 
 
 size_t InfileMerger::_getResultTableSizeMB() {
-    std::string tableSizeSql = std::string("SELECT table_name, ")
-                             + "round(((data_length + index_length) / 1048576), 2) as 'MB' "
+    // Staging tables kept for the merge statement are part of the result.
+    std::string tableNames;
+    for (auto const& table : _getMergedTableNames()) {
+        tableNames += (tableNames.empty() ? "'" : ",'") + table + "'";
+    }
+    std::string tableSizeSql = "SELECT '" + _mergeTable + "', "
+                             + "round((COALESCE(SUM(data_length + index_length), 0) / 1048576), 2) as 'MB' "
                              + "FROM information_schema.TABLES "
                              + "WHERE table_schema = '" + _config.mySqlConfig.dbName
-                             + "' AND table_name = '" + _mergeTable + "'";
+                             + "' AND table_name IN (" + tableNames + ")";
     LOGS(_log, LOG_LVL_DEBUG, "Checking ResultTableSize " << tableSizeSql);
     std::lock_guard<std::mutex> m(_sqlMutex);
     sql::SqlErrorObject errObj;
@@ -495,29 +1289,45 @@ bool InfileMerger::_setupTable(proto::WorkerResponse const& response) {
 
             sch.columns.push_back(scs);
         }
-        // Add jobId column that does not conflict with existing columns.
-        for (auto iter = sch.columns.begin(), end = sch.columns.end(); iter != end; ++iter) {
-            auto const& col = *iter;
-            if (col.name == _jobIdColName) {
-                _alterJobIdColName();
-                iter = sch.columns.begin(); // start over
+        sql::Schema schema;
+        if (!_jobIdColName.empty()) {
+            // Add jobId column that does not conflict with existing columns.
+            for (auto iter = sch.columns.begin(), end = sch.columns.end(); iter != end; ++iter) {
+                auto const& col = *iter;
+                if (col.name == _jobIdColName) {
+                    _alterJobIdColName();
+                    iter = sch.columns.begin(); // start over
+                }
             }
-        }
 
-
-        sql::Schema schema;
-        {
             sql::ColSchema scs;
             scs.name              = _jobIdColName;
             scs.colType.mysqlType = _jobIdMysqlType;
             scs.colType.sqlType   = _jobIdSqlType;
             schema.columns.push_back(scs);
-            schema.columns.insert(schema.columns.end(), sch.columns.begin(), sch.columns.end());
         }
+        schema.columns.insert(schema.columns.end(), sch.columns.begin(), sch.columns.end());
+        _mergeSchema = schema;
         std::string createStmt = sql::formCreateTable(_mergeTable, schema);
         // Specifying engine. There is some question about whether InnoDB or MyISAM is the better
         // choice when multiple threads are writing to the result table.
         createStmt += " ENGINE=MyISAM";
+        // The merge table is still needed by the native aggregation to
+        // derive the schema of the result table.
+        if (_aggMerger != nullptr && !_aggMerger->setSchema(rs)) {
+            LOGS(_log, LOG_LVL_INFO, _getQueryIdStr()
+                 << "InfileMerger result columns unsuitable for native aggregation");
+            _aggMerger.reset();
+        }
+        if (_topKMerger != nullptr && !_topKMerger->setSchema(rs)) {
+            LOGS(_log, LOG_LVL_INFO, _getQueryIdStr()
+                 << "InfileMerger ORDER BY columns unsuitable for native top-k merge");
+            _topKMerger.reset();
+        }
+        if (_partialAgg != nullptr && (_aggMerger != nullptr || _topKMerger != nullptr
+                                       || !_partialAgg->setSchema(rs))) {
+            _partialAgg.reset();
+        }
         LOGS(_log, LOG_LVL_DEBUG, _getQueryIdStr() << "InfileMerger query prepared: " << createStmt);
 
         if (not _applySqlLocal(createStmt, "setupTable")) {
@@ -545,12 +1355,8 @@ void InfileMerger::_fixupTargetName() {
                                % _config.mySqlConfig.dbName % getTimeStampId()).str();
     }
 
-    if (_config.mergeStmt) {
-        // Set merging temporary if needed.
-        _mergeTable = _config.targetTable + "_m";
-    } else {
-        _mergeTable = _config.targetTable;
-    }
+    // Streamed results are loaded into the result table instead, see the constructor.
+    _mergeTable = getMergeTableName(_config.targetTable);
 }
 
 
@@ -648,6 +1454,31 @@ bool InvalidJobAttemptMgr::holdMergingForRowDelete(std::string const& msg) {
 }
 
 
+bool InvalidJobAttemptMgr::holdMergingFor(std::function<bool(jASetType const&)> const& func) {
+    std::unique_lock<std::mutex> lockJA(_iJAMtx);
+    _cv.wait(lockJA, [this](){ return !_waitFlag; });
+    _waitFlag = true;
+    _cv.wait(lockJA, [this](){ return _concurrentMergeCount == 0; });
+    // Rows of failed attempts must be gone before func sees the table.
+    if (!_invalidJAWithRows.empty()) {
+        if (!_deleteFunc(_invalidJAWithRows)) {
+            _cleanupIJA();
+            return false;
+        }
+        _invalidJAWithRows.clear();
+    }
+    jASetType haveRows;
+    for (int jobIdAttempt : _jobIdAttemptsHaveRows) {
+        if (!_isJobAttemptInvalid(jobIdAttempt)) {
+            haveRows.insert(jobIdAttempt);
+        }
+    }
+    bool res = func(haveRows);
+    _cleanupIJA();
+    return res;
+}
+
+
 bool InvalidJobAttemptMgr::isJobAttemptInvalid(int jobIdAttempt) {
     // Return true if jobIdAttempt is in the invalid set.
     std::lock_guard<std::mutex> iJALock(_iJAMtx);
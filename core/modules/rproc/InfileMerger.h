@@ -30,15 +30,26 @@
 /// (see individual class documentation for more information)
 
 // System headers
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 // Qserv headers
 #include "mysql/LocalInfile.h"
 #include "mysql/MySqlConfig.h"
 #include "mysql/MySqlConnection.h"
+#include "rproc/AggregateMerger.h"
+#include "rproc/PartialAggregator.h"
+#include "rproc/SpillFile.h"
+#include "rproc/TopKMerger.h"
+#include "sql/Schema.h"
 #include "sql/SqlConnection.h"
 #include "util/Error.h"
 #include "util/EventThread.h"
@@ -91,13 +102,46 @@ public:
     mysql::MySqlConfig const mySqlConfig;
     std::string targetTable;
     std::shared_ptr<query::SelectStmt> mergeStmt;
+    /// Maximum number of mysql connections used to load worker results into
+    /// the merge table concurrently. 1 serializes all LOAD DATA statements.
+    int maxMergeConnections{1};
+    /// Evaluate merge statements made only of decomposable aggregates in
+    /// memory instead of loading every worker row into the merge table.
+    bool nativeAggregation{false};
+    /// Keep only the first LIMIT rows of ORDER BY ... LIMIT merge statements
+    /// in memory, and load only those into the merge table.
+    bool nativeTopK{false};
+    /// When the merge statement aggregates, fold the rows of the merge table
+    /// into a partial aggregate after every partialAggregateRows rows loaded
+    /// into it. 0 disables folding.
+    std::int64_t partialAggregateRows{0};
+    /// When worker rows are loaded into the result table as they are, move
+    /// them to a batch table readers can fetch after every streamingBatchRows
+    /// rows. 0 disables streaming.
+    std::int64_t streamingBatchRows{0};
+    /// Directory of the spill files rows are appended to, instead of being
+    /// loaded into the merge table, once spillThresholdBytes were loaded.
+    /// Empty disables spilling.
+    std::string spillDir;
+    std::int64_t spillThresholdBytes{0};
+    /// Maximum size of the spill file of a query, 0 for no limit.
+    std::int64_t spillQuotaBytes{0};
+    /// Load the rows of job attempts that span several messages into a
+    /// staging table of the attempt until its last message has arrived, when
+    /// there is a merge statement. Otherwise, or if false, they are loaded as
+    /// they arrive, and a failed attempt has its rows deleted from the merge
+    /// table. Streamed and partially aggregated results are always staged, as
+    /// their rows cannot be deleted once published or folded.
+    bool stageJobAttempts{true};
 };
 
 
 /// This class is used to remove invalid rows from cancelled job attempts.
 /// Removing the invalid rows from the result table can be very expensive,
 /// so steps are taken to only do it when rows are known to exist in the
-/// result table.
+/// result table. With a merge statement, attempts whose results span several
+/// messages are loaded into staging tables by InfileMerger, and only reach
+/// the result table once complete, so this is rarely needed then.
 ///
 /// The rows can only be safely deleted from the result table when
 /// nothing is writing to the table. To minimize the time locking the mutex
@@ -132,6 +176,11 @@ public:
     bool isJobAttemptInvalid(int jobIdAttempt);
 
     bool prepScrub(int jobIdAttempt);
+
+    /// Stop merging to the result table, wait for merges in progress to end,
+    /// and call func with the job attempts that have rows in the result table.
+    /// @return the value returned by func.
+    bool holdMergingFor(std::function<bool(jASetType const&)> const& func);
 private:
     /// Precondition: must hold _iJAMtx before calling.
     /// @return true if jobIdAttempt is in the invalid set.
@@ -161,15 +210,56 @@ private:
 /// Bytes 1 - size_ph : ProtoHeader message (containing size of result message)
 /// Bytes size_ph - size_ph + size_rm : Result message
 /// At present, Result messages are not chained.
+///
+/// Responses arriving concurrently are loaded in parallel, each LOAD DATA
+/// statement using its own connection from a pool of at most
+/// InfileMergerConfig::maxMergeConnections connections.
+///
+/// When nativeAggregation is set and the merge statement only contains COUNT,
+/// SUM, MIN, MAX and AVG merge expressions over GROUP BY columns, rows are
+/// aggregated in memory by an AggregateMerger as they arrive instead, and
+/// only the final rows are written to the result table.
+///
+/// When nativeTopK is set and the merge statement is ORDER BY ... LIMIT k over
+/// plain columns, a TopKMerger keeps the first k rows in memory as they arrive,
+/// and only those are loaded into the merge table by finalize().
+///
+/// When the merge statement is left to the database and only aggregates in
+/// ways that decompose, the merge table is folded by a PartialAggregator into a
+/// partial aggregate table every InfileMergerConfig::partialAggregateRows rows,
+/// while worker results keep arriving. finalize() then runs the merge
+/// statement on the partial aggregate and the rows loaded since the last fold.
+///
+/// Without a merge statement, rows are loaded into a merge table that keeps
+/// the jobId column, so that the rows of failed job attempts can be deleted,
+/// and finalize() makes the result table a view of its other columns.
+///
+/// When streamingBatchRows is set and there is no merge statement, the rows
+/// are loaded into the result table as they are instead. They are moved to a
+/// batch table every streamingBatchRows rows, and the batch is listed in a
+/// cursor table. Async query results can then be read in batches while the
+/// query runs, the rows left in the result table being the last batch.
+///
+/// When spillDir is set and rows are loaded as they arrive, rows that arrive
+/// once spillThresholdBytes were loaded are appended to a SpillFile instead,
+/// and loaded into the merge table by finalize() in large batches, skipping
+/// those of failed job attempts. Attempts already being staged in a staging
+/// table finish there.
+///
+/// The rows of a job attempt that arrive in more than one message are loaded
+/// into a staging table of that attempt. If the attempt fails first, its
+/// staging table is dropped, and the merge table never needs to be scrubbed
+/// of its rows, which would hold up all other merges. Once the last message
+/// has arrived, the staging table is kept as it is, and finalize() runs the
+/// merge statement over a MERGE table of the merge table and the kept staging
+/// tables. Streamed results are staged too, a complete staging table being
+/// renamed to a batch of its own. Other results without a merge statement are
+/// not staged, as the rows would have to be copied into the merge table.
 class InfileMerger {
 public:
     explicit InfileMerger(InfileMergerConfig const& c);
     ~InfileMerger();
 
-    /// Create the shared thread pool and/or change its size.
-    // @return the size of the large result thread pool.
-    static int setLargeResultPoolSize(int size);
-
     /// Merge a worker response, which contains:
     /// Size of ProtoHeader message
     /// ProtoHeader message
@@ -186,10 +276,41 @@ public:
     /// Check if the object has completed all processing.
     bool isFinished() const;
 
+    /// @return true if merge() folds responses in memory, without loading
+    ///         them into the result database.
+    bool mergesInMemory() { return _getAggMerger() != nullptr || _getTopKMerger() != nullptr; }
+
+    /// @return the number of rows loaded into the merge table so far.
+    std::uint64_t getMergedRows() const { return _mergedRows; }
+    /// @return the number of bytes of rows loaded into the merge table so far.
+    std::uint64_t getMergedBytes() const { return _mergedBytes; }
+
     bool prepScrub(int jobId, int attempt);
+    /// @return false if rows of the attempt were loaded in a way they cannot
+    /// be removed by, without the jobId column, folded, or published.
+    bool canScrub(int jobId, int attempt);
     bool scrubResults(int jobId, int attempt);
     int makeJobIdAttempt(int jobId, int attemptCount);
 
+    /// @return the table listing the batches of a streamed result table that
+    ///         can be read, one row (batch, tableName, rowCount) per batch.
+    static std::string getCursorTableName(std::string const& resultTable) {
+        return resultTable + "_cursor";
+    }
+    /// Batch number of the cursor table row, with an empty tableName, that
+    /// readers add once they have read the last rows of a streamed result.
+    static int const CURSOR_END_BATCH = -1;
+    /// @return the name of a batch of a streamed result table.
+    static std::string getBatchTableName(std::string const& resultTable, int batch) {
+        return resultTable + "_b" + std::to_string(batch);
+    }
+    /// @return the table worker rows are loaded into for resultTable. Unless
+    ///         the result is streamed, it outlives the query when there is no
+    ///         merge statement, resultTable being a view of it.
+    static std::string getMergeTableName(std::string const& resultTable) {
+        return resultTable + "_m";
+    }
+
 private:
     bool _applyMysql(std::string const& query);
     bool _merge(std::shared_ptr<proto::WorkerResponse>& response);
@@ -205,14 +326,69 @@ private:
     std::string _getQueryIdStr();
     void _setQueryIdStr(std::string const& qIdStr);
     void _fixupTargetName();
-
-    bool _setupConnection() {
-        if (_mysqlConn.connect()) {
-            _infileMgr.attach(_mysqlConn.getMySql());
+    bool _loadAggregateResult(AggregateMerger& aggMerger);
+    AggregateMerger::Ptr _getAggMerger() {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        return _aggMerger;
+    }
+    bool _loadTopKRows(TopKMerger& topKMerger);
+    TopKMerger::Ptr _getTopKMerger() {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        return _topKMerger;
+    }
+    bool _checkMemorySize(size_t sizeBytes, std::string const& queryIdJobStr);
+    PartialAggregator::Ptr _getPartialAggregator() {
+        std::lock_guard<std::mutex> lock(_createTableMutex);
+        return _partialAgg;
+    }
+    bool _startSwap(int rowCount, std::int64_t everyRows);
+    bool _swapOutMergeTable(std::string const& toTable, std::int64_t& rows,
+                            std::string const& queryIdJobStr);
+    bool _foldMergeTable(PartialAggregator const& partialAgg, std::string const& queryIdJobStr);
+    bool _publishBatch(std::string const& queryIdJobStr);
+    bool _publishStaged(std::string const& stagingTable, std::int64_t rows, int jobIdAttempt,
+                        std::string const& queryIdJobStr);
+    bool _listBatch(int batch, std::string const& batchTable, std::int64_t rows,
+                    std::string const& queryIdJobStr);
+    std::string _getPartialTableName() const { return _mergeTable + "_partial"; }
+
+    /// The staging table of a job attempt.
+    struct StagingTable {
+        std::mutex mtx; ///< Held while the table is written to or dropped.
+        bool created{false};
+        bool dropped{false};
+        std::int64_t rows{0}; ///< Rows loaded into the table.
+    };
+    std::string _getStagingTableName(int jobIdAttempt) const {
+        return _mergeTable + "_a" + std::to_string(jobIdAttempt);
+    }
+    bool _hasStagingTable(int jobIdAttempt);
+    SpillFile::Ptr _getSpillFile() {
+        std::lock_guard<std::mutex> lock(_spillMtx);
+        return _spillFile;
+    }
+    void _startSpill(std::string const& queryIdJobStr);
+    bool _spill(SpillFile& spillFile, proto::Result& result, int jobIdAttempt, bool last,
+                std::string const& queryIdJobStr);
+    bool _loadSpilledRows();
+    bool _mergeStaged(std::shared_ptr<mysql::RowBuffer> const& rowBuffer, int rowCount,
+                      int jobIdAttempt, bool last, std::string const& queryIdJobStr);
+    void _dropStagingTable(int jobIdAttempt);
+    void _dropStagingTables();
+    std::vector<std::string> _getMergedTableNames();
+    bool _createUnionTable(std::vector<std::string> const& tables);
+    bool _createResultView();
+    std::string _getUnionTableName() const { return _mergeTable + "_union"; }
+
+    bool _setupConnection(mysql::MySqlConnection& conn) {
+        if (conn.connect()) {
+            _infileMgr.attach(conn.getMySql());
             return true;
         }
         return false;
     }
+    std::unique_ptr<mysql::MySqlConnection> _getMergeConn();
+    void _releaseMergeConn(std::unique_ptr<mysql::MySqlConnection> conn);
 
     InfileMergerConfig _config; ///< Configuration
     std::shared_ptr<sql::SqlConnection> _sqlConn; ///< SQL connection
@@ -228,26 +404,72 @@ private:
         _jobIdColName = "jobId" + std::to_string(_jobIdColNameAdj++);
     }
 
-    mysql::MySqlConnection _mysqlConn;
-
-    std::mutex _mysqlMutex;
-    lsst::qserv::mysql::LocalInfile::Mgr _infileMgr;
+    /// Idle connections for LOAD DATA statements. Connections are made as needed,
+    /// up to _maxMergeConnections, and each is used by one merge at a time.
+    std::vector<std::unique_ptr<mysql::MySqlConnection>> _mysqlConnPool;
+    int _mysqlConnCount{0}; ///< Number of connections, idle or in use.
+    int _maxMergeConnections{1}; ///< Maximum value for _mysqlConnCount.
+    std::mutex _mysqlMutex; ///< protects _mysqlConnPool and _mysqlConnCount
+    std::condition_variable _mysqlConnCv; ///< Notified when a connection is returned.
+    lsst::qserv::mysql::LocalInfile::Mgr _infileMgr; ///< Attached to every pool connection.
 
     std::mutex _queryIdStrMtx; ///< protects _queryIdStr
     std::atomic<bool> _queryIdStrSet{false};
     std::string _queryIdStr{"QI=?"}; ///< Unknown until results start coming back from workers.
 
     /// Name of the jobId column in the result table. Protected by _createTableMutex
+    /// Empty when rows are loaded straight into the result table.
     std::string _jobIdColName;
     int _jobIdColNameAdj{0}; ///< Adjustment to make if _jobIdColName is not unique.
     int const _jobIdMysqlType{MYSQL_TYPE_LONG}; ///< 4 byte integer.
     std::string const _jobIdSqlType{"INT(9)"}; ///< The 9 only affects '0' padding with ZEROFILL.
 
     InvalidJobAttemptMgr _invalidJobAttemptMgr;
+    std::mutex _stagingMtx; ///< Protects _stagingTables.
+    std::map<int, std::shared_ptr<StagingTable>> _stagingTables; ///< By job attempt.
+    /// Job attempts whose complete staging table is read by the merge
+    /// statement along with the merge table. Protected by _stagingMtx.
+    std::set<int> _keptAttempts;
+    sql::Schema _mergeSchema; ///< Columns of the merge table. Protected by _createTableMutex.
+    std::mutex _permanentMtx; ///< Protects _permanentAttempts.
+    /// Job attempts whose rows can no longer be removed from the merge table,
+    /// as it has no jobId column or their rows were folded.
+    std::set<int> _permanentAttempts;
+    void _addUntaggedAttempt(int jobIdAttempt);
     bool _deleteInvalidRows(std::set<int> const& jobIdAttempts);
 
-
-    int _sizeCheckRowCount{0}; ///< Number of rows read since last size check.
+    /// In-memory merger, nullptr when the merge is done by the database.
+    /// Dropped by _setupTable() if the worker results cannot be used with it.
+    /// Protected by _createTableMutex.
+    AggregateMerger::Ptr _aggMerger;
+    /// In-memory top-k merger, same as _aggMerger. At most one of them is set.
+    TopKMerger::Ptr _topKMerger;
+    /// Folds the merge table while results arrive, nullptr if it cannot be
+    /// done. Only set when _aggMerger and _topKMerger are not.
+    PartialAggregator::Ptr _partialAgg;
+    bool _partialTableCreated{false}; ///< Only accessed by the merge holding _swapping.
+    std::int64_t _streamingBatchRows{0}; ///< Rows per published batch, 0 if not streaming.
+    std::atomic<int> _batchCount{0}; ///< Batches published so far.
+    std::atomic<std::int64_t> _rowsSinceSwap{0}; ///< Rows loaded into the merge table since it was swapped out.
+    std::atomic<bool> _swapping{false}; ///< True while a merge is swapping out the merge table.
+
+    std::mutex _spillMtx; ///< Protects _spillFile, _spillFailed and _spillCompleted.
+    SpillFile::Ptr _spillFile; ///< Set once rows are spilled, nullptr before.
+    bool _spillFailed{false}; ///< The spill file could not be created, rows are loaded.
+    std::set<int> _spillCompleted; ///< Job attempts whose last rows were spilled.
+    /// Spilled bytes loaded into the merge table by each LOAD DATA of finalize().
+    static constexpr std::uint64_t SPILL_LOAD_BYTES = 256*1024*1024;
+
+
+    /// Fraction of the maximum result table size the bytes loaded must reach
+    /// before the size of the table is read from the database.
+    static constexpr double SIZE_CHECK_FRACTION = 0.9;
+    static constexpr double MB_SIZE_BYTES = 1024*1024;
+
+    std::atomic<std::uint64_t> _mergedRows{0}; ///< Rows loaded into the merge table.
+    std::atomic<std::uint64_t> _mergedBytes{0}; ///< LOAD DATA bytes of those rows.
+    std::uint64_t _sizeCheckBytes{0}; ///< _mergedBytes that trigger size checks.
+    std::atomic<int> _sizeCheckRowCount{0}; ///< Number of rows read since last size check.
     int _checkSizeEveryXRows{1000}; ///< Check the size of the result table after every x number of rows.
     size_t _maxResultTableSizeMB{5000}; ///< Max result table size.
 };
@@ -0,0 +1,123 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+#ifndef LSST_QSERV_RPROC_MERGERTESTFIXTURE_H
+#define LSST_QSERV_RPROC_MERGERTESTFIXTURE_H
+
+// System headers
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "mysql/RowBuffer.h"
+#include "proto/RowBatch.h"
+#include "proto/worker.pb.h"
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// Worker results for the unit tests of the czar side mergers.
+struct MergerTestFixture {
+
+    /// Add a column to the schema of the worker results.
+    void addColumn(std::string const& name, int mysqlType) {
+        auto cs = schemaResult.mutable_rowschema()->add_columnschema();
+        cs->set_name(name);
+        cs->set_sqltype("");
+        cs->set_mysqltype(mysqlType);
+    }
+
+    /// @return a result with the given rows, "N" standing for NULL.
+    static proto::Result makeResult(std::vector<std::vector<std::string>> const& rows, bool continues) {
+        proto::Result result;
+        result.set_continues(continues);
+        for (auto const& row : rows) {
+            auto rb = result.add_row();
+            for (auto const& col : row) {
+                rb->add_column(col == "N" ? "" : col);
+                rb->add_isnull(col == "N");
+            }
+        }
+        return result;
+    }
+
+    /// @return a protocol 3 result with the given rows of columns of
+    ///         batchKinds, nullptr standing for NULL.
+    proto::Result makeBatchResult(std::vector<std::vector<char const*>> const& rows, bool continues) {
+        proto::Result result;
+        result.set_continues(continues);
+        proto::RowBatchWriter writer(batchKinds);
+        writer.start(result.add_batch());
+        for (auto const& row : rows) {
+            std::vector<unsigned long> lengths;
+            for (auto col : row) {
+                lengths.push_back(col ? strlen(col) : 0);
+            }
+            writer.addRow(row.data(), lengths.data());
+        }
+        return result;
+    }
+
+    /// @return the sorted rows of result, columns separated by ',' and "N"
+    ///         standing for NULL.
+    static std::vector<std::string> resultLines(proto::Result const& result) {
+        std::vector<std::string> lines;
+        for (auto const& rb : result.row()) {
+            std::string line;
+            for (int i = 0; i < rb.column_size(); ++i) {
+                if (i > 0) line += ",";
+                line += rb.isnull(i) ? "N" : rb.column(i);
+            }
+            lines.push_back(line);
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+
+    /// @return the sorted lines fetched from rowBuffer for LOAD DATA.
+    static std::vector<std::string> bufferLines(mysql::RowBuffer& rowBuffer) {
+        std::string all;
+        char buf[7]; // Small, to exercise partial fetches.
+        for (unsigned n; (n = rowBuffer.fetch(buf, sizeof(buf))) > 0;) {
+            all.append(buf, n);
+        }
+        std::vector<std::string> lines;
+        std::istringstream is(all);
+        for (std::string line; std::getline(is, line);) {
+            lines.push_back(line);
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+
+    proto::Result schemaResult;                    ///< Holds the schema of the results
+    std::vector<proto::ColumnBatch::Kind> batchKinds; ///< Columns of makeBatchResult() results
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_MERGERTESTFIXTURE_H
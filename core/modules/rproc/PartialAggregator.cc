@@ -0,0 +1,240 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/PartialAggregator.h"
+
+// System headers
+#include <algorithm>
+#include <sstream>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "proto/worker.pb.h"
+#include "query/ColumnRef.h"
+#include "query/FuncExpr.h"
+#include "query/GroupByClause.h"
+#include "query/HavingClause.h"
+#include "query/OrderByClause.h"
+#include "query/SelectList.h"
+#include "query/SelectStmt.h"
+#include "query/ValueExpr.h"
+#include "query/ValueFactor.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.PartialAggregator");
+
+using lsst::qserv::rproc::PartialAggregator;
+
+/// Set the function folding column, unless it already has another one.
+/// @return false if it does.
+bool setKind(std::map<std::string, PartialAggregator::Kind>& kinds,
+             std::string const& column, PartialAggregator::Kind kind) {
+    auto result = kinds.insert(std::make_pair(column, kind));
+    return result.second || result.first->second == kind;
+}
+
+
+/// Record the function folding each worker result column aggregated in ve.
+/// @return false if ve aggregates in a way that cannot be folded.
+bool addAggregates(lsst::qserv::query::ValueExpr const& ve,
+                   std::map<std::string, PartialAggregator::Kind>& kinds) {
+    using lsst::qserv::query::ValueFactor;
+    for (auto const& factorOp : ve.getFactorOps()) {
+        std::shared_ptr<ValueFactor const> vf = factorOp.factor;
+        if (vf == nullptr) {
+            return false;
+        }
+        switch (vf->getType()) {
+        case ValueFactor::COLUMNREF:
+        case ValueFactor::CONST:
+            break;
+        case ValueFactor::EXPR:
+            if (vf->getExpr() == nullptr || !addAggregates(*vf->getExpr(), kinds)) {
+                return false;
+            }
+            break;
+        case ValueFactor::FUNCTION:
+            if (vf->getFuncExpr() == nullptr) {
+                return false;
+            }
+            for (auto const& param : vf->getFuncExpr()->params) {
+                if (param == nullptr || !addAggregates(*param, kinds)) {
+                    return false;
+                }
+            }
+            break;
+        case ValueFactor::AGGFUNC: {
+            auto fe = vf->getFuncExpr();
+            if (fe == nullptr || fe->params.size() != 1 || fe->params.front() == nullptr) {
+                return false;
+            }
+            auto cr = fe->params.front()->getColumnRef();
+            if (cr == nullptr) {
+                return false;
+            }
+            std::string funcName = fe->getName();
+            std::transform(funcName.begin(), funcName.end(), funcName.begin(), ::toupper);
+            // COUNT and AVG reach the merge statement as SUMs of worker columns.
+            PartialAggregator::Kind kind;
+            if (funcName == "SUM") {
+                kind = PartialAggregator::SUM;
+            } else if (funcName == "MIN") {
+                kind = PartialAggregator::MIN;
+            } else if (funcName == "MAX") {
+                kind = PartialAggregator::MAX;
+            } else {
+                return false;
+            }
+            if (!setKind(kinds, cr->column, kind)) {
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+
+std::string quote(std::string const& name) {
+    return "`" + name + "`";
+}
+
+} // anonymous namespace
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+PartialAggregator::PartialAggregator(std::map<std::string, Kind> const& kinds)
+    : _kinds(kinds) {
+}
+
+
+PartialAggregator::Ptr PartialAggregator::newIfSupported(query::SelectStmt& mergeStmt) {
+    // A WHERE clause would have to be applied before folding, and DISTINCT
+    // is not decomposable.
+    if (mergeStmt.getDistinct() || mergeStmt.hasWhereClause()) {
+        return nullptr;
+    }
+    std::map<std::string, Kind> kinds;
+    if (mergeStmt.hasGroupBy()) {
+        query::ValueExprPtrVector groupExprs;
+        mergeStmt.getGroupBy().findValueExprs(groupExprs);
+        for (auto const& ve : groupExprs) {
+            auto cr = (ve == nullptr) ? nullptr : ve->getColumnRef();
+            if (cr == nullptr || !setKind(kinds, cr->column, GROUP)) {
+                return nullptr;
+            }
+        }
+    }
+    size_t const groupCount = kinds.size();
+
+    query::ValueExprPtrVector exprs;
+    auto selectList = mergeStmt.getSelectList().getValueExprList();
+    if (selectList == nullptr || selectList->empty()) {
+        return nullptr;
+    }
+    exprs.insert(exprs.end(), selectList->begin(), selectList->end());
+    if (mergeStmt.hasHaving()) {
+        mergeStmt.getHaving().findValueExprs(exprs);
+    }
+    if (mergeStmt.hasOrderBy()) {
+        mergeStmt.getOrderBy().findValueExprs(exprs);
+    }
+    for (auto const& ve : exprs) {
+        if (ve == nullptr || !addAggregates(*ve, kinds)) {
+            return nullptr;
+        }
+    }
+    // Without GROUP BY or aggregates, there is nothing to fold.
+    if (!mergeStmt.hasGroupBy() && kinds.size() == groupCount) {
+        return nullptr;
+    }
+    return std::make_shared<PartialAggregator>(kinds);
+}
+
+
+bool PartialAggregator::setSchema(proto::RowSchema const& rowSchema) {
+    _columns.clear();
+    size_t groupCount = 0;
+    for (int i = 0, e = rowSchema.columnschema_size(); i != e; ++i) {
+        std::string const& name = rowSchema.columnschema(i).name();
+        auto iter = _kinds.find(name);
+        if (iter == _kinds.end()) {
+            LOGS(_log, LOG_LVL_DEBUG, "PartialAggregator no function for column " << name);
+            _columns.clear();
+            return false;
+        }
+        if (iter->second == GROUP) {
+            ++groupCount;
+        }
+        _columns.push_back(name);
+    }
+    auto isGroup = [](std::pair<std::string const, Kind> const& entry) {
+        return entry.second == GROUP;
+    };
+    if (groupCount != static_cast<size_t>(std::count_if(_kinds.begin(), _kinds.end(), isGroup))) {
+        LOGS(_log, LOG_LVL_DEBUG, "PartialAggregator GROUP BY column missing");
+        _columns.clear();
+        return false;
+    }
+    return true;
+}
+
+
+std::string PartialAggregator::makeFoldSelect(std::string const& table, std::string const& jobIdColName,
+                                              int jobIdValue) const {
+    std::ostringstream select;
+    std::ostringstream groupBy;
+    select << "SELECT " << jobIdValue << " AS " << quote(jobIdColName);
+    for (auto const& column : _columns) {
+        select << ",";
+        switch (_kinds.at(column)) {
+        case GROUP:
+            select << quote(column);
+            groupBy << (groupBy.tellp() > 0 ? "," : " GROUP BY ") << quote(column);
+            break;
+        case SUM:
+            select << "SUM(" << quote(column) << ") AS " << quote(column);
+            break;
+        case MIN:
+            select << "MIN(" << quote(column) << ") AS " << quote(column);
+            break;
+        case MAX:
+            select << "MAX(" << quote(column) << ") AS " << quote(column);
+            break;
+        }
+    }
+    select << " FROM " << table << groupBy.str();
+    return select.str();
+}
+
+}}} // namespace lsst::qserv::rproc
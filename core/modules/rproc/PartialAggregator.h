@@ -0,0 +1,90 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_RPROC_PARTIALAGGREGATOR_H
+#define LSST_QSERV_RPROC_PARTIALAGGREGATOR_H
+
+// System headers
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Forward declarations
+namespace lsst {
+namespace qserv {
+namespace proto {
+    class RowSchema;
+}
+namespace query {
+    class SelectStmt;
+}
+}} // End of forward declarations
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// PartialAggregator writes the SQL that folds the rows of a merge table into
+/// fewer rows with the same columns, for merge statements whose aggregates
+/// all decompose, as done by query::AggOp, into SUM, MIN and MAX of worker
+/// result columns. Running the merge statement on the folded rows gives the
+/// same result as running it on the rows they were folded from, so the merge
+/// table can be folded while worker results are still arriving, leaving
+/// finalize() only a small table to aggregate.
+class PartialAggregator {
+public:
+    typedef std::shared_ptr<PartialAggregator> Ptr;
+
+    /// Function folding a worker result column.
+    enum Kind { GROUP, SUM, MIN, MAX };
+
+    /// @param kinds the function folding each worker result column, GROUP
+    ///        for the GROUP BY columns.
+    explicit PartialAggregator(std::map<std::string, Kind> const& kinds);
+    PartialAggregator(PartialAggregator const&) = delete;
+    PartialAggregator& operator=(PartialAggregator const&) = delete;
+
+    /// @return a PartialAggregator for mergeStmt, or nullptr if mergeStmt
+    ///         does not aggregate, or does so in a way that cannot be folded.
+    static Ptr newIfSupported(query::SelectStmt& mergeStmt);
+
+    /// Record the worker result column order.
+    /// @return false if a worker result column has no known function, or a
+    ///         GROUP BY column is missing. No folding may be done in that case.
+    bool setSchema(proto::RowSchema const& rowSchema);
+
+    /// @return a SELECT statement folding the rows of table, with the columns
+    ///         of the merge table: jobIdColName, set to jobIdValue, followed
+    ///         by the worker result columns.
+    std::string makeFoldSelect(std::string const& table, std::string const& jobIdColName,
+                               int jobIdValue) const;
+
+private:
+    std::map<std::string, Kind> const _kinds;
+    std::vector<std::string> _columns; ///< Worker result columns, set by setSchema().
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_PARTIALAGGREGATOR_H
@@ -23,7 +23,9 @@
 #include "rproc/ProtoRowBuffer.h"
 
 // System headers
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <sstream>
 #include <stdexcept>
 #include <string.h>
@@ -35,6 +37,7 @@
 #include "lsst/log/Log.h"
 
 // Qserv headers
+#include "proto/RowBatch.h"
 #include "proto/worker.pb.h"
 
 ////////////////////////////////////////////////////////////////////////
@@ -79,44 +82,208 @@ ProtoRowBuffer::ProtoRowBuffer(proto::Result& res, int jobId, std::string const&
       _jobIdColName(jobIdColName),
       _jobIdSqlType(jobIdSqlType),
       _jobIdMysqlType(jobIdMysqlType) {
-    _jobIdStr = std::string("'") + std::to_string(jobId) + "'";
-    _initSchema();
-    if (_result.row_size() > 0) {
-        _initCurrentRow();
+    if (!_jobIdColName.empty()) {
+        _jobIdStr = std::string("'") + std::to_string(jobId) + "'";
     }
+    _initSchema();
+    _skipEmptyBatches();
 }
 
 
-/// Fetch a up to a single row from from the Result message
+/// Fetch as many rows as fit into buffer, and the rest of a row that was too
+/// large for the previous buffer.
 unsigned ProtoRowBuffer::fetch(char* buffer, unsigned bufLen) {
     unsigned fetched = 0;
-    if (bufLen <= _currentRow.size()) {
-        memcpy(buffer, &_currentRow[0], bufLen);
-        _currentRow.erase(_currentRow.begin(), _currentRow.begin() + bufLen);
-        fetched = bufLen;
-    } else { // Want more than we have.
-        if (_currentRow.size()) {
-            memcpy(buffer, &_currentRow[0], _currentRow.size());
-            fetched = _currentRow.size();
-            _currentRow.clear();
+    if (_currentPos < _currentRow.size()) {
+        fetched = std::min<size_t>(bufLen, _currentRow.size() - _currentPos);
+        memcpy(buffer, &_currentRow[_currentPos], fetched);
+        _currentPos += fetched;
+        if (_currentPos < _currentRow.size()) {
+            _bytesFetched += fetched;
+            return fetched;
         }
+        _currentRow.clear();
+        _currentPos = 0;
     }
-    if ((_currentRow.size() == 0) && (_rowIdx < _rowTotal)) {
-        _readNextRow();
+    while (_hasRow()) {
+        size_t maxSize = _maxRowSize();
+        if (maxSize <= bufLen - fetched) {
+            fetched += _copyRow(buffer + fetched);
+            _nextRow();
+            continue;
+        }
+        if (fetched == 0) {
+            // The row may not fit in an empty buffer, stage it.
+            _currentRow.resize(maxSize);
+            _currentRow.resize(_copyRow(&_currentRow[0]));
+            _nextRow();
+            LOGS(_log, LOG_LVL_TRACE, "staged row " << _rowsDone << " size=" << _currentRow.size());
+            fetched = std::min<size_t>(bufLen, _currentRow.size());
+            memcpy(buffer, &_currentRow[0], fetched);
+            _currentPos = fetched;
+        }
+        break;
     }
+    _bytesFetched += fetched;
     return fetched;
 }
 
+
+/// Advance to the next row, row bundles first, then the rows of each batch.
+void ProtoRowBuffer::_nextRow() {
+    ++_rowsDone;
+    if (_rowIdx < _rowTotal) {
+        ++_rowIdx;
+        return;
+    }
+    ++_batchRow;
+    _skipEmptyBatches();
+}
+
+
+void ProtoRowBuffer::_skipEmptyBatches() {
+    while (_batchIdx < _result.batch_size()
+           && _batchRow >= static_cast<int>(_result.batch(_batchIdx).rowcount())) {
+        ++_batchIdx;
+        _batchRow = 0;
+    }
+}
+
+
+/// @return an upper bound on the number of bytes _copyRow() writes for the
+///         current row.
+size_t ProtoRowBuffer::_maxRowSize() const {
+    if (_rowIdx < _rowTotal) {
+        return _maxRowSize(_result.row(_rowIdx));
+    }
+    proto::RowBatch const& batch = _result.batch(_batchIdx);
+    size_t size = _rowSep.size() + _jobIdStr.size();
+    for (auto const& col : batch.column()) {
+        size_t valSize = proto::MAX_NUMBER_SIZE;
+        if (col.kind() == proto::ColumnBatch::BYTES) {
+            char const* data;
+            size_t len;
+            proto::getBytes(col, _batchRow, data, len);
+            valSize = 2 + 2 * len;
+        }
+        size += _colSep.size() + std::max(valSize, _nullToken.size());
+    }
+    return size;
+}
+
+
+/// Serialize the current row. dest must have room for _maxRowSize() bytes.
+/// @return the number of bytes written.
+size_t ProtoRowBuffer::_copyRow(char* dest) const {
+    if (_rowIdx < _rowTotal) {
+        return _copyRow(dest, _result.row(_rowIdx));
+    }
+    proto::RowBatch const& batch = _result.batch(_batchIdx);
+    char* cursor = dest;
+    if (_rowsDone > 0) {
+        cursor = std::copy(_rowSep.begin(), _rowSep.end(), cursor);
+    }
+    cursor = std::copy(_jobIdStr.begin(), _jobIdStr.end(), cursor);
+    bool sep = !_jobIdColName.empty();
+    for (auto const& col : batch.column()) {
+        if (sep) {
+            cursor = std::copy(_colSep.begin(), _colSep.end(), cursor);
+        }
+        sep = true;
+        if (proto::isNull(col, _batchRow)) {
+            cursor = std::copy(_nullToken.begin(), _nullToken.end(), cursor);
+        } else if (col.kind() == proto::ColumnBatch::BYTES) {
+            char const* data;
+            size_t len;
+            proto::getBytes(col, _batchRow, data, len);
+            *cursor++ = '\'';
+            cursor += escapeBytes(cursor, data, len);
+            *cursor++ = '\'';
+        } else {
+            // Numbers need neither quotes nor escapes.
+            cursor += proto::formatNumber(col, _batchRow, cursor);
+        }
+    }
+    return cursor - dest;
+}
+
+
+/// @return an upper bound on the number of bytes _copyRow() writes for rb.
+size_t ProtoRowBuffer::_maxRowSize(proto::RowBundle const& rb) const {
+    size_t size = _rowSep.size() + _jobIdStr.size();
+    for(int ci=0, ce=rb.column_size(); ci != ce; ++ci) {
+        // Separator, and either quotes around the escaped column or NULL.
+        size += _colSep.size() + std::max(2 + 2 * rb.column(ci).size(), _nullToken.size());
+    }
+    return size;
+}
+
+
+/// Serialize a row bundle, preceded by a row separator unless it is the
+/// first row. dest must have room for _maxRowSize(rb) bytes.
+/// @return the number of bytes written.
+size_t ProtoRowBuffer::_copyRow(char* dest, proto::RowBundle const& rb) const {
+    char* cursor = dest;
+    if (_rowsDone > 0) {
+        cursor = std::copy(_rowSep.begin(), _rowSep.end(), cursor);
+    }
+    cursor = std::copy(_jobIdStr.begin(), _jobIdStr.end(), cursor);
+    for(int ci=0, ce=rb.column_size(); ci != ce; ++ci) {
+        if (ci > 0 || !_jobIdColName.empty()) {
+            cursor = std::copy(_colSep.begin(), _colSep.end(), cursor);
+        }
+        if (!rb.isnull(ci)) {
+            std::string const& col = rb.column(ci);
+            *cursor++ = '\'';
+            cursor += escapeBytes(cursor, col.data(), col.size());
+            *cursor++ = '\'';
+        } else {
+            cursor = std::copy(_nullToken.begin(), _nullToken.end(), cursor);
+        }
+    }
+    return cursor - dest;
+}
+
+
+int ProtoRowBuffer::escapeBytes(char* dest, char const* src, size_t len) {
+    // Every character that needs escaping is below 0x20. A word has such a
+    // byte iff (w - 0x20 in each byte) & ~w has a byte with its high bit set.
+    std::uint64_t const lowBytes = 0x2020202020202020ULL;
+    std::uint64_t const highBits = 0x8080808080808080ULL;
+    char* destI = dest;
+    size_t i = 0;
+    while (i < len) {
+        if (i + sizeof(std::uint64_t) <= len) {
+            std::uint64_t w;
+            memcpy(&w, src + i, sizeof(w));
+            if (((w - lowBytes) & ~w & highBits) == 0) {
+                memcpy(destI, src + i, sizeof(w));
+                destI += sizeof(w);
+                i += sizeof(w);
+                continue;
+            }
+        }
+        // Escape byte by byte up to the end of the current word.
+        size_t end = std::min(len, i + sizeof(std::uint64_t));
+        destI += escapeString(destI, src + i, src + end);
+        i = end;
+    }
+    return destI - dest;
+}
+
+
 /// Import schema from the proto message into a Schema object
 void ProtoRowBuffer::_initSchema() {
     _schema.columns.clear();
 
     // Set jobId and attemptCount
-    sql::ColSchema jobIdCol;
-    jobIdCol.name = _jobIdColName;
-    jobIdCol.colType.sqlType = _jobIdSqlType;
-    jobIdCol.colType.mysqlType = _jobIdMysqlType;
-    _schema.columns.push_back(jobIdCol);
+    if (!_jobIdColName.empty()) {
+        sql::ColSchema jobIdCol;
+        jobIdCol.name = _jobIdColName;
+        jobIdCol.colType.sqlType = _jobIdSqlType;
+        jobIdCol.colType.mysqlType = _jobIdMysqlType;
+        _schema.columns.push_back(jobIdCol);
+    }
 
     proto::RowSchema const& prs = _result.rowschema();
     for(int i=0, e=prs.columnschema_size(); i != e; ++i) {
@@ -141,34 +308,11 @@ std::string ProtoRowBuffer::dump() const {
         str += ",colType=" + sCol.colType.sqlType + ":" + std::to_string(sCol.colType.mysqlType) + ")";
     }
     str += ") ";
-    str += "Row " + std::to_string(_rowIdx) + "(";
+    str += "Row " + std::to_string(_rowsDone) + " staged(";
     str += printCharVect(_currentRow);
     str += ")";
     return str;
 }
 
 
-/// Import the next row into the buffer
-void ProtoRowBuffer::_readNextRow() {
-    ++_rowIdx;
-    if (_rowIdx >= _rowTotal) {
-        return;
-    }
-    _currentRow.clear();
-    // Start the new row with a row separator.
-    _currentRow.insert(_currentRow.end(), _rowSep.begin(), _rowSep.end());
-    _copyRowBundle(_currentRow, _result.row(_rowIdx));
-    LOGS(_log, LOG_LVL_TRACE, "_currentrow=" << printCharVect(_currentRow));
-}
-
-
-/// Setup the row byte buffer
-void ProtoRowBuffer::_initCurrentRow() {
-    // Copy row and reserve 2x size.
-    int rowSize = _copyRowBundle(_currentRow, _result.row(_rowIdx));
-    LOGS(_log, LOG_LVL_TRACE, "init _rowIdx=" <<_rowIdx << " _currentrow=" << printCharVect(_currentRow));
-    _currentRow.reserve(rowSize*2); // for future usage
-}
-
-
 }}} // lsst::qserv::mysql
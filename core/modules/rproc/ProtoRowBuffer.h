@@ -38,14 +38,31 @@ namespace rproc {
 
 
 /// ProtoRowBuffer is an implementation of RowBuffer designed to allow a
-/// LocalInfile object to use a Protobufs Result message as a row source
+/// LocalInfile object to use a Protobufs Result message as a row source.
+/// The rows of protocol 2 row bundles come first, followed by those of
+/// protocol 3 row batches.
+/// Rows are serialized directly into the buffer passed to fetch(), as many
+/// as fit. Only a row that is larger than the whole buffer is staged in an
+/// internal buffer, which is then handed out over several fetch() calls.
+/// Each row starts with a jobId column, unless jobIdColName is empty.
 class ProtoRowBuffer : public mysql::RowBuffer {
 public:
     ProtoRowBuffer(proto::Result& res, int jobId, std::string const& jobIdColName,
                    std::string const& jobIdSqlType, int jobIdMysqlType);
-    virtual unsigned fetch(char* buffer, unsigned bufLen);
+    unsigned fetch(char* buffer, unsigned bufLen) override;
+    bool fetchesPartialRows() const override { return true; }
     std::string dump() const override;
 
+    /// @return the number of bytes returned by fetch() so far.
+    size_t getBytesFetched() const { return _bytesFetched; }
+
+    /// Same as escapeString(), for a contiguous source. Eight bytes are
+    /// checked at a time for characters needing an escape, and runs without
+    /// them are copied as they are.
+    /// @return the number of bytes written to dest, which must have room for
+    ///         2*len bytes.
+    static int escapeBytes(char* dest, char const* src, size_t len);
+
     /// Escape a bytestring for LOAD DATA INFILE, as specified by MySQL doc:
     /// https://dev.mysql.com/doc/refman/5.1/en/load-data.html
     /// This is limited to:
@@ -96,25 +113,14 @@ public:
     }
 
 private:
-    void _initCurrentRow();
     void _initSchema();
-    void _readNextRow();
-    // Copy a row bundle into a destination STL char container
-    template <typename T>
-    int _copyRowBundle(T& dest, proto::RowBundle const& rb) {
-        int sizeBefore = dest.size();
-        // Add jobId
-        dest.insert(dest.end(), _jobIdStr.begin(), _jobIdStr.end());
-        for(int ci=0, ce=rb.column_size(); ci != ce; ++ci) {
-            dest.insert(dest.end(), _colSep.begin(), _colSep.end());
-            if (!rb.isnull(ci)) {
-                copyColumn(dest, rb.column(ci));
-            } else {
-                dest.insert(dest.end(), _nullToken.begin(), _nullToken.end() );
-            }
-        }
-        return dest.size() - sizeBefore;
-    }
+    bool _hasRow() const { return _rowIdx < _rowTotal || _batchIdx < _result.batch_size(); }
+    void _nextRow();
+    void _skipEmptyBatches();
+    size_t _maxRowSize() const;
+    size_t _copyRow(char* dest) const;
+    size_t _maxRowSize(proto::RowBundle const& rb) const;
+    size_t _copyRow(char* dest, proto::RowBundle const& rb) const;
 
 
     std::string _colSep; ///< Column separator
@@ -123,9 +129,14 @@ private:
     proto::Result& _result; ///< Ref to Resultmessage
 
     sql::Schema _schema; ///< Schema object
-    int _rowIdx; ///< Row index
-    int _rowTotal; ///< Total row count
-    std::vector<char> _currentRow; ///< char buffer representing current row.
+    int _rowIdx; ///< Index of the next row bundle to serialize
+    int _rowTotal; ///< Total row bundle count
+    int _batchIdx{0}; ///< Index of the batch of the next row, once bundles are done
+    int _batchRow{0}; ///< Index of the next row in that batch
+    int _rowsDone{0}; ///< Number of rows serialized so far
+    std::vector<char> _currentRow; ///< Row too large for the fetch() buffer.
+    size_t _currentPos{0}; ///< Bytes of _currentRow already fetched.
+    size_t _bytesFetched{0}; ///< Total bytes returned by fetch().
 
     /// Name and type for jobId column in result table. Passed from InfileMerger.
     std::string _jobIdStr; ///< String form of jobId.
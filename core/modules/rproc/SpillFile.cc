@@ -0,0 +1,233 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/SpillFile.h"
+
+// System headers
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "mysql/RowBuffer.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.SpillFile");
+
+/// Size of the reads from a RowBuffer.
+unsigned const FETCH_SIZE = 1024*1024;
+
+/// Write all of iov, retrying on partial writes.
+bool writeAll(int fd, struct iovec* iov, int iovCount) {
+    while (iovCount > 0) {
+        ssize_t n = ::writev(fd, iov, iovCount);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (iovCount > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovCount;
+        }
+        if (iovCount > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+char const SpillFile::FILE_MAGIC[8] = {'Q', 'S', 'S', 'P', 'I', 'L', 'L', '1'};
+std::uint32_t const SpillFile::SEGMENT_MAGIC;
+char const* const SpillFile::SUFFIX = ".spill";
+std::atomic<std::uint64_t> SpillFile::_totalBytes{0};
+std::atomic<std::uint64_t> SpillFile::_totalQuota{0};
+
+
+SpillFile::SpillFile(std::string const& path, int fd, std::uint64_t quotaBytes)
+    : _path(path), _fd(fd), _quotaBytes(quotaBytes) {
+}
+
+
+SpillFile::~SpillFile() {
+    ::close(_fd);
+    if (::unlink(_path.c_str()) != 0) {
+        LOGS(_log, LOG_LVL_WARN, "SpillFile failed to remove " << _path << ": " << std::strerror(errno));
+    }
+    _totalBytes -= _bytes;
+    LOGS(_log, LOG_LVL_DEBUG, "SpillFile removed " << _path << " bytes=" << _bytes
+         << " totalBytes=" << _totalBytes);
+}
+
+
+SpillFile::Ptr SpillFile::create(std::string const& dir, std::string const& name, std::uint64_t quotaBytes) {
+    if (::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile failed to create " << dir << ": " << std::strerror(errno));
+        return nullptr;
+    }
+    std::string const path = dir + "/" + name + SUFFIX;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile failed to create " << path << ": " << std::strerror(errno));
+        return nullptr;
+    }
+    struct iovec iov = {const_cast<char*>(FILE_MAGIC), sizeof(FILE_MAGIC)};
+    if (!writeAll(fd, &iov, 1)) {
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile failed to write " << path << ": " << std::strerror(errno));
+        ::close(fd);
+        ::unlink(path.c_str());
+        return nullptr;
+    }
+    Ptr spillFile(new SpillFile(path, fd, quotaBytes));
+    spillFile->_bytes = sizeof(FILE_MAGIC);
+    _totalBytes += sizeof(FILE_MAGIC);
+    LOGS(_log, LOG_LVL_INFO, "SpillFile created " << path << " quotaBytes=" << quotaBytes);
+    return spillFile;
+}
+
+
+bool SpillFile::append(int jobIdAttempt, std::uint64_t rowCount, mysql::RowBuffer& rowBuffer) {
+    // Rows are gathered first, a message holds a bounded amount of them,
+    // so that concurrent merges only wait for each other's writes.
+    std::vector<char> rows;
+    while (true) {
+        size_t pos = rows.size();
+        rows.resize(pos + FETCH_SIZE);
+        unsigned n = rowBuffer.fetch(rows.data() + pos, FETCH_SIZE);
+        rows.resize(pos + n);
+        if (n == 0) break;
+    }
+    SegmentHeader header{SEGMENT_MAGIC, jobIdAttempt, rowCount, rows.size()};
+    std::uint64_t const size = sizeof(header) + rows.size();
+
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (_quotaBytes > 0 && _bytes + size > _quotaBytes) {
+        _error = "spill file " + _path + " over quota of " + std::to_string(_quotaBytes) + " bytes";
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile " << _error);
+        return false;
+    }
+    std::uint64_t const total = _totalBytes += size;
+    if (_totalQuota > 0 && total > _totalQuota) {
+        _totalBytes -= size;
+        _error = "spill files over total quota of " + std::to_string(_totalQuota) + " bytes";
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile " << _path << " " << _error);
+        return false;
+    }
+    struct iovec iov[2] = {{&header, sizeof(header)}, {rows.data(), rows.size()}};
+    if (!writeAll(_fd, iov, 2)) {
+        _totalBytes -= size;
+        _error = "failed to write " + _path + ": " + std::strerror(errno);
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile " << _error);
+        // The file may end with part of a segment, which makes it unreadable.
+        return false;
+    }
+    _bytes += size;
+    return true;
+}
+
+
+bool SpillFile::forEachSegment(SegmentFunc const& func, FinishFunc const& finish) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    size_t const size = _bytes;
+    void* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (map == MAP_FAILED) {
+        _error = "failed to map " + _path + ": " + std::strerror(errno);
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile " << _error);
+        return false;
+    }
+    ::madvise(map, size, MADV_SEQUENTIAL);
+    char const* const data = static_cast<char const*>(map);
+    bool ok = std::memcmp(data, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0;
+    size_t pos = sizeof(FILE_MAGIC);
+    while (ok && pos < size) {
+        SegmentHeader header;
+        if (size - pos < sizeof(header)) {
+            ok = false;
+            break;
+        }
+        std::memcpy(&header, data + pos, sizeof(header));
+        pos += sizeof(header);
+        if (header.magic != SEGMENT_MAGIC || header.length > size - pos) {
+            ok = false;
+            break;
+        }
+        if (!func(header, data + pos)) {
+            break;
+        }
+        pos += header.length;
+    }
+    if (ok && finish) {
+        finish();
+    }
+    ::munmap(map, size);
+    if (!ok) {
+        _error = "malformed spill file " + _path + " at offset " + std::to_string(pos);
+        LOGS(_log, LOG_LVL_ERROR, "SpillFile " << _error);
+    }
+    return ok;
+}
+
+
+std::string SpillFile::getError() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _error;
+}
+
+
+void SpillFile::removeAll(std::string const& dir) {
+    DIR* d = ::opendir(dir.c_str());
+    if (d == nullptr) {
+        return;
+    }
+    std::string const suffix(SUFFIX);
+    while (struct dirent* entry = ::readdir(d)) {
+        std::string const name(entry->d_name);
+        if (name.size() > suffix.size()
+            && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            std::string const path = dir + "/" + name;
+            LOGS(_log, LOG_LVL_INFO, "SpillFile removing old " << path);
+            ::unlink(path.c_str());
+        }
+    }
+    ::closedir(d);
+}
+
+}}} // namespace lsst::qserv::rproc
@@ -0,0 +1,136 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_RPROC_SPILLFILE_H
+#define LSST_QSERV_RPROC_SPILLFILE_H
+
+// System headers
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Forward declarations
+namespace lsst {
+namespace qserv {
+namespace mysql {
+    class RowBuffer;
+}
+}} // End of forward declarations
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// SpillFile is an append-only local file of worker result rows, which
+/// InfileMerger writes rows to instead of the merge table once a result is
+/// too large for the result database to absorb well while it arrives. The
+/// rows are loaded into the merge table in large sequential batches once
+/// all are in, skipping those of failed job attempts.
+///
+/// On-disk format, in host byte order:
+///
+///   file    := "QSSPILL1" segment*
+///   segment := SegmentHeader rows
+///   rows    := SegmentHeader::length bytes of rows in LOAD DATA INFILE
+///              text format, as produced by ProtoRowBuffer: tab separated
+///              fields, newline terminated rows, NULL written as \N.
+///
+/// Each segment holds rows of one worker result message, and names the job
+/// attempt they belong to. A file only lives as long as its SpillFile, and
+/// is removed when it is destroyed.
+///
+/// The bytes appended are bounded by a quota of the file, and by a quota
+/// shared by all files of the process.
+class SpillFile {
+public:
+    typedef std::shared_ptr<SpillFile> Ptr;
+
+    struct SegmentHeader {
+        std::uint32_t magic;      ///< SEGMENT_MAGIC
+        std::int32_t jobIdAttempt;
+        std::uint64_t rowCount;
+        std::uint64_t length;     ///< Bytes of rows following the header.
+    };
+    static char const FILE_MAGIC[8];
+    static std::uint32_t const SEGMENT_MAGIC = 0x47455351; ///< "QSEG"
+    static char const* const SUFFIX; ///< Of file names.
+
+    /// Called for each segment by forEachSegment().
+    /// @return false to stop.
+    using SegmentFunc = std::function<bool(SegmentHeader const& header, char const* rows)>;
+    /// Called by forEachSegment() once it is done with the segments.
+    using FinishFunc = std::function<void()>;
+
+    SpillFile(SpillFile const&) = delete;
+    SpillFile& operator=(SpillFile const&) = delete;
+    ~SpillFile();
+
+    /// Create the file dir/name.SUFFIX, and dir if needed.
+    /// @param quotaBytes maximum size of the file, 0 for no limit.
+    /// @return the file, or nullptr if it could not be created.
+    static Ptr create(std::string const& dir, std::string const& name, std::uint64_t quotaBytes);
+
+    /// Append a segment of the rows of rowBuffer, which are all fetched.
+    /// @return false if the rows could not be written, or a quota would be exceeded.
+    bool append(int jobIdAttempt, std::uint64_t rowCount, mysql::RowBuffer& rowBuffer);
+
+    /// Map the file into memory and call func with each segment in turn,
+    /// then finish, if given and the file is well formed. The rows passed
+    /// to func stay valid until finish returns. No segment may be appended meanwhile.
+    /// @return false if the file could not be read, or is malformed.
+    bool forEachSegment(SegmentFunc const& func, FinishFunc const& finish=nullptr);
+
+    /// @return the size of the file.
+    std::uint64_t getBytes() const { return _bytes; }
+    std::string const& getPath() const { return _path; }
+    /// @return an error description if append() or forEachSegment() failed.
+    std::string getError() const;
+
+    /// Set the maximum size of all files together, 0 for no limit.
+    static void setTotalQuota(std::uint64_t bytes) { _totalQuota = bytes; }
+    /// @return the size of all files.
+    static std::uint64_t getTotalBytes() { return _totalBytes; }
+    /// Remove files left in dir by a previous process.
+    static void removeAll(std::string const& dir);
+
+private:
+    SpillFile(std::string const& path, int fd, std::uint64_t quotaBytes);
+    void _setError(std::string const& msg);
+
+    std::string const _path;
+    int const _fd;
+    std::uint64_t const _quotaBytes;
+    mutable std::mutex _mtx; ///< Serializes appends, protects _error.
+    std::atomic<std::uint64_t> _bytes{0};
+    std::string _error;
+
+    static std::atomic<std::uint64_t> _totalBytes;
+    static std::atomic<std::uint64_t> _totalQuota;
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_SPILLFILE_H
@@ -0,0 +1,422 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// Class header
+#include "rproc/TopKMerger.h"
+
+// System headers
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// LSST headers
+#include "lsst/log/Log.h"
+
+// Qserv headers
+#include "proto/RowBatch.h"
+#include "query/ColumnRef.h"
+#include "query/OrderByClause.h"
+#include "query/SelectList.h"
+#include "query/SelectStmt.h"
+#include "query/ValueExpr.h"
+
+namespace {
+
+LOG_LOGGER _log = LOG_GET("lsst.qserv.rproc.TopKMerger");
+
+/// Approximate bookkeeping cost of one kept row, in bytes.
+size_t const ENTRY_OVERHEAD = 64;
+
+/// @return true if values of mysqlType can be ordered as numbers. Wide
+///         DECIMAL values could tie or swap places as doubles, so ordering
+///         by them is left to mysql.
+bool isNumeric(int mysqlType) {
+    switch (mysqlType) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_YEAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // anonymous namespace
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// SortValue is the value of an ORDER BY column. Integers are compared
+/// exactly, anything else as a double. NULL sorts before any value, as in
+/// mysql.
+struct TopKMerger::SortValue {
+    bool isNull{true};
+    bool isInt{true};
+    std::int64_t i{0};
+    double d{0.0};
+
+    double asDouble() const { return isInt ? static_cast<double>(i) : d; }
+
+    /// Parse the text form of a numeric column, as sent by the worker.
+    void parse(char const* begin) {
+        isNull = false;
+        char* end = nullptr;
+        errno = 0;
+        long long ll = std::strtoll(begin, &end, 10);
+        isInt = (errno == 0 && end != begin && *end == '\0');
+        if (isInt) {
+            i = ll;
+        } else {
+            d = std::strtod(begin, nullptr);
+        }
+    }
+
+    /// @return a negative number, zero, or a positive number if this value
+    ///         sorts before, with, or after other.
+    int compare(SortValue const& other) const {
+        if (isNull || other.isNull) {
+            return static_cast<int>(other.isNull) - static_cast<int>(isNull);
+        }
+        if (isInt && other.isInt) {
+            return (i < other.i) ? -1 : (other.i < i);
+        }
+        double a = asDouble();
+        double b = other.asDouble();
+        return (a < b) ? -1 : (b < a);
+    }
+};
+
+
+/// Entry is a kept row and its ORDER BY values.
+struct TopKMerger::Entry {
+    std::vector<SortValue> key;
+    proto::RowBundle row;
+    size_t sizeBytes{0};
+};
+
+
+/// Heap holds at most _limit entries, the one sorting last on top.
+class TopKMerger::Heap {
+public:
+    std::mutex mtx; ///< Protects the members of a pending heap.
+    std::vector<Entry> entries;
+    size_t sizeBytes{0};
+};
+
+
+namespace {
+
+/// BundleRow gives access to the values of a protocol 2 row.
+struct BundleRow {
+    proto::RowBundle const& rb;
+
+    bool isNull(int pos) const { return rb.isnull(pos); }
+
+    char const* getText(int pos, std::string&) const { return rb.column(pos).c_str(); }
+
+    void copyTo(proto::RowBundle& dest) const { dest = rb; }
+};
+
+
+/// BatchRow gives access to the values of a row of a protocol 3 batch.
+struct BatchRow {
+    proto::RowBatch const& batch;
+    int row;
+
+    bool isNull(int pos) const { return proto::isNull(batch.column(pos), row); }
+
+    /// @return the text form of a value, which may be kept in buf.
+    char const* getText(int pos, std::string& buf) const {
+        proto::ColumnBatch const& col = batch.column(pos);
+        if (col.kind() == proto::ColumnBatch::BYTES) {
+            char const* data;
+            size_t len;
+            proto::getBytes(col, row, data, len);
+            buf.assign(data, len);
+        } else {
+            buf.resize(proto::MAX_NUMBER_SIZE);
+            buf.resize(proto::formatNumber(col, row, &buf[0]));
+        }
+        return buf.c_str();
+    }
+
+    /// Convert the row to protocol 2, the form kept rows are loaded in.
+    void copyTo(proto::RowBundle& dest) const {
+        std::string buf;
+        for (int pos = 0, e = batch.column_size(); pos != e; ++pos) {
+            bool null = isNull(pos);
+            dest.add_column(null ? std::string() : getText(pos, buf));
+            dest.add_isnull(null);
+        }
+    }
+};
+
+} // anonymous namespace
+
+
+TopKMerger::TopKMerger(std::vector<SortColumn> const& sortColumns, std::int64_t limit)
+    : _sortColumns(sortColumns), _limit(std::max<std::int64_t>(limit, 0)),
+      _heap(std::make_shared<Heap>()) {
+}
+
+
+TopKMerger::Ptr TopKMerger::newIfSupported(query::SelectStmt& mergeStmt) {
+    if (!mergeStmt.hasOrderBy() || !mergeStmt.hasLimit() || mergeStmt.getDistinct()
+        || mergeStmt.hasWhereClause() || mergeStmt.hasGroupBy() || mergeStmt.hasHaving()) {
+        return nullptr;
+    }
+    auto selectList = mergeStmt.getSelectList().getValueExprList();
+    if (selectList == nullptr || selectList->empty()) {
+        return nullptr;
+    }
+    bool hasStar = false;
+    for (auto const& ve : *selectList) {
+        if (ve == nullptr || ve->hasAggregation()) {
+            return nullptr;
+        }
+        hasStar = hasStar || ve->isStar();
+    }
+
+    std::vector<SortColumn> sortColumns;
+    for (auto const& term : *mergeStmt.getOrderBy().getTerms()) {
+        auto const& expr = term.getExpr();
+        auto cr = (expr == nullptr) ? nullptr : expr->getColumnRef();
+        if (cr == nullptr) {
+            return nullptr;
+        }
+        // The term names a select list column, through its alias if it has
+        // one, and the worker result column is the one that select list
+        // entry refers to.
+        std::string input;
+        for (auto const& ve : *selectList) {
+            std::string outName = ve->getAlias();
+            auto veCr = ve->getColumnRef();
+            if (outName.empty() && veCr != nullptr) {
+                outName = veCr->column;
+            }
+            if (outName != cr->column) continue;
+            if (veCr == nullptr || !input.empty()) {
+                return nullptr; // An expression, or ambiguous.
+            }
+            input = veCr->column;
+        }
+        if (input.empty()) {
+            if (!hasStar) {
+                return nullptr;
+            }
+            input = cr->column;
+        }
+        sortColumns.emplace_back(input, term.getOrder() == query::OrderByTerm::DESC);
+    }
+    return std::make_shared<TopKMerger>(sortColumns, mergeStmt.getLimit());
+}
+
+
+bool TopKMerger::setSchema(proto::RowSchema const& rowSchema) {
+    _rowSchema = rowSchema;
+    _sortPos.clear();
+    for (auto const& sortCol : _sortColumns) {
+        int pos = -1;
+        for (int i = 0, e = rowSchema.columnschema_size(); i != e; ++i) {
+            proto::ColumnSchema const& cs = rowSchema.columnschema(i);
+            if (cs.name() == sortCol.name) {
+                pos = (cs.has_mysqltype() && isNumeric(cs.mysqltype())) ? i : -1;
+                break;
+            }
+        }
+        if (pos < 0) {
+            LOGS(_log, LOG_LVL_DEBUG, "TopKMerger cannot order by " << sortCol.name);
+            return false;
+        }
+        _sortPos.push_back(pos);
+    }
+    return true;
+}
+
+
+std::shared_ptr<TopKMerger::Heap> TopKMerger::_getPending(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto& pending = _pending[jobIdAttempt];
+    if (pending == nullptr) {
+        pending = std::make_shared<Heap>();
+    }
+    return pending;
+}
+
+
+void TopKMerger::add(proto::Result const& result, int jobIdAttempt) {
+    int const rowCount = proto::countRows(result);
+    if (rowCount > 0) {
+        _rowsSeen += rowCount;
+        auto pending = _getPending(jobIdAttempt);
+        std::lock_guard<std::mutex> lock(pending->mtx);
+        // Rows are only copied once they are known to be kept.
+        auto addRow = [this, &pending](auto const& row, Entry& entry) -> long {
+            _getKey(row, entry.key);
+            Heap& heap = *pending;
+            if (heap.entries.size() >= _limit
+                && (_limit == 0 || !_before(entry.key, heap.entries.front().key))) {
+                return 0;
+            }
+            entry.row.Clear();
+            row.copyTo(entry.row);
+            entry.sizeBytes = ENTRY_OVERHEAD + entry.key.size() * sizeof(SortValue);
+            for (auto const& col : entry.row.column()) {
+                entry.sizeBytes += col.size();
+            }
+            return _push(heap, entry);
+        };
+        long added = 0;
+        Entry entry;
+        for (auto const& rb : result.row()) {
+            added += addRow(BundleRow{rb}, entry);
+        }
+        for (auto const& batch : result.batch()) {
+            for (int r = 0, e = batch.rowcount(); r != e; ++r) {
+                added += addRow(BatchRow{batch, r}, entry);
+            }
+        }
+        pending->sizeBytes += added;
+        _sizeBytes += added;
+    }
+    if (!result.continues()) {
+        _commit(jobIdAttempt);
+    }
+}
+
+
+template <typename Row>
+void TopKMerger::_getKey(Row const& row, std::vector<SortValue>& key) const {
+    std::string buf;
+    key.resize(_sortPos.size());
+    for (size_t j = 0; j < _sortPos.size(); ++j) {
+        int pos = _sortPos[j];
+        key[j] = SortValue();
+        if (!row.isNull(pos)) {
+            key[j].parse(row.getText(pos, buf));
+        }
+    }
+}
+
+
+/// @return true if a row with key a sorts before a row with key b.
+bool TopKMerger::_before(std::vector<SortValue> const& a, std::vector<SortValue> const& b) const {
+    for (size_t j = 0; j < a.size(); ++j) {
+        int cmp = a[j].compare(b[j]);
+        if (cmp != 0) {
+            return _sortColumns[j].descending ? cmp > 0 : cmp < 0;
+        }
+    }
+    return false;
+}
+
+
+/// Move entry into heap, replacing the entry on top if heap is full. The
+/// caller has checked that entry sorts before that one.
+/// @return the change in the size of heap, in bytes.
+long TopKMerger::_push(Heap& heap, Entry& entry) {
+    auto before = [this](Entry const& a, Entry const& b) { return _before(a.key, b.key); };
+    long change = entry.sizeBytes;
+    if (heap.entries.size() >= _limit) {
+        std::pop_heap(heap.entries.begin(), heap.entries.end(), before);
+        change -= heap.entries.back().sizeBytes;
+        std::swap(heap.entries.back(), entry);
+    } else {
+        heap.entries.emplace_back();
+        std::swap(heap.entries.back(), entry);
+    }
+    std::push_heap(heap.entries.begin(), heap.entries.end(), before);
+    return change;
+}
+
+
+/// Move the rows of a completed job attempt into the shared heap.
+void TopKMerger::_commit(int jobIdAttempt) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _committed.insert(jobIdAttempt);
+    auto pIter = _pending.find(jobIdAttempt);
+    if (pIter == _pending.end()) {
+        return; // No rows.
+    }
+    std::shared_ptr<Heap> pending = pIter->second;
+    _pending.erase(pIter);
+
+    std::lock_guard<std::mutex> pLock(pending->mtx);
+    long change = 0;
+    for (auto& entry : pending->entries) {
+        if (_heap->entries.size() < _limit || _before(entry.key, _heap->entries.front().key)) {
+            change += _push(*_heap, entry);
+        }
+    }
+    _heap->sizeBytes += change;
+    _sizeBytes += change - static_cast<long>(pending->sizeBytes);
+    LOGS(_log, LOG_LVL_TRACE, "TopKMerger committed " << jobIdAttempt
+         << " rows=" << _heap->entries.size());
+}
+
+
+bool TopKMerger::scrub(std::set<int> const& jobIdAttempts) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    bool ok = true;
+    for (int jobIdAttempt : jobIdAttempts) {
+        if (_committed.count(jobIdAttempt) > 0) {
+            LOGS(_log, LOG_LVL_ERROR, "TopKMerger rows of " << jobIdAttempt
+                 << " already committed, cannot be removed");
+            ok = false;
+            continue;
+        }
+        auto iter = _pending.find(jobIdAttempt);
+        if (iter != _pending.end()) {
+            _sizeBytes -= iter->second->sizeBytes;
+            _pending.erase(iter);
+        }
+    }
+    return ok;
+}
+
+
+void TopKMerger::takeRows(proto::Result& result) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    *result.mutable_rowschema() = _rowSchema;
+    for (auto& entry : _heap->entries) {
+        result.add_row()->Swap(&entry.row);
+    }
+    LOGS(_log, LOG_LVL_DEBUG, "TopKMerger kept " << _heap->entries.size()
+         << " of " << _rowsSeen << " rows");
+    _heap->entries.clear();
+    _heap->sizeBytes = 0;
+    _pending.clear();
+    _sizeBytes = 0;
+}
+
+}}} // namespace lsst::qserv::rproc
@@ -0,0 +1,134 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+#ifndef LSST_QSERV_RPROC_TOPKMERGER_H
+#define LSST_QSERV_RPROC_TOPKMERGER_H
+
+// System headers
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+// Forward declarations
+namespace lsst {
+namespace qserv {
+namespace query {
+    class SelectStmt;
+}
+}} // End of forward declarations
+
+
+namespace lsst {
+namespace qserv {
+namespace rproc {
+
+/// TopKMerger keeps the first LIMIT rows, in ORDER BY order, of the worker
+/// results of a merge statement of the form
+///   SELECT <columns> ORDER BY <columns> LIMIT k
+/// in a bounded heap. Rows that cannot be among the first k are dropped as
+/// they arrive, so only k rows are loaded into the merge table, where the
+/// merge statement sorts them.
+///
+/// As in AggregateMerger, rows of a job attempt are kept in a heap of their
+/// own until the last message of the attempt has arrived, at which point
+/// they are committed to the shared heap.
+class TopKMerger {
+public:
+    typedef std::shared_ptr<TopKMerger> Ptr;
+
+    /// An ORDER BY term, naming a worker result column.
+    struct SortColumn {
+        SortColumn(std::string const& name_, bool descending_)
+            : name(name_), descending(descending_) {}
+        std::string name;
+        bool descending;
+    };
+
+    TopKMerger(std::vector<SortColumn> const& sortColumns, std::int64_t limit);
+    TopKMerger(TopKMerger const&) = delete;
+    TopKMerger& operator=(TopKMerger const&) = delete;
+
+    /// @return a TopKMerger for mergeStmt, or nullptr if the rows mergeStmt
+    ///         returns cannot be chosen by this class.
+    static Ptr newIfSupported(query::SelectStmt& mergeStmt);
+
+    /// Locate the ORDER BY columns in the worker result schema.
+    /// @return false if a column is missing or is not numeric, in which case
+    ///         no rows may be added.
+    bool setSchema(proto::RowSchema const& rowSchema);
+
+    /// Add the rows of a worker result to the heap of jobIdAttempt, and
+    /// commit that heap if the result is the last one of the attempt.
+    void add(proto::Result const& result, int jobIdAttempt);
+
+    /// Drop the rows of failed job attempts.
+    /// @return false if rows of any of them were already committed and can
+    ///         no longer be removed.
+    bool scrub(std::set<int> const& jobIdAttempts);
+
+    /// Move the committed rows, in no particular order, to result, along
+    /// with the worker result schema. Uncommitted rows are dropped.
+    void takeRows(proto::Result& result);
+
+    /// @return the approximate memory used by committed and pending rows.
+    size_t getSizeBytes() const { return _sizeBytes; }
+
+    /// @return the number of rows added so far, kept or not.
+    std::uint64_t getRowsSeen() const { return _rowsSeen; }
+
+private:
+    struct SortValue;
+    struct Entry;
+    class Heap;
+
+    std::shared_ptr<Heap> _getPending(int jobIdAttempt);
+    template <typename Row>
+    void _getKey(Row const& row, std::vector<SortValue>& key) const;
+    bool _before(std::vector<SortValue> const& a, std::vector<SortValue> const& b) const;
+    long _push(Heap& heap, Entry& entry);
+    void _commit(int jobIdAttempt);
+
+    std::vector<SortColumn> const _sortColumns;
+    size_t const _limit;
+
+    proto::RowSchema _rowSchema; ///< Set by setSchema().
+    std::vector<int> _sortPos; ///< Position of each ORDER BY column, set by setSchema().
+
+    std::mutex _mtx; ///< Protects _heap, _pending, and _committed.
+    std::shared_ptr<Heap> _heap; ///< Committed rows.
+    std::map<int, std::shared_ptr<Heap>> _pending; ///< Rows of attempts still in progress.
+    std::set<int> _committed; ///< Job attempts whose rows are in _heap.
+    std::atomic<size_t> _sizeBytes{0};
+    std::atomic<std::uint64_t> _rowsSeen{0};
+};
+
+}}} // namespace lsst::qserv::rproc
+
+#endif // LSST_QSERV_RPROC_TOPKMERGER_H
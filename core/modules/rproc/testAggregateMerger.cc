@@ -0,0 +1,179 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <string>
+#include <vector>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// Class header
+#include "rproc/AggregateMerger.h"
+
+// Qserv headers
+#include "rproc/MergerTestFixture.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE AggregateMerger_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::proto::ColumnBatch;
+using lsst::qserv::proto::Result;
+using lsst::qserv::rproc::AggregateMerger;
+
+struct Fixture : lsst::qserv::rproc::MergerTestFixture {
+    Fixture(void) {
+        // Worker result of:
+        // SELECT filterId, COUNT(*) AS QS1_COUNT, MAX(flux) AS QS2_MAX,
+        //        COUNT(flux) AS QS3_COUNT, SUM(flux) AS QS4_SUM ... GROUP BY filterId
+        addColumn("filterId", MYSQL_TYPE_LONG);
+        addColumn("QS1_COUNT", MYSQL_TYPE_LONGLONG);
+        addColumn("QS2_MAX", MYSQL_TYPE_DOUBLE);
+        addColumn("QS3_COUNT", MYSQL_TYPE_LONGLONG);
+        addColumn("QS4_SUM", MYSQL_TYPE_DOUBLE);
+        batchKinds = {ColumnBatch::INT64, ColumnBatch::INT64, ColumnBatch::DOUBLE,
+                      ColumnBatch::INT64, ColumnBatch::DOUBLE};
+
+        std::vector<AggregateMerger::Column> columns;
+        columns.emplace_back(AggregateMerger::GROUP, "filterId");
+        columns.emplace_back(AggregateMerger::SUM, "QS1_COUNT");
+        columns.emplace_back(AggregateMerger::MAX, "QS2_MAX");
+        columns.emplace_back(AggregateMerger::AVG, "QS4_SUM", "QS3_COUNT");
+        merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>{"filterId"});
+    }
+    ~Fixture(void) { }
+
+    /// @return the sorted lines produced by the merger for LOAD DATA.
+    std::vector<std::string> readRows() {
+        return bufferLines(*merger->newRowBuffer());
+    }
+
+    AggregateMerger::Ptr merger;
+};
+
+
+BOOST_FIXTURE_TEST_SUITE(suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(FoldAndCommit) {
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->fold(makeResult({{"1", "10", "2.5", "10", "20"},
+                             {"2", "3", "N", "0", "N"}}, true), 10);
+    merger->fold(makeResult({{"1", "5", "4", "5", "10"}}, false), 10);
+    merger->fold(makeResult({{"2", "4", "-1", "4", "8"}}, false), 20);
+    // Attempt 30 does not complete, its rows must not show up.
+    merger->fold(makeResult({{"3", "7", "1", "7", "7"}}, true), 30);
+
+    std::vector<std::string> expected = {"'1'\t15\t4\t2", "'2'\t7\t-1\t2"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(FoldBatches) {
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->fold(makeResult({{"1", "10", "2.5", "10", "20"}}, false), 10);
+    merger->fold(makeBatchResult({{"1", "5", "4", "5", "10"},
+                                  {"2", "3", nullptr, "0", nullptr}}, false), 20);
+    std::vector<std::string> expected = {"'1'\t15\t4\t2", "'2'\t3\t\\N\t\\N"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(FloatGroupKey) {
+    // Protocol 2 text and protocol 3 doubles of the same value share a group.
+    std::vector<AggregateMerger::Column> columns;
+    columns.emplace_back(AggregateMerger::GROUP, "QS2_MAX");
+    columns.emplace_back(AggregateMerger::SUM, "QS1_COUNT");
+    merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>{"QS2_MAX"});
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->fold(makeResult({{"1", "10", "0.1", "10", "20"}}, false), 10);
+    merger->fold(makeBatchResult({{"1", "5", "0.1", "5", "10"}}, false), 20);
+    std::vector<std::string> expected = {"'0.10000000000000001'\t15"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(ExactIntegers) {
+    // Sums of integers are exact, averages of them are DECIMAL quotients.
+    std::vector<AggregateMerger::Column> columns;
+    columns.emplace_back(AggregateMerger::GROUP, "filterId");
+    columns.emplace_back(AggregateMerger::SUM, "QS1_COUNT");
+    columns.emplace_back(AggregateMerger::AVG, "QS1_COUNT", "QS3_COUNT");
+    merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>{"filterId"});
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->fold(makeResult({{"1", "9223372036854775807", "0", "2", "0"},
+                             {"2", "-2", "0", "3", "0"}}, false), 10);
+    merger->fold(makeBatchResult({{"1", "9223372036854775807", "0", "1", "0"}}, false), 20);
+    std::vector<std::string> expected = {"'1'\t18446744073709551614\t6148914691236517204.6667",
+                                         "'2'\t-2\t-0.6667"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(Decimal) {
+    addColumn("QS5_SUM", MYSQL_TYPE_NEWDECIMAL);
+    // DECIMAL values are not aggregated through int64 or double.
+    std::vector<AggregateMerger::Column> columns;
+    columns.emplace_back(AggregateMerger::SUM, "QS5_SUM");
+    merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>());
+    BOOST_CHECK(!merger->setSchema(schemaResult.rowschema()));
+
+    // Their text is kept as is when grouping by them.
+    columns.clear();
+    columns.emplace_back(AggregateMerger::GROUP, "QS5_SUM");
+    columns.emplace_back(AggregateMerger::SUM, "QS1_COUNT");
+    merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>{"QS5_SUM"});
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->fold(makeResult({{"1", "10", "0.1", "10", "20", "12345678901234567.89"}}, false), 10);
+    merger->fold(makeResult({{"1", "5", "0.1", "5", "10", "12345678901234567.89"}}, false), 20);
+    std::vector<std::string> expected = {"'12345678901234567.89'\t15"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(Scrub) {
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->fold(makeResult({{"1", "10", "2.5", "10", "20"}}, false), 10);
+    merger->fold(makeResult({{"1", "3", "9", "3", "3"}}, true), 11);
+    BOOST_CHECK(merger->scrub({11}));
+    BOOST_CHECK(!merger->scrub({10}));
+    std::vector<std::string> expected = {"'1'\t10\t2.5\t2"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(NoGroupBy) {
+    std::vector<AggregateMerger::Column> columns;
+    columns.emplace_back(AggregateMerger::SUM, "QS1_COUNT");
+    merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>());
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    // No rows at all still gives a single NULL row.
+    std::vector<std::string> expected = {"\\N"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(BadSchema) {
+    addColumn("name", MYSQL_TYPE_VAR_STRING);
+    std::vector<AggregateMerger::Column> columns;
+    columns.emplace_back(AggregateMerger::MIN, "name");
+    merger = std::make_shared<AggregateMerger>(columns, std::vector<std::string>());
+    BOOST_CHECK(!merger->setSchema(schemaResult.rowschema()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
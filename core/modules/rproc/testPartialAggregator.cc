@@ -0,0 +1,96 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <map>
+#include <string>
+
+// Class header
+#include "rproc/PartialAggregator.h"
+
+// Qserv headers
+#include "proto/worker.pb.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE PartialAggregator_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::proto::RowSchema;
+using lsst::qserv::rproc::PartialAggregator;
+
+struct Fixture {
+    Fixture(void) {
+        // Merge statement of:
+        // SELECT chunkId, COUNT(*), AVG(ra), MAX(decl) ... GROUP BY chunkId
+        kinds["chunkId"] = PartialAggregator::GROUP;
+        kinds["QS1_COUNT"] = PartialAggregator::SUM;
+        kinds["QS2_SUM"] = PartialAggregator::SUM;
+        kinds["QS3_COUNT"] = PartialAggregator::SUM;
+        kinds["QS4_MAX"] = PartialAggregator::MAX;
+    }
+    ~Fixture(void) { }
+
+    RowSchema makeSchema(std::vector<std::string> const& names) {
+        RowSchema rowSchema;
+        for (auto const& name : names) {
+            rowSchema.add_columnschema()->set_name(name);
+        }
+        return rowSchema;
+    }
+
+    std::map<std::string, PartialAggregator::Kind> kinds;
+};
+
+
+BOOST_FIXTURE_TEST_SUITE(suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(FoldSelect) {
+    PartialAggregator partialAgg(kinds);
+    BOOST_REQUIRE(partialAgg.setSchema(makeSchema({"chunkId", "QS1_COUNT", "QS2_SUM",
+                                                   "QS3_COUNT", "QS4_MAX"})));
+    std::string expected = "SELECT -1 AS `jobId`,`chunkId`,SUM(`QS1_COUNT`) AS `QS1_COUNT`,"
+        "SUM(`QS2_SUM`) AS `QS2_SUM`,SUM(`QS3_COUNT`) AS `QS3_COUNT`,MAX(`QS4_MAX`) AS `QS4_MAX`"
+        " FROM r_fold GROUP BY `chunkId`";
+    BOOST_CHECK_EQUAL(partialAgg.makeFoldSelect("r_fold", "jobId", -1), expected);
+}
+
+BOOST_AUTO_TEST_CASE(NoGroupBy) {
+    kinds.erase("chunkId");
+    PartialAggregator partialAgg(kinds);
+    BOOST_REQUIRE(partialAgg.setSchema(makeSchema({"QS4_MAX", "QS1_COUNT"})));
+    std::string expected = "SELECT 0 AS `jobId0`,MAX(`QS4_MAX`) AS `QS4_MAX`,"
+        "SUM(`QS1_COUNT`) AS `QS1_COUNT` FROM r_fold";
+    BOOST_CHECK_EQUAL(partialAgg.makeFoldSelect("r_fold", "jobId0", 0), expected);
+}
+
+BOOST_AUTO_TEST_CASE(BadSchema) {
+    PartialAggregator partialAgg(kinds);
+    // A column without a function.
+    BOOST_CHECK(!partialAgg.setSchema(makeSchema({"chunkId", "QS1_COUNT", "ra"})));
+    // The GROUP BY column is missing.
+    BOOST_CHECK(!partialAgg.setSchema(makeSchema({"QS1_COUNT", "QS4_MAX"})));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
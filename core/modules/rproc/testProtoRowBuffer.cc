@@ -26,6 +26,7 @@
 #include "rproc/ProtoRowBuffer.h"
 
 // Qserv headers
+#include "proto/RowBatch.h"
 #include "proto/worker.pb.h"
 #include "proto/FakeProtocolFixture.h"
 
@@ -80,4 +81,123 @@ BOOST_AUTO_TEST_CASE(TestCopyColumn) {
     BOOST_CHECK_EQUAL(target, eSimple);
 }
 
+BOOST_AUTO_TEST_CASE(TestEscapeBytes) {
+    // Escapes at every position relative to the 8 byte words scanned.
+    std::string src;
+    for (int i = 0; i < 40; ++i) {
+        src += "abc\tdefghij\0klmnopq\n"[i % 22];
+        src += static_cast<char>(0x80 + i); // High bytes are never escaped.
+    }
+    for (size_t len = 0; len <= src.size(); ++len) {
+        std::string expected(2 * len, 'X');
+        int eCount = ProtoRowBuffer::escapeString(expected.begin(), src.begin(), src.begin() + len);
+        std::string target(2 * len, 'X');
+        int count = ProtoRowBuffer::escapeBytes(&target[0], src.data(), len);
+        BOOST_CHECK_EQUAL(count, eCount);
+        BOOST_CHECK_EQUAL(target.substr(0, count), expected.substr(0, eCount));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFetch) {
+    lsst::qserv::proto::Result result;
+    auto cs = result.mutable_rowschema()->add_columnschema();
+    cs->set_name("a");
+    cs->set_sqltype("VARCHAR(100)");
+    for (int i = 0; i < 5; ++i) {
+        auto row = result.add_row();
+        row->add_column(std::string(i * 20, 'r') + "\t" + std::to_string(i));
+        row->add_isnull(i == 3);
+    }
+    std::string expected;
+    for (int i = 0; i < 5; ++i) {
+        if (i > 0) expected += "\n";
+        expected += "'7'\t";
+        expected += (i == 3) ? "\\N" : "'" + std::string(i * 20, 'r') + "\\t" + std::to_string(i) + "'";
+    }
+    // Rows longer than the buffer are split across fetches.
+    for (unsigned bufLen : {1u, 7u, 64u, 4096u}) {
+        ProtoRowBuffer pRowBuffer(result, 7, "jobId", "INT(9)", 3);
+        std::vector<char> buf(bufLen);
+        std::string fetched;
+        for (unsigned n; (n = pRowBuffer.fetch(&buf[0], bufLen)) > 0;) {
+            BOOST_CHECK(n <= bufLen);
+            fetched.append(&buf[0], n);
+        }
+        BOOST_CHECK_EQUAL(fetched, expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFetchBatch) {
+    using lsst::qserv::proto::ColumnBatch;
+    lsst::qserv::proto::Result result;
+    for (int i = 0; i < 4; ++i) {
+        result.mutable_rowschema()->add_columnschema();
+    }
+    // A protocol 2 row comes first.
+    auto row = result.add_row();
+    for (int i = 0; i < 4; ++i) {
+        row->add_column("x");
+        row->add_isnull(false);
+    }
+    lsst::qserv::proto::RowBatchWriter writer({ColumnBatch::INT64, ColumnBatch::UINT64,
+                                               ColumnBatch::DOUBLE, ColumnBatch::BYTES});
+    writer.start(result.add_batch());
+    char const* row1[] = {"-9223372036854775808", "18446744073709551615", "0.1", "a\tb"};
+    unsigned long len1[] = {20, 20, 3, 3};
+    writer.addRow(row1, len1);
+    char const* row2[] = {nullptr, "0", nullptr, nullptr};
+    unsigned long len2[] = {0, 1, 0, 0};
+    writer.addRow(row2, len2);
+    result.add_batch(); // Empty batches are skipped.
+    writer.start(result.add_batch());
+    char const* row3[] = {"42", "7", "-2.5e-3", ""};
+    unsigned long len3[] = {2, 1, 7, 0};
+    writer.addRow(row3, len3);
+    BOOST_CHECK_EQUAL(lsst::qserv::proto::countRows(result), 4);
+    BOOST_CHECK(lsst::qserv::proto::checkBatches(result));
+
+    std::string expected = "'7'\t'x'\t'x'\t'x'\t'x'\n"
+        "'7'\t-9223372036854775808\t18446744073709551615\t0.10000000000000001\t'a\\tb'\n"
+        "'7'\t\\N\t0\t\\N\t\\N\n"
+        "'7'\t42\t7\t-0.0025000000000000001\t''";
+    for (unsigned bufLen : {1u, 7u, 4096u}) {
+        ProtoRowBuffer pRowBuffer(result, 7, "jobId", "INT(9)", 3);
+        std::vector<char> buf(bufLen);
+        std::string fetched;
+        for (unsigned n; (n = pRowBuffer.fetch(&buf[0], bufLen)) > 0;) {
+            fetched.append(&buf[0], n);
+        }
+        BOOST_CHECK_EQUAL(fetched, expected);
+        BOOST_CHECK_EQUAL(pRowBuffer.getBytesFetched(), expected.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFetchNoJobId) {
+    using lsst::qserv::proto::ColumnBatch;
+    lsst::qserv::proto::Result result;
+    for (int i = 0; i < 2; ++i) {
+        result.mutable_rowschema()->add_columnschema()->set_sqltype("INT");
+    }
+    auto row = result.add_row();
+    for (int i = 0; i < 2; ++i) {
+        row->add_column(std::to_string(i));
+        row->add_isnull(false);
+    }
+    lsst::qserv::proto::RowBatchWriter writer({ColumnBatch::INT64, ColumnBatch::INT64});
+    writer.start(result.add_batch());
+    char const* row1[] = {nullptr, "5"};
+    unsigned long len1[] = {0, 1};
+    writer.addRow(row1, len1);
+
+    // Without a jobId column name, rows are loaded as the worker sent them.
+    ProtoRowBuffer pRowBuffer(result, 7, "", "INT(9)", 3);
+    std::string expected = "'0'\t'1'\n\\N\t5";
+    std::vector<char> buf(4096);
+    std::string fetched;
+    for (unsigned n; (n = pRowBuffer.fetch(&buf[0], buf.size())) > 0;) {
+        fetched.append(&buf[0], n);
+    }
+    BOOST_CHECK_EQUAL(fetched, expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
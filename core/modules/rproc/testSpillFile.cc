@@ -0,0 +1,161 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Class header
+#include "rproc/SpillFile.h"
+
+// Qserv headers
+#include "mysql/RowBuffer.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE SpillFile_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::rproc::SpillFile;
+
+namespace {
+
+/// Hands out a string, a few bytes at a time.
+class StringRowBuffer : public lsst::qserv::mysql::RowBuffer {
+public:
+    explicit StringRowBuffer(std::string const& rows) : _rows(rows) {}
+    unsigned fetch(char* buffer, unsigned bufLen) override {
+        unsigned n = std::min<size_t>({bufLen, 5, _rows.size() - _pos});
+        std::memcpy(buffer, _rows.data() + _pos, n);
+        _pos += n;
+        return n;
+    }
+    bool fetchesPartialRows() const override { return true; }
+    std::string dump() const override { return "StringRowBuffer"; }
+private:
+    std::string _rows;
+    size_t _pos{0};
+};
+
+} // anonymous namespace
+
+struct Fixture {
+    Fixture(void) {
+        char tmpl[] = "/tmp/testSpillFile.XXXXXX";
+        dir = ::mkdtemp(tmpl);
+    }
+    ~Fixture(void) {
+        SpillFile::setTotalQuota(0);
+        ::rmdir(dir.c_str());
+    }
+
+    bool append(SpillFile& spillFile, int jobIdAttempt, std::string const& rows) {
+        StringRowBuffer rowBuffer(rows);
+        return spillFile.append(jobIdAttempt, std::count(rows.begin(), rows.end(), '\n'), rowBuffer);
+    }
+
+    std::string dir;
+};
+
+
+BOOST_FIXTURE_TEST_SUITE(suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(AppendAndRead) {
+    std::string path;
+    {
+        auto spillFile = SpillFile::create(dir, "result_1", 0);
+        BOOST_REQUIRE(spillFile != nullptr);
+        path = spillFile->getPath();
+        BOOST_CHECK(append(*spillFile, 10, "1\ta\n2\t\\N\n"));
+        BOOST_CHECK(append(*spillFile, 20, "3\tbcdefghijk\n"));
+        size_t const expected = 8 + 2*sizeof(SpillFile::SegmentHeader) + 9 + 13;
+        BOOST_CHECK_EQUAL(spillFile->getBytes(), expected);
+        BOOST_CHECK_EQUAL(SpillFile::getTotalBytes(), expected);
+
+        std::vector<int> attempts;
+        std::string rows;
+        BOOST_CHECK(spillFile->forEachSegment([&](SpillFile::SegmentHeader const& header, char const* data) {
+            attempts.push_back(header.jobIdAttempt);
+            rows.append(data, header.length);
+            return true;
+        }));
+        BOOST_CHECK(attempts == std::vector<int>({10, 20}));
+        BOOST_CHECK_EQUAL(rows, "1\ta\n2\t\\N\n3\tbcdefghijk\n");
+        BOOST_CHECK(std::ifstream(path).good());
+    }
+    // The file goes with its SpillFile.
+    BOOST_CHECK(!std::ifstream(path).good());
+    BOOST_CHECK_EQUAL(SpillFile::getTotalBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(PartialBatch) {
+    // Rows gathered for a batch that never fills up are only read once all
+    // segments were passed, by the finish function, while the file is mapped.
+    auto spillFile = SpillFile::create(dir, "result_5", 0);
+    BOOST_REQUIRE(spillFile != nullptr);
+    BOOST_CHECK(append(*spillFile, 10, "1\ta\n"));
+    BOOST_CHECK(append(*spillFile, 11, "2\tb\n"));
+    std::vector<std::pair<char const*, size_t>> batch;
+    std::string rows;
+    int finished = 0;
+    BOOST_CHECK(spillFile->forEachSegment([&](SpillFile::SegmentHeader const& header, char const* data) {
+        batch.emplace_back(data, header.length);
+        return true;
+    }, [&]() {
+        ++finished;
+        for (auto const& span : batch) {
+            rows.append(span.first, span.second);
+        }
+    }));
+    BOOST_CHECK_EQUAL(finished, 1);
+    BOOST_CHECK_EQUAL(rows, "1\ta\n2\tb\n");
+}
+
+BOOST_AUTO_TEST_CASE(Quota) {
+    auto spillFile = SpillFile::create(dir, "result_2", 8 + sizeof(SpillFile::SegmentHeader) + 4);
+    BOOST_REQUIRE(spillFile != nullptr);
+    BOOST_CHECK(append(*spillFile, 1, "1\ta\n"));
+    BOOST_CHECK(!append(*spillFile, 1, "2\tb\n"));
+    BOOST_CHECK(!spillFile->getError().empty());
+
+    auto other = SpillFile::create(dir, "result_3", 0);
+    BOOST_REQUIRE(other != nullptr);
+    SpillFile::setTotalQuota(SpillFile::getTotalBytes() + sizeof(SpillFile::SegmentHeader) + 4);
+    BOOST_CHECK(append(*other, 1, "3\tc\n"));
+    BOOST_CHECK(!append(*other, 1, "4\td\n"));
+}
+
+BOOST_AUTO_TEST_CASE(RemoveAll) {
+    std::string const leftover = dir + "/result_4" + SpillFile::SUFFIX;
+    std::ofstream(leftover) << "QSSPILL1";
+    SpillFile::removeAll(dir);
+    BOOST_CHECK(!std::ifstream(leftover).good());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
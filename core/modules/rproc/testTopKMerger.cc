@@ -0,0 +1,136 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+// System headers
+#include <string>
+#include <vector>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// Class header
+#include "rproc/TopKMerger.h"
+
+// Qserv headers
+#include "rproc/MergerTestFixture.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE TopKMerger_1
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+using lsst::qserv::proto::ColumnBatch;
+using lsst::qserv::proto::Result;
+using lsst::qserv::rproc::TopKMerger;
+
+struct Fixture : lsst::qserv::rproc::MergerTestFixture {
+    Fixture(void) {
+        // Worker result of:
+        // SELECT objectId, psfMag ... ORDER BY psfMag, objectId DESC LIMIT 3
+        addColumn("objectId", MYSQL_TYPE_LONGLONG);
+        addColumn("psfMag", MYSQL_TYPE_DOUBLE);
+        batchKinds = {ColumnBatch::INT64, ColumnBatch::DOUBLE};
+        makeMerger(3);
+    }
+    ~Fixture(void) { }
+
+    void makeMerger(int limit) {
+        std::vector<TopKMerger::SortColumn> sortColumns;
+        sortColumns.emplace_back("psfMag", false);
+        sortColumns.emplace_back("objectId", true);
+        merger = std::make_shared<TopKMerger>(sortColumns, limit);
+    }
+
+    /// @return the sorted rows kept by the merger, columns separated by ','.
+    std::vector<std::string> readRows() {
+        Result result;
+        merger->takeRows(result);
+        BOOST_CHECK_EQUAL(result.rowschema().columnschema_size(), 2);
+        return resultLines(result);
+    }
+
+    TopKMerger::Ptr merger;
+};
+
+
+BOOST_FIXTURE_TEST_SUITE(suite, Fixture)
+
+BOOST_AUTO_TEST_CASE(KeepFirstRows) {
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->add(makeResult({{"1", "20.5"}, {"2", "18"}, {"3", "N"}}, true), 10);
+    merger->add(makeResult({{"4", "19"}, {"5", "22"}}, false), 10);
+    merger->add(makeResult({{"6", "18"}, {"7", "17.25"}}, false), 20);
+    // Attempt 30 does not complete, its rows must not show up.
+    merger->add(makeResult({{"8", "1"}}, true), 30);
+
+    // NULL sorts first, and ties on psfMag go to the larger objectId.
+    std::vector<std::string> expected = {"3,N", "6,18", "7,17.25"};
+    BOOST_CHECK(readRows() == expected);
+    BOOST_CHECK_EQUAL(merger->getRowsSeen(), 8u);
+    BOOST_CHECK_EQUAL(merger->getSizeBytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(AddBatches) {
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->add(makeResult({{"1", "20.5"}, {"2", "18"}}, false), 10);
+    merger->add(makeBatchResult({{"3", "0.1"}, {"4", "25"}, {"5", "19"}}, false), 20);
+    std::vector<std::string> expected = {"2,18", "3,0.10000000000000001", "5,19"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(Scrub) {
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->add(makeResult({{"1", "20"}}, false), 10);
+    merger->add(makeResult({{"2", "10"}}, true), 11);
+    BOOST_CHECK(merger->getSizeBytes() > 0);
+    BOOST_CHECK(merger->scrub({11}));
+    BOOST_CHECK(!merger->scrub({10}));
+    std::vector<std::string> expected = {"1,20"};
+    BOOST_CHECK(readRows() == expected);
+}
+
+BOOST_AUTO_TEST_CASE(LimitZero) {
+    makeMerger(0);
+    BOOST_REQUIRE(merger->setSchema(schemaResult.rowschema()));
+    merger->add(makeResult({{"1", "20"}}, false), 10);
+    BOOST_CHECK(readRows().empty());
+}
+
+BOOST_AUTO_TEST_CASE(BadSchema) {
+    std::vector<TopKMerger::SortColumn> sortColumns;
+    sortColumns.emplace_back("name", false);
+    addColumn("name", MYSQL_TYPE_VAR_STRING);
+    merger = std::make_shared<TopKMerger>(sortColumns, 10);
+    BOOST_CHECK(!merger->setSchema(schemaResult.rowschema()));
+    sortColumns[0].name = "missing";
+    merger = std::make_shared<TopKMerger>(sortColumns, 10);
+    BOOST_CHECK(!merger->setSchema(schemaResult.rowschema()));
+    // DECIMAL values are not compared as doubles.
+    sortColumns[0].name = "amount";
+    addColumn("amount", MYSQL_TYPE_NEWDECIMAL);
+    merger = std::make_shared<TopKMerger>(sortColumns, 10);
+    BOOST_CHECK(!merger->setSchema(schemaResult.rowschema()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
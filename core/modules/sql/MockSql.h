@@ -46,6 +46,8 @@ public:
                           SqlErrorObject&) {
         return false; }
     virtual std::shared_ptr<SqlResultIter> getQueryIter(std::string const& query);
+    virtual std::shared_ptr<SqlResultIter> runQueryIter(std::string const& query) {
+        return getQueryIter(query); }
     virtual bool runQuery(std::string const query, SqlErrorObject&) {
         return false; }
     virtual bool dbExists(std::string const& dbName, SqlErrorObject&) {
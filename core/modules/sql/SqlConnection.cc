@@ -71,6 +71,23 @@ SqlResultIter::SqlResultIter(mysql::MySqlConfig const& sqlConfig,
     ++(*this);
 }
 
+SqlResultIter::SqlResultIter(std::shared_ptr<mysql::MySqlConnection> const& connection,
+                             std::string const& query)
+    : _connection(connection), _columnCount(0) {
+    if (!_connection->connected() || !_connection->queryUnbuffered(query)) {
+        populateErrorObject(*_connection, _errObj);
+        return;
+    }
+    ++(*this);
+}
+
+SqlResultIter::~SqlResultIter() {
+    // Rows not read are discarded, so that the connection can be used again.
+    if (_connection && _connection->getResult()) {
+        _connection->freeResult();
+    }
+}
+
 SqlResultIter&
 SqlResultIter::operator++() {
     MYSQL_RES* result = _connection->getResult();
@@ -231,6 +248,16 @@ SqlConnection::getQueryIter(std::string const& query) {
     return i; // Can't defer to iterator without thread mgmt.
 }
 
+std::shared_ptr<SqlResultIter>
+SqlConnection::runQueryIter(std::string const& query) {
+    SqlErrorObject errObj;
+    if (!connectToDb(errObj)) {
+        // The iterator reports the error of the query on the closed connection.
+        LOGS(_log, LOG_LVL_ERROR, "runQueryIter failed to connect: " << errObj.printErrMsg());
+    }
+    return std::make_shared<SqlResultIter>(_connection, query);
+}
+
 bool
 SqlConnection::dbExists(std::string const& dbName, SqlErrorObject& errObj) {
     if (!connectToDb(errObj)) return false;
@@ -62,7 +62,9 @@ class SqlResultIter {
 public:
     SqlResultIter() : _columnCount(0) {}
     SqlResultIter(mysql::MySqlConfig const& sc, std::string const& query);
-    virtual ~SqlResultIter() {}
+    /// Run query on connection, which is busy until the iterator is destroyed.
+    SqlResultIter(std::shared_ptr<mysql::MySqlConnection> const& connection, std::string const& query);
+    virtual ~SqlResultIter();
     virtual SqlErrorObject& getErrorObject() { return _errObj; }
 
     virtual StringVector const& operator*() const { return _current; }
@@ -92,8 +94,10 @@ public:
     virtual bool runQuery(char const* query, int qSize, SqlErrorObject&);
     virtual bool runQuery(std::string const query, SqlResults&,
                           SqlErrorObject&);
-    /// with runQueryIter SqlConnection is busy until SqlResultIter is closed
+    /// getQueryIter runs the query on a connection of its own
     virtual std::shared_ptr<SqlResultIter> getQueryIter(std::string const& query);
+    /// with runQueryIter SqlConnection is busy until SqlResultIter is closed
+    virtual std::shared_ptr<SqlResultIter> runQueryIter(std::string const& query);
     virtual bool runQuery(std::string const query, SqlErrorObject&);
     virtual bool dbExists(std::string const& dbName, SqlErrorObject&);
     virtual bool createDb(std::string const& dbName, SqlErrorObject&,
@@ -0,0 +1,101 @@
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+/// Compare the throughput of the checksums available for result messages.
+
+// System headers
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+// Qserv headers
+#include "util/CmdLineParser.h"
+#include "util/StringHash.h"
+#include "util/Timer.h"
+
+namespace util = lsst::qserv::util;
+
+namespace {
+
+// Command line parameters
+
+unsigned int messageSizeMB;
+unsigned int numMessages;
+
+
+void measure(std::string const& name, std::string const& data,
+             std::function<std::string(char const*, int)> const& digest) {
+    std::string result;
+    util::Timer t;
+    t.start();
+    for (unsigned int i = 0; i < numMessages; ++i) {
+        result = digest(data.data(), data.size());
+    }
+    t.stop();
+    double const totalMB = static_cast<double>(data.size()) * numMessages / (1024*1024);
+    std::cout << std::setw(8) << name << ": " << std::fixed << std::setprecision(3)
+              << t.getElapsed() << " s " << std::setprecision(1)
+              << totalMB / t.getElapsed() << " MB/s" << std::endl;
+}
+
+
+int test() {
+    std::string data(messageSizeMB * 1024 * 1024, '\0');
+    std::uint32_t x = 1;
+    for (auto& c : data) {
+        x = x * 1103515245 + 12345;
+        c = static_cast<char>(x >> 16);
+    }
+    std::cout << numMessages << " messages of " << messageSizeMB << " MB" << std::endl;
+    measure("MD5", data, util::StringHash::getMd5);
+    measure("CRC32C", data, util::StringHash::getCrc32c);
+    return 0;
+}
+
+} // namespace
+
+
+int main(int argc, const char* const argv[]) {
+    try {
+        util::CmdLineParser parser(
+            argc,
+            argv,
+            "\n"
+            "Usage:\n"
+            "  [--size=<MB>]\n"
+            "  [--messages=<value>]\n"
+            "\n"
+            "Flags an options:\n"
+            "  --size=<MB>        - size of each message (default: 64)\n"
+            "  --messages=<value> - the number of messages to checksum (default: 16)\n");
+
+        ::messageSizeMB = parser.option<unsigned int>("size", 64);
+        ::numMessages   = parser.option<unsigned int>("messages", 16);
+
+    } catch (std::exception const& ex) {
+        return 1;
+    }
+    return ::test();
+}
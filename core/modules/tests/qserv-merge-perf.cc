@@ -0,0 +1,605 @@
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsstcorp.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+
+/// Measure the throughput of the czar merge path on synthetic worker results.
+///
+/// Result messages are generated the way a worker would send them, and each
+/// stage of their processing by the czar is timed on its own: checksum,
+/// decompression, decoding, and conversion to LOAD DATA rows. When a MySQL
+/// socket is given, the messages are then pushed through MergingHandler into
+/// an InfileMerger, which loads them into a result table, and the merge
+/// and finalize times are reported as well.
+
+// System headers
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Third-party headers
+#include <mysql/mysql.h>
+
+// Qserv headers
+#include "ccontrol/MergeScheduler.h"
+#include "ccontrol/MergingHandler.h"
+#include "global/ResourceUnit.h"
+#include "mysql/MySqlConfig.h"
+#include "proto/ProtoHeaderWrap.h"
+#include "proto/ProtoImporter.h"
+#include "proto/ResultCompressor.h"
+#include "proto/RowBatch.h"
+#include "proto/worker.pb.h"
+#include "qdisp/Executive.h"
+#include "qdisp/JobDescription.h"
+#include "qdisp/JobQuery.h"
+#include "qdisp/JobStatus.h"
+#include "qdisp/MessageStore.h"
+#include "qdisp/QdispPool.h"
+#include "qproc/ChunkQuerySpec.h"
+#include "qproc/TaskMsgFactory.h"
+#include "rproc/InfileMerger.h"
+#include "rproc/ProtoRowBuffer.h"
+#include "sql/SqlConnection.h"
+#include "sql/SqlErrorObject.h"
+#include "util/CmdLineParser.h"
+#include "util/StringHash.h"
+#include "util/Timer.h"
+
+namespace ccontrol = lsst::qserv::ccontrol;
+namespace mysql = lsst::qserv::mysql;
+namespace proto = lsst::qserv::proto;
+namespace qdisp = lsst::qserv::qdisp;
+namespace qproc = lsst::qserv::qproc;
+namespace rproc = lsst::qserv::rproc;
+namespace sql = lsst::qserv::sql;
+namespace util = lsst::qserv::util;
+
+using lsst::qserv::QueryId;
+using lsst::qserv::ResourceUnit;
+
+namespace {
+
+// Command line parameters
+
+std::string columns;
+unsigned int numJobs;
+unsigned int messagesPerJob;
+unsigned int rowsPerMessage;
+unsigned int nullPercent;
+unsigned int stringSize;
+unsigned int protocol;
+std::string checksum;
+int compressionLevel;
+unsigned int numThreads;
+bool stageJobAttempts;
+std::string mysqlSocket;
+std::string mysqlUser;
+std::string mysqlPassword;
+std::string mysqlDb;
+std::string resultTable;
+
+QueryId const QUERY_ID = 1;
+
+/// Rows of protocol 3 messages are split into batches of about this size,
+/// as the worker does.
+size_t const BATCH_SIZE = 256*1024;
+
+
+/// A column of the synthetic result.
+struct Column {
+    proto::ColumnBatch::Kind kind;
+    std::string sqlType;
+    int mysqlType;
+};
+
+
+/// A message as a worker sends it, its wrapped ProtoHeader followed by the
+/// Result message.
+struct Message {
+    std::string header;
+    std::string body;
+    std::uint64_t rawSize = 0; ///< Size of the Result message before compression.
+    int rows = 0;
+};
+
+
+/// Time spent in a stage of the merge path.
+struct Stage {
+    explicit Stage(std::string const& name_) : name(name_) {}
+    std::string name;
+    double seconds = 0;
+};
+
+
+std::vector<Column> parseColumns(std::string const& spec) {
+    std::vector<Column> result;
+    std::istringstream is(spec);
+    std::string kind;
+    while (std::getline(is, kind, ',')) {
+        if (kind == "int") {
+            result.push_back({proto::ColumnBatch::INT64, "BIGINT", MYSQL_TYPE_LONGLONG});
+        } else if (kind == "uint") {
+            result.push_back({proto::ColumnBatch::UINT64, "BIGINT UNSIGNED", MYSQL_TYPE_LONGLONG});
+        } else if (kind == "double") {
+            result.push_back({proto::ColumnBatch::DOUBLE, "DOUBLE", MYSQL_TYPE_DOUBLE});
+        } else if (kind == "string") {
+            result.push_back({proto::ColumnBatch::BYTES, "VARCHAR(" + std::to_string(stringSize) + ")",
+                              MYSQL_TYPE_VAR_STRING});
+        } else {
+            throw std::invalid_argument("unknown column kind: " + kind);
+        }
+    }
+    if (result.empty()) {
+        throw std::invalid_argument("no columns");
+    }
+    return result;
+}
+
+
+/// Pseudo-random numbers, the same on every run.
+class Random {
+public:
+    std::uint32_t next() {
+        _x = _x * 1103515245 + 12345;
+        return _x >> 16;
+    }
+    bool isNull() { return next() % 100 < nullPercent; }
+private:
+    std::uint32_t _x{1};
+};
+
+
+/// @return the mysql text of a value of col.
+std::string makeValue(Column const& col, Random& random) {
+    switch (col.kind) {
+    case proto::ColumnBatch::INT64:
+        return std::to_string(static_cast<std::int64_t>(random.next()) - 32768);
+    case proto::ColumnBatch::UINT64:
+        return std::to_string((static_cast<std::uint64_t>(random.next()) << 16) | random.next());
+    case proto::ColumnBatch::DOUBLE: {
+        std::ostringstream os;
+        os << std::setprecision(17) << random.next() / 1024.0;
+        return os.str();
+    }
+    default: {
+        std::string value(stringSize, ' ');
+        for (auto& c : value) {
+            c = "abcdefghijklmnopqrstuvwxyz\t\n\\'"[random.next() % 30];
+        }
+        return value;
+    }
+    }
+}
+
+
+/// Fill result with rowsPerMessage rows of the given columns.
+void makeRows(std::vector<Column> const& cols, Random& random, proto::Result& result) {
+    auto schema = result.mutable_rowschema();
+    for (size_t i = 0; i < cols.size(); ++i) {
+        auto cs = schema->add_columnschema();
+        cs->set_name("c" + std::to_string(i));
+        cs->set_deprecated_hasdefault(false);
+        cs->set_sqltype(cols[i].sqlType);
+        cs->set_mysqltype(cols[i].mysqlType);
+    }
+    std::vector<std::string> values(cols.size());
+    std::vector<bool> nulls(cols.size());
+    std::vector<proto::ColumnBatch::Kind> kinds;
+    for (auto const& col : cols) {
+        kinds.push_back(col.kind);
+    }
+    proto::RowBatchWriter writer(kinds);
+    std::vector<char const*> ptrs(cols.size());
+    std::vector<unsigned long> lengths(cols.size());
+    for (unsigned int r = 0; r < rowsPerMessage; ++r) {
+        for (size_t i = 0; i < cols.size(); ++i) {
+            nulls[i] = random.isNull();
+            values[i] = nulls[i] ? std::string() : makeValue(cols[i], random);
+        }
+        if (protocol >= 3) {
+            for (size_t i = 0; i < cols.size(); ++i) {
+                ptrs[i] = nulls[i] ? nullptr : values[i].c_str();
+                lengths[i] = values[i].size();
+            }
+            if (!writer.isStarted() || writer.getBatchBytes() >= BATCH_SIZE) {
+                writer.start(result.add_batch());
+            }
+            writer.addRow(ptrs.data(), lengths.data());
+        } else {
+            auto rb = result.add_row();
+            for (size_t i = 0; i < cols.size(); ++i) {
+                rb->add_column(values[i]);
+                rb->add_isnull(nulls[i]);
+            }
+        }
+    }
+}
+
+
+/// @return the messages of a job, as QueryRunner would transmit them.
+/// Messages are compressed by compressor, unless it is nullptr.
+std::vector<Message> makeJob(std::vector<Column> const& cols, int jobId, Random& random,
+                             proto::ResultCompressor* compressor) {
+    std::vector<Message> messages;
+    for (unsigned int m = 0; m < messagesPerJob; ++m) {
+        proto::Result result;
+        makeRows(cols, random, result);
+        bool last = (m + 1 == messagesPerJob);
+        result.set_queryid(QUERY_ID);
+        result.set_jobid(jobId);
+        result.set_continues(!last);
+        result.set_largeresult(m > 0);
+        result.set_rowcount(rowsPerMessage);
+        result.set_transmitsize(0);
+        result.set_attemptcount(0);
+
+        Message msg;
+        msg.rows = rowsPerMessage;
+        result.SerializeToString(&msg.body);
+        msg.rawSize = msg.body.size();
+        std::string compressed;
+        if (compressor != nullptr && compressor->compress(msg.body, compressionLevel, compressed)) {
+            msg.body.swap(compressed);
+        }
+
+        proto::ProtoHeader header;
+        header.set_protocol(protocol);
+        header.set_size(msg.body.size());
+        if (msg.rawSize != msg.body.size()) {
+            header.set_compression(proto::COMPRESSION_ZSTD);
+            header.set_rawsize(msg.rawSize);
+        }
+        if (checksum == "crc32c") {
+            header.set_checksumtype(proto::CHECKSUM_CRC32C);
+            header.set_checksum(util::StringHash::getCrc32c(msg.body.data(), msg.body.size()));
+        } else {
+            header.set_md5(util::StringHash::getMd5(msg.body.data(), msg.body.size()));
+        }
+        header.set_wname("qserv-merge-perf");
+        header.set_largeresult(m > 0);
+        std::string headerString;
+        header.SerializeToString(&headerString);
+        msg.header = proto::ProtoHeaderWrap::wrap(headerString);
+        messages.push_back(std::move(msg));
+    }
+    return messages;
+}
+
+
+/// A TaskMsgFactory for jobs that are never sent to a worker.
+class BenchTaskMsgFactory : public qproc::TaskMsgFactory {
+public:
+    BenchTaskMsgFactory() : TaskMsgFactory(0) {}
+    void serializeMsg(qproc::ChunkQuerySpec const& s, std::string const& chunkResultName,
+                      uint64_t queryId, int jobId, int attemptCount, std::ostream& os) override {}
+};
+
+
+/// Time the stages of the merge path that do not need a database, one
+/// message at a time.
+void measureStages(std::vector<std::vector<Message>> const& jobs, std::vector<Stage>& stages) {
+    Stage checksumStage(checksum == "crc32c" ? "CRC32C" : "MD5");
+    Stage decompress("decompress");
+    Stage decode("decode");
+    Stage convert("row conversion");
+    std::unique_ptr<proto::ResultDecompressor> decompressor;
+    if (compressionLevel > 0) {
+        decompressor.reset(new proto::ResultDecompressor());
+    }
+    std::vector<char> buffer(1024*1024);
+    util::Timer t;
+    for (auto const& job : jobs) {
+        for (auto const& msg : job) {
+            t.start();
+            std::string digest = (checksum == "crc32c")
+                ? util::StringHash::getCrc32c(msg.body.data(), msg.body.size())
+                : util::StringHash::getMd5(msg.body.data(), msg.body.size());
+            t.stop();
+            checksumStage.seconds += t.getElapsed();
+
+            std::string raw;
+            char const* data = msg.body.data();
+            size_t size = msg.body.size();
+            if (msg.rawSize != msg.body.size()) {
+                t.start();
+                if (!decompressor->decompress(data, size, msg.rawSize, raw)) {
+                    throw std::runtime_error("decompression failed");
+                }
+                t.stop();
+                decompress.seconds += t.getElapsed();
+                data = raw.data();
+                size = raw.size();
+            }
+
+            proto::Result result;
+            t.start();
+            if (!proto::ProtoImporter<proto::Result>::setMsgFrom(result, data, size)) {
+                throw std::runtime_error("decoding failed");
+            }
+            t.stop();
+            decode.seconds += t.getElapsed();
+
+            // Rows are converted without the jobId column, as when they are
+            // loaded straight into the result table.
+            t.start();
+            rproc::ProtoRowBuffer rowBuffer(result, result.jobid(), "", "", 0);
+            while (rowBuffer.fetch(buffer.data(), buffer.size()) > 0) {}
+            t.stop();
+            convert.seconds += t.getElapsed();
+        }
+    }
+    stages.push_back(checksumStage);
+    if (compressionLevel > 0) {
+        stages.push_back(decompress);
+    }
+    stages.push_back(decode);
+    stages.push_back(convert);
+}
+
+
+/// Push the messages of job through handler, in the buffers it asks for.
+void feed(ccontrol::MergingHandler& handler, std::vector<Message> const& job) {
+    std::string stream;
+    for (auto const& msg : job) {
+        stream += msg.header;
+        stream += msg.body;
+    }
+    size_t pos = 0;
+    bool last = false;
+    while (!last) {
+        size_t size = handler.nextBufferSize();
+        if (pos + size > stream.size()) {
+            throw std::runtime_error("MergingHandler asked for more bytes than were sent");
+        }
+        auto& buffer = handler.nextBuffer();
+        std::copy(stream.data() + pos, stream.data() + pos + size, buffer.begin());
+        pos += size;
+        bool largeResult = false;
+        if (!handler.flush(size, last, largeResult)) {
+            throw std::runtime_error("merge failed: " + handler.getError().getMsg());
+        }
+    }
+}
+
+
+/// Drop the result table, a view of the merge table when it is kept.
+void dropResult(sql::SqlConnection& sqlConn) {
+    sql::SqlErrorObject errObj;
+    sqlConn.runQuery("DROP VIEW IF EXISTS " + resultTable, errObj);
+    sqlConn.dropTable(resultTable, errObj, false);
+    sqlConn.dropTable(rproc::InfileMerger::getMergeTableName(resultTable), errObj, false);
+}
+
+
+/// Merge all jobs into a result table through MergingHandler and InfileMerger.
+void measureMerge(std::vector<std::vector<Message>> const& jobs, std::vector<Stage>& stages) {
+    mysql::MySqlConfig mySqlConfig(mysqlUser, mysqlPassword, mysqlSocket, mysqlDb);
+    sql::SqlConnection sqlConn(mySqlConfig);
+    dropResult(sqlConn);
+
+    rproc::InfileMergerConfig config(mySqlConfig);
+    config.targetTable = resultTable;
+    config.maxMergeConnections = numThreads;
+    config.stageJobAttempts = stageJobAttempts;
+    auto merger = std::make_shared<rproc::InfileMerger>(config);
+
+    auto executive = qdisp::Executive::create(std::make_shared<qdisp::Executive::Config>(0, 0),
+                                              std::make_shared<qdisp::MessageStore>(),
+                                              std::make_shared<qdisp::QdispPool>());
+    executive->setQueryId(QUERY_ID);
+    ccontrol::MergeScheduler::get().addQuery(QUERY_ID);
+    auto taskMsgFactory = std::make_shared<BenchTaskMsgFactory>();
+    auto chunkQuerySpec = std::make_shared<qproc::ChunkQuerySpec>();
+
+    std::atomic<size_t> nextJob{0};
+    std::atomic<bool> failed{false};
+    auto mergeJobs = [&]() {
+        for (size_t j = nextJob++; j < jobs.size() && !failed; j = nextJob++) {
+            auto handler = std::make_shared<ccontrol::MergingHandler>(nullptr, merger, resultTable);
+            ResourceUnit ru;
+            ru.setAsDbChunk("Bench", static_cast<int>(j));
+            auto desc = qdisp::JobDescription::create(QUERY_ID, static_cast<int>(j), ru, handler,
+                                                      taskMsgFactory, chunkQuerySpec, "bench", true);
+            desc->incrAttemptCountScrubResults(); // attempt 0
+            auto jobQuery = qdisp::JobQuery::create(executive, desc,
+                                                    std::make_shared<qdisp::JobStatus>(), nullptr,
+                                                    QUERY_ID);
+            try {
+                feed(*handler, jobs[j]);
+            } catch (std::exception const& ex) {
+                std::cerr << "job " << j << ": " << ex.what() << std::endl;
+                failed = true;
+            }
+        }
+    };
+
+    util::Timer t;
+    t.start();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < numThreads; ++i) {
+        threads.emplace_back(mergeJobs);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    t.stop();
+    if (failed) {
+        throw std::runtime_error("merge failed");
+    }
+    Stage merge("handler total");
+    merge.seconds = t.getElapsed();
+
+    // InfileMerger::merge() converts the rows and loads them.
+    auto schedStats = ccontrol::MergeScheduler::get().removeQuery(QUERY_ID);
+    Stage load("LOAD DATA");
+    load.seconds = schedStats.mergeMicros / 1.0e6;
+    for (auto const& stage : stages) {
+        if (stage.name == "row conversion") {
+            load.seconds = std::max(0.0, load.seconds - stage.seconds);
+        }
+    }
+
+    Stage finalize("finalize");
+    t.start();
+    if (!merger->finalize()) {
+        throw std::runtime_error("finalize failed: " + merger->getError().getMsg());
+    }
+    t.stop();
+    finalize.seconds = t.getElapsed();
+
+    stages.push_back(load);
+    stages.push_back(finalize);
+    stages.push_back(merge);
+    dropResult(sqlConn);
+}
+
+
+void report(Stage const& stage, double rows, double bytes) {
+    double const seconds = std::max(stage.seconds, 1.0e-9);
+    std::cout << std::setw(16) << stage.name << ": " << std::fixed << std::setprecision(3)
+              << stage.seconds << " s " << std::setprecision(0) << std::setw(12)
+              << rows / seconds << " rows/s " << std::setprecision(1) << std::setw(10)
+              << bytes / seconds / (1024*1024) << " MB/s" << std::endl;
+}
+
+
+int test() {
+    auto cols = parseColumns(columns);
+    std::vector<std::vector<Message>> jobs;
+    Random random;
+    std::unique_ptr<proto::ResultCompressor> compressor;
+    if (compressionLevel > 0) {
+        compressor.reset(new proto::ResultCompressor());
+    }
+    double rows = 0;
+    double bytes = 0;
+    double rawBytes = 0;
+    for (unsigned int j = 0; j < numJobs; ++j) {
+        jobs.push_back(makeJob(cols, j, random, compressor.get()));
+        for (auto const& msg : jobs.back()) {
+            rows += msg.rows;
+            bytes += msg.body.size();
+            rawBytes += msg.rawSize;
+        }
+    }
+    std::cout << numJobs << " jobs of " << messagesPerJob << " messages of " << rowsPerMessage
+              << " rows, " << cols.size() << " columns, protocol " << protocol << ", "
+              << std::setprecision(1) << std::fixed << bytes / (1024*1024) << " MB sent, "
+              << rawBytes / (1024*1024) << " MB decompressed" << std::endl;
+
+    std::vector<Stage> stages;
+    measureStages(jobs, stages);
+    if (!mysqlSocket.empty()) {
+        measureMerge(jobs, stages);
+    }
+    for (auto const& stage : stages) {
+        report(stage, rows, stage.name == "decode" || stage.name == "row conversion" ? rawBytes : bytes);
+    }
+    return 0;
+}
+
+} // namespace
+
+
+int main(int argc, const char* const argv[]) {
+    try {
+        util::CmdLineParser parser(
+            argc,
+            argv,
+            "\n"
+            "Usage:\n"
+            "  [--columns=<kinds>]\n"
+            "  [--jobs=<value>]\n"
+            "  [--messages=<value>]\n"
+            "  [--rows=<value>]\n"
+            "  [--null-percent=<value>]\n"
+            "  [--string-size=<bytes>]\n"
+            "  [--protocol=<value>]\n"
+            "  [--checksum=<name>]\n"
+            "  [--compression=<level>]\n"
+            "  [--threads=<value>]\n"
+            "  [--no-staging]\n"
+            "  [--socket=<path>]\n"
+            "  [--user=<name>]\n"
+            "  [--password=<value>]\n"
+            "  [--db=<name>]\n"
+            "  [--table=<name>]\n"
+            "\n"
+            "Flags and options:\n"
+            "  --columns=<kinds>      - comma separated kinds of the result columns: int, uint,\n"
+            "                           double or string (default: int,double,double,string)\n"
+            "  --jobs=<value>         - the number of jobs (default: 16)\n"
+            "  --messages=<value>     - the number of messages of each job (default: 4)\n"
+            "  --rows=<value>         - the number of rows of each message (default: 20000)\n"
+            "  --null-percent=<value> - the percentage of NULL values (default: 10)\n"
+            "  --string-size=<bytes>  - the size of string values (default: 16)\n"
+            "  --protocol=<value>     - result protocol, 2 or 3 (default: 3)\n"
+            "  --checksum=<name>      - md5 or crc32c (default: crc32c)\n"
+            "  --compression=<level>  - zstd level of the messages, 0 for none (default: 0)\n"
+            "  --threads=<value>      - the number of jobs merged at once (default: 1)\n"
+            "  --no-staging           - load the rows of each job as they arrive, instead of\n"
+            "                           staging them and copying them into the result table\n"
+            "  --socket=<path>        - MySQL socket of the result database, results are\n"
+            "                           only loaded into a table when it is set\n"
+            "  --user=<name>          - MySQL user (default: qsmaster)\n"
+            "  --password=<value>     - MySQL password (default: none)\n"
+            "  --db=<name>            - result database (default: qservResult)\n"
+            "  --table=<name>         - result table, dropped when done (default: merge_perf)\n");
+
+        ::columns          = parser.option<std::string>("columns", "int,double,double,string");
+        ::numJobs          = parser.option<unsigned int>("jobs", 16);
+        ::messagesPerJob   = parser.option<unsigned int>("messages", 4);
+        ::rowsPerMessage   = parser.option<unsigned int>("rows", 20000);
+        ::nullPercent      = parser.option<unsigned int>("null-percent", 10);
+        ::stringSize       = parser.option<unsigned int>("string-size", 16);
+        ::protocol         = parser.option<unsigned int>("protocol", 3);
+        ::checksum         = parser.option<std::string>("checksum", "crc32c");
+        ::compressionLevel = parser.option<int>("compression", 0);
+        ::numThreads       = std::max(1u, parser.option<unsigned int>("threads", 1));
+        ::stageJobAttempts = !parser.flag("no-staging");
+        ::mysqlSocket      = parser.option<std::string>("socket", "");
+        ::mysqlUser        = parser.option<std::string>("user", "qsmaster");
+        ::mysqlPassword    = parser.option<std::string>("password", "");
+        ::mysqlDb          = parser.option<std::string>("db", "qservResult");
+        ::resultTable      = parser.option<std::string>("table", "merge_perf");
+
+    } catch (std::exception const& ex) {
+        return 1;
+    }
+    if (::compressionLevel > 0 && !proto::ResultCompressor::isSupported()) {
+        std::cerr << "qserv-merge-perf: --compression needs a build with zstd" << std::endl;
+        return 1;
+    }
+    try {
+        return ::test();
+    } catch (std::exception const& ex) {
+        std::cerr << "qserv-merge-perf: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -26,6 +26,8 @@
 #include "util/StringHash.h"
 
 // System headers
+#include <array>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
@@ -37,6 +39,14 @@
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 #endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#include <nmmintrin.h>
+#define QSERV_CRC32C_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define QSERV_CRC32C_ARM 1
+#endif
 
 namespace {
 
@@ -84,6 +94,88 @@ inline std::string wrapHashHex(void const* buffer, int bufferSize) {
     return s.str();
 }
 
+/// Tables for the slicing-by-8 software CRC32C, reflected polynomial 0x82F63B78.
+struct Crc32cTables {
+    Crc32cTables() {
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+            }
+            t[0][i] = crc;
+        }
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                t[k][i] = (t[k-1][i] >> 8) ^ t[0][t[k-1][i] & 0xff];
+            }
+        }
+    }
+    std::array<std::array<std::uint32_t, 256>, 8> t;
+};
+
+std::uint32_t crc32cSoftware(std::uint32_t crc, unsigned char const* p, size_t n) {
+    static Crc32cTables const tables;
+    auto const& t = tables.t;
+    for (; n >= 8; n -= 8, p += 8) {
+        std::uint32_t lo;
+        std::uint32_t hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; n > 0; --n, ++p) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+    }
+    return crc;
+}
+
+#if QSERV_CRC32C_SSE42
+
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cHardware(std::uint32_t crc, unsigned char const* p, size_t n) {
+    std::uint64_t crc64 = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+    for (; n > 0; --n, ++p) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+
+bool hasCrc32cHardware() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    return (ecx & bit_SSE4_2) != 0;
+}
+
+#elif QSERV_CRC32C_ARM
+
+std::uint32_t crc32cHardware(std::uint32_t crc, unsigned char const* p, size_t n) {
+    for (; n >= 8; n -= 8, p += 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+    }
+    for (; n > 0; --n, ++p) {
+        crc = __crc32cb(crc, *p);
+    }
+    return crc;
+}
+
+bool hasCrc32cHardware() { return true; }
+
+#endif
+
 } // anonymous namespace
 
 namespace lsst {
@@ -125,4 +217,52 @@ std::string StringHash::getSha256(char const* buffer, int bufferSize) {
     return wrapHash<SHA256, SHA256_DIGEST_LENGTH>(buffer, bufferSize);
 }
 
+/// @return the CRC32C checksum of the input buffer
+/// 32 bits -> 4 bytes, most significant first
+std::string StringHash::getCrc32c(char const* buffer, int bufferSize) {
+    Crc32cStream crc;
+    crc.update(buffer, bufferSize);
+    return crc.digest();
+}
+
+std::uint32_t StringHash::crc32c(std::uint32_t crc, char const* buffer, size_t bufferSize) {
+    auto p = reinterpret_cast<unsigned char const*>(buffer);
+    crc = ~crc;
+#if QSERV_CRC32C_SSE42 || QSERV_CRC32C_ARM
+    static bool const hardware = hasCrc32cHardware();
+    if (hardware) {
+        return ~crc32cHardware(crc, p, bufferSize);
+    }
+#endif
+    return ~crc32cSoftware(crc, p, bufferSize);
+}
+
+std::string Crc32cStream::digest() const {
+    char digest[4] = { static_cast<char>(_crc >> 24), static_cast<char>(_crc >> 16),
+                       static_cast<char>(_crc >> 8), static_cast<char>(_crc) };
+    return std::string(digest, sizeof(digest));
+}
+
+struct Md5Stream::Context {
+    MD5_CTX ctx;
+};
+
+Md5Stream::Md5Stream() : _ctx(new Context()) {
+    MD5_Init(&_ctx->ctx);
+}
+
+Md5Stream::~Md5Stream() {}
+
+void Md5Stream::update(char const* buffer, size_t bufferSize) {
+    MD5_Update(&_ctx->ctx, buffer, bufferSize);
+}
+
+/// @return the raw MD5 hash of the data passed to update()
+/// 128 bits -> 16 bytes
+std::string Md5Stream::digest() {
+    unsigned char digest[MD5_DIGEST_LENGTH];
+    MD5_Final(digest, &_ctx->ctx);
+    return std::string(reinterpret_cast<char*>(digest), MD5_DIGEST_LENGTH);
+}
+
 }}} // namespace lsst::qserv::util
@@ -25,6 +25,9 @@
 #define LSST_QSERV_UTIL_STRINGHASH_H
 
 // System headers
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 
 namespace lsst {
@@ -40,6 +43,54 @@ public:
     static std::string getMd5(char const* buffer, int bufferSize);
     static std::string getSha1(char const* buffer, int bufferSize);
     static std::string getSha256(char const* buffer, int bufferSize);
+
+    /// @return the CRC32C (Castagnoli) checksum of the input buffer, as 4
+    ///         bytes in network byte order.
+    static std::string getCrc32c(char const* buffer, int bufferSize);
+
+    /// Extend the CRC32C checksum crc of some data with the input buffer.
+    /// Starting from crc=0, this gives the value encoded by getCrc32c.
+    /// Uses the SSE4.2 or ARMv8 CRC32 instructions when available.
+    static std::uint32_t crc32c(std::uint32_t crc, char const* buffer, size_t bufferSize);
+};
+
+/// Md5Stream computes the MD5 hash of data that is only available in pieces.
+/// The digest is the same as StringHash::getMd5 over the concatenated pieces.
+class Md5Stream {
+public:
+    Md5Stream();
+    Md5Stream(Md5Stream const&) = delete;
+    Md5Stream& operator=(Md5Stream const&) = delete;
+    ~Md5Stream();
+
+    void update(char const* buffer, size_t bufferSize);
+
+    /// @return the raw MD5 hash of everything passed to update(). No more
+    ///         calls to update() are allowed after this.
+    std::string digest();
+
+private:
+    struct Context;
+    std::unique_ptr<Context> _ctx;
+};
+
+/// Crc32cStream computes the CRC32C checksum of data that is only available
+/// in pieces. The digest is the same as StringHash::getCrc32c over the
+/// concatenated pieces.
+class Crc32cStream {
+public:
+    Crc32cStream() {}
+
+    void update(char const* buffer, size_t bufferSize) {
+        _crc = StringHash::crc32c(_crc, buffer, bufferSize);
+    }
+
+    /// @return the checksum of everything passed to update(), in the
+    ///         format of StringHash::getCrc32c.
+    std::string digest() const;
+
+private:
+    std::uint32_t _crc{0};
 };
 
 }}} // namespace lsst::qserv::util
@@ -0,0 +1,112 @@
+// -*- LSST-C++ -*-
+/*
+ * LSST Data Management System
+ * Copyright 2018 LSST Corporation.
+ *
+ * This product includes software developed by the
+ * LSST Project (http://www.lsst.org/).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the LSST License Statement and
+ * the GNU General Public License along with this program.  If not,
+ * see <http://www.lsstcorp.org/LegalNotices/>.
+ */
+/**
+ * @file
+ *
+ * @ingroup util
+ *
+ * @brief test StringHash digests
+ */
+
+// System headers
+#include <cstdint>
+#include <string>
+
+// Qserv headers
+#include "util/StringHash.h"
+
+// Boost unit test header
+#define BOOST_TEST_MODULE StringHash
+#include "boost/test/included/unit_test.hpp"
+
+namespace test = boost::test_tools;
+
+namespace util = lsst::qserv::util;
+
+namespace {
+
+/// Bit at a time CRC32C, to check the fast versions against.
+std::uint32_t referenceCrc32c(std::string const& s) {
+    std::uint32_t crc = ~0u;
+    for (unsigned char c : s) {
+        crc ^= c;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+        }
+    }
+    return ~crc;
+}
+
+std::string makeData(size_t size) {
+    std::string data(size, '\0');
+    std::uint32_t x = 12345;
+    for (auto& c : data) {
+        x = x * 1103515245 + 12345;
+        c = static_cast<char>(x >> 16);
+    }
+    return data;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(Suite)
+
+BOOST_AUTO_TEST_CASE(Crc32c) {
+    std::string const check("123456789");
+    BOOST_CHECK_EQUAL(util::StringHash::crc32c(0, check.data(), check.size()), 0xE3069283u);
+    BOOST_CHECK_EQUAL(util::StringHash::getCrc32c(check.data(), check.size()),
+                      std::string("\xE3\x06\x92\x83"));
+    BOOST_CHECK_EQUAL(util::StringHash::crc32c(0, nullptr, 0), 0u);
+
+    // All lengths and alignments around the 8 byte steps.
+    std::string const data = makeData(100);
+    for (size_t start = 0; start < 8; ++start) {
+        for (size_t len = 0; start + len <= data.size(); ++len) {
+            BOOST_REQUIRE_EQUAL(util::StringHash::crc32c(0, data.data() + start, len),
+                                referenceCrc32c(data.substr(start, len)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Crc32cIncremental) {
+    std::string const data = makeData(10000);
+    std::uint32_t const whole = util::StringHash::crc32c(0, data.data(), data.size());
+    for (size_t split : {1, 7, 64, 4099}) {
+        std::uint32_t crc = 0;
+        for (size_t pos = 0; pos < data.size(); pos += split) {
+            crc = util::StringHash::crc32c(crc, data.data() + pos, std::min(split, data.size() - pos));
+        }
+        BOOST_CHECK_EQUAL(crc, whole);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Md5Stream) {
+    std::string const data = makeData(10000);
+    util::Md5Stream md5;
+    for (size_t pos = 0; pos < data.size(); pos += 999) {
+        md5.update(data.data() + pos, std::min<size_t>(999, data.size() - pos));
+    }
+    BOOST_CHECK(md5.digest() == util::StringHash::getMd5(data.data(), data.size()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
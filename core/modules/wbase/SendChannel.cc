@@ -162,6 +162,10 @@ bool SendChannel::sendFile(int fd, Size fSize) {
 
 
 bool SendChannel::sendStream(xrdsvc::StreamBuffer::Ptr const& sBuf, bool last) {
+    // Only the last message of the last task sharing the channel ends the stream.
+    if (last && --_taskCount > 0) {
+        last = false;
+    }
     return _ssiRequest->replyStream(sBuf, last);
 }
 
@@ -27,6 +27,7 @@
 // System headers
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <stdexcept>
 
@@ -81,6 +82,21 @@ public:
         _release();
     }
 
+    /// Set the number of tasks sending their results on this channel with
+    /// sendStream, each ending them with last=true. The stream only ends with
+    /// the last message of the last of them.
+    void setTaskCount(int taskCount) {
+        _taskCount = taskCount;
+        _streamShared = taskCount > 1;
+    }
+
+    /// @return true if tasks share this channel, see setTaskCount().
+    bool isStreamShared() const { return _streamShared; }
+
+    /// @return the mutex to hold while sending the header and the body of a
+    /// message, so those of tasks sharing this channel do not interleave.
+    std::mutex& getStreamMutex() { return _streamMutex; }
+
     /// Construct a new NopChannel that ignores everything it is asked to send
     static SendChannel::Ptr newNopChannel();
 
@@ -93,6 +109,9 @@ protected:
 
 private:
     std::shared_ptr<xrdsvc::SsiRequest> _ssiRequest;
+    std::mutex _streamMutex;
+    int _taskCount = 1; ///< Tasks that have not sent their last message, protected by _streamMutex.
+    bool _streamShared = false;
 };
 
 }}} // lsst::qserv::wbase
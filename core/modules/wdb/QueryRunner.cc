@@ -36,6 +36,8 @@
 #include <cstddef>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 // Third-party headers
 #include <mysql/mysql.h>
@@ -55,6 +57,8 @@
 #include "mysql/MySqlConnection.h"
 #include "mysql/SchemaFactory.h"
 #include "proto/ProtoHeaderWrap.h"
+#include "proto/ResultCompressor.h"
+#include "proto/RowBatch.h"
 #include "proto/worker.pb.h"
 #include "sql/Schema.h"
 #include "sql/SqlErrorObject.h"
@@ -70,8 +74,36 @@
 
 namespace {
 LOG_LOGGER _log = LOG_GET("lsst.qserv.wdb.QueryRunner");
+
+/// Protocol 3 rows are split into batches of about this size, so that the
+/// czar can decode a message as it arrives.
+size_t const BATCH_SIZE = 256*1024;
+
+/// Smaller messages are not worth compressing.
+size_t const MIN_COMPRESS_SIZE = 4096;
+
+/// @return the protocol 3 encoding of the values of field.
+lsst::qserv::proto::ColumnBatch::Kind getColumnKind(MYSQL_FIELD const& field) {
+    using lsst::qserv::proto::ColumnBatch;
+    switch (field.type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONGLONG:
+        return (field.flags & UNSIGNED_FLAG) ? ColumnBatch::UINT64 : ColumnBatch::INT64;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+        return ColumnBatch::DOUBLE;
+    default:
+        // Including DECIMAL, which a double cannot hold exactly, and YEAR,
+        // whose two digit form does not survive a conversion to a number.
+        return ColumnBatch::BYTES;
+    }
 }
 
+} // anonymous namespace
+
 namespace lsst {
 namespace qserv {
 namespace wdb {
@@ -136,6 +168,17 @@ bool QueryRunner::runQuery() {
     };
     Release release(_task, this);
 
+    // Tasks of a multi-chunk request share a stream, which only ends with the
+    // last message of each of them, so every way out of here sends one.
+    class LastMessage {
+    public:
+        LastMessage(QueryRunner* qr) : _qr{qr} {}
+        ~LastMessage() { _qr->_transmitLastIfShared(); }
+    private:
+        QueryRunner* _qr;
+    };
+    LastMessage lastMessage(this);
+
     if (_task->getCancelled()) {
         LOGS(_log, LOG_LVL_DEBUG, _task->getIdStr() << " runQuery, task was cancelled before it started.");
         return false;
@@ -163,6 +206,17 @@ bool QueryRunner::runQuery() {
     if (_task->msg->has_protocol()) {
         switch(_task->msg->protocol()) {
         case 2:
+            if (_task->msg->has_maxprotocol() && _task->msg->maxprotocol() >= 3) {
+                _protocol = 3;
+            }
+            if (_task->msg->compressionlevel() > 0) {
+                if (proto::ResultCompressor::isSupported()) {
+                    _compressor.reset(new proto::ResultCompressor());
+                } else {
+                    LOGS(_log, LOG_LVL_DEBUG, _task->getIdStr()
+                         << " compressionlevel ignored, worker built without zstd");
+                }
+            }
             return _dispatchChannel(); // Run the query and send the results back.
         case 1:
             throw UnsupportedError(_task->getIdStr() + " QueryRunner: Expected protocol > 1 in TaskMsg");
@@ -192,6 +246,9 @@ void QueryRunner::_initMsgs() {
 }
 
 void QueryRunner::_initMsg() {
+    if (_batchWriter != nullptr) {
+        _batchWriter->start(nullptr); // The batch belongs to the previous message.
+    }
     _result = std::make_shared<proto::Result>();
     _result->mutable_rowschema();
     _result->set_continues(0);
@@ -211,6 +268,14 @@ void QueryRunner::_fillSchema(MYSQL_RES* result) {
         cs->set_sqltype(i->colType.sqlType);
         cs->set_mysqltype(i->colType.mysqlType);
     }
+    if (_protocol >= 3) {
+        std::vector<proto::ColumnBatch::Kind> kinds;
+        MYSQL_FIELD* fields = mysql_fetch_fields(result);
+        for (unsigned int i = 0, e = mysql_num_fields(result); i < e; ++i) {
+            kinds.push_back(getColumnKind(fields[i]));
+        }
+        _batchWriter.reset(new proto::RowBatchWriter(kinds));
+    }
 }
 
 /// Fill one row in the Result msg from one row in MYSQL_RES*
@@ -222,17 +287,21 @@ bool QueryRunner::_fillRows(MYSQL_RES* result, int numFields, uint& rowCount, si
 
     while ((row = mysql_fetch_row(result))) {
         auto lengths = mysql_fetch_lengths(result);
-        proto::RowBundle* rawRow =_result->add_row();
-        for(int i=0; i < numFields; ++i) {
-            if (row[i]) {
-                rawRow->add_column(row[i], lengths[i]);
-                rawRow->add_isnull(false);
-            } else {
-                rawRow->add_column();
-                rawRow->add_isnull(true);
+        if (_batchWriter != nullptr) {
+            tSize += _addBatchRow(row, lengths);
+        } else {
+            proto::RowBundle* rawRow =_result->add_row();
+            for(int i=0; i < numFields; ++i) {
+                if (row[i]) {
+                    rawRow->add_column(row[i], lengths[i]);
+                    rawRow->add_isnull(false);
+                } else {
+                    rawRow->add_column();
+                    rawRow->add_isnull(true);
+                }
             }
+            tSize += rawRow->ByteSize();
         }
-        tSize += rawRow->ByteSize();
         ++rowCount;
 
         unsigned int szLimit = std::min(proto::ProtoHeaderWrap::PROTOBUFFER_DESIRED_LIMIT,
@@ -272,6 +341,16 @@ bool QueryRunner::_fillRows(MYSQL_RES* result, int numFields, uint& rowCount, si
     return true;
 }
 
+/// Add a row to the current protocol 3 batch, starting a new batch if there
+/// is none yet or the current one is full.
+/// @return the approximate number of bytes added to the Result msg.
+size_t QueryRunner::_addBatchRow(MYSQL_ROW row, unsigned long const* lengths) {
+    if (!_batchWriter->isStarted() || _batchWriter->getBatchBytes() >= BATCH_SIZE) {
+        _batchWriter->start(_result->add_batch());
+    }
+    return _batchWriter->addRow(row, lengths);
+}
+
 /// Transmit result data with its header.
 /// If 'last' is true, this is the last message in the result set
 /// and flags are set accordingly.
@@ -295,14 +374,29 @@ void QueryRunner::_transmit(bool last, uint rowCount, size_t tSize) {
     _result->SerializeToString(&resultString);
     _result.reset(); // don't need it anymore and a new one will be made when needed..
 
-    _transmitHeader(resultString);
+    size_t rawSize = resultString.size();
+    if (_compressor != nullptr && rawSize >= MIN_COMPRESS_SIZE) {
+        std::string compressed;
+        if (_compressor->compress(resultString, _task->msg->compressionlevel(), compressed)) {
+            LOGS(_log, LOG_LVL_DEBUG, _task->getIdStr() << " compressed " << rawSize
+                 << " bytes to " << compressed.size());
+            resultString.swap(compressed);
+        }
+    }
+
+    // Tasks of a multi-chunk request share the channel, the header and the body
+    // of a message must follow each other on it.
+    std::unique_lock<std::mutex> streamLock(_task->sendChannel->getStreamMutex());
+    _transmitHeader(resultString, rawSize);
     LOGS(_log, LOG_LVL_DEBUG, "_transmit last=" << last << " " << _task->getIdStr()
          << " resultString=" << util::prettyCharList(resultString, 5));
 
-    if (!_cancelled) {
+    if (!_cancelled || _closingStream) {
         // StreamBuffer::create invalidates resultString by using std::move()
         xrdsvc::StreamBuffer::Ptr streamBuf(xrdsvc::StreamBuffer::createWithMove(resultString));
         bool sent = _task->sendChannel->sendStream(streamBuf, last);
+        _lastSent = last;
+        streamLock.unlock();
         if (!sent) {
             LOGS(_log, LOG_LVL_ERROR, _task->getIdStr() << " Failed to transmit message!");
         }
@@ -323,14 +417,29 @@ void QueryRunner::_transmit(bool last, uint rowCount, size_t tSize) {
     _largeResult = true; // Transmits after the first are considered large results.
 }
 
-/// Transmit the protoHeader
-void QueryRunner::_transmitHeader(std::string& msg) {
+/// Transmit the protoHeader for msg, which was rawSize bytes before being
+/// compressed, or is not compressed if that is its size.
+void QueryRunner::_transmitHeader(std::string& msg, size_t rawSize) {
     LOGS(_log, LOG_LVL_DEBUG, "_transmitHeader");
     // Set header
-    _protoHeader->set_protocol(2); // protocol 2: row-by-row message
+    _protoHeader->set_protocol(_protocol); // protocol 2: row-by-row message, 3: row batches
     _protoHeader->set_size(msg.size());
-    _protoHeader->set_md5(util::StringHash::getMd5(msg.data(), msg.size()));
+    if (rawSize != msg.size()) {
+        _protoHeader->set_compression(proto::COMPRESSION_ZSTD);
+        _protoHeader->set_rawsize(rawSize);
+    } else {
+        _protoHeader->clear_compression();
+        _protoHeader->clear_rawsize();
+    }
+    if (_task->msg->checksumtype() == proto::CHECKSUM_CRC32C) {
+        _protoHeader->set_checksumtype(proto::CHECKSUM_CRC32C);
+        _protoHeader->set_checksum(util::StringHash::getCrc32c(msg.data(), msg.size()));
+    } else {
+        // The czar may not know about any other checksum.
+        _protoHeader->set_md5(util::StringHash::getMd5(msg.data(), msg.size()));
+    }
     _protoHeader->set_wname(getHostname());
+    _protoHeader->set_jobid(_task->getJobId());
     _protoHeader->set_largeresult(_largeResult);
     std::string protoHeaderString;
     _protoHeader->SerializeToString(&protoHeaderString);
@@ -338,7 +447,7 @@ void QueryRunner::_transmitHeader(std::string& msg) {
     // Flush to channel.
     // Make sure protoheader size can be encoded in a byte.
     assert(protoHeaderString.size() < 255);
-    if (!_cancelled) {
+    if (!_cancelled || _closingStream) {
         auto msgBuf = proto::ProtoHeaderWrap::wrap(protoHeaderString);
         xrdsvc::StreamBuffer::Ptr streamBuf(xrdsvc::StreamBuffer::createWithMove(msgBuf)); // invalidates msgBuf
         bool sent = _task->sendChannel->sendStream(streamBuf, false);
@@ -351,6 +460,26 @@ void QueryRunner::_transmitHeader(std::string& msg) {
     }
 }
 
+/// Send an error as the last message of a task that ends without having
+/// sent one, if it shares its stream with other tasks. Otherwise, the czar
+/// cancelled the request or receives the error of the task.
+void QueryRunner::_transmitLastIfShared() {
+    if (_lastSent || !_task->sendChannel->isStreamShared()) {
+        return;
+    }
+    LOGS(_log, LOG_LVL_WARN, _task->getIdStr() << " ended without its last message, sending an error");
+    try {
+        if (_multiError.empty()) {
+            _multiError.push_back(util::Error(-1, _task->getCancelled() ? "Cancelled." : "Task failed."));
+        }
+        _closingStream = true;
+        _initMsgs();
+        _transmit(true, 0, 0);
+    } catch (std::exception const& e) {
+        LOGS(_log, LOG_LVL_ERROR, _task->getIdStr() << " failed to send the last message: " << e.what());
+    }
+}
+
 class ChunkResourceRequest {
 public:
     ChunkResourceRequest(std::shared_ptr<ChunkResourceMgr> const& mgr,
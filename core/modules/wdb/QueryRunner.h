@@ -49,6 +49,8 @@ namespace qserv {
 namespace proto {
 class ProtoHeader;
 class Result;
+class ResultCompressor;
+class RowBatchWriter;
 }}}
 
 namespace lsst {
@@ -82,11 +84,13 @@ private:
     MYSQL_RES* _primeResult(std::string const& query); ///< Obtain a result handle for a query.
 
     bool _fillRows(MYSQL_RES* result, int numFields, uint& rowCount, size_t& tsize);
+    size_t _addBatchRow(MYSQL_ROW row, unsigned long const* lengths);
     void _fillSchema(MYSQL_RES* result);
     void _initMsgs();
     void _initMsg();
     void _transmit(bool last, uint rowCount, size_t size);
-    void _transmitHeader(std::string& msg);
+    void _transmitHeader(std::string& msg, size_t rawSize);
+    void _transmitLastIfShared();
 
     ///< Actual task
     wbase::Task::Ptr _task;
@@ -95,6 +99,8 @@ private:
     ChunkResourceMgr::Ptr _chunkResourceMgr;
     std::string _dbName;
     std::atomic<bool> _cancelled{false};
+    bool _lastSent{false}; ///< Set once the last message of the task was sent.
+    bool _closingStream{false}; ///< Set to send the last message even when cancelled.
     mysql::MySqlConfig const _mySqlConfig;
     std::unique_ptr<mysql::MySqlConnection> _mysqlConn;
 
@@ -103,6 +109,9 @@ private:
     std::shared_ptr<proto::ProtoHeader> _protoHeader;
     std::shared_ptr<proto::Result> _result;
     bool _largeResult{false}; //< True for all transmits after the first transmit.
+    int _protocol{2}; ///< Result protocol, 3 if the czar can read row batches.
+    std::unique_ptr<proto::RowBatchWriter> _batchWriter; ///< Writer of protocol 3 rows.
+    std::unique_ptr<proto::ResultCompressor> _compressor; ///< Set if the czar wants compressed results.
     unsigned int _initialBlockSize{5000}; //< Maximum size of initial transmit block.
 };
 
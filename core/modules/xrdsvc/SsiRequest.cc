@@ -23,6 +23,7 @@
 
 // Class header
 #include <xrdsvc/SsiRequest.h>
+#include <algorithm>
 #include <cctype>
 #include <cstddef>
 #include <iostream>
@@ -37,6 +38,7 @@
 // Qserv headers
 #include "global/ResourceUnit.h"
 #include "proto/FrameBuffer.h"
+#include "proto/TaskMsgTemplate.h"
 #include "proto/worker.pb.h"
 #include "util/Timer.h"
 #include "wbase/MsgProcessor.h"
@@ -128,19 +130,59 @@ void SsiRequest::execute(XrdSsiRequest& req) {
                 return;
             }
         
+            // A multi-chunk request carries the tasks of further chunks, which must
+            // all be on this worker, or the czar sends them one by one instead.
+            std::vector<std::shared_ptr<proto::TaskMsg>> taskMsgs;
+            for (int i = 0; i < taskMsg->chunkmsg_size(); ++i) {
+                auto chunkMsg = std::make_shared<proto::TaskMsg>();
+                chunkMsg->Swap(taskMsg->mutable_chunkmsg(i));
+                ResourceUnit chunkRu;
+                chunkRu.setAsDbChunk(chunkMsg->db(), chunkMsg->chunkid());
+                if (!chunkMsg->has_db() || !chunkMsg->has_chunkid() || !(*_validator)(chunkRu)) {
+                    reportError("Multi-chunk request to the unowned resource " + chunkRu.path() +
+                                " on resource=" + _resourceName);
+                    return;
+                }
+                // Query templates the same for all chunks are only sent once.
+                int const nFrags = std::min(chunkMsg->fragment_size(), taskMsg->fragment_size());
+                for (int j = 0; j < nFrags; ++j) {
+                    auto frag = chunkMsg->mutable_fragment(j);
+                    if (frag->query_size() == 0 && frag->querytemplate_size() == 0) {
+                        frag->mutable_querytemplate()->CopyFrom(taskMsg->fragment(j).querytemplate());
+                    }
+                }
+                taskMsgs.push_back(chunkMsg);
+            }
+            taskMsg->clear_chunkmsg();
+            taskMsgs.insert(taskMsgs.begin(), taskMsg);
+            for (auto const& msg : taskMsgs) {
+                proto::expandQueryTemplates(*msg);
+            }
+            for (auto it = taskMsgs.begin() + 1; it != taskMsgs.end(); ++it) {
+                ResourceUnit chunkRu;
+                chunkRu.setAsDbChunk((*it)->db(), (*it)->chunkid());
+                _resourceMonitor->increment(chunkRu.path());
+                _chunkResources.push_back(chunkRu.path());
+            }
+
             // Now that the request is decoded (successfully or not), release the
             // xrootd request buffer. To avoid data races, this must happen before
             // the task is handed off to another thread for processing, as there is a
             // reference to this SsiRequest inside the reply channel for the task,
             // and after the call to BindRequest.
-            auto task = std::make_shared<wbase::Task>(
-                                taskMsg,
-                                std::make_shared<wbase::SendChannel>(shared_from_this()));
+            auto sendChannel = std::make_shared<wbase::SendChannel>(shared_from_this());
+            sendChannel->setTaskCount(taskMsgs.size());
+            std::vector<wbase::Task::Ptr> tasks;
+            for (auto const& msg : taskMsgs) {
+                tasks.push_back(std::make_shared<wbase::Task>(msg, sendChannel));
+            }
             ReleaseRequestBuffer();
             t.start();
-            _processor->processTask(task); // Queues task to be run later.
+            for (auto const& task : tasks) {
+                _processor->processTask(task); // Queues task to be run later.
+            }
             t.stop();
-            LOGS(_log, LOG_LVL_DEBUG, "Enqueued TaskMsg for " << ru <<
+            LOGS(_log, LOG_LVL_DEBUG, "Enqueued " << tasks.size() << " TaskMsg for " << ru <<
                  " in " << t.getElapsed() << " seconds");
 
             break;
@@ -306,6 +348,9 @@ void SsiRequest::Finished(XrdSsiRequest& req, XrdSsiRespInfo const& rinfo, bool
     ResourceUnit ru(_resourceName);
     if (ru.unitType() == ResourceUnit::DBCHUNK) {
         _resourceMonitor->decrement(_resourceName);
+        for (auto const& resource : _chunkResources) {
+            _resourceMonitor->decrement(resource);
+        }
     }
 
     // We can't do much other than close the file.
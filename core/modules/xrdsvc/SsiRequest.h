@@ -145,6 +145,7 @@ private:
 
     std::mutex  _finMutex;      ///< Protects execute() from Finish()
     std::string _resourceName;
+    std::vector<std::string> _chunkResources; ///< Further chunks of a multi-chunk request
 
     ChannelStream* _stream;
 
@@ -56,6 +56,27 @@ def checkMySql(env):
     return None
 
 
+def checkZstd(env):
+    """Checks for zstd includes and libraries, ZSTD_decompressStream()
+    being needed to decompress streamed result messages. zstd is optional,
+    if it is found HAVE_ZSTD is defined, and set in env.
+    """
+    conf = env.Configure()
+    state.log.debug("checkZstd():\n" +
+                    "\tCPPPATH : %s\n" % env['CPPPATH'] +
+                    "\tLIBPATH : %s" % env['LIBPATH'])
+
+    found = conf.CheckLibWithHeader("zstd", "zstd.h", language="C++", autoadd=0) and \
+        conf.CheckDeclaration("ZSTD_decompressStream", "#include <zstd.h>", "c++")
+    conf.Finish()
+    if found:
+        env.Append(CPPDEFINES=['HAVE_ZSTD'])
+        env['HAVE_ZSTD'] = True
+    else:
+        state.log.info("zstd not found or too old, results will not be compressed")
+    return found
+
+
 class BoostChecker:
 
     def __init__(self, env):
@@ -260,6 +260,19 @@ def _setEnvWithDependencies():
         )
         opts.Update(env)
 
+    # zstd is optional, without it results are not compressed
+    zstd_dir = os.getenv("ZSTD_DIR")
+    if zstd_dir:
+        opts.AddVariables(
+            (PathVariable('ZSTD_DIR', 'zstd install dir',
+                          _findPrefixFromName("ZSTD"), PathVariable.PathIsDir)),
+            (PathVariable('ZSTD_INC', 'zstd include path',
+                          os.path.join(zstd_dir, "include"), PathVariable.PathIsDir)),
+            (PathVariable('ZSTD_LIB', 'zstd libraries path',
+                          os.path.join(zstd_dir, "lib"), PathVariable.PathIsDir)),
+        )
+        opts.Update(env)
+
     SCons.Script.Help(opts.GenerateHelpText(env))
 
 